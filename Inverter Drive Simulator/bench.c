@@ -0,0 +1,1151 @@
+#include "motor.h"
+#include "motor_batch.h"
+#include "numeric_kernels.h"
+#include "inverter.h"
+#include "switching.h"
+#include "fault.h"
+#include "harmonic.h"
+#include "instrument.h"
+#include "recorder.h"
+#include "scenario.h"
+#include "sim.h"
+#include "snapshot.h"
+#include "sweep.h"
+#ifdef BENCH_DRAW
+#include "gui.h"
+#include "waveform.h"
+#endif
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BATCH_DRIVES 1024
+#define BATCH_STEPS 2000
+#define PWM_SAMPLES_PER_CARRIER 32
+#define PWM_REPEATS 200
+#define SWITCH_OBSERVATIONS 2000
+#define SWITCH_OBSERVE_DT 1e-4
+#define INDUCTION_TICKS 200
+#define INDUCTION_LOAD 0.5    // per unit of rated torque
+#define KERNEL_SAMPLES 2000
+#define MOTOR_CALLS 16
+#define FAULT_CALLS 1024
+#define WAVEFORM_SAMPLES_PER_CARRIER 8
+#define DRAW_SAMPLES 200
+#define DRAW_WIDTH 600
+#define DRAW_HEIGHT 650
+#define MAX_RESULTS 64
+#define PROBE_CALLS 1000
+#define RECORD_SAMPLES (1 << 22)
+#define RECORD_BATCH 4096
+#define RECORD_PATH "inverter_bench.rec"
+#define SWEEP_REPEATS 5
+#define SWEEP_DURATION 5.0
+#define ZOOM_COLUMNS 1000
+#define ZOOM_QUERIES 200
+#define HARMONIC_BLOCK 1000
+#define HARMONIC_BLOCKS 2000
+#define HARMONIC_QUERIES 50
+#define CONTROL_TICK 1e-3
+#define CONTROL_TICKS 5000
+#define CONTROL_STEP_AT 3000     // tick of the load step
+#define CONTROL_LOAD_FROM 0.25   // per unit of rated torque
+#define CONTROL_LOAD_TO 0.75
+#define CONTROL_BLOCK 1000
+#define CONTROL_BLOCKS 1000
+#define SNAPSHOT_CALLS 100
+#define SNAPSHOT_SAMPLES 2000
+#define SNAPSHOT_BRANCHES 64
+#define NUMERIC_DRIVES 256
+#define NUMERIC_BLOCKS 40
+#define NUMERIC_BLOCK_TICKS 10   // 40 x 10 ticks: 20 s, the longest ramp is 9 s
+#define NUMERIC_PWM_REPEATS 50
+#define NUMERIC_PWM_LONG_STEP (1.0 + M_SQRT2)   // carrier periods a sample, no exact period boundaries
+#define NUMERIC_FAULT_SAMPLES 200000   // 20 s at 10 kHz
+#define NUMERIC_FAULT_DT 1e-4
+#define NUMERIC_FAULT_BLOCK 1000
+#define SOAK_DURATION 14400.0   // s
+#define SOAK_EVERY 1200         // one row a minute
+#define SOAK_MAX_ROWS 256
+#define SOAK_STEPPED_RUNS 3
+#define SOAK_FAST_RUNS 50
+
+typedef struct {
+    const char *name;
+    int (*run)(void);
+} Benchmark;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Per-operation timing statistics, all in ns/op. ns_per_op is the median.
+typedef struct {
+    char name[64];
+    int samples;
+    double ns_per_op;
+    double mean;
+    double min;
+    double p90;
+    double p99;
+    double ops_per_sec;
+} BenchResult;
+
+static BenchResult results[MAX_RESULTS];
+static int num_results = 0;
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double percentile(const double *sorted, int n, double p) {
+    double pos = p * (n - 1);
+    int i = (int)pos;
+    if (i >= n - 1) return sorted[n - 1];
+    return sorted[i] + (pos - i) * (sorted[i + 1] - sorted[i]);
+}
+
+// sample_ns holds the wall time of each sample, each covering ops operations.
+// The array is scaled and sorted in place.
+static void record_result(const char *name, double *sample_ns, int n, double ops) {
+    if (num_results == MAX_RESULTS || n < 1) return;
+    BenchResult *r = &results[num_results++];
+    snprintf(r->name, sizeof(r->name), "%s", name);
+    double sum = 0.0;
+    for (int i = 0; i < n; i++) {
+        sample_ns[i] /= ops;
+        sum += sample_ns[i];
+    }
+    qsort(sample_ns, (size_t)n, sizeof(double), compare_double);
+    r->samples = n;
+    r->mean = sum / n;
+    r->min = sample_ns[0];
+    r->ns_per_op = percentile(sample_ns, n, 0.5);
+    r->p90 = percentile(sample_ns, n, 0.9);
+    r->p99 = percentile(sample_ns, n, 0.99);
+    r->ops_per_sec = r->ns_per_op > 0 ? 1e9 / r->ns_per_op : 0.0;
+}
+
+// Gives every drive its own parameters and reference so all ramp branches are exercised.
+static void seed_drive(MotorState *m, double *target_freq, int *is_forward, int i) {
+    // Padding too, as the batch check compares whole states
+    memset(m, 0, sizeof(*m));
+    motor_init(m);
+    set_motor_model(m, MOTOR_MODEL_RAMP, INTEGRATOR_RK4, 1, MOTOR_DT);
+    set_motor_params(m, 230.0 + (i % 7) * 30.0, 5.0 + (i % 11), 50.0 + (i % 2) * 10.0, 1000.0 + (i % 5) * 250.0);
+    set_drive_params(m, 0.5 + (i % 9) * 0.5, 1.0 + (i % 4), 80.0 + (i % 3) * 10.0, 5.0 + (i % 6));
+    *target_freq = (i * 37) % 120;
+    *is_forward = (i % 3) != 0;
+}
+
+static int bench_motor_batch(void) {
+    static MotorState ref[BATCH_DRIVES];
+    static double target[BATCH_DRIVES];
+    static int forward[BATCH_DRIVES];
+    for (int i = 0; i < BATCH_DRIVES; i++) seed_drive(&ref[i], &target[i], &forward[i], i);
+
+    static double step_ns[BATCH_STEPS];
+    double t0 = now_seconds();
+    for (int s = 0; s < BATCH_STEPS; s++) {
+        if (s == BATCH_STEPS / 2) {
+            for (int i = 0; i < BATCH_DRIVES; i++) forward[i] = !forward[i];
+        }
+        double ts = now_seconds();
+        for (int i = 0; i < BATCH_DRIVES; i++) update_motor(&ref[i], target[i], forward[i]);
+        step_ns[s] = (now_seconds() - ts) * 1e9;
+    }
+    double scalar_ns = (now_seconds() - t0) * 1e9 / ((double)BATCH_DRIVES * BATCH_STEPS);
+    printf("motor_batch: update_motor loop   %8.2f ns/drive-step\n", scalar_ns);
+    record_result("update_motor/ramp", step_ns, BATCH_STEPS, BATCH_DRIVES);
+
+    int status = 0;
+    MotorBatchIsa isas[] = { MOTOR_BATCH_SCALAR, MOTOR_BATCH_SSE2, MOTOR_BATCH_AVX2 };
+    for (size_t k = 0; k < sizeof(isas) / sizeof(isas[0]); k++) {
+        if (motor_batch_select(isas[k]) != isas[k]) continue;
+        MotorBatch *b = motor_batch_create(BATCH_DRIVES);
+        int mismatches = 0;
+        for (int i = 0; i < BATCH_DRIVES; i++) {
+            MotorState m;
+            int fwd;
+            seed_drive(&m, &b->target_freq[i], &fwd, i);
+            if (!motor_batch_load(b, i, &m)) mismatches++;
+            b->direction[i] = fwd ? 1.0 : -1.0;
+        }
+        t0 = now_seconds();
+        for (int s = 0; s < BATCH_STEPS; s++) {
+            if (s == BATCH_STEPS / 2) {
+                for (int i = 0; i < BATCH_DRIVES; i++) b->direction[i] = -b->direction[i];
+            }
+            double ts = now_seconds();
+            motor_batch_update(b);
+            step_ns[s] = (now_seconds() - ts) * 1e9;
+        }
+        double ns = (now_seconds() - t0) * 1e9 / ((double)BATCH_DRIVES * BATCH_STEPS);
+        for (int i = 0; i < BATCH_DRIVES; i++) {
+            MotorState m;
+            double unused_target;
+            int unused_forward;
+            seed_drive(&m, &unused_target, &unused_forward, i);
+            motor_batch_store(b, i, &m);
+            if (memcmp(&m, &ref[i], sizeof(m)) != 0) mismatches++;
+        }
+        printf("motor_batch: batch %-6s         %8.2f ns/drive-step  %5.2fx  %s\n",
+               motor_batch_isa_name(isas[k]), ns, scalar_ns / ns,
+               mismatches ? "MISMATCH" : "bit-exact");
+        if (mismatches) status = 1;
+        char name[64];
+        snprintf(name, sizeof(name), "motor_batch/%s", motor_batch_isa_name(isas[k]));
+        record_result(name, step_ns, BATCH_STEPS, BATCH_DRIVES);
+        motor_batch_destroy(b);
+    }
+    motor_batch_select(MOTOR_BATCH_AUTO);
+    return status;
+}
+
+// Samples further apart than a carrier period must each read the period
+// they fall in, as a lone sample at the same time does.
+static int check_pwm_long_step(void) {
+    enum { N = 500 };
+    InverterState inv;
+    inverter_init(&inv);
+    set_inverter_params(&inv, 400.0, 10.0, 0.8);
+    double t0 = 0.0123, dt = 2.37 / inv.carrier_freq;
+    uint8_t legs[3 * N];
+    PwmOutput out = { legs, legs + N, legs + 2 * N, NULL, NULL, NULL };
+    pwm_generate(&inv, t0, dt, N, &out);
+    int mismatches = 0, on = 0;
+    for (int i = 0; i < N; i++) {
+        uint8_t one[3];
+        PwmOutput single = { one, one + 1, one + 2, NULL, NULL, NULL };
+        pwm_generate(&inv, t0 + i * dt, dt, 1, &single);
+        if (one[0] != out.leg_a[i] || one[1] != out.leg_b[i] || one[2] != out.leg_c[i]) mismatches++;
+        on += out.leg_a[i];
+    }
+    printf("pwm: %d samples %.2f carrier periods apart, leg a on %.0f %%  %s\n", N, dt * inv.carrier_freq,
+           100.0 * on / N, mismatches ? "MISMATCH" : "consistent");
+    return mismatches != 0;
+}
+
+static int bench_pwm(void) {
+    InverterState inv;
+    inverter_init(&inv);
+    PwmMode modes[] = { PWM_SINE, PWM_THIRD_HARMONIC, PWM_SPACE_VECTOR };
+    for (size_t k = 0; k < sizeof(modes) / sizeof(modes[0]); k++) {
+        set_pwm_params(&inv, modes[k], PWM_MAX_CARRIER);
+        int n = pwm_period_samples(&inv, PWM_SAMPLES_PER_CARRIER);
+        uint8_t *legs = malloc((size_t)n * 3);
+        double *vll = malloc(sizeof(double) * (size_t)n * 3);
+        PwmOutput out = { legs, legs + n, legs + 2 * n, vll, vll + n, vll + 2 * n };
+        double dt = 1.0 / (inv.carrier_freq * PWM_SAMPLES_PER_CARRIER);
+        double period_ns[PWM_REPEATS];
+        double t0 = now_seconds();
+        for (int r = 0; r < PWM_REPEATS; r++) {
+            double ts = now_seconds();
+            pwm_generate(&inv, r * 0.02, dt, n, &out);
+            period_ns[r] = (now_seconds() - ts) * 1e9;
+        }
+        double per_period = (now_seconds() - t0) / PWM_REPEATS;
+        printf("pwm: %-14s %.0f kHz carrier, %d samples/period  %8.2f us/period  %7.1f Msamples/s\n",
+               pwm_mode_name(modes[k]), inv.carrier_freq / 1e3, n, per_period * 1e6, n / per_period / 1e6);
+        char name[64];
+        snprintf(name, sizeof(name), "pwm/%s", pwm_mode_name(modes[k]));
+        record_result(name, period_ns, PWM_REPEATS, 1);
+        free(legs);
+        free(vll);
+    }
+    return check_pwm_long_step();
+}
+
+// Direct-on-line start of the dq machine at rated V/f through the switching
+// model, one tick long, observing i_a every SWITCH_OBSERVE_DT.
+static double run_switching(SwitchingMode mode, double dt, double *ia, double *observe_ns, unsigned long *events) {
+    MotorState m;
+    motor_init(&m);
+    set_motor_model(&m, MOTOR_MODEL_DQ, INTEGRATOR_EXACT, 1, SWITCH_OBSERVATIONS * SWITCH_OBSERVE_DT);
+    m.drive_freq = m.rated_freq;
+    InverterState inv;
+    inverter_init(&inv);
+    inv.vdc = sqrt(2.0) * m.rated_voltage;
+    set_pwm_params(&inv, PWM_SINE, 10000.0);
+    SwitchingParams p;
+    switching_default_params(&p);
+    SwitchingState s;
+    switching_init(&s, &p);
+    double t0 = now_seconds();
+    motor_pwm_begin(&m, m.rated_freq, 1, &s);
+    for (int i = 0; i < SWITCH_OBSERVATIONS; i++) {
+        double ts = now_seconds();
+        motor_pwm_run(&m, &s, &inv, mode, dt, (i + 1) * SWITCH_OBSERVE_DT);
+        observe_ns[i] = (now_seconds() - ts) * 1e9;
+        ia[i] = s.current[0];
+    }
+    motor_pwm_end(&m);
+    *events = s.events;
+    return now_seconds() - t0;
+}
+
+// Event-driven switching steps the machine exactly between switching
+// instants, so it serves as the reference for the fixed-step error.
+static int bench_switching(void) {
+    static double reference[SWITCH_OBSERVATIONS], ia[SWITCH_OBSERVATIONS];
+    static double observe_ns[SWITCH_OBSERVATIONS];
+    unsigned long events;
+    double event_wall = run_switching(SWITCHING_EVENT, 0.0, reference, observe_ns, &events);
+    record_result("switching/event", observe_ns, SWITCH_OBSERVATIONS, 1);
+    double sim_time = SWITCH_OBSERVATIONS * SWITCH_OBSERVE_DT;
+    printf("switching: event-driven      %8.2f ms wall for %.2f s, %lu events, rms error 0 (reference)\n",
+           event_wall * 1e3, sim_time, events);
+    double steps[] = { 1e-5, 1e-6, 1e-7 };
+    for (size_t k = 0; k < sizeof(steps) / sizeof(steps[0]); k++) {
+        double wall = run_switching(SWITCHING_FIXED, steps[k], ia, observe_ns, &events);
+        double err = 0.0;
+        for (int i = 0; i < SWITCH_OBSERVATIONS; i++) err += (ia[i] - reference[i]) * (ia[i] - reference[i]);
+        char name[64];
+        snprintf(name, sizeof(name), "switching/fixed_%g", steps[k]);
+        record_result(name, observe_ns, SWITCH_OBSERVATIONS, 1);
+        printf("switching: fixed dt=%-8g %8.2f ms wall for %.2f s, rms error %.4g A\n",
+               steps[k], wall * 1e3, sim_time, sqrt(err / SWITCH_OBSERVATIONS));
+    }
+    return 0;
+}
+
+// Runs a loaded V/f start-up and records speed and current every tick.
+static double run_induction(Integrator integrator, int substeps, double *speed, double *current, double *tick_ns) {
+    MotorState m;
+    motor_init(&m);
+    set_motor_model(&m, MOTOR_MODEL_DQ, integrator, substeps, MOTOR_DT);
+    set_motor_load(&m, INDUCTION_LOAD * get_motor_rated_torque(&m));
+    double t0 = now_seconds();
+    for (int t = 0; t < INDUCTION_TICKS; t++) {
+        double ts = now_seconds();
+        update_motor(&m, m.rated_freq, 1);
+        tick_ns[t] = (now_seconds() - ts) * 1e9;
+        speed[t] = get_motor_speed(&m);
+        current[t] = get_motor_current(&m);
+    }
+    return now_seconds() - t0;
+}
+
+static int bench_induction(void) {
+    static double ref_speed[INDUCTION_TICKS], ref_current[INDUCTION_TICKS];
+    static double speed[INDUCTION_TICKS], current[INDUCTION_TICKS];
+    static double tick_ns[INDUCTION_TICKS];
+    run_induction(INTEGRATOR_RK4, 50000, ref_speed, ref_current, tick_ns);
+    static const struct {
+        Integrator integrator;
+        int substeps;
+    } configs[] = {
+        { INTEGRATOR_EULER, 500 }, { INTEGRATOR_EULER, 5000 }, { INTEGRATOR_EULER, 50000 },
+        { INTEGRATOR_RK4, 10 }, { INTEGRATOR_RK4, 50 }, { INTEGRATOR_RK4, 500 },
+        { INTEGRATOR_EXACT, 5 }, { INTEGRATOR_EXACT, 50 }, { INTEGRATOR_EXACT, 500 },
+    };
+    printf("induction: %.1f s loaded start-up, error vs rk4 with 1 us steps\n", INDUCTION_TICKS * MOTOR_DT);
+    for (size_t k = 0; k < sizeof(configs) / sizeof(configs[0]); k++) {
+        double wall = run_induction(configs[k].integrator, configs[k].substeps, speed, current, tick_ns);
+        double speed_err = 0.0, current_err = 0.0;
+        for (int t = 0; t < INDUCTION_TICKS; t++) {
+            speed_err = fmax(speed_err, fabs(speed[t] - ref_speed[t]));
+            current_err = fmax(current_err, fabs(current[t] - ref_current[t]));
+        }
+        double steps = (double)INDUCTION_TICKS * configs[k].substeps;
+        printf("induction: %-5s h=%-8g %8.1f ns/step %9.3f us/tick  max err %9.3g rpm %9.3g A\n",
+               integrator_name(configs[k].integrator), MOTOR_DT / configs[k].substeps,
+               wall * 1e9 / steps, wall * 1e6 / INDUCTION_TICKS, speed_err, current_err);
+        char name[64];
+        snprintf(name, sizeof(name), "induction/%s_%d", integrator_name(configs[k].integrator), configs[k].substeps);
+        record_result(name, tick_ns, INDUCTION_TICKS, configs[k].substeps);
+    }
+    return 0;
+}
+
+// The kernels the simulator calls every tick, timed one call (or a small
+// fixed batch) per sample so the percentiles show tick-to-tick jitter.
+static int bench_kernels(void) {
+    static double sample_ns[KERNEL_SAMPLES];
+
+    MotorState m;
+    motor_init(&m);
+    set_motor_load(&m, INDUCTION_LOAD * get_motor_rated_torque(&m));
+    for (int i = 0; i < KERNEL_SAMPLES; i++) {
+        double ts = now_seconds();
+        for (int c = 0; c < MOTOR_CALLS; c++) update_motor(&m, m.rated_freq, 1);
+        sample_ns[i] = (now_seconds() - ts) * 1e9;
+    }
+    record_result("update_motor/dq", sample_ns, KERNEL_SAMPLES, MOTOR_CALLS);
+
+    InverterState inv;
+    inverter_init(&inv);
+    set_inverter_params(&inv, 400.0, 50.0, 0.8);
+    int n = pwm_period_samples(&inv, WAVEFORM_SAMPLES_PER_CARRIER);
+    double *waveform = malloc(sizeof(double) * (size_t)n);
+    for (int i = 0; i < KERNEL_SAMPLES; i++) {
+        double ts = now_seconds();
+        get_pwm_waveform(&inv, waveform, n, i * MOTOR_DT);
+        sample_ns[i] = (now_seconds() - ts) * 1e9;
+    }
+    free(waveform);
+    record_result("get_pwm_waveform", sample_ns, KERNEL_SAMPLES, 1);
+
+    // Mostly healthy readings with an occasional trip, as in a long run. The
+    // engine sees them at a 10 kHz carrier, the rate it runs at with the
+    // switching model on.
+    static double signals[FAULT_CALLS][FAULT_SIGNAL_COUNT];
+    for (int i = 0; i < FAULT_CALLS; i++) {
+        signals[i][FAULT_SIGNAL_VOLTAGE] = 320.0 + (i % 17) - 8.0 - (i % 257 == 0 ? 100.0 : 0.0);
+        signals[i][FAULT_SIGNAL_CURRENT] = 5.0 + (i % 13) + (i % 509 == 0 ? 20.0 : 0.0);
+        signals[i][FAULT_SIGNAL_PHASE] = 1.4 * signals[i][FAULT_SIGNAL_CURRENT];
+        signals[i][FAULT_SIGNAL_TEMP] = 40.0 + (i % 31);
+    }
+    FaultState f;
+    fault_init(&f);
+    int trips = 0;
+    for (int i = 0; i < KERNEL_SAMPLES; i++) {
+        double ts = now_seconds();
+        for (int c = 0; c < FAULT_CALLS; c++) {
+            fault_sample(&f, 1e-4, signals[c]);
+            if (has_fault(&f)) {
+                reset_faults(&f);
+                trips++;
+            }
+        }
+        sample_ns[i] = (now_seconds() - ts) * 1e9;
+    }
+    record_result("fault_sample", sample_ns, KERNEL_SAMPLES, FAULT_CALLS);
+    FaultCapture *capture = fault_capture_create(4096, 1024);
+    fault_init(&f);
+    for (int i = 0; i < KERNEL_SAMPLES; i++) {
+        double ts = now_seconds();
+        for (int c = 0; c < FAULT_CALLS; c++) {
+            fault_sample(&f, 1e-4, signals[c]);
+            fault_capture_push(capture, &f, signals[c]);
+            if (has_fault(&f)) reset_faults(&f);
+        }
+        sample_ns[i] = (now_seconds() - ts) * 1e9;
+        fault_capture_arm(capture);
+    }
+    fault_capture_destroy(capture);
+    record_result("fault_sample_capture", sample_ns, KERNEL_SAMPLES, FAULT_CALLS);
+    printf("kernels: update_motor dq, get_pwm_waveform (%d samples), fault_sample (%d trips, %d rules)\n",
+           n, trips, f.num_rules);
+
+#ifdef BENCH_DRAW
+    // Offscreen: an image surface needs no display connection.
+    AppWidgets *w = calloc(1, sizeof(*w));
+    telemetry_history_init(&w->history);
+    for (int i = 0; i < TELEMETRY_HISTORY; i++) {
+        double t = i * MOTOR_DT;
+        TelemetrySample ts = { t, 300.0 + 20.0 * sin(t), 8.0 + 2.0 * sin(3.0 * t), 1400.0 * tanh(t / 5.0),
+                               20.0 * cos(t / 7.0), 25.0 + t / 60.0, 50.0 * tanh(t / 5.0), 0 };
+        telemetry_history_append(&w->history, &ts);
+    }
+    cairo_surface_t *surface = cairo_image_surface_create(CAIRO_FORMAT_RGB24, DRAW_WIDTH, DRAW_HEIGHT);
+    cairo_t *cr = cairo_create(surface);
+    for (int i = 0; i < DRAW_SAMPLES; i++) {
+        double ts = now_seconds();
+        draw_waveform(NULL, cr, DRAW_WIDTH, DRAW_HEIGHT, w);
+        cairo_surface_flush(surface);
+        sample_ns[i] = (now_seconds() - ts) * 1e9;
+    }
+    record_result("draw_waveform", sample_ns, DRAW_SAMPLES, 1);
+    cairo_destroy(cr);
+    cairo_surface_destroy(surface);
+    if (w->plot_background) cairo_surface_destroy(w->plot_background);
+    free(w);
+#endif
+    return 0;
+}
+
+// Cost of one PROBE_BEGIN/PROBE_END pair on an attached thread, which is
+// what every instrumented call pays on top of its own work.
+static int bench_instrument(void) {
+    static double sample_ns[KERNEL_SAMPLES];
+    instrument_attach_thread();
+    for (int i = 0; i < KERNEL_SAMPLES; i++) {
+        double ts = now_seconds();
+        for (int c = 0; c < PROBE_CALLS; c++) {
+            PROBE_BEGIN(PROBE_SIM_STEP);
+            __asm__ volatile("" ::: "memory");
+            PROBE_END(PROBE_SIM_STEP);
+        }
+        sample_ns[i] = (now_seconds() - ts) * 1e9;
+    }
+    record_result("instrument/probe", sample_ns, KERNEL_SAMPLES, PROBE_CALLS);
+    printf("instrument: probes %s\n", instrument_enabled() ? "enabled" : "compiled out");
+    instrument_reset();
+    instrument_thread_active = 0;
+    return 0;
+}
+
+// One plot-width envelope per zoom level, from the whole capture down to
+// 64 samples; with the LOD pyramid every level should cost about the same.
+static int bench_zoom(const Recording *rec) {
+    static double col_min[ZOOM_COLUMNS], col_max[ZOOM_COLUMNS];
+    static double sample_ns[ZOOM_QUERIES];
+    int status = !recording_has_lod(rec);
+    for (uint64_t window = RECORD_SAMPLES; window >= 64; window >>= 4) {
+        for (int q = 0; q < ZOOM_QUERIES; q++) {
+            uint64_t first = (uint64_t)q * 7919 * 4096 % (RECORD_SAMPLES - window + 1);
+            double ts = now_seconds();
+            recording_envelope(rec, 4, first, first + window, ZOOM_COLUMNS, col_min, col_max);
+            sample_ns[q] = (now_seconds() - ts) * 1e9;
+        }
+        char name[64];
+        snprintf(name, sizeof(name), "recorder/zoom_%llu", (unsigned long long)window);
+        record_result(name, sample_ns, ZOOM_QUERIES, 1);
+    }
+    // Channel 4 rises linearly, so the whole-capture envelope must end on the last sample.
+    recording_envelope(rec, 4, 0, RECORD_SAMPLES, ZOOM_COLUMNS, col_min, col_max);
+    double expect = recording_value(rec, 4, RECORD_SAMPLES - 1);
+    if (col_min[0] != recording_value(rec, 4, 0) || fabs(col_max[ZOOM_COLUMNS - 1] - expect) > 1e-9 * expect)
+        status = 1;
+    return status;
+}
+
+// Carrier-rate capture: 4 M samples of every sim channel, timed per batch,
+// then the time to open the file and to stream one channel back.
+static int bench_recorder(void) {
+    static double sample_ns[RECORD_SAMPLES / RECORD_BATCH];
+    Recorder *r = recorder_create(RECORD_PATH, SIM_CHANNELS, sim_channel_names);
+    if (!r) {
+        perror(RECORD_PATH);
+        return 1;
+    }
+    double values[SIM_CHANNELS];
+    double t0 = now_seconds();
+    for (int b = 0; b < RECORD_SAMPLES / RECORD_BATCH; b++) {
+        double ts = now_seconds();
+        for (int i = 0; i < RECORD_BATCH; i++) {
+            double t = (b * RECORD_BATCH + i) * 2.5e-5;
+            for (int ch = 0; ch < SIM_CHANNELS; ch++) values[ch] = t * (ch + 1);
+            recorder_append(r, values);
+        }
+        sample_ns[b] = (now_seconds() - ts) * 1e9;
+    }
+    int ok = recorder_close(r);
+    double write_wall = now_seconds() - t0;
+    record_result("recorder/append", sample_ns, RECORD_SAMPLES / RECORD_BATCH, RECORD_BATCH);
+
+    t0 = now_seconds();
+    Recording *rec = recording_open(RECORD_PATH);
+    double open_wall = now_seconds() - t0;
+    int status = !ok || !rec || recording_count(rec) != RECORD_SAMPLES;
+    if (rec) {
+        static double column[RECORD_BATCH];
+        t0 = now_seconds();
+        for (uint64_t i = 0; i < RECORD_SAMPLES; i += RECORD_BATCH) {
+            recording_read(rec, 4, i, RECORD_BATCH, column);
+        }
+        double read_wall = now_seconds() - t0;
+        double expect = recording_value(rec, 0, RECORD_SAMPLES - 1) * 5.0;
+        if (fabs(column[RECORD_BATCH - 1] - expect) > 1e-9 * expect) status = 1;
+        printf("recorder: %d samples x %d channels, write %.1f Msamples/s, open %.1f us, read %.0f MB/s%s\n",
+               RECORD_SAMPLES, SIM_CHANNELS, RECORD_SAMPLES / write_wall / 1e6, open_wall * 1e6,
+               RECORD_SAMPLES * sizeof(double) / read_wall / 1e6, status ? "  MISMATCH" : "");
+        if (bench_zoom(rec)) status = 1;
+        recording_close(rec);
+    }
+    unlink(RECORD_PATH);
+    unlink(RECORD_PATH ".lod");
+    return status;
+}
+
+// Cost per sweep case on one thread and on every online CPU.
+static int bench_sweep(void) {
+    SweepSpec spec;
+    sweep_default_spec(&spec);
+    spec.duration = SWEEP_DURATION;
+    sweep_parse_axis("ramp_up=0.5:10:8", &spec.axes[spec.num_axes++]);
+    sweep_parse_axis("load=0:40:4", &spec.axes[spec.num_axes++]);
+    sweep_parse_load_profiles("constant,step,fan", &spec.load_profiles);
+    int cases = sweep_case_count(&spec);
+    int cpus = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int thread_counts[2] = { 1, cpus > 1 ? cpus : 1 };
+    int status = 0;
+    for (int t = 0; t < (thread_counts[1] > 1 ? 2 : 1); t++) {
+        double sample_ns[SWEEP_REPEATS];
+        SweepStats stats;
+        for (int r = 0; r < SWEEP_REPEATS; r++) {
+            if (sweep_run(&spec, thread_counts[t], NULL, NULL, &stats) != cases) status = 1;
+            sample_ns[r] = stats.wall_seconds * 1e9;
+        }
+        char name[64];
+        snprintf(name, sizeof(name), "sweep/case_%dthreads", thread_counts[t]);
+        record_result(name, sample_ns, SWEEP_REPEATS, cases);
+    }
+    return status;
+}
+
+// Two channels of 50 Hz PWM-like content through the sliding DFT, against
+// the alternatives it replaces: an exact recompute of the same bins, which
+// a per-frame analysis would pay, and the on-demand full FFT.
+static int bench_harmonic(void) {
+    static double sample_ns[HARMONIC_BLOCKS];
+    double fs = HARMONIC_DEFAULT_RATE, f1 = 50.0;
+    HarmonicAnalyzer *h = harmonic_create(2, HARMONIC_DEFAULT_ORDERS, HARMONIC_DEFAULT_CYCLES, fs);
+    if (!h) return 1;
+    harmonic_set_fundamental(h, f1);
+    // One fundamental period of samples, so the timed loop only pushes
+    static double signal[2000][2];
+    int period = (int)(fs / f1);
+    for (int i = 0; i < period; i++) {
+        double w = 2.0 * M_PI * i / period;
+        signal[i][0] = 300.0 * sin(w) + 15.0 * sin(5.0 * w) + 6.0 * sin(7.0 * w);
+        signal[i][1] = 20.0 * sin(w - 0.5);
+    }
+    long n = 0;
+    for (int b = 0; b < HARMONIC_BLOCKS; b++) {
+        double ts = now_seconds();
+        for (int i = 0; i < HARMONIC_BLOCK; i++, n++) harmonic_push(h, n / fs, signal[n % period]);
+        sample_ns[b] = (now_seconds() - ts) * 1e9;
+    }
+    record_result("harmonic/push", sample_ns, HARMONIC_BLOCKS, HARMONIC_BLOCK);
+    double thd = harmonic_thd(h, 0), expect = hypot(15.0, 6.0) / 300.0;
+    int status = fabs(thd - expect) > 1e-6 * expect;
+    double a5 = harmonic_amplitude(h, 0, 5);
+    harmonic_recompute(h);
+    double drift = fabs(harmonic_amplitude(h, 0, 5) - a5);
+    for (int q = 0; q < HARMONIC_QUERIES; q++) {
+        double ts = now_seconds();
+        harmonic_recompute(h);
+        sample_ns[q] = (now_seconds() - ts) * 1e9;
+    }
+    record_result("harmonic/recompute", sample_ns, HARMONIC_QUERIES, 1);
+    double recompute_ns = sample_ns[HARMONIC_QUERIES / 2];
+    static double amplitude[1 << 16];
+    double bin_hz = 0.0;
+    int bins = 0;
+    for (int q = 0; q < HARMONIC_QUERIES; q++) {
+        double ts = now_seconds();
+        bins = harmonic_spectrum(h, 0, amplitude, 1 << 16, &bin_hz);
+        sample_ns[q] = (now_seconds() - ts) * 1e9;
+    }
+    record_result("harmonic/fft", sample_ns, HARMONIC_QUERIES, 1);
+    printf("harmonic: %d orders x 2 channels at %.0f kHz, window %.0f samples; THD %.6f (expect %.6f), "
+           "drift %.2g after %ld samples; exact recompute %.0f us, FFT %d bins of %.1f Hz%s\n",
+           HARMONIC_DEFAULT_ORDERS, fs / 1e3, HARMONIC_DEFAULT_CYCLES * fs / f1, thd, expect, drift, n,
+           recompute_ns / 1e3, bins, bin_hz, status ? "  MISMATCH" : "");
+    harmonic_destroy(h);
+    return status;
+}
+
+// Each control mode through the same loaded start-up and load step on the
+// dq model, then the controller alone: its state at the end of the run
+// replayed against steady rotating currents, so the timing is of the
+// control law and not the plant it sits in.
+static int bench_control(void) {
+    static double sample_ns[CONTROL_BLOCKS];
+    printf("control: start to rated speed at %.2f pu load, step to %.2f pu at %.1f s; "
+           "controller ns/iteration and CPU share at 8/10/20 kHz\n",
+           CONTROL_LOAD_FROM, CONTROL_LOAD_TO, CONTROL_STEP_AT * CONTROL_TICK);
+    for (int mode = 0; mode < CONTROL_MODE_COUNT; mode++) {
+        MotorState m;
+        motor_init(&m);
+        set_motor_model(&m, MOTOR_MODEL_DQ, INTEGRATOR_RK4, 50, CONTROL_TICK);
+        set_motor_control(&m, (ControlMode)mode, CONTROL_DEFAULT_RATE);
+        double rated = get_motor_rated_torque(&m);
+        double sync_rpm = 60.0 * m.rated_freq / m.im.params.pole_pairs;
+        double rise = NAN, peak_speed = 0.0, before = 0.0, dip = 0.0, peak_current = 0.0;
+        double sum = 0.0, sq = 0.0;
+        int ripple_ticks = 0;
+        double t0 = now_seconds();
+        for (int t = 0; t < CONTROL_TICKS; t++) {
+            set_motor_load(&m, (t < CONTROL_STEP_AT ? CONTROL_LOAD_FROM : CONTROL_LOAD_TO) * rated);
+            update_motor(&m, m.rated_freq, 1);
+            double speed = get_motor_speed(&m), torque = get_motor_torque(&m);
+            peak_current = fmax(peak_current, get_motor_current(&m));
+            if (isnan(rise) && speed >= 0.9 * sync_rpm) rise = (t + 1) * CONTROL_TICK;
+            if (t < CONTROL_STEP_AT) {
+                peak_speed = fmax(peak_speed, speed);
+                before = speed;
+            } else {
+                dip = fmax(dip, before - speed);
+            }
+            if (t >= CONTROL_TICKS - CONTROL_TICKS / 5) {
+                sum += torque;
+                sq += torque * torque;
+                ripple_ticks++;
+            }
+        }
+        double wall = now_seconds() - t0;
+        double mean = sum / ripple_ticks;
+        double ripple = sqrt(fmax(0.0, sq / ripple_ticks - mean * mean));
+        printf("control: %-17s to 90%% %5.2f s  overshoot %6.1f rpm  dip %6.1f rpm  ripple %6.3f Nm  "
+               "peak %5.1f A  %8.1f us/tick",
+               control_mode_name((ControlMode)mode), rise, fmax(0.0, peak_speed - sync_rpm), dip, ripple,
+               peak_current, wall * 1e6 / CONTROL_TICKS);
+        if (mode == CONTROL_VF) {
+            printf("\n");
+            continue;
+        }
+        ControlState c = m.ctrl;
+        double amplitude = hypot(m.im.ids, m.im.iqs), ts = 1.0 / c.rate, v[2];
+        double speed = m.im.omega_r / m.im.params.pole_pairs, angle = 0.0, step = c.omega_e * ts;
+        for (int b = 0; b < CONTROL_BLOCKS; b++) {
+            double start = now_seconds();
+            for (int k = 0; k < CONTROL_BLOCK; k++) {
+                double i_abc[3] = { amplitude * cos(angle), amplitude * cos(angle - 2.0 * M_PI / 3.0),
+                                    amplitude * cos(angle + 2.0 * M_PI / 3.0) };
+                control_step(&c, i_abc, speed, speed, ts, v);
+                angle += step;
+            }
+            sample_ns[b] = (now_seconds() - start) * 1e9;
+        }
+        char name[64];
+        snprintf(name, sizeof(name), "control/%s", mode == CONTROL_FOC ? "foc" : mode == CONTROL_SENSORLESS ? "sensorless" : "dtc");
+        record_result(name, sample_ns, CONTROL_BLOCKS, CONTROL_BLOCK);
+        double ns = results[num_results - 1].ns_per_op;
+        printf("  %6.1f ns/iter  %.3f/%.3f/%.3f%% CPU\n", ns, ns * 8e3 / 1e7, ns * 10e3 / 1e7, ns * 20e3 / 1e7);
+    }
+    return 0;
+}
+
+// A drive mid-run under vector control, the largest state, saved to and
+// restored from memory, and forked into a batch of branches.
+static int bench_snapshot(void) {
+    static double sample_ns[SNAPSHOT_SAMPLES];
+    static SimContext branches[SNAPSHOT_BRANCHES];
+    SimParams p;
+    sim_default_params(&p);
+    p.control_mode = CONTROL_FOC;
+    p.dt = CONTROL_TICK;
+    SimContext ctx;
+    sim_init(&ctx, &p);
+    SimInputs in = { 80.0, 1, 10.0 };
+    for (int t = 0; t < 500; t++) sim_step(&ctx, &in);
+    size_t size = snapshot_size();
+    unsigned char *buf = malloc(size);
+    if (!buf) return 1;
+    int status = 0;
+    for (int s = 0; s < SNAPSHOT_SAMPLES; s++) {
+        double start = now_seconds();
+        for (int k = 0; k < SNAPSHOT_CALLS; k++)
+            if (snapshot_save(&ctx, buf, size) != size) status = 1;
+        sample_ns[s] = (now_seconds() - start) * 1e9;
+    }
+    record_result("snapshot/save", sample_ns, SNAPSHOT_SAMPLES, SNAPSHOT_CALLS);
+    SimContext restored;
+    for (int s = 0; s < SNAPSHOT_SAMPLES; s++) {
+        double start = now_seconds();
+        for (int k = 0; k < SNAPSHOT_CALLS; k++)
+            if (!snapshot_restore(&restored, buf, size)) status = 1;
+        sample_ns[s] = (now_seconds() - start) * 1e9;
+    }
+    record_result("snapshot/restore", sample_ns, SNAPSHOT_SAMPLES, SNAPSHOT_CALLS);
+    for (int s = 0; s < SNAPSHOT_SAMPLES; s++) {
+        double start = now_seconds();
+        for (int b = 0; b < SNAPSHOT_BRANCHES; b++) branches[b] = restored;
+        sample_ns[s] = (now_seconds() - start) * 1e9;
+    }
+    record_result("snapshot/fork_branch", sample_ns, SNAPSHOT_SAMPLES, SNAPSHOT_BRANCHES);
+    // A restored branch must carry on exactly as the original
+    sim_step(&ctx, &in);
+    sim_step(&branches[SNAPSHOT_BRANCHES - 1], &in);
+    if (memcmp(&ctx.motor.im, &branches[SNAPSHOT_BRANCHES - 1].motor.im, sizeof(ctx.motor.im)) != 0) status = 1;
+    printf("snapshot: %zu bytes per drive%s\n", size, status ? ", ROUND TRIP FAILED" : "");
+    free(buf);
+    return status;
+}
+
+static const NumericKernels *const numeric_types[] = {
+    &numeric_kernels_double, &numeric_kernels_float, &numeric_kernels_q31, &numeric_kernels_q15
+};
+#define NUMERIC_TYPES ((int)(sizeof(numeric_types) / sizeof(numeric_types[0])))
+
+// type is NULL for the double model the simulator runs.
+static void numeric_row(const char *kernel, const NumericKernels *type, double *sample_ns, int n, double ops,
+                        double model_ns, const char *error) {
+    char name[64];
+    snprintf(name, sizeof(name), "numeric/%s/%s", kernel, type ? type->name : "model");
+    record_result(name, sample_ns, n, ops);
+    double ns = results[num_results - 1].ns_per_op;
+    printf("numeric: %-6s %-7s %8.2f ns  %5.2fx  %s\n", kernel, type ? type->name : "model", ns,
+           model_ns > 0.0 ? model_ns / ns : 1.0, error);
+}
+
+// The ramp drives of bench_motor_batch, compared with update_motor every
+// block of ticks over a run long enough to reach every target.
+static int numeric_ramp(void) {
+    static MotorState drives[NUMERIC_DRIVES];
+    static double target[NUMERIC_DRIVES];
+    static int forward[NUMERIC_DRIVES];
+    static double ref_speed[NUMERIC_BLOCKS][NUMERIC_DRIVES], ref_temp[NUMERIC_BLOCKS][NUMERIC_DRIVES];
+    static double sample_ns[NUMERIC_BLOCKS];
+    for (int i = 0; i < NUMERIC_DRIVES; i++) seed_drive(&drives[i], &target[i], &forward[i], i);
+    static MotorState model[NUMERIC_DRIVES];
+    memcpy(model, drives, sizeof(model));
+    for (int b = 0; b < NUMERIC_BLOCKS; b++) {
+        double ts = now_seconds();
+        for (int i = 0; i < NUMERIC_DRIVES; i++)
+            for (int t = 0; t < NUMERIC_BLOCK_TICKS; t++) update_motor(&model[i], target[i], forward[i]);
+        sample_ns[b] = (now_seconds() - ts) * 1e9;
+        for (int i = 0; i < NUMERIC_DRIVES; i++) {
+            ref_speed[b][i] = model[i].current_speed;
+            ref_temp[b][i] = model[i].temp;
+        }
+    }
+    double ops = (double)NUMERIC_DRIVES * NUMERIC_BLOCK_TICKS;
+    numeric_row("ramp", NULL, sample_ns, NUMERIC_BLOCKS, ops, 0.0, "reference");
+    double model_ns = results[num_results - 1].ns_per_op;
+    for (int k = 0; k < NUMERIC_TYPES; k++) {
+        const NumericKernels *type = numeric_types[k];
+        NumRamp *r = type->ramp_create(drives, target, forward, NUMERIC_DRIVES);
+        if (!r) return 1;
+        double speed_err = 0.0, temp_err = 0.0;
+        for (int b = 0; b < NUMERIC_BLOCKS; b++) {
+            double ts = now_seconds();
+            type->ramp_update(r, NUMERIC_BLOCK_TICKS);
+            sample_ns[b] = (now_seconds() - ts) * 1e9;
+            for (int i = 0; i < NUMERIC_DRIVES; i++) {
+                MotorState m;
+                type->ramp_store(r, i, &m);
+                speed_err = fmax(speed_err, fabs(m.current_speed - ref_speed[b][i]));
+                temp_err = fmax(temp_err, fabs(m.temp - ref_temp[b][i]));
+            }
+        }
+        type->ramp_destroy(r);
+        char error[96];
+        snprintf(error, sizeof(error), "max error %.3g rpm, %.3g C", speed_err, temp_err);
+        numeric_row("ramp", type, sample_ns, NUMERIC_BLOCKS, ops, model_ns, error);
+    }
+    return 0;
+}
+
+// One fundamental period at the highest carrier in each PWM mode, at a
+// spread of start times, compared leg by leg with pwm_generate.
+static int numeric_pwm(void) {
+    static double sample_ns[NUMERIC_PWM_REPEATS * 3];
+    PwmMode modes[] = { PWM_SINE, PWM_THIRD_HARMONIC, PWM_SPACE_VECTOR };
+    InverterState inv;
+    inverter_init(&inv);
+    set_pwm_params(&inv, PWM_SINE, PWM_MAX_CARRIER);
+    int n = pwm_period_samples(&inv, PWM_SAMPLES_PER_CARRIER);
+    double dt = 1.0 / (inv.carrier_freq * PWM_SAMPLES_PER_CARRIER);
+    uint8_t *legs = malloc((size_t)n * 6);
+    if (!legs) return 1;
+    PwmOutput ref = { legs, legs + n, legs + 2 * n, NULL, NULL, NULL };
+    PwmOutput out = { legs + 3 * n, legs + 4 * n, legs + 5 * n, NULL, NULL, NULL };
+    double model_ns = 0.0;
+    for (int k = -1; k < NUMERIC_TYPES; k++) {
+        const NumericKernels *type = k < 0 ? NULL : numeric_types[k];
+        long mismatched = 0;
+        int s = 0;
+        for (int m = 0; m < 3; m++) {
+            set_pwm_params(&inv, modes[m], PWM_MAX_CARRIER);
+            for (int r = 0; r < NUMERIC_PWM_REPEATS; r++, s++) {
+                double time = r * 0.0123;
+                double ts = now_seconds();
+                if (type) {
+                    type->pwm_generate(&inv, time, dt, n, &out);
+                } else {
+                    pwm_generate(&inv, time, dt, n, &ref);
+                }
+                sample_ns[s] = (now_seconds() - ts) * 1e9;
+                if (!type) continue;
+                pwm_generate(&inv, time, dt, n, &ref);
+                for (int j = 0; j < 3 * n; j++) mismatched += ref.leg_a[j] != out.leg_a[j];
+            }
+        }
+        // Samples further apart than a carrier period, untimed
+        long long_mismatched = 0;
+        if (type) {
+            double long_dt = NUMERIC_PWM_LONG_STEP / inv.carrier_freq;
+            for (int r = 0; r < NUMERIC_PWM_REPEATS; r++) {
+                type->pwm_generate(&inv, r * 0.0123, long_dt, n, &out);
+                pwm_generate(&inv, r * 0.0123, long_dt, n, &ref);
+                for (int j = 0; j < 3 * n; j++) long_mismatched += ref.leg_a[j] != out.leg_a[j];
+            }
+        }
+        char error[128];
+        snprintf(error, sizeof(error), "%ld of %ld leg states differ, %ld at %.2f periods a sample", mismatched,
+                 3L * n * s, long_mismatched, NUMERIC_PWM_LONG_STEP);
+        numeric_row("pwm", type, sample_ns, s, n, model_ns, type ? error : "reference");
+        if (!type) model_ns = results[num_results - 1].ns_per_op;
+    }
+    free(legs);
+    return 0;
+}
+
+// 20 s at 10 kHz: an overload from 2 s to 9 s that the I2T rule trips on,
+// a current spike, an undervoltage dip and a winding temperature that
+// crosses 80 C near its peak. Every trip is reset at once, as in
+// bench_kernels, so a standing condition trips on every sample.
+static void numeric_fault_trace(double (*s)[FAULT_SIGNAL_COUNT], int n) {
+    for (int i = 0; i < n; i++) {
+        double t = i * NUMERIC_FAULT_DT;
+        double current = 8.0 + (t >= 2.0 && t < 9.0 ? 9.0 : 0.0) + 0.5 * sin(2.0 * M_PI * 1.3 * t);
+        if (t >= 15.0 && t < 15.0003) current = 25.0;
+        s[i][FAULT_SIGNAL_CURRENT] = current;
+        s[i][FAULT_SIGNAL_PHASE] = current * sqrt(2.0) * fabs(sin(2.0 * M_PI * 50.0 * t));
+        s[i][FAULT_SIGNAL_VOLTAGE] = (t >= 12.0 && t < 12.005 ? 290.0 : 320.0) + 0.5 * (i % 17) - 4.0;
+        s[i][FAULT_SIGNAL_TEMP] = 60.0 + 21.0 * sin(M_PI * t / 20.0);
+    }
+}
+
+static int numeric_fault(void) {
+    static double signals[NUMERIC_FAULT_SAMPLES][FAULT_SIGNAL_COUNT];
+    static signed char ref_trip[NUMERIC_FAULT_SAMPLES], trip[NUMERIC_FAULT_SAMPLES];
+    static double sample_ns[NUMERIC_FAULT_SAMPLES / NUMERIC_FAULT_BLOCK];
+    const int blocks = NUMERIC_FAULT_SAMPLES / NUMERIC_FAULT_BLOCK;
+    numeric_fault_trace(signals, NUMERIC_FAULT_SAMPLES);
+    // The default table without its RMS rule, which the kernels lack
+    FaultRule all[FAULT_MAX_RULES], rules[FAULT_MAX_RULES];
+    int num_all, num_rules = 0;
+    fault_default_rules(all, &num_all);
+    for (int i = 0; i < num_all; i++)
+        if (all[i].kind != FAULT_RULE_RMS_ABOVE) rules[num_rules++] = all[i];
+    FaultState f;
+    fault_init(&f);
+    fault_set_rules(&f, rules, num_rules);
+    memset(ref_trip, -1, sizeof(ref_trip));
+    int ref_trips = 0;
+    for (int b = 0; b < blocks; b++) {
+        double ts = now_seconds();
+        for (int i = b * NUMERIC_FAULT_BLOCK; i < (b + 1) * NUMERIC_FAULT_BLOCK; i++) {
+            fault_sample(&f, NUMERIC_FAULT_DT, signals[i]);
+            if (has_fault(&f)) {
+                ref_trip[i] = (signed char)f.trip_rule;
+                reset_faults(&f);
+            }
+        }
+        sample_ns[b] = (now_seconds() - ts) * 1e9;
+    }
+    for (int i = 0; i < NUMERIC_FAULT_SAMPLES; i++) ref_trips += ref_trip[i] >= 0;
+    char error[96];
+    snprintf(error, sizeof(error), "reference, %d trip samples", ref_trips);
+    numeric_row("fault", NULL, sample_ns, blocks, NUMERIC_FAULT_BLOCK, 0.0, error);
+    double model_ns = results[num_results - 1].ns_per_op;
+    for (int k = 0; k < NUMERIC_TYPES; k++) {
+        const NumericKernels *type = numeric_types[k];
+        NumFault *nf = type->fault_create(rules, num_rules, NUMERIC_FAULT_DT, (const double (*)[FAULT_SIGNAL_COUNT])signals,
+                                          NUMERIC_FAULT_SAMPLES);
+        if (!nf) return 1;
+        memset(trip, -1, sizeof(trip));
+        for (int b = 0; b < blocks; b++) {
+            int end = (b + 1) * NUMERIC_FAULT_BLOCK;
+            double ts = now_seconds();
+            for (int i = b * NUMERIC_FAULT_BLOCK; (i = type->fault_run(nf, i, end)) < end; i++) {
+                trip[i] = (signed char)type->fault_trip_rule(nf);
+                type->fault_reset(nf);
+            }
+            sample_ns[b] = (now_seconds() - ts) * 1e9;
+        }
+        type->fault_destroy(nf);
+        // How far each rule's first trip moved, and how many samples disagree
+        int differ = 0;
+        double shift = 0.0;
+        for (int r = 0; r < num_rules; r++) {
+            int first_ref = -1, first = -1;
+            for (int i = 0; i < NUMERIC_FAULT_SAMPLES && (first_ref < 0 || first < 0); i++) {
+                if (first_ref < 0 && ref_trip[i] == r) first_ref = i;
+                if (first < 0 && trip[i] == r) first = i;
+            }
+            if ((first_ref < 0) != (first < 0)) shift = INFINITY;
+            else if (first >= 0) shift = fmax(shift, fabs((double)(first - first_ref)) * NUMERIC_FAULT_DT);
+        }
+        for (int i = 0; i < NUMERIC_FAULT_SAMPLES; i++) differ += trip[i] != ref_trip[i];
+        snprintf(error, sizeof(error), "first trips within %.3g ms, %d samples differ", shift * 1e3, differ);
+        numeric_row("fault", type, sample_ns, blocks, NUMERIC_FAULT_BLOCK, model_ns, error);
+    }
+    return 0;
+}
+
+// The ramp, PWM and fault kernels in each scalar type of numeric.h beside
+// the double model: time per drive tick or sample, speedup and error.
+static int bench_numeric(void) {
+    printf("numeric: kernel type          time  speedup  error against the model\n");
+    int status = numeric_ramp();
+    status |= numeric_pwm();
+    status |= numeric_fault();
+    return status;
+}
+
+typedef struct {
+    long rows;
+    double trip_time;   // drive clock at the trip, -1 if none
+    double temp[SOAK_MAX_ROWS];
+} SoakTrace;
+
+static int soak_row(const double *row, void *user_data) {
+    SoakTrace *t = user_data;
+    if (t->rows < SOAK_MAX_ROWS) t->temp[t->rows] = row[7];
+    t->rows++;
+    if (row[8] != FAULT_NONE && t->trip_time < 0.0) t->trip_time = row[1];
+    return 0;
+}
+
+static double soak_run(const Scenario *s, SoakTrace *t) {
+    t->rows = 0;
+    t->trip_time = -1.0;
+    double start = now_seconds();
+    scenario_run(s, soak_row, t);
+    return (now_seconds() - start) * 1e9;
+}
+
+// The thermal_soak scenario, stepped and fast-forwarded: time per simulated
+// tick, and whether the overtemperature trip lands on the same tick.
+static int bench_thermal(void) {
+    static const ScenarioEvent events[] = {
+        { 0.0, SCENARIO_SPEED, 50.0 }, { 10.0, SCENARIO_LOAD, 43.0 },
+        { 2400.0, SCENARIO_LOAD, 20.0 }, { 3000.0, SCENARIO_LOAD, 43.0 },
+    };
+    static SoakTrace stepped, fast;
+    double stepped_ns[SOAK_STEPPED_RUNS], fast_ns[SOAK_FAST_RUNS];
+    Scenario *s = calloc(1, sizeof(*s));
+    if (!s) return 1;
+    sim_default_params(&s->params);
+    s->params.thermal_model = THERMAL_NETWORK;
+    s->duration = SOAK_DURATION;
+    s->every = SOAK_EVERY;
+    s->num_events = (int)(sizeof(events) / sizeof(events[0]));
+    memcpy(s->events, events, sizeof(events));
+    long ticks = (long)(s->duration / s->params.dt + 0.5);
+    for (int r = 0; r < SOAK_STEPPED_RUNS; r++) stepped_ns[r] = soak_run(s, &stepped);
+    s->fast_forward = 1;
+    for (int r = 0; r < SOAK_FAST_RUNS; r++) fast_ns[r] = soak_run(s, &fast);
+    free(s);
+    double max_error = 0.0;
+    for (long i = 0; i < stepped.rows && i < SOAK_MAX_ROWS; i++)
+        max_error = fmax(max_error, fabs(fast.temp[i] - stepped.temp[i]));
+    int status = stepped.rows != fast.rows || stepped.trip_time != fast.trip_time;
+    record_result("thermal/soak_stepped", stepped_ns, SOAK_STEPPED_RUNS, ticks);
+    record_result("thermal/soak_fast_forward", fast_ns, SOAK_FAST_RUNS, ticks);
+    // record_result leaves both arrays sorted
+    double speedup = percentile(stepped_ns, SOAK_STEPPED_RUNS, 0.5) / percentile(fast_ns, SOAK_FAST_RUNS, 0.5);
+    printf("thermal: %.0f s soak, trip at %.2f s stepped and %.2f s fast-forwarded, %.0fx faster, "
+           "temperature within %.3g C%s\n", SOAK_DURATION, stepped.trip_time, fast.trip_time, speedup, max_error,
+           status ? ", TRIP MISMATCH" : "");
+    return status;
+}
+
+static const Benchmark benchmarks[] = {
+    { "motor_batch", bench_motor_batch },
+    { "pwm", bench_pwm },
+    { "switching", bench_switching },
+    { "induction", bench_induction },
+    { "kernels", bench_kernels },
+    { "instrument", bench_instrument },
+    { "recorder", bench_recorder },
+    { "sweep", bench_sweep },
+    { "harmonic", bench_harmonic },
+    { "control", bench_control },
+    { "snapshot", bench_snapshot },
+    { "numeric", bench_numeric },
+    { "thermal", bench_thermal },
+};
+
+static void print_results(void) {
+    printf("\n%-28s %8s %12s %12s %12s %12s %14s\n", "benchmark", "samples", "ns/op p50", "mean", "p90", "p99", "ops/s");
+    for (int i = 0; i < num_results; i++) {
+        const BenchResult *r = &results[i];
+        printf("%-28s %8d %12.2f %12.2f %12.2f %12.2f %14.0f\n",
+               r->name, r->samples, r->ns_per_op, r->mean, r->p90, r->p99, r->ops_per_sec);
+    }
+}
+
+// One result per line so --compare can read it back without a JSON parser.
+static int write_json(const char *path) {
+    FILE *f = strcmp(path, "-") == 0 ? stdout : fopen(path, "w");
+    if (!f) {
+        perror(path);
+        return 0;
+    }
+    fprintf(f, "{\n  \"benchmarks\": [\n");
+    for (int i = 0; i < num_results; i++) {
+        const BenchResult *r = &results[i];
+        fprintf(f, "    {\"name\": \"%s\", \"samples\": %d, \"ns_per_op\": %.3f, \"mean\": %.3f, \"min\": %.3f, "
+                   "\"p90\": %.3f, \"p99\": %.3f, \"ops_per_sec\": %.1f}%s\n",
+                r->name, r->samples, r->ns_per_op, r->mean, r->min, r->p90, r->p99, r->ops_per_sec,
+                i + 1 < num_results ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+    if (f != stdout) fclose(f);
+    return 1;
+}
+
+// Compares median ns/op with a file written by --json. Returns the number of
+// benchmarks that got slower by more than threshold percent, or -1.
+static int compare_json(const char *path, double threshold) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    int regressions = 0;
+    char line[512];
+    printf("\n%-28s %12s %12s %9s\n", "benchmark", "baseline", "current", "change");
+    while (fgets(line, sizeof(line), f)) {
+        char name[64];
+        double base;
+        const char *n = strstr(line, "\"name\": \"");
+        const char *v = strstr(line, "\"ns_per_op\": ");
+        if (!n || !v || sscanf(n + 9, "%63[^\"]", name) != 1 || sscanf(v + 13, "%lf", &base) != 1) continue;
+        for (int i = 0; i < num_results; i++) {
+            if (strcmp(results[i].name, name) != 0) continue;
+            double change = base > 0 ? (results[i].ns_per_op - base) / base * 100.0 : 0.0;
+            int slower = change > threshold;
+            printf("%-28s %12.2f %12.2f %+8.1f%%%s\n", name, base, results[i].ns_per_op, change,
+                   slower ? "  REGRESSION" : "");
+            regressions += slower;
+        }
+    }
+    fclose(f);
+    return regressions;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [options] [benchmark...]\n"
+            "  -j, --json FILE         write results as JSON ('-' for stdout)\n"
+            "  -c, --compare FILE      compare with an earlier --json file, exit 1 on regression\n"
+            "  -t, --threshold PCT     slowdown reported as a regression (default 10)\n"
+            "  -l, --list              list benchmark names\n",
+            prog);
+}
+
+int main(int argc, char *argv[]) {
+    const char *json_path = NULL;
+    const char *compare_path = NULL;
+    double threshold = 10.0;
+    static const struct option long_opts[] = {
+        {"json", required_argument, NULL, 'j'},
+        {"compare", required_argument, NULL, 'c'},
+        {"threshold", required_argument, NULL, 't'},
+        {"list", no_argument, NULL, 'l'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+    size_t count = sizeof(benchmarks) / sizeof(benchmarks[0]);
+    int opt;
+    while ((opt = getopt_long(argc, argv, "j:c:t:lh", long_opts, NULL)) != -1) {
+        switch (opt) {
+            case 'j': json_path = optarg; break;
+            case 'c': compare_path = optarg; break;
+            case 't': threshold = atof(optarg); break;
+            case 'l':
+                for (size_t i = 0; i < count; i++) printf("%s\n", benchmarks[i].name);
+                return 0;
+            case 'h': usage(argv[0]); return 0;
+            default: usage(argv[0]); return 1;
+        }
+    }
+
+    int status = 0;
+    for (size_t i = 0; i < count; i++) {
+        int selected = optind >= argc;
+        for (int a = optind; a < argc; a++) {
+            if (strcmp(argv[a], benchmarks[i].name) == 0) selected = 1;
+        }
+        if (selected && benchmarks[i].run() != 0) status = 1;
+    }
+    print_results();
+    if (json_path && !write_json(json_path)) status = 1;
+    if (compare_path && compare_json(compare_path, threshold) != 0) status = 1;
+    return status;
+}
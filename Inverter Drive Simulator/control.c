@@ -0,0 +1,263 @@
+#include "control.h"
+#include <math.h>
+#include <string.h>
+
+#define SQRT3 1.7320508075688772
+
+// Unit voltage vectors V1..V6 of a two-level inverter, 60 degrees apart.
+static const double dtc_vectors[6][2] = {
+    { 1.0, 0.0 }, { 0.5, SQRT3 / 2.0 }, { -0.5, SQRT3 / 2.0 },
+    { -1.0, 0.0 }, { -0.5, -SQRT3 / 2.0 }, { 0.5, -SQRT3 / 2.0 },
+};
+
+void control_init(ControlState *c) {
+    memset(c, 0, sizeof(*c));
+    c->mode = CONTROL_VF;
+    c->rate = CONTROL_DEFAULT_RATE;
+}
+
+// Gains follow from the machine model and the rate. The current loops cancel
+// the stator pole and close at CONTROL_CURRENT_BW of the rate; the speed loop
+// closes at CONTROL_SPEED_BW with its zero a quarter of the way below.
+void control_configure(ControlState *c, const InductionParams *p, double v_max, double base_omega, double i_max) {
+    c->model = *p;
+    c->sigma_ls = p->ls - p->lm * p->lm / p->lr;
+    c->v_max = v_max;
+    c->i_max = i_max;
+    c->base_omega = base_omega;
+    c->psi_s_rated = v_max / base_omega;
+    c->psi_r_rated = c->psi_s_rated * p->lm / p->ls;
+    double kt = 1.5 * p->pole_pairs * p->lm / p->lr * c->psi_r_rated;   // Nm per A of iq
+    double id = c->psi_r_rated / p->lm;
+    c->torque_max = kt * sqrt(fmax(0.0, i_max * i_max - id * id));
+    double wi = 2.0 * M_PI * CONTROL_CURRENT_BW * c->rate;
+    double r = p->rs + p->rr * (p->lm / p->lr) * (p->lm / p->lr);
+    c->id_pi.kp = c->iq_pi.kp = c->sigma_ls * wi;
+    c->id_pi.ki = c->iq_pi.ki = r * wi;
+    double ws = 2.0 * M_PI * CONTROL_SPEED_BW;
+    c->speed_pi.kp = p->inertia * ws / (c->mode == CONTROL_DTC ? 1.0 : kt);
+    c->speed_pi.ki = c->speed_pi.kp * ws / 4.0;
+}
+
+// Starts the loops afresh, as on a flying restart, with the estimators
+// seeded from the flux the machine already carries.
+void control_reset(ControlState *c, const double psi_s[2], const double psi_r[2], double omega_e) {
+    c->speed_pi.integral = c->id_pi.integral = c->iq_pi.integral = 0.0;
+    c->psi_s[0] = psi_s[0];
+    c->psi_s[1] = psi_s[1];
+    c->psi_r_model[0] = psi_r[0];
+    c->psi_r_model[1] = psi_r[1];
+    c->psi_r = hypot(psi_r[0], psi_r[1]);
+    c->theta = c->mode == CONTROL_DTC ? atan2(psi_s[1], psi_s[0]) : atan2(psi_r[1], psi_r[0]);
+    c->omega_e = omega_e;
+    c->speed_est = c->model.pole_pairs > 0.0 ? omega_e / c->model.pole_pairs : 0.0;
+    c->i_last[0] = c->i_last[1] = 0.0;
+    c->v_cmd[0] = c->v_cmd[1] = c->v_out[0] = c->v_out[1] = 0.0;
+    c->flux_up = 1;
+    c->torque_dir = 0;
+    c->magnetised = 0;
+    c->vector = 0;
+}
+
+void control_clarke(const double abc[3], double ab[2]) {
+    ab[0] = abc[0];
+    ab[1] = (abc[0] + 2.0 * abc[1]) / SQRT3;
+}
+
+void control_inverse_clarke(const double ab[2], double abc[3]) {
+    abc[0] = ab[0];
+    abc[1] = -0.5 * ab[0] + 0.5 * SQRT3 * ab[1];
+    abc[2] = -0.5 * ab[0] - 0.5 * SQRT3 * ab[1];
+}
+
+void control_park(const double ab[2], double theta, double dq[2]) {
+    double c = cos(theta), s = sin(theta);
+    dq[0] = c * ab[0] + s * ab[1];
+    dq[1] = -s * ab[0] + c * ab[1];
+}
+
+void control_inverse_park(const double dq[2], double theta, double ab[2]) {
+    double c = cos(theta), s = sin(theta);
+    ab[0] = c * dq[0] - s * dq[1];
+    ab[1] = s * dq[0] + c * dq[1];
+}
+
+const char *control_mode_name(ControlMode mode) {
+    switch (mode) {
+        case CONTROL_FOC: return "Vector Control";
+        case CONTROL_SENSORLESS: return "Sensorless Vector";
+        case CONTROL_DTC: return "DTC";
+        default: return "V/f";
+    }
+}
+
+// PI with conditional integration: the integral is frozen while the output
+// sits on a limit, so it never winds up.
+static double pi_step(PiController *pi, double error, double ts, double lo, double hi) {
+    double step = pi->ki * error * ts;
+    double out = pi->kp * error + pi->integral + step;
+    if (out > hi) return hi;
+    if (out < lo) return lo;
+    pi->integral += step;
+    return out;
+}
+
+// Near base speed the flux reference falls with 1 / speed, leaving the
+// current loops CONTROL_VOLTAGE_MARGIN of v_max to work with.
+static double field_weakening(const ControlState *c, double omega) {
+    double w = fabs(omega), knee = CONTROL_VOLTAGE_MARGIN * c->base_omega;
+    return w > knee ? knee / w : 1.0;
+}
+
+static double low_pass(double y, double x, double ts) {
+    return y + (x - y) * fmin(1.0, 2.0 * M_PI * CONTROL_SPEED_FILTER * ts);
+}
+
+// Moves the field angle to a flux vector and returns its unfiltered speed;
+// too little flux to resolve an angle holds the angle and the speed.
+static double track_angle(ControlState *c, const double psi[2], double rated, double ts) {
+    if (hypot(psi[0], psi[1]) < CONTROL_MIN_FLUX * rated) return c->omega_e;
+    double theta = atan2(psi[1], psi[0]);
+    double w = remainder(theta - c->theta, 2.0 * M_PI) / ts;
+    c->theta = theta;
+    return w;
+}
+
+// Voltage model: the stator flux is the integral of v - Rs i, with the
+// voltage applied over the last period and the mean current across it. A
+// pure integral keeps any offset it picks up, so it is pulled towards the
+// current model, the rotor flux that the current and the shaft speed
+// imply, at CONTROL_OBSERVER_GAIN. The current model is what remains near
+// zero frequency, where the voltage carries no flux information.
+static void observe_flux(ControlState *c, const double i[2], double omega_r, double ts) {
+    const InductionParams *p = &c->model;
+    double cs = cos(omega_r * ts), sn = sin(omega_r * ts);
+    double r0 = cs * c->psi_r_model[0] - sn * c->psi_r_model[1];
+    double r1 = sn * c->psi_r_model[0] + cs * c->psi_r_model[1];
+    c->psi_r_model[0] = r0 + ts * p->rr / p->lr * (p->lm * i[0] - r0);
+    c->psi_r_model[1] = r1 + ts * p->rr / p->lr * (p->lm * i[1] - r1);
+    for (int k = 0; k < 2; k++) {
+        double emf = c->v_out[k] - p->rs * 0.5 * (i[k] + c->i_last[k]);
+        double model = p->lm / p->lr * c->psi_r_model[k] + c->sigma_ls * i[k];
+        c->psi_s[k] += ts * (emf + CONTROL_OBSERVER_GAIN * (model - c->psi_s[k]));
+    }
+}
+
+// Field orientation: speed PI to iq, flux to id, then decoupled current PIs
+// in the field frame. The voltage goes out 1.5 periods later on average,
+// so the inverse Park transform leads by that much rotation.
+static void step_vector(ControlState *c, const double i[2], double speed, double speed_ref, double ts) {
+    const InductionParams *p = &c->model;
+    double idq[2];
+    if (c->mode == CONTROL_SENSORLESS) {
+        observe_flux(c, i, c->speed_est * p->pole_pairs, ts);
+        double psi_r[2];
+        for (int k = 0; k < 2; k++) psi_r[k] = p->lr / p->lm * (c->psi_s[k] - c->sigma_ls * i[k]);
+        double w = track_angle(c, psi_r, c->psi_r_rated, ts);
+        c->psi_r = hypot(psi_r[0], psi_r[1]);
+        control_park(i, c->theta, idq);
+        // Filter field speed less slip as one, so a step in iq does not
+        // show up in the estimate ahead of the field's response to it.
+        double slip = c->psi_r > CONTROL_MIN_FLUX * c->psi_r_rated ? p->lm * p->rr * idq[1] / (p->lr * c->psi_r) : 0.0;
+        c->omega_e = low_pass(c->omega_e, w, ts);
+        c->speed_est = low_pass(c->speed_est, (w - slip) / p->pole_pairs, ts);
+        speed = c->speed_est;
+    } else {
+        // Current model: rotor flux lags id by the rotor time constant; slip
+        // follows from iq, and the field angle integrates slip plus shaft speed.
+        control_park(i, c->theta, idq);
+        c->psi_r += ts * p->rr / p->lr * (p->lm * idq[0] - c->psi_r);
+        double slip = c->psi_r > CONTROL_MIN_FLUX * c->psi_r_rated ? p->lm * p->rr * idq[1] / (p->lr * c->psi_r) : 0.0;
+        c->omega_e = speed * p->pole_pairs + slip;
+    }
+    c->flux_ref = c->psi_r_rated * field_weakening(c, c->omega_e);
+    c->id_ref = c->flux_ref / p->lm;
+    double iq_max = sqrt(fmax(0.0, c->i_max * c->i_max - c->id_ref * c->id_ref));
+    c->iq_ref = pi_step(&c->speed_pi, speed_ref - speed, ts, -iq_max, iq_max);
+    double w = c->omega_e;
+    double vd_ff = -w * c->sigma_ls * idq[1];
+    double vq_ff = w * (c->sigma_ls * idq[0] + p->lm / p->lr * c->psi_r);
+    double vdq[2];
+    vdq[0] = vd_ff + pi_step(&c->id_pi, c->id_ref - idq[0], ts, -c->v_max - vd_ff, c->v_max - vd_ff);
+    double vq_max = sqrt(fmax(0.0, c->v_max * c->v_max - vdq[0] * vdq[0]));
+    vdq[1] = vq_ff + pi_step(&c->iq_pi, c->iq_ref - idq[1], ts, -vq_max - vq_ff, vq_max - vq_ff);
+    control_inverse_park(vdq, c->theta + 1.5 * w * ts, c->v_cmd);
+    c->torque_est = 1.5 * p->pole_pairs * p->lm / p->lr * c->psi_r * idq[1];
+    if (c->mode == CONTROL_FOC) c->theta = remainder(c->theta + w * ts, 2.0 * M_PI);
+}
+
+// Direct torque control: two-level flux and three-level torque comparators
+// pick one of the eight inverter states from a table indexed by the stator
+// flux sector. The bus is sized so that its linear range reaches v_max.
+static void step_dtc(ControlState *c, const double i[2], double speed, double speed_ref, double ts) {
+    const InductionParams *p = &c->model;
+    observe_flux(c, i, speed * p->pole_pairs, ts);
+    c->omega_e = low_pass(c->omega_e, track_angle(c, c->psi_s, c->psi_s_rated, ts), ts);
+    c->torque_est = 1.5 * p->pole_pairs * (c->psi_s[0] * i[1] - c->psi_s[1] * i[0]);
+    c->torque_ref = pi_step(&c->speed_pi, speed_ref - speed, ts, -c->torque_max, c->torque_max);
+    // The stator flux angle moves in steps under hysteresis control, so
+    // field weakening goes by the shaft speed instead.
+    c->flux_ref = c->psi_s_rated * field_weakening(c, speed * p->pole_pairs);
+
+    double flux_err = c->flux_ref - hypot(c->psi_s[0], c->psi_s[1]);
+    double flux_band = 0.5 * CONTROL_DTC_FLUX_BAND * c->psi_s_rated;
+    if (flux_err > flux_band) c->flux_up = 1;
+    else if (flux_err < -flux_band) c->flux_up = 0;
+    double torque_err = c->torque_ref - c->torque_est;
+    double torque_band = 0.5 * CONTROL_DTC_TORQUE_BAND * c->torque_max;
+    if (torque_err > torque_band) c->torque_dir = 1;
+    else if (torque_err < -torque_band) c->torque_dir = -1;
+    else if ((c->torque_dir > 0 && torque_err <= 0.0) || (c->torque_dir < 0 && torque_err >= 0.0)) c->torque_dir = 0;
+    // Past the current limit the torque is pulled back towards zero, which
+    // closes the angle between stator and rotor flux and with it the current.
+    // The vector now chosen only comes in a period from now, so the limit is
+    // checked on the current carried on by its last period's change.
+    double i_next[2] = { 2.0 * i[0] - c->i_last[0], 2.0 * i[1] - c->i_last[1] };
+    if (c->magnetised && hypot(i_next[0], i_next[1]) > c->i_max) c->torque_dir = c->torque_est > 0.0 ? -1 : 1;
+
+    // A start from rest first builds the rotor flux with the stator flux
+    // held still, the current kept under i_max by the zero vector. The
+    // current climbs for two periods after the sample that sees it high, so
+    // the zero vector comes in at a fraction of the limit. A flux left to
+    // decay to half of that under the zero vector, as while held at zero
+    // speed, is built up again the same way.
+    double psi_r[2];
+    for (int k = 0; k < 2; k++) psi_r[k] = p->lr / p->lm * (c->psi_s[k] - c->sigma_ls * i[k]);
+    c->psi_r = hypot(psi_r[0], psi_r[1]);
+    double psi_r_built = CONTROL_DTC_MAGNETISED * c->flux_ref * p->lm / p->ls;
+    if (c->psi_r >= psi_r_built) c->magnetised = 1;
+    else if (c->psi_r < 0.5 * psi_r_built) c->magnetised = 0;
+    int magnetising = !c->magnetised;
+    if (magnetising ? hypot(i[0], i[1]) > CONTROL_DTC_MAGNETISING_CURRENT * c->i_max : c->torque_dir == 0) {
+        c->vector = 0;
+        c->v_cmd[0] = c->v_cmd[1] = 0.0;
+        return;
+    }
+    // Sector k is centred on V(k+1); the vector one or two ahead raises the
+    // torque, one or two behind lowers it, the nearer one also raising the
+    // flux. While magnetising, the vector in line raises the flux alone:
+    // turning it earlier only spins it past a rotor with no flux to pull on.
+    int sector = (int)floor(c->theta / (M_PI / 3.0) + 0.5);
+    int n = magnetising ? sector : sector + c->torque_dir * (c->flux_up ? 1 : 2);
+    n = ((n % 6) + 6) % 6;
+    double amplitude = 2.0 / SQRT3 * c->v_max;
+    c->vector = n + 1;
+    c->v_cmd[0] = amplitude * dtc_vectors[n][0];
+    c->v_cmd[1] = amplitude * dtc_vectors[n][1];
+}
+
+// One control period. i_abc and speed are the samples at the start of the
+// period; v_ab receives the stationary-frame voltage to apply until the next
+// call, which is the one computed at the previous sample.
+void control_step(ControlState *c, const double i_abc[3], double speed, double speed_ref, double ts, double v_ab[2]) {
+    double i[2];
+    double out[2] = { c->v_cmd[0], c->v_cmd[1] };
+    control_clarke(i_abc, i);
+    if (c->mode == CONTROL_DTC) step_dtc(c, i, speed, speed_ref, ts);
+    else if (c->mode != CONTROL_VF) step_vector(c, i, speed, speed_ref, ts);
+    for (int k = 0; k < 2; k++) {
+        c->i_last[k] = i[k];
+        c->v_out[k] = v_ab[k] = out[k];
+    }
+    c->iterations++;
+}
@@ -0,0 +1,86 @@
+#ifndef CONTROL_H
+#define CONTROL_H
+
+#include "induction.h"
+
+#define CONTROL_DEFAULT_RATE 10000.0
+#define CONTROL_MIN_RATE 1000.0
+#define CONTROL_MAX_RATE 50000.0
+#define CONTROL_CURRENT_BW 0.05       // current loop bandwidth, fraction of the control rate
+#define CONTROL_SPEED_BW 10.0         // speed loop bandwidth (Hz)
+#define CONTROL_SPEED_FILTER 1000.0   // Hz, low-pass on the estimated field and shaft speeds
+#define CONTROL_OBSERVER_GAIN 5.0     // rad/s; voltage- to current-model flux crossover
+#define CONTROL_MIN_FLUX 0.05         // per unit; below this the field angle is held
+#define CONTROL_VOLTAGE_MARGIN 0.85   // field weakening starts at this fraction of base speed
+#define CONTROL_DTC_FLUX_BAND 0.02    // hysteresis bands, per unit of rated flux and torque
+#define CONTROL_DTC_TORQUE_BAND 0.05
+#define CONTROL_DTC_MAGNETISED 0.8    // rotor flux, per unit of its reference, before DTC makes torque
+#define CONTROL_DTC_MAGNETISING_CURRENT 0.75   // per unit of i_max, while building the flux
+
+typedef enum {
+    CONTROL_VF,          // open-loop V/f ramp, stepped once per tick by motor.c
+    CONTROL_FOC,         // indirect field orientation with an encoder
+    CONTROL_SENSORLESS,  // field orientation on a voltage-model flux observer
+    CONTROL_DTC,         // direct torque control, hysteresis and switching table
+    CONTROL_MODE_COUNT
+} ControlMode;
+
+typedef struct {
+    double kp;
+    double ki;
+    double integral;
+} PiController;
+
+// A digital drive controller sampling the phase currents and shaft speed
+// once per period of 1 / rate. Like a real one it has a period of delay:
+// the voltage computed from one sample is applied during the next period.
+// Plain data, so it travels with the MotorState that owns it.
+typedef struct {
+    ControlMode mode;
+    double rate;             // control loop rate (Hz)
+    // Machine model and limits, refreshed by control_configure
+    InductionParams model;
+    double sigma_ls;         // stator transient inductance (H)
+    double v_max;            // largest phase voltage peak the modulator can produce
+    double i_max;            // stator current limit (A peak)
+    double base_omega;       // rated electrical speed (rad/s); field weakening above it
+    double psi_s_rated;      // Vs
+    double psi_r_rated;
+    double torque_max;       // Nm at i_max and rated flux
+    PiController speed_pi;
+    PiController id_pi;
+    PiController iq_pi;
+    // Estimator state
+    double theta;            // field angle (rad): rotor flux, or stator flux for DTC
+    double omega_e;          // field speed (rad/s)
+    double psi_r;            // rotor flux magnitude (Vs)
+    double psi_s[2];         // observed stator flux, stationary frame
+    double psi_r_model[2];   // current-model rotor flux, stationary frame
+    double i_last[2];
+    double speed_est;        // sensorless shaft speed estimate (rad/s)
+    double torque_est;
+    // References and outputs
+    double id_ref;
+    double iq_ref;
+    double torque_ref;
+    double flux_ref;
+    int flux_up;             // DTC comparator states
+    int torque_dir;
+    int magnetised;          // DTC: rotor flux built up since the last reset
+    int vector;              // DTC voltage vector 0..7, 0 and 7 zero
+    double v_cmd[2];         // computed at the last sample, applied in the next period
+    double v_out[2];         // being applied in this period
+    unsigned long iterations;
+} ControlState;
+
+void control_init(ControlState *c);
+void control_configure(ControlState *c, const InductionParams *p, double v_max, double base_omega, double i_max);
+void control_reset(ControlState *c, const double psi_s[2], const double psi_r[2], double omega_e);
+void control_step(ControlState *c, const double i_abc[3], double speed, double speed_ref, double ts, double v_ab[2]);
+void control_clarke(const double abc[3], double ab[2]);
+void control_inverse_clarke(const double ab[2], double abc[3]);
+void control_park(const double ab[2], double theta, double dq[2]);
+void control_inverse_park(const double dq[2], double theta, double ab[2]);
+const char *control_mode_name(ControlMode mode);
+
+#endif
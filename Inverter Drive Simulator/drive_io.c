@@ -0,0 +1,121 @@
+#include "drive_io.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+void drive_status_init(DriveStatusBlock *b) {
+    memset(b, 0, sizeof(*b));
+    memcpy(b->magic, DRIVE_STATUS_MAGIC, sizeof(DRIVE_STATUS_MAGIC));
+    b->version = DRIVE_STATUS_VERSION;
+    b->size = (uint32_t)sizeof(*b);
+    atomic_init(&b->seq, 0);
+}
+
+void drive_status_fill(DriveStatus *s, const SimContext *ctx, const SimInputs *in, int running) {
+    s->time = ctx->time;
+    s->speed_ref = in->speed_ref;
+    s->freq = ctx->inverter.freq;
+    s->vll = calculate_vll(&ctx->inverter);
+    s->current = get_motor_current(&ctx->motor);
+    s->speed = get_motor_speed(&ctx->motor);
+    s->torque = get_motor_torque(&ctx->motor);
+    s->temp = get_motor_temp(&ctx->motor);
+    s->steps = ctx->steps;
+    s->fault = (uint32_t)ctx->fault.current_fault;
+    s->flags = (running ? DRIVE_FLAG_RUNNING : 0) | (in->is_forward ? 0 : DRIVE_FLAG_REVERSE) |
+               (has_fault(&ctx->fault) ? DRIVE_FLAG_FAULTED : 0);
+}
+
+void drive_status_publish(DriveStatusBlock *b, const DriveStatus *s) {
+    unsigned long seq = atomic_load_explicit(&b->seq, memory_order_relaxed);
+    atomic_store_explicit(&b->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    b->data = *s;
+    atomic_store_explicit(&b->seq, seq + 2, memory_order_release);
+}
+
+void drive_status_read(DriveStatusBlock *b, DriveStatus *out) {
+    for (;;) {
+        unsigned long before = atomic_load_explicit(&b->seq, memory_order_acquire);
+        if (before & 1) continue;
+        memcpy(out, &b->data, sizeof(*out));
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&b->seq, memory_order_relaxed) == before) return;
+    }
+}
+
+// POSIX shared-memory names start with a slash; allow it to be left off.
+static void shm_name(const char *name, char *out, size_t len) {
+    snprintf(out, len, "%s%s", name[0] == '/' ? "" : "/", name);
+}
+
+DriveStatusBlock *drive_status_shm_create(const char *name) {
+    char path[256];
+    shm_name(name, path, sizeof(path));
+    int fd = shm_open(path, O_CREAT | O_RDWR, 0644);
+    if (fd < 0) return NULL;
+    void *p = MAP_FAILED;
+    if (ftruncate(fd, sizeof(DriveStatusBlock)) == 0)
+        p = mmap(NULL, sizeof(DriveStatusBlock), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) return NULL;
+    drive_status_init(p);
+    return p;
+}
+
+// Maps a block read-only; NULL unless it was created by a matching build.
+DriveStatusBlock *drive_status_shm_open(const char *name) {
+    char path[256];
+    shm_name(name, path, sizeof(path));
+    int fd = shm_open(path, O_RDONLY, 0);
+    if (fd < 0) return NULL;
+    void *p = mmap(NULL, sizeof(DriveStatusBlock), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) return NULL;
+    const DriveStatusBlock *b = p;
+    if (memcmp(b->magic, DRIVE_STATUS_MAGIC, sizeof(DRIVE_STATUS_MAGIC)) != 0 ||
+        b->version != DRIVE_STATUS_VERSION || b->size != sizeof(DriveStatusBlock)) {
+        munmap(p, sizeof(DriveStatusBlock));
+        return NULL;
+    }
+    return p;
+}
+
+void drive_status_shm_close(DriveStatusBlock *b) {
+    if (b) munmap(b, sizeof(*b));
+}
+
+void drive_status_shm_unlink(const char *name) {
+    char path[256];
+    shm_name(name, path, sizeof(path));
+    shm_unlink(path);
+}
+
+void drive_commands_init(DriveCommands *c, const SimInputs *in, int run) {
+    atomic_init(&c->run, run);
+    atomic_init(&c->reverse, !in->is_forward);
+    atomic_init(&c->speed_ref, (int)(in->speed_ref * 100.0 + 0.5));
+    atomic_init(&c->load_torque, (int)(in->load_torque * 10.0 + (in->load_torque < 0 ? -0.5 : 0.5)));
+    atomic_init(&c->pending, 0);
+}
+
+// Posts one DRIVE_CMD_* value; DRIVE_CMD_RESET ignores it.
+void drive_commands_post(DriveCommands *c, unsigned which, int value) {
+    switch (which) {
+        case DRIVE_CMD_RUN: atomic_store_explicit(&c->run, value, memory_order_relaxed); break;
+        case DRIVE_CMD_REVERSE: atomic_store_explicit(&c->reverse, value, memory_order_relaxed); break;
+        case DRIVE_CMD_SPEED: atomic_store_explicit(&c->speed_ref, value, memory_order_relaxed); break;
+        case DRIVE_CMD_LOAD: atomic_store_explicit(&c->load_torque, value, memory_order_relaxed); break;
+        default: break;
+    }
+    atomic_fetch_or_explicit(&c->pending, which, memory_order_release);
+}
+
+// Returns and clears the mask of commands posted since the last call. A
+// value posted while the caller reads it is simply applied again next time.
+unsigned drive_commands_take(DriveCommands *c) {
+    if (!atomic_load_explicit(&c->pending, memory_order_relaxed)) return 0;
+    return atomic_exchange_explicit(&c->pending, 0, memory_order_acquire);
+}
@@ -0,0 +1,78 @@
+#ifndef DRIVE_IO_H
+#define DRIVE_IO_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include "sim.h"
+
+// The drive as seen from outside the simulation: a status block the
+// simulation thread publishes once per tick, and commands any other thread
+// may post. Neither side ever waits for the other.
+
+#define DRIVE_STATUS_MAGIC "IDSSTA1"
+#define DRIVE_STATUS_VERSION 1
+
+enum {
+    DRIVE_FLAG_RUNNING = 1,
+    DRIVE_FLAG_REVERSE = 2,
+    DRIVE_FLAG_FAULTED = 4
+};
+
+// Fixed-width fields only: the block may be mapped by another process.
+typedef struct {
+    double time;
+    double speed_ref;   // percent of max_freq in use, 0 while stopped
+    double freq;        // inverter output (Hz)
+    double vll;
+    double current;
+    double speed;       // rpm
+    double torque;
+    double temp;
+    uint64_t steps;
+    uint32_t flags;     // DRIVE_FLAG_*
+    uint32_t fault;     // FaultType
+} DriveStatus;
+
+// Seqlocked like ParamStore, with the simulation thread as the one writer.
+// Laid out to live in a shared-memory object, where readers in other
+// processes check magic, version and size before trusting it.
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t size;                     // sizeof(DriveStatusBlock)
+    _Alignas(64) atomic_ulong seq;
+    DriveStatus data;
+} DriveStatusBlock;
+
+enum {
+    DRIVE_CMD_RUN = 1,
+    DRIVE_CMD_REVERSE = 2,
+    DRIVE_CMD_SPEED = 4,
+    DRIVE_CMD_LOAD = 8,
+    DRIVE_CMD_RESET = 16
+};
+
+// Latest commanded values in register units, and a mask of the ones written
+// since the owner of the drive last took them.
+typedef struct {
+    atomic_int run;
+    atomic_int reverse;
+    atomic_int speed_ref;     // 0.01 %
+    atomic_int load_torque;   // 0.1 Nm
+    atomic_uint pending;      // DRIVE_CMD_*
+} DriveCommands;
+
+void drive_status_init(DriveStatusBlock *b);
+void drive_status_fill(DriveStatus *s, const SimContext *ctx, const SimInputs *in, int running);
+void drive_status_publish(DriveStatusBlock *b, const DriveStatus *s);
+void drive_status_read(DriveStatusBlock *b, DriveStatus *out);
+DriveStatusBlock *drive_status_shm_create(const char *name);
+DriveStatusBlock *drive_status_shm_open(const char *name);
+void drive_status_shm_close(DriveStatusBlock *b);
+void drive_status_shm_unlink(const char *name);
+
+void drive_commands_init(DriveCommands *c, const SimInputs *in, int run);
+void drive_commands_post(DriveCommands *c, unsigned which, int value);
+unsigned drive_commands_take(DriveCommands *c);
+
+#endif
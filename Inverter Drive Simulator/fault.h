@@ -1,17 +1,110 @@
 #ifndef FAULT_H
 #define FAULT_H
 
+#include <stddef.h>
+
 typedef enum {
     FAULT_NONE,
     FAULT_OVERCURRENT,
     FAULT_UNDERVOLTAGE,
-    FAULT_OVERTEMP
+    FAULT_OVERTEMP,
+    FAULT_OVERLOAD,
+    FAULT_TYPE_COUNT
 } FaultType;
 
-void check_faults(double voltage, double current, double temp);
-void trigger_fault(FaultType fault);
-void reset_faults(void);
-int has_fault(void);
-const char *get_fault_status(void);
+// Signals the rules watch, sampled once per tick or, with the switching
+// model on, once per carrier period.
+typedef enum {
+    FAULT_SIGNAL_CURRENT,   // motor RMS current (A)
+    FAULT_SIGNAL_PHASE,     // largest instantaneous phase current (A)
+    FAULT_SIGNAL_VOLTAGE,   // DC bus (V)
+    FAULT_SIGNAL_TEMP,      // winding temperature (C)
+    FAULT_SIGNAL_COUNT
+} FaultSignal;
+
+typedef enum {
+    FAULT_RULE_ABOVE,       // signal > threshold
+    FAULT_RULE_BELOW,       // signal < threshold
+    FAULT_RULE_RMS_ABOVE,   // RMS over the last `window` seconds > threshold
+    FAULT_RULE_I2T          // integral of (x^2 - threshold^2) dt reaches `limit`
+} FaultRuleKind;
+
+typedef struct {
+    FaultType fault;
+    FaultSignal signal;
+    FaultRuleKind kind;
+    double threshold;   // level, RMS level or I2t pickup
+    double window;      // RMS window (s)
+    double limit;       // I2t trip constant (A^2 s)
+    double debounce;    // s the condition must hold before a trip
+} FaultRule;
+
+#define FAULT_MAX_RULES 8
+#define FAULT_RMS_BLOCKS 16   // an RMS window slides in steps of window / FAULT_RMS_BLOCKS
+
+typedef struct {
+    double held;                           // s the condition has held
+    double i2t;
+    double block_sum[FAULT_RMS_BLOCKS];    // integral of x^2 dt per completed block
+    double block_time[FAULT_RMS_BLOCKS];
+    double window_sum;                     // over the completed blocks
+    double window_time;
+    double open_sum;                       // the block being filled
+    double open_time;
+    int head;
+} FaultRuleState;
+
+// Plain data like the rest of SimContext: the rule table travels with the
+// drive when it is copied.
+typedef struct {
+    FaultType current_fault;
+    int trip_rule;       // rule that latched current_fault, -1 if injected or none
+    double trip_time;
+    double trip_value;   // the rule's measure at the trip
+    double time;         // engine clock, advanced by each sample's dt
+    int num_rules;
+    FaultRule rules[FAULT_MAX_RULES];
+    FaultRuleState state[FAULT_MAX_RULES];
+} FaultState;
+
+typedef struct {
+    double time;
+    double signals[FAULT_SIGNAL_COUNT];
+    int fault;
+} FaultSample;
+
+// Scope-style capture of the samples around a trip. Kept outside FaultState
+// because it is large and only the caller that inspects trips needs one.
+typedef struct FaultCapture FaultCapture;
+
+// Seconds until a varying signal first reaches level, HUGE_VAL if never.
+typedef double (*FaultCrossingFn)(FaultSignal signal, double level, void *user_data);
+
+void fault_init(FaultState *f);
+void fault_default_rules(FaultRule *rules, int *num_rules);
+int fault_set_rules(FaultState *f, const FaultRule *rules, int num_rules);
+void fault_sample(FaultState *f, double dt, const double *signals);
+void trigger_fault(FaultState *f, FaultType fault);
+void reset_faults(FaultState *f);
+int has_fault(const FaultState *f);
+const char *get_fault_status(const FaultState *f);
+const char *fault_type_name(FaultType fault);
+const char *fault_signal_name(FaultSignal signal);
+
+// Fast-forward support. fault_quiet_time bounds how long the rules stay
+// quiet with the signals held, except those in the varying mask, which may
+// only move as crossing reports; 0 if a rule may act on the next sample.
+// fault_advance then takes that many samples of the held signals in one go.
+double fault_quiet_time(const FaultState *f, const double *signals, unsigned varying,
+                        FaultCrossingFn crossing, void *user_data);
+void fault_advance(FaultState *f, double dt, long samples, const double *signals);
+
+FaultCapture *fault_capture_create(size_t length, size_t pre_samples);
+void fault_capture_destroy(FaultCapture *c);
+void fault_capture_push(FaultCapture *c, const FaultState *f, const double *signals);
+int fault_capture_ready(const FaultCapture *c);
+size_t fault_capture_read(const FaultCapture *c, FaultSample *out, size_t max);
+double fault_capture_trigger_time(const FaultCapture *c);
+void fault_capture_arm(FaultCapture *c);
 
 #endif
@@ -0,0 +1,229 @@
+#include "fleet.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Each worker owns a contiguous range of chunks. The owner and any thief
+// claim chunks from the same atomic cursor, so an idle worker can drain
+// the tail of a busy worker's range without locks.
+typedef struct {
+    _Alignas(64) atomic_int next;
+    int end;
+} WorkQueue;
+
+typedef struct {
+    _Alignas(64) Fleet *fleet;
+    int index;
+    unsigned long steps;
+    unsigned long steals;
+} Worker;
+
+struct Fleet {
+    int num_drives;
+    int num_threads;
+    int num_chunks;
+    SimContext *drives;
+    SimInputs *inputs;
+    WorkQueue *queues;
+    Worker *workers;
+    pthread_t *threads;
+    pthread_barrier_t start_barrier;
+    pthread_barrier_t end_barrier;
+    atomic_int quit;
+    pthread_mutex_t launch_lock;
+    pthread_cond_t launch_cond;
+    int launch;
+};
+
+enum { LAUNCH_PENDING, LAUNCH_GO, LAUNCH_ABORT };
+
+static void step_chunk(Fleet *fleet, int chunk, Worker *worker) {
+    int begin = chunk * FLEET_CHUNK;
+    int end = begin + FLEET_CHUNK;
+    if (end > fleet->num_drives) end = fleet->num_drives;
+    for (int i = begin; i < end; i++) {
+        if (has_fault(&fleet->drives[i].fault)) continue;
+        sim_step(&fleet->drives[i], &fleet->inputs[i]);
+        worker->steps++;
+    }
+}
+
+static void run_tick_share(Fleet *fleet, int self) {
+    Worker *own = &fleet->workers[self];
+    for (int v = 0; v < fleet->num_threads; v++) {
+        int victim = (self + v) % fleet->num_threads;
+        WorkQueue *q = &fleet->queues[victim];
+        for (;;) {
+            int chunk = atomic_fetch_add_explicit(&q->next, 1, memory_order_relaxed);
+            if (chunk >= q->end) break;
+            step_chunk(fleet, chunk, own);
+            if (victim != self) own->steals++;
+        }
+    }
+}
+
+static void reset_queues(Fleet *fleet) {
+    int per = fleet->num_chunks / fleet->num_threads;
+    int extra = fleet->num_chunks % fleet->num_threads;
+    int begin = 0;
+    for (int w = 0; w < fleet->num_threads; w++) {
+        int count = per + (w < extra ? 1 : 0);
+        atomic_store_explicit(&fleet->queues[w].next, begin, memory_order_relaxed);
+        fleet->queues[w].end = begin + count;
+        begin += count;
+    }
+}
+
+// Workers hold here until fleet_create knows every thread started, so none
+// waits on a barrier sized for threads that never came up.
+static int wait_launch(Fleet *fleet) {
+    pthread_mutex_lock(&fleet->launch_lock);
+    while (fleet->launch == LAUNCH_PENDING) pthread_cond_wait(&fleet->launch_cond, &fleet->launch_lock);
+    int go = fleet->launch == LAUNCH_GO;
+    pthread_mutex_unlock(&fleet->launch_lock);
+    return go;
+}
+
+static void set_launch(Fleet *fleet, int launch) {
+    pthread_mutex_lock(&fleet->launch_lock);
+    fleet->launch = launch;
+    pthread_cond_broadcast(&fleet->launch_cond);
+    pthread_mutex_unlock(&fleet->launch_lock);
+}
+
+static void free_fleet(Fleet *fleet) {
+    free(fleet->drives);
+    free(fleet->inputs);
+    free(fleet->queues);
+    free(fleet->workers);
+    free(fleet->threads);
+    free(fleet);
+}
+
+static void *worker_main(void *arg) {
+    Worker *worker = arg;
+    Fleet *fleet = worker->fleet;
+    if (!wait_launch(fleet)) return NULL;
+    for (;;) {
+        pthread_barrier_wait(&fleet->start_barrier);
+        if (atomic_load(&fleet->quit)) break;
+        run_tick_share(fleet, worker->index);
+        pthread_barrier_wait(&fleet->end_barrier);
+    }
+    return NULL;
+}
+
+Fleet *fleet_create(int num_drives, int num_threads, const SimParams *params) {
+    if (num_drives <= 0 || num_threads <= 0) return NULL;
+    Fleet *fleet = calloc(1, sizeof(Fleet));
+    if (!fleet) return NULL;
+    fleet->num_drives = num_drives;
+    fleet->num_threads = num_threads;
+    fleet->num_chunks = (num_drives + FLEET_CHUNK - 1) / FLEET_CHUNK;
+    fleet->drives = calloc(num_drives, sizeof(SimContext));
+    fleet->inputs = calloc(num_drives, sizeof(SimInputs));
+    fleet->queues = aligned_alloc(64, sizeof(WorkQueue) * num_threads);
+    fleet->workers = aligned_alloc(64, sizeof(Worker) * num_threads);
+    fleet->threads = calloc(num_threads, sizeof(pthread_t));
+    if (!fleet->drives || !fleet->inputs || !fleet->queues || !fleet->workers || !fleet->threads) {
+        free_fleet(fleet);
+        return NULL;
+    }
+    memset(fleet->queues, 0, sizeof(WorkQueue) * num_threads);
+    memset(fleet->workers, 0, sizeof(Worker) * num_threads);
+    for (int i = 0; i < num_drives; i++) {
+        sim_init(&fleet->drives[i], params);
+        fleet->inputs[i].speed_ref = 0.0;
+        fleet->inputs[i].is_forward = 1;
+        fleet->inputs[i].load_torque = 0.0;
+    }
+    atomic_init(&fleet->quit, 0);
+    pthread_mutex_init(&fleet->launch_lock, NULL);
+    pthread_cond_init(&fleet->launch_cond, NULL);
+    fleet->launch = LAUNCH_PENDING;
+    // Worker 0 is whichever thread calls fleet_run.
+    int started = 1;
+    for (int w = 0; w < num_threads; w++) {
+        fleet->workers[w].fleet = fleet;
+        fleet->workers[w].index = w;
+        if (w > 0) {
+            if (pthread_create(&fleet->threads[w], NULL, worker_main, &fleet->workers[w]) != 0) break;
+            started++;
+        }
+    }
+    if (started < num_threads) {
+        set_launch(fleet, LAUNCH_ABORT);
+        for (int w = 1; w < started; w++) pthread_join(fleet->threads[w], NULL);
+        pthread_mutex_destroy(&fleet->launch_lock);
+        pthread_cond_destroy(&fleet->launch_cond);
+        free_fleet(fleet);
+        return NULL;
+    }
+    pthread_barrier_init(&fleet->start_barrier, NULL, num_threads);
+    pthread_barrier_init(&fleet->end_barrier, NULL, num_threads);
+    set_launch(fleet, LAUNCH_GO);
+    return fleet;
+}
+
+void fleet_destroy(Fleet *fleet) {
+    if (!fleet) return;
+    atomic_store(&fleet->quit, 1);
+    pthread_barrier_wait(&fleet->start_barrier);
+    for (int w = 1; w < fleet->num_threads; w++) pthread_join(fleet->threads[w], NULL);
+    pthread_barrier_destroy(&fleet->start_barrier);
+    pthread_barrier_destroy(&fleet->end_barrier);
+    pthread_mutex_destroy(&fleet->launch_lock);
+    pthread_cond_destroy(&fleet->launch_cond);
+    free_fleet(fleet);
+}
+
+int fleet_size(const Fleet *fleet) {
+    return fleet->num_drives;
+}
+
+int fleet_threads(const Fleet *fleet) {
+    return fleet->num_threads;
+}
+
+SimContext *fleet_drive(Fleet *fleet, int index) {
+    return &fleet->drives[index];
+}
+
+SimInputs *fleet_inputs(Fleet *fleet, int index) {
+    return &fleet->inputs[index];
+}
+
+// Replaces every drive with a copy of state, so each continues from the same
+// point as its own branch under whatever inputs the tick callback gives it.
+void fleet_fork(Fleet *fleet, const SimContext *state) {
+    for (int i = 0; i < fleet->num_drives; i++) fleet->drives[i] = *state;
+}
+
+void fleet_run(Fleet *fleet, unsigned long ticks, FleetTickFn tick_fn, void *user_data, FleetStats *stats) {
+    for (int w = 0; w < fleet->num_threads; w++) {
+        fleet->workers[w].steps = 0;
+        fleet->workers[w].steals = 0;
+    }
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (unsigned long tick = 0; tick < ticks; tick++) {
+        if (tick_fn) tick_fn(fleet, tick, user_data);
+        reset_queues(fleet);
+        pthread_barrier_wait(&fleet->start_barrier);
+        run_tick_share(fleet, 0);
+        pthread_barrier_wait(&fleet->end_barrier);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    if (stats) {
+        memset(stats, 0, sizeof(*stats));
+        stats->ticks = ticks;
+        for (int w = 0; w < fleet->num_threads; w++) {
+            stats->drive_steps += fleet->workers[w].steps;
+            stats->steals += fleet->workers[w].steals;
+        }
+        stats->wall_seconds = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9;
+        stats->steps_per_second = stats->wall_seconds > 0 ? stats->drive_steps / stats->wall_seconds : 0.0;
+    }
+}
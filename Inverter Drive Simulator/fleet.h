@@ -0,0 +1,30 @@
+#ifndef FLEET_H
+#define FLEET_H
+
+#include "sim.h"
+
+#define FLEET_CHUNK 16
+
+typedef struct Fleet Fleet;
+
+// Called on the calling thread before every tick, while all workers are parked.
+typedef void (*FleetTickFn)(Fleet *fleet, unsigned long tick, void *user_data);
+
+typedef struct {
+    unsigned long ticks;
+    unsigned long drive_steps;
+    unsigned long steals;
+    double wall_seconds;
+    double steps_per_second;
+} FleetStats;
+
+Fleet *fleet_create(int num_drives, int num_threads, const SimParams *params);
+void fleet_destroy(Fleet *fleet);
+int fleet_size(const Fleet *fleet);
+int fleet_threads(const Fleet *fleet);
+SimContext *fleet_drive(Fleet *fleet, int index);
+SimInputs *fleet_inputs(Fleet *fleet, int index);
+void fleet_fork(Fleet *fleet, const SimContext *state);
+void fleet_run(Fleet *fleet, unsigned long ticks, FleetTickFn tick_fn, void *user_data, FleetStats *stats);
+
+#endif
@@ -3,13 +3,180 @@
 #include "waveform.h"
 #include "motor.h"
 #include "fault.h"
+#include "sim.h"
+#include "telemetry.h"
+#include "param_store.h"
+#include "instrument.h"
+#include "recorder.h"
+#include "harmonic.h"
+#include "modbus.h"
+#include <math.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+
+#define GUI_TIMER_MS 50
+#define REPLAY_MIN_WINDOW 1e-5
+#define REPLAY_MAX_WINDOW 86400.0
+#define REPLAY_DEFAULT_WINDOW 0.1
+#define STATS_REFRESH_TICKS 20
 
 static AppWidgets *app_widgets;
 static gboolean is_running = FALSE;
-static gboolean is_forward = TRUE;
+
+// The simulation thread owns sim. Parameters and inputs reach it through
+// the seqlocked store, run/reset/fault commands through atomics, and
+// results come back only through the telemetry ring.
+static SimContext sim;
+static ParamStore store;
+static TelemetryRing telemetry;
+static GThread *sim_thread;
+static gint sim_quit;
+static gint sim_running;
+static gint sim_reset;
+static gint sim_inject;    // bit per FaultType
+
+// Recording runs on the simulation thread; the GUI only posts commands.
+enum { RECORD_IDLE, RECORD_START, RECORD_STOP };
+static gint record_command;
+static gint record_active;
+static char record_path[256];
+static Recorder *recorder;
+
+// The analyser is fed on the simulation thread; results are copied out
+// under the lock once per step, and a full FFT only when the GUI asks. The
+// FFT runs into the simulation thread's own buffers outside the lock.
+static HarmonicAnalyzer *analyzer;
+static GMutex harmonic_lock;
+static HarmonicSnapshot harmonic_shared;
+static double *fft_work[SIM_HARMONIC_CHANNELS];
+static double *fft_shared[SIM_HARMONIC_CHANNELS];
+static int fft_shared_bins;
+static double fft_shared_hz;
+static unsigned fft_shared_serial;
+static gint fft_request;
+
+// Optional Modbus server and shared-memory status. The simulation thread
+// publishes the status; commands are applied on the GUI thread.
+static int remote_port = -1;
+static char remote_shm[256];
+static DriveStatusBlock local_status;
+static DriveStatusBlock *status_block;
+static DriveCommands commands;
+static ModbusServer *modbus;
+
+// Working copies edited by the signal handlers, published on change.
+static SimParams pending_params;
+static SimInputs pending_inputs;
+static gboolean params_valid = TRUE;
+
+typedef enum { FIELD_DOUBLE, FIELD_INT } FieldType;
+
+typedef struct {
+    size_t widget;   // offsetof(AppWidgets, ...)
+    size_t field;    // offsetof(SimParams, ...)
+    FieldType type;
+} ParamEntry;
+
+static const ParamEntry param_entries[] = {
+    { offsetof(AppWidgets, rated_voltage_entry), offsetof(SimParams, rated_voltage), FIELD_DOUBLE },
+    { offsetof(AppWidgets, rated_current_entry), offsetof(SimParams, rated_current), FIELD_DOUBLE },
+    { offsetof(AppWidgets, rated_freq_entry), offsetof(SimParams, rated_freq), FIELD_DOUBLE },
+    { offsetof(AppWidgets, rated_rpm_entry), offsetof(SimParams, rated_rpm), FIELD_DOUBLE },
+    { offsetof(AppWidgets, ramp_up_entry), offsetof(SimParams, ramp_up), FIELD_DOUBLE },
+    { offsetof(AppWidgets, ramp_down_entry), offsetof(SimParams, ramp_down), FIELD_DOUBLE },
+    { offsetof(AppWidgets, max_freq_entry), offsetof(SimParams, max_freq), FIELD_DOUBLE },
+    { offsetof(AppWidgets, min_freq_entry), offsetof(SimParams, min_freq), FIELD_DOUBLE },
+    { offsetof(AppWidgets, carrier_freq_entry), offsetof(SimParams, carrier_freq), FIELD_DOUBLE },
+    { offsetof(AppWidgets, substeps_entry), offsetof(SimParams, substeps), FIELD_INT },
+    { offsetof(AppWidgets, control_rate_entry), offsetof(SimParams, control_rate), FIELD_DOUBLE },
+};
+#define NUM_PARAM_ENTRIES (sizeof(param_entries) / sizeof(param_entries[0]))
+
+static void publish_harmonics(void) {
+    HarmonicSnapshot snap;
+    harmonic_snapshot(analyzer, &snap);
+    int fft = g_atomic_int_compare_and_exchange(&fft_request, 1, 0);
+    int bins = 0;
+    double bin_hz = 0.0;
+    if (fft) {
+        for (int c = 0; c < SIM_HARMONIC_CHANNELS; c++)
+            bins = harmonic_spectrum(analyzer, c, fft_work[c], harmonic_spectrum_bins(analyzer), &bin_hz);
+    }
+    g_mutex_lock(&harmonic_lock);
+    harmonic_shared = snap;
+    if (fft) {
+        for (int c = 0; c < SIM_HARMONIC_CHANNELS; c++)
+            memcpy(fft_shared[c], fft_work[c], sizeof(double) * (size_t)bins);
+        fft_shared_bins = bins;
+        fft_shared_hz = bin_hz;
+        fft_shared_serial++;
+    }
+    g_mutex_unlock(&harmonic_lock);
+}
+
+static gpointer simulation_thread(gpointer data) {
+    instrument_attach_thread();
+    SimTaps taps = { NULL, analyzer };
+    ParamSnapshot snap;
+    param_store_snapshot(&store, &snap);
+    sim_apply_params(&sim, &snap.params);
+    gint64 next = g_get_monotonic_time();
+    while (!g_atomic_int_get(&sim_quit)) {
+        TICK_MARK(TICK_SIM, sim.motor.dt);
+        if (param_store_version(&store) != snap.version) {
+            unsigned long applied = snap.params_version;
+            param_store_snapshot(&store, &snap);
+            if (snap.params_version != applied) sim_apply_params(&sim, &snap.params);
+        }
+        if (g_atomic_int_compare_and_exchange(&sim_reset, 1, 0)) reset_faults(&sim.fault);
+        int command = g_atomic_int_get(&record_command);
+        if (command != RECORD_IDLE) {
+            g_atomic_int_set(&record_command, RECORD_IDLE);
+            if (recorder) recorder_close(recorder);
+            recorder = command == RECORD_START ? recorder_create(record_path, SIM_CHANNELS, sim_channel_names) : NULL;
+            g_atomic_int_set(&record_active, recorder != NULL);
+        }
+        if (g_atomic_int_get(&sim_running) && !has_fault(&sim.fault)) {
+            sim_step_tapped(&sim, &snap.inputs, &taps);
+            int inject = g_atomic_int_get(&sim_inject);
+            for (int f = FAULT_OVERCURRENT; f < FAULT_TYPE_COUNT; f++)
+                if (inject & (1 << f)) trigger_fault(&sim.fault, (FaultType)f);
+            TelemetrySample sample;
+            sample.time = sim.time;
+            sample.vll = calculate_vll(&sim.inverter);
+            sample.current = get_motor_current(&sim.motor);
+            sample.speed = get_motor_speed(&sim.motor);
+            sample.torque = get_motor_torque(&sim.motor);
+            sample.temp = get_motor_temp(&sim.motor);
+            sample.freq = sim.inverter.freq;
+            sample.fault = sim.fault.current_fault;
+            telemetry_push(&telemetry, &sample);
+            if (recorder) {
+                double channels[SIM_CHANNELS];
+                sim_channel_values(&sim, channels);
+                recorder_append(recorder, channels);
+            }
+        }
+        publish_harmonics();
+        if (status_block) {
+            DriveStatus st;
+            drive_status_fill(&st, &sim, &snap.inputs, g_atomic_int_get(&sim_running) && !has_fault(&sim.fault));
+            drive_status_publish(status_block, &st);
+        }
+
+        // Pace to real time against an absolute deadline; never wait on the GUI.
+        next += (gint64)(sim.motor.dt * G_USEC_PER_SEC);
+        gint64 now = g_get_monotonic_time();
+        if (next > now) g_usleep(next - now);
+        else next = now;
+    }
+    if (recorder) recorder_close(recorder);
+    recorder = NULL;
+    return NULL;
+}
 
 static void cleanup_widgets(GtkWidget *widget, gpointer data) {
     g_print("Cleaning up widgets\n");
@@ -17,93 +184,248 @@ static void cleanup_widgets(GtkWidget *widget, gpointer data) {
         g_source_remove(app_widgets->timer_id);
         app_widgets->timer_id = 0;
     }
+    if (app_widgets->plot_background) cairo_surface_destroy(app_widgets->plot_background);
+    if (app_widgets->replay) recording_close(app_widgets->replay);
+    g_atomic_int_set(&sim_quit, 1);
+    g_thread_join(sim_thread);
+    sim_thread = NULL;
+    modbus_server_stop(modbus);
+    modbus = NULL;
+    if (status_block && status_block != &local_status) {
+        drive_status_shm_close(status_block);
+        drive_status_shm_unlink(remote_shm);
+    }
+    status_block = NULL;
+    harmonic_destroy(analyzer);
+    analyzer = NULL;
+    for (int c = 0; c < SIM_HARMONIC_CHANNELS; c++) {
+        g_free(fft_work[c]);
+        g_free(fft_shared[c]);
+        g_free(app_widgets->fft[c]);
+    }
     g_free(app_widgets);
     app_widgets = NULL;
 }
 
+static gboolean drive_faulted(void) {
+    return app_widgets->history.latest.fault != FAULT_NONE;
+}
+
+static void set_running(gboolean running) {
+    is_running = running;
+    g_atomic_int_set(&sim_running, running);
+}
+
 static void update_status_label(void) {
     char status[64];
     snprintf(status, sizeof(status), "Status: %s%s",
-             is_running ? "Running" : (has_fault() ? "Faulted" : "Stopped"),
-             is_running ? (is_forward ? " (Forward)" : " (Reverse)") : "");
+             is_running ? "Running" : (drive_faulted() ? "Faulted" : "Stopped"),
+             is_running ? (pending_inputs.is_forward ? " (Forward)" : " (Reverse)") : "");
     gtk_label_set_text(GTK_LABEL(app_widgets->status_label), status);
 }
 
-gboolean update_simulation(gpointer data) {
-    if (!is_running || has_fault()) {
-        is_running = FALSE;
-        update_status_label();
-        return G_SOURCE_CONTINUE;
-    }
-    double rated_voltage = atof(gtk_editable_get_text(GTK_EDITABLE(app_widgets->rated_voltage_entry)));
-    double rated_current = atof(gtk_editable_get_text(GTK_EDITABLE(app_widgets->rated_current_entry)));
-    double rated_freq = atof(gtk_editable_get_text(GTK_EDITABLE(app_widgets->rated_freq_entry)));
-    double rated_rpm = atof(gtk_editable_get_text(GTK_EDITABLE(app_widgets->rated_rpm_entry)));
-    double ramp_up = atof(gtk_editable_get_text(GTK_EDITABLE(app_widgets->ramp_up_entry)));
-    double ramp_down = atof(gtk_editable_get_text(GTK_EDITABLE(app_widgets->ramp_down_entry)));
-    double max_freq = atof(gtk_editable_get_text(GTK_EDITABLE(app_widgets->max_freq_entry)));
-    double min_freq = atof(gtk_editable_get_text(GTK_EDITABLE(app_widgets->min_freq_entry)));
-    double speed_ref = gtk_range_get_value(GTK_RANGE(app_widgets->speed_ref_scale)) * max_freq / 100.0;
-    char error_msg[256] = "";
-    if (rated_voltage <= 0 || rated_voltage > 10000) snprintf(error_msg, sizeof(error_msg), "Invalid Rated Voltage (110000 V)");
-    else if (rated_current <= 0 || rated_current > 1000) snprintf(error_msg, sizeof(error_msg), "Invalid Rated Current (11000 A)");
-    else if (rated_freq <= 0 || rated_freq > 1000) snprintf(error_msg, sizeof(error_msg), "Invalid Rated Frequency (11000 Hz)");
-    else if (rated_rpm <= 0 || rated_rpm > 10000) snprintf(error_msg, sizeof(error_msg), "Invalid Rated RPM (110000)");
-    else if (ramp_up < 0 || ramp_up > 60) snprintf(error_msg, sizeof(error_msg), "Invalid Ramp Up Time (060 s)");
-    else if (ramp_down < 0 || ramp_down > 60) snprintf(error_msg, sizeof(error_msg), "Invalid Ramp Down Time (060 s)");
-    else if (max_freq <= min_freq || max_freq > 1000) snprintf(error_msg, sizeof(error_msg), "Invalid Max Frequency");
-    else if (min_freq < 0 || min_freq > max_freq) snprintf(error_msg, sizeof(error_msg), "Invalid Min Frequency");
-    if (strlen(error_msg) > 0) {
-        gtk_label_set_text(GTK_LABEL(app_widgets->error_label), error_msg);
-        gtk_label_set_text(GTK_LABEL(app_widgets->output_label), "Output: Invalid input");
-        is_running = FALSE;
-        update_status_label();
-        return G_SOURCE_CONTINUE;
-    }
-    set_motor_params(rated_voltage, rated_current, rated_freq, rated_rpm);
-    set_drive_params(ramp_up, ramp_down, max_freq, min_freq);
-    set_inverter_params(rated_voltage, speed_ref, 0.8);
-    update_motor(speed_ref, is_forward, ramp_up, ramp_down);
-    check_faults(rated_voltage, get_motor_current(), get_motor_temp());
-    if (gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(app_widgets->overcurrent_check))) trigger_fault(FAULT_OVERCURRENT);
-    if (gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(app_widgets->undervoltage_check))) trigger_fault(FAULT_UNDERVOLTAGE);
-    if (gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(app_widgets->overtemp_check))) trigger_fault(FAULT_OVERTEMP);
-    double vll = calculate_vll();
-    double current = get_motor_current();
-    double speed = get_motor_speed();
-    double torque = get_motor_torque();
-    char output[256];
-    snprintf(output, sizeof(output), "V_L-L: %.2f V\nCurrent: %.2f A\nSpeed: %.2f RPM\nTorque: %.2f Nm\nFreq: %.2f Hz",
-             vll, current, speed, torque, speed_ref);
-    gtk_label_set_text(GTK_LABEL(app_widgets->output_label), output);
-    gtk_label_set_text(GTK_LABEL(app_widgets->error_label), get_fault_status());
+static void publish_params(void) {
+    char error_msg[256];
+    params_valid = param_store_set_params(&store, &pending_params, error_msg, sizeof(error_msg));
+    gtk_label_set_text(GTK_LABEL(app_widgets->error_label), error_msg);
+}
 
-    gtk_widget_queue_draw(app_widgets->plot_area);
+static void on_param_entry_changed(GtkEditable *editable, gpointer data) {
+    const ParamEntry *e = &param_entries[GPOINTER_TO_INT(data)];
+    const char *text = gtk_editable_get_text(editable);
+    char *field = (char *)&pending_params + e->field;
+    if (e->type == FIELD_INT) *(int *)field = atoi(text);
+    else *(double *)field = atof(text);
+    publish_params();
+}
+
+static void on_pwm_mode_changed(GtkComboBox *combo, gpointer data) {
+    pending_params.pwm_mode = (PwmMode)gtk_combo_box_get_active(combo);
+    publish_params();
+}
+
+static void on_control_mode_changed(GtkComboBox *combo, gpointer data) {
+    pending_params.control_mode = (ControlMode)gtk_combo_box_get_active(combo);
+    publish_params();
+}
+
+static void on_motor_model_changed(GtkComboBox *combo, gpointer data) {
+    int model = gtk_combo_box_get_active(combo);
+    pending_params.motor_model = model == 0 ? MOTOR_MODEL_RAMP : MOTOR_MODEL_DQ;
+    pending_params.integrator = model == 1 ? INTEGRATOR_EULER : model == 3 ? INTEGRATOR_EXACT : INTEGRATOR_RK4;
+    publish_params();
+}
+
+static void on_speed_ref_changed(GtkRange *range, gpointer data) {
+    pending_inputs.speed_ref = gtk_range_get_value(range);
+    param_store_set_inputs(&store, &pending_inputs);
+}
+
+static void on_load_torque_changed(GtkEditable *editable, gpointer data) {
+    pending_inputs.load_torque = atof(gtk_editable_get_text(editable));
+    param_store_set_inputs(&store, &pending_inputs);
+}
+
+static void on_fault_check_toggled(GtkWidget *check, gpointer data) {
+    int mask = 0;
+    if (gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(app_widgets->overcurrent_check))) mask |= 1 << FAULT_OVERCURRENT;
+    if (gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(app_widgets->undervoltage_check))) mask |= 1 << FAULT_UNDERVOLTAGE;
+    if (gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(app_widgets->overtemp_check))) mask |= 1 << FAULT_OVERTEMP;
+    g_atomic_int_set(&sim_inject, mask);
+}
+
+// Takes the latest harmonic results and, once per request, the full FFT.
+static void update_harmonics(void) {
+    AppWidgets *w = app_widgets;
+    g_mutex_lock(&harmonic_lock);
+    w->harmonics = harmonic_shared;
+    if (fft_shared_serial != w->fft_serial) {
+        w->fft_serial = fft_shared_serial;
+        w->fft_bins = fft_shared_bins;
+        w->fft_bin_hz = fft_shared_hz;
+        for (int c = 0; c < SIM_HARMONIC_CHANNELS; c++)
+            memcpy(w->fft[c], fft_shared[c], sizeof(double) * (size_t)fft_shared_bins);
+    }
+    g_mutex_unlock(&harmonic_lock);
+    char text[128];
+    if (w->harmonics.ready)
+        snprintf(text, sizeof(text), "THD at %.1f Hz: v_ab %.2f %%, i_a %.2f %%", w->harmonics.fundamental,
+                 w->harmonics.thd[0] * 100.0, w->harmonics.thd[1] * 100.0);
+    else
+        snprintf(text, sizeof(text), "THD: waiting for a full window");
+    gtk_label_set_text(GTK_LABEL(w->thd_label), text);
+    gtk_widget_queue_draw(w->spectrum_area);
+}
+
+static void on_fft_toggled(GtkWidget *button, gpointer data) {
+    if (gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(button))) g_atomic_int_set(&fft_request, 1);
+    gtk_widget_queue_draw(app_widgets->spectrum_area);
+}
+
+static void drain_telemetry(void) {
+    if (telemetry_history_drain(&app_widgets->history, &telemetry) > 0 && !app_widgets->replay)
+        app_widgets->plot_dirty = TRUE;
+}
+
+// Sample range shown while replaying: the zoom window ending at the playback
+// position. The plot reads it through the recording's LOD pyramid.
+static void update_replay_range(void) {
+    Recording *rec = app_widgets->replay;
+    double t = app_widgets->replay_time;
+    uint64_t last = recording_find_time(rec, app_widgets->replay_time_ch, t);
+    if (last < recording_count(rec)) last++;
+    app_widgets->replay_first = recording_find_time(rec, app_widgets->replay_time_ch, t - app_widgets->replay_window);
+    app_widgets->replay_last = last;
+    app_widgets->plot_dirty = TRUE;
+}
+
+static void set_replay_time(double t) {
+    app_widgets->replay_time = t;
+    update_replay_range();
+    app_widgets->seek_updating = TRUE;
+    gtk_range_set_value(GTK_RANGE(app_widgets->replay_seek_scale), t);
+    app_widgets->seek_updating = FALSE;
+}
+
+static void advance_replay(GdkFrameClock *clock) {
+    gint64 frame = gdk_frame_clock_get_frame_time(clock);
+    if (app_widgets->replay_playing && app_widgets->replay_last_frame) {
+        double t = app_widgets->replay_time +
+                   (frame - app_widgets->replay_last_frame) / (double)G_USEC_PER_SEC * app_widgets->replay_speed;
+        if (t >= app_widgets->replay_end) {
+            t = app_widgets->replay_end;
+            app_widgets->replay_playing = FALSE;
+            gtk_button_set_label(GTK_BUTTON(app_widgets->replay_play_button), "Play");
+        }
+        set_replay_time(t);
+    }
+    app_widgets->replay_last_frame = frame;
+}
+
+// Redraws follow the frame clock and only happen when new samples arrived.
+static gboolean on_plot_tick(GtkWidget *widget, GdkFrameClock *clock, gpointer data) {
+    drain_telemetry();
+    if (app_widgets->replay) advance_replay(clock);
+    if (app_widgets->plot_dirty) {
+        app_widgets->plot_dirty = FALSE;
+        gtk_widget_queue_draw(widget);
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+// Modbus writes go through the same handlers as the widgets, so the store
+// keeps its single writer and the controls show what the master set.
+static void apply_remote_commands(void) {
+    unsigned changed = modbus ? drive_commands_take(&commands) : 0;
+    if (changed & DRIVE_CMD_SPEED)
+        gtk_range_set_value(GTK_RANGE(app_widgets->speed_ref_scale), atomic_load(&commands.speed_ref) / 100.0);
+    if (changed & DRIVE_CMD_LOAD) {
+        char text[32];
+        snprintf(text, sizeof(text), "%g", atomic_load(&commands.load_torque) / 10.0);
+        gtk_editable_set_text(GTK_EDITABLE(app_widgets->load_torque_entry), text);
+    }
+    if (changed & DRIVE_CMD_REVERSE) {
+        if (atomic_load(&commands.reverse)) on_reverse_button_clicked(NULL, NULL);
+        else on_forward_button_clicked(NULL, NULL);
+    }
+    if (changed & DRIVE_CMD_RESET) on_reset_button_clicked(NULL, NULL);
+    if (changed & DRIVE_CMD_RUN) {
+        if (atomic_load(&commands.run)) on_run_button_clicked(NULL, NULL);
+        else on_stop_button_clicked(NULL, NULL);
+    }
+}
+
+gboolean update_simulation(gpointer data) {
+    TICK_MARK(TICK_GUI_TIMER, GUI_TIMER_MS / 1000.0);
+    apply_remote_commands();
+    drain_telemetry();
+    if (is_running && drive_faulted()) set_running(FALSE);
+    PROBE_BEGIN(PROBE_LABEL_UPDATE);
+    update_status_label();
+    if (params_valid && app_widgets->history.count > 0) {
+        const TelemetrySample *s = &app_widgets->history.latest;
+        char output[256];
+        snprintf(output, sizeof(output), "V_L-L: %.2f V\nCurrent: %.2f A\nSpeed: %.2f RPM\nTorque: %.2f Nm\nFreq: %.2f Hz",
+                 s->vll, s->current, s->speed, s->torque, s->freq);
+        gtk_label_set_text(GTK_LABEL(app_widgets->output_label), output);
+        FaultState fault = { .current_fault = (FaultType)s->fault };
+        gtk_label_set_text(GTK_LABEL(app_widgets->error_label), get_fault_status(&fault));
+    }
+    update_harmonics();
+    PROBE_END(PROBE_LABEL_UPDATE);
+    if (++app_widgets->stats_ticks >= STATS_REFRESH_TICKS) {
+        char stats[1024];
+        app_widgets->stats_ticks = 0;
+        instrument_format(stats, sizeof(stats));
+        gtk_label_set_text(GTK_LABEL(app_widgets->stats_label), stats);
+    }
     return G_SOURCE_CONTINUE;
 }
 
 void on_run_button_clicked(GtkWidget *button, gpointer data) {
     g_print("Run button clicked\n");
-    if (!is_running && !has_fault()) {
-        is_running = TRUE;
+    if (!params_valid) {
+        gtk_label_set_text(GTK_LABEL(app_widgets->output_label), "Output: Invalid input");
+        return;
+    }
+    if (!is_running && !drive_faulted()) {
+        set_running(TRUE);
         update_status_label();
-        if (app_widgets->timer_id == 0) {
-            app_widgets->timer_id = g_timeout_add(50, update_simulation, NULL);
-            g_print("Started simulation timer\n");
-        }
     }
 }
 
 void on_stop_button_clicked(GtkWidget *button, gpointer data) {
     g_print("Stop button clicked\n");
-    is_running = FALSE;
+    set_running(FALSE);
     update_status_label();
 }
 
 void on_reset_button_clicked(GtkWidget *button, gpointer data) {
     g_print("Reset button clicked\n");
-    reset_faults();
-    is_running = FALSE;
+    drain_telemetry();
+    app_widgets->history.latest.fault = FAULT_NONE;
+    g_atomic_int_set(&sim_reset, 1);
+    set_running(FALSE);
     update_status_label();
     gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(app_widgets->overcurrent_check), FALSE);
     gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(app_widgets->undervoltage_check), FALSE);
@@ -113,16 +435,118 @@ void on_reset_button_clicked(GtkWidget *button, gpointer data) {
 
 void on_forward_button_clicked(GtkWidget *button, gpointer data) {
     g_print("Forward button clicked\n");
-    is_forward = TRUE;
+    pending_inputs.is_forward = TRUE;
+    param_store_set_inputs(&store, &pending_inputs);
     update_status_label();
 }
 
 void on_reverse_button_clicked(GtkWidget *button, gpointer data) {
     g_print("Reverse button clicked\n");
-    is_forward = FALSE;
+    pending_inputs.is_forward = FALSE;
+    param_store_set_inputs(&store, &pending_inputs);
     update_status_label();
 }
 
+static void on_record_button_clicked(GtkWidget *button, gpointer data) {
+    if (g_atomic_int_get(&record_active)) {
+        g_atomic_int_set(&record_command, RECORD_STOP);
+        gtk_button_set_label(GTK_BUTTON(button), "Record");
+        return;
+    }
+    time_t now = time(NULL);
+    strftime(record_path, sizeof(record_path), "inverter-%Y%m%d-%H%M%S.idsrec", localtime(&now));
+    g_atomic_int_set(&record_command, RECORD_START);
+    gtk_button_set_label(GTK_BUTTON(button), "Stop Recording");
+    gtk_label_set_text(GTK_LABEL(app_widgets->replay_label), record_path);
+}
+
+static void close_replay(void) {
+    if (app_widgets->replay) recording_close(app_widgets->replay);
+    app_widgets->replay = NULL;
+    app_widgets->replay_playing = FALSE;
+    gtk_button_set_label(GTK_BUTTON(app_widgets->replay_play_button), "Play");
+    gtk_widget_set_sensitive(app_widgets->replay_play_button, FALSE);
+    gtk_widget_set_sensitive(app_widgets->replay_seek_scale, FALSE);
+    app_widgets->plot_dirty = TRUE;
+}
+
+static void on_replay_opened(GObject *source, GAsyncResult *result, gpointer data) {
+    GFile *file = gtk_file_dialog_open_finish(GTK_FILE_DIALOG(source), result, NULL);
+    if (!file) return;
+    char *path = g_file_get_path(file);
+    g_object_unref(file);
+    Recording *rec = path ? recording_open(path) : NULL;
+    int time_ch = rec ? recording_channel_index(rec, "time") : -1;
+    if (!rec || time_ch < 0 || recording_count(rec) == 0) {
+        gtk_label_set_text(GTK_LABEL(app_widgets->replay_label), "Not a recording");
+        recording_close(rec);
+        g_free(path);
+        return;
+    }
+    close_replay();
+    app_widgets->replay = rec;
+    app_widgets->replay_time_ch = time_ch;
+    double start = recording_value(rec, time_ch, 0);
+    app_widgets->replay_start = start;
+    app_widgets->replay_end = recording_value(rec, time_ch, recording_count(rec) - 1);
+    gtk_range_set_range(GTK_RANGE(app_widgets->replay_seek_scale), start,
+                        app_widgets->replay_end > start ? app_widgets->replay_end : start + 1.0);
+    gtk_widget_set_sensitive(app_widgets->replay_play_button, TRUE);
+    gtk_widget_set_sensitive(app_widgets->replay_seek_scale, TRUE);
+    set_replay_time(start);
+    if (recording_has_lod(rec)) {
+        gtk_label_set_text(GTK_LABEL(app_widgets->replay_label), path);
+    } else {
+        char *text = g_strdup_printf("%s (no LOD index: wide zoom reads every sample)", path);
+        gtk_label_set_text(GTK_LABEL(app_widgets->replay_label), text);
+        g_free(text);
+    }
+    g_free(path);
+}
+
+static void on_replay_open_clicked(GtkWidget *button, gpointer data) {
+    GtkFileDialog *dialog = gtk_file_dialog_new();
+    gtk_file_dialog_open(dialog, GTK_WINDOW(app_widgets->window), NULL, on_replay_opened, NULL);
+    g_object_unref(dialog);
+}
+
+static void on_replay_play_clicked(GtkWidget *button, gpointer data) {
+    if (!app_widgets->replay) return;
+    app_widgets->replay_playing = !app_widgets->replay_playing;
+    if (app_widgets->replay_playing && app_widgets->replay_time >= app_widgets->replay_end)
+        set_replay_time(app_widgets->replay_start);
+    app_widgets->replay_last_frame = 0;
+    gtk_button_set_label(GTK_BUTTON(button), app_widgets->replay_playing ? "Pause" : "Play");
+}
+
+static void on_replay_live_clicked(GtkWidget *button, gpointer data) {
+    close_replay();
+    gtk_label_set_text(GTK_LABEL(app_widgets->replay_label), "Live");
+}
+
+static void on_replay_seek_changed(GtkRange *range, gpointer data) {
+    if (app_widgets->seek_updating || !app_widgets->replay) return;
+    app_widgets->replay_time = gtk_range_get_value(range);
+    update_replay_range();
+}
+
+static void on_replay_speed_changed(GtkSpinButton *spin, gpointer data) {
+    app_widgets->replay_speed = gtk_spin_button_get_value(spin);
+}
+
+static void on_replay_zoom_changed(GtkSpinButton *spin, gpointer data) {
+    app_widgets->replay_window = gtk_spin_button_get_value(spin);
+    if (app_widgets->replay) update_replay_range();
+}
+
+// Mouse wheel over the plots zooms the replay window by 25 % a notch.
+static gboolean on_plot_scroll(GtkEventControllerScroll *controller, double dx, double dy, gpointer data) {
+    if (!app_widgets->replay || dy == 0.0) return FALSE;
+    double window = app_widgets->replay_window * pow(1.25, dy);
+    gtk_spin_button_set_value(GTK_SPIN_BUTTON(app_widgets->replay_zoom_spin), window);
+    return TRUE;
+}
+
 void on_keypad_entry_activate(GtkWidget *entry, gpointer data) {
     g_print("Keypad entry activated\n");
     const char *text = gtk_editable_get_text(GTK_EDITABLE(entry));
@@ -130,12 +554,61 @@ void on_keypad_entry_activate(GtkWidget *entry, gpointer data) {
     gtk_editable_set_text(GTK_EDITABLE(entry), "");
 }
 
+// Reads every widget once, then keeps the working copies current from
+// "changed" signals so the periodic timer never parses entry text.
+static void connect_params(void) {
+    sim_default_params(&pending_params);
+    for (size_t i = 0; i < NUM_PARAM_ENTRIES; i++) {
+        GtkWidget *entry = *(GtkWidget **)((char *)app_widgets + param_entries[i].widget);
+        on_param_entry_changed(GTK_EDITABLE(entry), GINT_TO_POINTER((int)i));
+        g_signal_connect(entry, "changed", G_CALLBACK(on_param_entry_changed), GINT_TO_POINTER((int)i));
+    }
+    on_pwm_mode_changed(GTK_COMBO_BOX(app_widgets->pwm_mode_combo), NULL);
+    on_motor_model_changed(GTK_COMBO_BOX(app_widgets->motor_model_combo), NULL);
+    on_control_mode_changed(GTK_COMBO_BOX(app_widgets->control_mode_combo), NULL);
+    g_signal_connect(app_widgets->pwm_mode_combo, "changed", G_CALLBACK(on_pwm_mode_changed), NULL);
+    g_signal_connect(app_widgets->control_mode_combo, "changed", G_CALLBACK(on_control_mode_changed), NULL);
+    g_signal_connect(app_widgets->motor_model_combo, "changed", G_CALLBACK(on_motor_model_changed), NULL);
+
+    pending_inputs.speed_ref = gtk_range_get_value(GTK_RANGE(app_widgets->speed_ref_scale));
+    pending_inputs.is_forward = TRUE;
+    pending_inputs.load_torque = atof(gtk_editable_get_text(GTK_EDITABLE(app_widgets->load_torque_entry)));
+    g_signal_connect(app_widgets->speed_ref_scale, "value-changed", G_CALLBACK(on_speed_ref_changed), NULL);
+    g_signal_connect(app_widgets->load_torque_entry, "changed", G_CALLBACK(on_load_torque_changed), NULL);
+    g_signal_connect(app_widgets->overcurrent_check, "toggled", G_CALLBACK(on_fault_check_toggled), NULL);
+    g_signal_connect(app_widgets->undervoltage_check, "toggled", G_CALLBACK(on_fault_check_toggled), NULL);
+    g_signal_connect(app_widgets->overtemp_check, "toggled", G_CALLBACK(on_fault_check_toggled), NULL);
+    param_store_set_inputs(&store, &pending_inputs);
+}
+
+void gui_set_remote(int modbus_port, const char *shm_name) {
+    remote_port = modbus_port;
+    snprintf(remote_shm, sizeof(remote_shm), "%s", shm_name ? shm_name : "");
+}
+
+static void start_remote(void) {
+    if (remote_shm[0]) {
+        status_block = drive_status_shm_create(remote_shm);
+        if (!status_block) g_print("Cannot create shared memory %s\n", remote_shm);
+    }
+    if (remote_port < 0) return;
+    if (!status_block) {
+        status_block = &local_status;
+        drive_status_init(status_block);
+    }
+    drive_commands_init(&commands, &pending_inputs, FALSE);
+    modbus = modbus_server_start(remote_port, status_block, &commands);
+    if (modbus) g_print("Modbus TCP on 127.0.0.1:%d\n", modbus_server_port(modbus));
+    else g_print("Cannot start the Modbus server on port %d\n", remote_port);
+}
+
 void create_main_window(GtkApplication *app) {
     g_print("Creating main window\n");
     app_widgets = g_new0(AppWidgets, 1);
+    telemetry_history_init(&app_widgets->history);
     app_widgets->window = gtk_application_window_new(app);
     gtk_window_set_title(GTK_WINDOW(app_widgets->window), "Inverter Drive Simulator");
-    gtk_window_set_default_size(GTK_WINDOW(app_widgets->window), 1200, 750); // Increased width for plots
+    gtk_window_set_default_size(GTK_WINDOW(app_widgets->window), 1550, 750); // Increased width for plots
     g_signal_connect(app_widgets->window, "destroy", G_CALLBACK(cleanup_widgets), NULL);
     g_print("Window created\n");
     GtkWidget *grid = gtk_grid_new();
@@ -190,14 +663,23 @@ void create_main_window(GtkApplication *app) {
     gtk_grid_attach(GTK_GRID(grid), app_widgets->min_freq_entry, 3, row++, 1, 1);
     gtk_grid_attach(GTK_GRID(grid), gtk_label_new("Control Mode:"), 0, row, 1, 1);
     app_widgets->control_mode_combo = gtk_combo_box_text_new();
-    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(app_widgets->control_mode_combo), "V/f");
-    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(app_widgets->control_mode_combo), "Vector Control");
-    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(app_widgets->control_mode_combo), "Sensorless Vector");
-    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(app_widgets->control_mode_combo), "DTC");
-    gtk_combo_box_set_active(GTK_COMBO_BOX(app_widgets->control_mode_combo), 0);
-    gtk_grid_attach(GTK_GRID(grid), app_widgets->control_mode_combo, 1, row++, 1, 1);
+    for (int mode = 0; mode < CONTROL_MODE_COUNT; mode++)
+        gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(app_widgets->control_mode_combo), control_mode_name((ControlMode)mode));
+    gtk_combo_box_set_active(GTK_COMBO_BOX(app_widgets->control_mode_combo), CONTROL_VF);
+    gtk_grid_attach(GTK_GRID(grid), app_widgets->control_mode_combo, 1, row, 1, 1);
+    gtk_grid_attach(GTK_GRID(grid), gtk_label_new("PWM Mode:"), 2, row, 1, 1);
+    app_widgets->pwm_mode_combo = gtk_combo_box_text_new();
+    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(app_widgets->pwm_mode_combo), pwm_mode_name(PWM_SINE));
+    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(app_widgets->pwm_mode_combo), pwm_mode_name(PWM_THIRD_HARMONIC));
+    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(app_widgets->pwm_mode_combo), pwm_mode_name(PWM_SPACE_VECTOR));
+    gtk_combo_box_set_active(GTK_COMBO_BOX(app_widgets->pwm_mode_combo), PWM_SINE);
+    gtk_grid_attach(GTK_GRID(grid), app_widgets->pwm_mode_combo, 3, row++, 1, 1);
     g_print("Drive settings created\n");
-    gtk_grid_attach(GTK_GRID(grid), gtk_label_new("Input Signals"), 0, row++, 2, 1);
+    gtk_grid_attach(GTK_GRID(grid), gtk_label_new("Input Signals"), 0, row, 2, 1);
+    gtk_grid_attach(GTK_GRID(grid), gtk_label_new("Carrier Frequency (Hz):"), 2, row, 1, 1);
+    app_widgets->carrier_freq_entry = gtk_entry_new();
+    gtk_editable_set_text(GTK_EDITABLE(app_widgets->carrier_freq_entry), "5000");
+    gtk_grid_attach(GTK_GRID(grid), app_widgets->carrier_freq_entry, 3, row++, 1, 1);
     gtk_grid_attach(GTK_GRID(grid), gtk_label_new("Speed Reference (%):"), 0, row, 1, 1);
     app_widgets->speed_ref_scale = gtk_scale_new_with_range(GTK_ORIENTATION_HORIZONTAL, 0, 100, 1);
     gtk_range_set_value(GTK_RANGE(app_widgets->speed_ref_scale), 50);
@@ -232,17 +714,109 @@ void create_main_window(GtkApplication *app) {
     app_widgets->overtemp_check = gtk_check_button_new_with_label("Overtemperature");
     gtk_grid_attach(GTK_GRID(grid), app_widgets->overtemp_check, 2, row++, 1, 1);
     g_print("Fault inputs created\n");
+    gtk_grid_attach(GTK_GRID(grid), gtk_label_new("Motor Model:"), 0, row, 1, 1);
+    app_widgets->motor_model_combo = gtk_combo_box_text_new();
+    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(app_widgets->motor_model_combo), "Ramp (legacy)");
+    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(app_widgets->motor_model_combo), "dq Euler");
+    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(app_widgets->motor_model_combo), "dq RK4");
+    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(app_widgets->motor_model_combo), "dq Exact");
+    gtk_combo_box_set_active(GTK_COMBO_BOX(app_widgets->motor_model_combo), 2);
+    gtk_grid_attach(GTK_GRID(grid), app_widgets->motor_model_combo, 1, row, 1, 1);
+    gtk_grid_attach(GTK_GRID(grid), gtk_label_new("Sub-steps:"), 2, row, 1, 1);
+    app_widgets->substeps_entry = gtk_entry_new();
+    gtk_editable_set_text(GTK_EDITABLE(app_widgets->substeps_entry), "50");
+    gtk_grid_attach(GTK_GRID(grid), app_widgets->substeps_entry, 3, row++, 1, 1);
+    gtk_grid_attach(GTK_GRID(grid), gtk_label_new("Load Torque (Nm):"), 0, row, 1, 1);
+    app_widgets->load_torque_entry = gtk_entry_new();
+    gtk_editable_set_text(GTK_EDITABLE(app_widgets->load_torque_entry), "0");
+    gtk_grid_attach(GTK_GRID(grid), app_widgets->load_torque_entry, 1, row, 1, 1);
+    gtk_grid_attach(GTK_GRID(grid), gtk_label_new("Control Rate (Hz):"), 2, row, 1, 1);
+    app_widgets->control_rate_entry = gtk_entry_new();
+    gtk_editable_set_text(GTK_EDITABLE(app_widgets->control_rate_entry), "10000");
+    gtk_grid_attach(GTK_GRID(grid), app_widgets->control_rate_entry, 3, row++, 1, 1);
+    g_print("Motor model created\n");
     app_widgets->output_label = gtk_label_new("Output: Waiting...");
     gtk_grid_attach(GTK_GRID(grid), app_widgets->output_label, 0, row++, 3, 1);
     app_widgets->error_label = gtk_label_new("");
     gtk_grid_attach(GTK_GRID(grid), app_widgets->error_label, 0, row++, 3, 1);
+    gtk_grid_attach(GTK_GRID(grid), gtk_label_new("Timing Statistics"), 0, row++, 2, 1);
+    app_widgets->stats_label = gtk_label_new("");
+    gtk_label_set_xalign(GTK_LABEL(app_widgets->stats_label), 0.0f);
+    gtk_widget_add_css_class(app_widgets->stats_label, "monospace");
+    gtk_grid_attach(GTK_GRID(grid), app_widgets->stats_label, 0, row++, 4, 1);
+    gtk_grid_attach(GTK_GRID(grid), gtk_label_new("Recording"), 0, row++, 2, 1);
+    app_widgets->record_button = gtk_button_new_with_label("Record");
+    g_signal_connect(app_widgets->record_button, "clicked", G_CALLBACK(on_record_button_clicked), NULL);
+    gtk_grid_attach(GTK_GRID(grid), app_widgets->record_button, 0, row, 1, 1);
+    GtkWidget *open_button = gtk_button_new_with_label("Open Replay...");
+    g_signal_connect(open_button, "clicked", G_CALLBACK(on_replay_open_clicked), NULL);
+    gtk_grid_attach(GTK_GRID(grid), open_button, 1, row, 1, 1);
+    app_widgets->replay_play_button = gtk_button_new_with_label("Play");
+    g_signal_connect(app_widgets->replay_play_button, "clicked", G_CALLBACK(on_replay_play_clicked), NULL);
+    gtk_widget_set_sensitive(app_widgets->replay_play_button, FALSE);
+    gtk_grid_attach(GTK_GRID(grid), app_widgets->replay_play_button, 2, row, 1, 1);
+    GtkWidget *live_button = gtk_button_new_with_label("Live");
+    g_signal_connect(live_button, "clicked", G_CALLBACK(on_replay_live_clicked), NULL);
+    gtk_grid_attach(GTK_GRID(grid), live_button, 3, row++, 1, 1);
+    gtk_grid_attach(GTK_GRID(grid), gtk_label_new("Seek (s):"), 0, row, 1, 1);
+    app_widgets->replay_seek_scale = gtk_scale_new_with_range(GTK_ORIENTATION_HORIZONTAL, 0, 1, 0.05);
+    gtk_widget_set_sensitive(app_widgets->replay_seek_scale, FALSE);
+    g_signal_connect(app_widgets->replay_seek_scale, "value-changed", G_CALLBACK(on_replay_seek_changed), NULL);
+    gtk_grid_attach(GTK_GRID(grid), app_widgets->replay_seek_scale, 1, row, 1, 1);
+    gtk_grid_attach(GTK_GRID(grid), gtk_label_new("Speed (x):"), 2, row, 1, 1);
+    app_widgets->replay_speed_spin = gtk_spin_button_new_with_range(0.1, 100.0, 0.5);
+    gtk_spin_button_set_value(GTK_SPIN_BUTTON(app_widgets->replay_speed_spin), 1.0);
+    app_widgets->replay_speed = 1.0;
+    g_signal_connect(app_widgets->replay_speed_spin, "value-changed", G_CALLBACK(on_replay_speed_changed), NULL);
+    gtk_grid_attach(GTK_GRID(grid), app_widgets->replay_speed_spin, 3, row++, 1, 1);
+    gtk_grid_attach(GTK_GRID(grid), gtk_label_new("Zoom window (s):"), 0, row, 1, 1);
+    app_widgets->replay_zoom_spin = gtk_spin_button_new_with_range(REPLAY_MIN_WINDOW, REPLAY_MAX_WINDOW, 0.01);
+    gtk_spin_button_set_digits(GTK_SPIN_BUTTON(app_widgets->replay_zoom_spin), 6);
+    gtk_spin_button_set_value(GTK_SPIN_BUTTON(app_widgets->replay_zoom_spin), REPLAY_DEFAULT_WINDOW);
+    app_widgets->replay_window = REPLAY_DEFAULT_WINDOW;
+    g_signal_connect(app_widgets->replay_zoom_spin, "value-changed", G_CALLBACK(on_replay_zoom_changed), NULL);
+    gtk_grid_attach(GTK_GRID(grid), app_widgets->replay_zoom_spin, 1, row++, 1, 1);
+    app_widgets->replay_label = gtk_label_new("Live");
+    gtk_grid_attach(GTK_GRID(grid), app_widgets->replay_label, 0, row++, 4, 1);
     g_print("Output labels created\n");
     app_widgets->plot_area = gtk_drawing_area_new();
     gtk_widget_set_size_request(app_widgets->plot_area, 600, 600); // Adjusted for vertical space
     gtk_drawing_area_set_draw_func(GTK_DRAWING_AREA(app_widgets->plot_area), draw_waveform, app_widgets, NULL);
     gtk_grid_attach(GTK_GRID(grid), app_widgets->plot_area, 4, 0, 1, row); // Span all rows
     gtk_widget_set_visible(app_widgets->plot_area, TRUE);
+    GtkEventController *scroll = gtk_event_controller_scroll_new(GTK_EVENT_CONTROLLER_SCROLL_VERTICAL);
+    g_signal_connect(scroll, "scroll", G_CALLBACK(on_plot_scroll), NULL);
+    gtk_widget_add_controller(app_widgets->plot_area, scroll);
+    GtkWidget *spectrum_box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 5);
+    app_widgets->thd_label = gtk_label_new("THD: waiting for a full window");
+    gtk_box_append(GTK_BOX(spectrum_box), app_widgets->thd_label);
+    app_widgets->fft_button = gtk_toggle_button_new_with_label("Full FFT");
+    g_signal_connect(app_widgets->fft_button, "toggled", G_CALLBACK(on_fft_toggled), NULL);
+    gtk_box_append(GTK_BOX(spectrum_box), app_widgets->fft_button);
+    app_widgets->spectrum_area = gtk_drawing_area_new();
+    gtk_widget_set_size_request(app_widgets->spectrum_area, 320, 560);
+    gtk_drawing_area_set_draw_func(GTK_DRAWING_AREA(app_widgets->spectrum_area), draw_spectrum, app_widgets, NULL);
+    gtk_box_append(GTK_BOX(spectrum_box), app_widgets->spectrum_area);
+    gtk_grid_attach(GTK_GRID(grid), spectrum_box, 5, 0, 1, row);
     g_print("Plot area created\n");
+    sim_init(&sim, NULL);
+    analyzer = harmonic_create(SIM_HARMONIC_CHANNELS, HARMONIC_DEFAULT_ORDERS, HARMONIC_DEFAULT_CYCLES,
+                               HARMONIC_DEFAULT_RATE);
+    for (int c = 0; c < SIM_HARMONIC_CHANNELS; c++) {
+        fft_work[c] = g_new0(double, harmonic_spectrum_bins(analyzer));
+        fft_shared[c] = g_new0(double, harmonic_spectrum_bins(analyzer));
+        app_widgets->fft[c] = g_new0(double, harmonic_spectrum_bins(analyzer));
+    }
+    telemetry_ring_init(&telemetry);
+    param_store_init(&store, &pending_params, &pending_inputs);
+    connect_params();
+    start_remote();
+    g_atomic_int_set(&sim_quit, 0);
+    sim_thread = g_thread_new("simulation", simulation_thread, NULL);
+    instrument_attach_thread();
+    app_widgets->timer_id = g_timeout_add(GUI_TIMER_MS, update_simulation, NULL);
+    gtk_widget_add_tick_callback(app_widgets->plot_area, on_plot_tick, NULL, NULL);
+    g_print("Started simulation thread\n");
     gtk_widget_set_visible(app_widgets->window, TRUE);
     g_print("Window set visible\n");
 }
@@ -1,6 +1,9 @@
 #ifndef GUI_H
 #define GUI_H
 #include <gtk/gtk.h>
+#include "telemetry.h"
+#include "recorder.h"
+#include "harmonic.h"
 
 typedef struct {
     GtkWidget *window;
@@ -15,6 +18,12 @@ typedef struct {
     GtkWidget *max_freq_entry;
     GtkWidget *min_freq_entry;
     GtkWidget *control_mode_combo;
+    GtkWidget *pwm_mode_combo;
+    GtkWidget *carrier_freq_entry;
+    GtkWidget *motor_model_combo;
+    GtkWidget *substeps_entry;
+    GtkWidget *control_rate_entry;
+    GtkWidget *load_torque_entry;
     GtkWidget *speed_ref_scale;
     GtkWidget *forward_button;
     GtkWidget *reverse_button;
@@ -26,10 +35,44 @@ typedef struct {
     GtkWidget *overtemp_check;
     GtkWidget *output_label;
     GtkWidget *plot_area;
+    GtkWidget *stats_label;
+    int stats_ticks;
+    GtkWidget *record_button;
+    GtkWidget *replay_play_button;
+    GtkWidget *replay_seek_scale;
+    GtkWidget *replay_speed_spin;
+    GtkWidget *replay_zoom_spin;
+    GtkWidget *replay_label;
+    Recording *replay;           // non-NULL while the plots show a recording
+    uint64_t replay_first;       // visible sample range [first, last)
+    uint64_t replay_last;
+    double replay_window;        // visible span in seconds
+    int replay_time_ch;
+    double replay_time;
+    double replay_start;
+    double replay_end;
+    double replay_speed;
+    gboolean replay_playing;
+    gboolean seek_updating;
+    gint64 replay_last_frame;
+    GtkWidget *spectrum_area;
+    GtkWidget *thd_label;
+    GtkWidget *fft_button;
+    HarmonicSnapshot harmonics;  // latest from the simulation thread
+    double *fft[2];              // on-demand spectrum of v_ab and i_a
+    int fft_bins;
+    double fft_bin_hz;
+    unsigned fft_serial;
     GtkWidget *keypad_entry;
+    TelemetryHistory history;
+    gboolean plot_dirty;
+    cairo_surface_t *plot_background;
+    int plot_background_width;
+    int plot_background_height;
     guint timer_id;
 } AppWidgets;
 
+void gui_set_remote(int modbus_port, const char *shm_name);
 void create_main_window(GtkApplication *app);
 void on_run_button_clicked(GtkWidget *button, gpointer data);
 void on_stop_button_clicked(GtkWidget *button, gpointer data);
@@ -0,0 +1,277 @@
+#include "harmonic.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct HarmonicAnalyzer {
+    int channels;
+    int orders;
+    int cycles;
+    double sample_rate;
+    double fundamental;
+    int capacity;       // ring length in samples
+    int window;         // samples per analysis window, 0 while no window fits
+    int active;         // orders below Nyquist at this window
+    int head;           // next ring slot
+    int filled;
+    long since_resync;
+    double next_time;
+    int fft_size;
+    double *ring;       // capacity x channels, interleaved
+    double *cos_w;      // per order: e^(j 2 pi h cycles / window)
+    double *sin_w;
+    double *re;         // channels x orders
+    double *im;
+    double *s1;         // Goertzel state, channels x orders
+    double *s2;
+    double *fft_re;     // fft_size, for harmonic_spectrum
+    double *fft_im;
+};
+
+HarmonicAnalyzer *harmonic_create(int channels, int orders, int cycles, double sample_rate) {
+    if (channels < 1 || channels > HARMONIC_MAX_CHANNELS || orders < 1 || orders > HARMONIC_MAX_ORDERS ||
+        cycles < 1 || sample_rate <= 0.0)
+        return NULL;
+    HarmonicAnalyzer *a = calloc(1, sizeof(*a));
+    if (!a) return NULL;
+    a->channels = channels;
+    a->orders = orders;
+    a->cycles = cycles;
+    a->sample_rate = sample_rate;
+    a->capacity = (int)ceil(cycles * sample_rate / HARMONIC_MIN_FREQ) + 1;
+    a->fft_size = 1;
+    while (a->fft_size < a->capacity) a->fft_size *= 2;
+    size_t bins = (size_t)channels * (size_t)orders;
+    a->ring = calloc((size_t)a->capacity * (size_t)channels, sizeof(double));
+    a->cos_w = calloc((size_t)orders, sizeof(double));
+    a->sin_w = calloc((size_t)orders, sizeof(double));
+    a->re = calloc(bins, sizeof(double));
+    a->im = calloc(bins, sizeof(double));
+    a->s1 = calloc(bins, sizeof(double));
+    a->s2 = calloc(bins, sizeof(double));
+    a->fft_re = malloc(sizeof(double) * (size_t)a->fft_size);
+    a->fft_im = malloc(sizeof(double) * (size_t)a->fft_size);
+    if (!a->ring || !a->cos_w || !a->sin_w || !a->re || !a->im || !a->s1 || !a->s2 || !a->fft_re || !a->fft_im) {
+        harmonic_destroy(a);
+        return NULL;
+    }
+    harmonic_reset(a);
+    return a;
+}
+
+void harmonic_destroy(HarmonicAnalyzer *a) {
+    if (!a) return;
+    free(a->ring);
+    free(a->cos_w);
+    free(a->sin_w);
+    free(a->re);
+    free(a->im);
+    free(a->s1);
+    free(a->s2);
+    free(a->fft_re);
+    free(a->fft_im);
+    free(a);
+}
+
+void harmonic_reset(HarmonicAnalyzer *a) {
+    size_t bins = (size_t)a->channels * (size_t)a->orders;
+    memset(a->ring, 0, sizeof(double) * (size_t)a->capacity * (size_t)a->channels);
+    memset(a->re, 0, sizeof(double) * bins);
+    memset(a->im, 0, sizeof(double) * bins);
+    a->head = 0;
+    a->filled = 0;
+    a->since_resync = 0;
+    a->next_time = -HUGE_VAL;
+}
+
+// Exact DFT of the tracked bins over the current window, one Goertzel pass
+// over the ring for all of them. Samples older than the ring contents count
+// as zero, matching what the sliding DFT has accumulated while filling.
+void harmonic_recompute(HarmonicAnalyzer *a) {
+    a->since_resync = 0;
+    if (!a->window) return;
+    int n = a->window, ch = a->channels, orders = a->orders, active = a->active;
+    size_t bins = (size_t)ch * (size_t)orders;
+    memset(a->s1, 0, sizeof(double) * bins);
+    memset(a->s2, 0, sizeof(double) * bins);
+    int avail = a->filled < n ? a->filled : n;
+    int pos = (a->head - avail + a->capacity) % a->capacity;
+    for (int j = 0; j < avail; j++) {
+        const double *x = a->ring + (size_t)pos * (size_t)ch;
+        for (int c = 0; c < ch; c++) {
+            double *s1 = a->s1 + (size_t)c * orders, *s2 = a->s2 + (size_t)c * orders;
+            for (int k = 0; k < active; k++) {
+                double s0 = x[c] + 2.0 * a->cos_w[k] * s1[k] - s2[k];
+                s2[k] = s1[k];
+                s1[k] = s0;
+            }
+        }
+        if (++pos == a->capacity) pos = 0;
+    }
+    for (int c = 0; c < ch; c++) {
+        for (int k = 0; k < orders; k++) {
+            size_t i = (size_t)c * orders + (size_t)k;
+            a->re[i] = k < active ? a->cos_w[k] * a->s1[i] - a->s2[i] : 0.0;
+            a->im[i] = k < active ? a->sin_w[k] * a->s1[i] : 0.0;
+        }
+    }
+}
+
+// Retunes the window to whole fundamental periods. The bins are rebuilt
+// from the buffered samples only when the window length changes.
+void harmonic_set_fundamental(HarmonicAnalyzer *a, double freq) {
+    a->fundamental = freq;
+    long n = freq > 0.0 ? lround(a->cycles * a->sample_rate / freq) : 0;
+    if (n < 2 || n > a->capacity) {
+        a->window = 0;
+        return;
+    }
+    if (n == a->window) return;
+    a->window = (int)n;
+    a->active = 0;
+    for (int k = 0; k < a->orders; k++) {
+        long bin = (long)(k + 1) * a->cycles;
+        if (2 * bin >= n) break;
+        double w = 2.0 * M_PI * (double)bin / (double)n;
+        a->cos_w[k] = cos(w);
+        a->sin_w[k] = sin(w);
+        a->active = k + 1;
+    }
+    harmonic_recompute(a);
+}
+
+// Sliding DFT: each bin drops the sample leaving the window, adds the new
+// one and rotates by one bin step. Rounding accumulates in the rotation, so
+// the bins are recomputed exactly every HARMONIC_RESYNC_WINDOWS windows.
+void harmonic_push(HarmonicAnalyzer *a, double time, const double *x) {
+    int ch = a->channels;
+    double *slot = a->ring + (size_t)a->head * (size_t)ch;
+    if (a->window) {
+        const double *old = NULL;
+        if (a->filled >= a->window) {
+            int pos = a->head - a->window;
+            if (pos < 0) pos += a->capacity;
+            old = a->ring + (size_t)pos * (size_t)ch;
+        }
+        int active = a->active;
+        const double *restrict cw = a->cos_w;
+        const double *restrict sw = a->sin_w;
+        for (int c = 0; c < ch; c++) {
+            double d = x[c] - (old ? old[c] : 0.0);
+            double *restrict re = a->re + (size_t)c * a->orders;
+            double *restrict im = a->im + (size_t)c * a->orders;
+            for (int k = 0; k < active; k++) {
+                double r = re[k] + d, i = im[k];
+                re[k] = r * cw[k] - i * sw[k];
+                im[k] = r * sw[k] + i * cw[k];
+            }
+        }
+    }
+    memcpy(slot, x, sizeof(double) * (size_t)ch);
+    if (++a->head == a->capacity) a->head = 0;
+    if (a->filled < a->capacity) a->filled++;
+    a->next_time = time + 1.0 / a->sample_rate;
+    if (a->window && ++a->since_resync >= (long)a->window * HARMONIC_RESYNC_WINDOWS) harmonic_recompute(a);
+}
+
+double harmonic_sample_rate(const HarmonicAnalyzer *a) {
+    return a->sample_rate;
+}
+
+// Time the next sample is due, -HUGE_VAL before the first.
+double harmonic_next_time(const HarmonicAnalyzer *a) {
+    return a->next_time;
+}
+
+int harmonic_ready(const HarmonicAnalyzer *a) {
+    return a->window > 0 && a->filled >= a->window;
+}
+
+// Peak amplitude of one harmonic; 0 above Nyquist or without a window.
+double harmonic_amplitude(const HarmonicAnalyzer *a, int channel, int order) {
+    if (!a->window || order < 1 || order > a->active) return 0.0;
+    size_t i = (size_t)channel * a->orders + (size_t)(order - 1);
+    return 2.0 * hypot(a->re[i], a->im[i]) / a->window;
+}
+
+// Total harmonic distortion over orders 2..orders, relative to the fundamental.
+double harmonic_thd(const HarmonicAnalyzer *a, int channel) {
+    double fund = harmonic_amplitude(a, channel, 1);
+    if (!(fund > 1e-9)) return NAN;
+    double sum = 0.0;
+    for (int h = 2; h <= a->active; h++) {
+        double v = harmonic_amplitude(a, channel, h);
+        sum += v * v;
+    }
+    return sqrt(sum) / fund;
+}
+
+void harmonic_snapshot(const HarmonicAnalyzer *a, HarmonicSnapshot *out) {
+    memset(out, 0, sizeof(*out));
+    out->ready = harmonic_ready(a);
+    out->channels = a->channels;
+    out->orders = a->orders;
+    out->fundamental = a->fundamental;
+    for (int c = 0; c < a->channels; c++) {
+        for (int h = 1; h <= a->orders; h++) out->amplitude[c][h] = harmonic_amplitude(a, c, h);
+        out->thd[c] = harmonic_thd(a, c);
+    }
+}
+
+// Most bins harmonic_spectrum can return.
+int harmonic_spectrum_bins(const HarmonicAnalyzer *a) {
+    return a->fft_size / 2 + 1;
+}
+
+// In-place iterative radix-2 FFT, n a power of two.
+static void fft(double *re, double *im, int n) {
+    for (int i = 1, j = 0; i < n; i++) {
+        int bit = n >> 1;
+        for (; j & bit; bit >>= 1) j ^= bit;
+        j |= bit;
+        if (i < j) {
+            double t = re[i]; re[i] = re[j]; re[j] = t;
+            t = im[i]; im[i] = im[j]; im[j] = t;
+        }
+    }
+    for (int len = 2; len <= n; len <<= 1) {
+        double w = -2.0 * M_PI / len;
+        for (int k = 0; k < len / 2; k++) {
+            double wr = cos(w * k), wi = sin(w * k);
+            for (int i = k; i < n; i += len) {
+                int j = i + len / 2;
+                double xr = re[j] * wr - im[j] * wi;
+                double xi = re[j] * wi + im[j] * wr;
+                re[j] = re[i] - xr;
+                im[j] = im[i] - xi;
+                re[i] += xr;
+                im[i] += xi;
+            }
+        }
+    }
+}
+
+// Full spectrum of one channel on demand: the window, or everything buffered
+// when no window fits, zero-padded to a power of two. Whole periods put the
+// harmonics exactly on the interpolated peaks. Writes peak amplitudes from
+// DC up to Nyquist and returns how many bins were written.
+int harmonic_spectrum(HarmonicAnalyzer *a, int channel, double *amplitude, int max_bins, double *bin_hz) {
+    int n = a->window ? a->window : a->filled;
+    if (n > a->filled) n = a->filled;
+    if (n < 2) return 0;
+    int m = 1;
+    while (m < n) m *= 2;
+    int pos = (a->head - n + a->capacity) % a->capacity;
+    for (int j = 0; j < n; j++) {
+        a->fft_re[j] = a->ring[(size_t)pos * a->channels + (size_t)channel];
+        if (++pos == a->capacity) pos = 0;
+    }
+    memset(a->fft_re + n, 0, sizeof(double) * (size_t)(m - n));
+    memset(a->fft_im, 0, sizeof(double) * (size_t)m);
+    fft(a->fft_re, a->fft_im, m);
+    int bins = m / 2 + 1 < max_bins ? m / 2 + 1 : max_bins;
+    for (int b = 0; b < bins; b++)
+        amplitude[b] = (b == 0 ? 1.0 : 2.0) * hypot(a->fft_re[b], a->fft_im[b]) / n;
+    *bin_hz = a->sample_rate / m;
+    return bins;
+}
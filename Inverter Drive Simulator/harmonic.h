@@ -0,0 +1,44 @@
+#ifndef HARMONIC_H
+#define HARMONIC_H
+
+#define HARMONIC_MAX_CHANNELS 4
+#define HARMONIC_MAX_ORDERS 64
+#define HARMONIC_DEFAULT_RATE 100e3    // samples/s
+#define HARMONIC_DEFAULT_ORDERS 40
+#define HARMONIC_DEFAULT_CYCLES 2
+#define HARMONIC_MIN_FREQ 5.0          // Hz; sizes the sample buffer
+#define HARMONIC_RESYNC_WINDOWS 64     // windows between exact recomputes of the bins
+
+// Streaming analyser for the harmonics 1..orders of a few signals sampled at
+// a fixed rate. The window is a whole number of fundamental periods, so
+// harmonic h falls on DFT bin h * cycles; only those bins are kept, and a
+// sliding DFT updates each of them in O(1) per sample. A full FFT of the
+// window is computed only on request.
+typedef struct HarmonicAnalyzer HarmonicAnalyzer;
+
+// Copy of the results for another thread or for output.
+typedef struct {
+    int ready;           // a full window has been seen at this fundamental
+    int channels;
+    int orders;
+    double fundamental;  // Hz
+    double amplitude[HARMONIC_MAX_CHANNELS][HARMONIC_MAX_ORDERS + 1];   // peak, by order; [0] unused
+    double thd[HARMONIC_MAX_CHANNELS];                                  // NAN without a fundamental
+} HarmonicSnapshot;
+
+HarmonicAnalyzer *harmonic_create(int channels, int orders, int cycles, double sample_rate);
+void harmonic_destroy(HarmonicAnalyzer *a);
+void harmonic_reset(HarmonicAnalyzer *a);
+void harmonic_set_fundamental(HarmonicAnalyzer *a, double freq);
+void harmonic_push(HarmonicAnalyzer *a, double time, const double *x);
+double harmonic_sample_rate(const HarmonicAnalyzer *a);
+double harmonic_next_time(const HarmonicAnalyzer *a);
+int harmonic_ready(const HarmonicAnalyzer *a);
+double harmonic_amplitude(const HarmonicAnalyzer *a, int channel, int order);
+double harmonic_thd(const HarmonicAnalyzer *a, int channel);
+void harmonic_snapshot(const HarmonicAnalyzer *a, HarmonicSnapshot *out);
+int harmonic_spectrum(HarmonicAnalyzer *a, int channel, double *amplitude, int max_bins, double *bin_hz);
+int harmonic_spectrum_bins(const HarmonicAnalyzer *a);
+void harmonic_recompute(HarmonicAnalyzer *a);
+
+#endif
@@ -0,0 +1,787 @@
+#include "sim.h"
+#include "fleet.h"
+#include "instrument.h"
+#include "modbus.h"
+#include "recorder.h"
+#include "snapshot.h"
+#include "sweep.h"
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_PROFILE_POINTS 256
+#define STATS_CHECK_MASK 1023   // poll the wall clock every 1024 steps when not paced
+#define CAPTURE_CHANNELS (FAULT_SIGNAL_COUNT + 2)
+
+typedef struct {
+    double time;
+    double speed_ref;   // signed percent, negative runs in reverse
+} ProfilePoint;
+
+static ProfilePoint profile[MAX_PROFILE_POINTS];
+static int profile_len = 0;
+static double load_torque = 0.0;
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  -d, --duration SEC        simulated time in seconds (default 600)\n"
+            "  -s, --speed-ref PCT       constant speed reference in %% of max freq (default 50)\n"
+            "  -r, --reverse             run in reverse\n"
+            "  -p, --profile T:PCT,...   piecewise-constant speed reference, negative PCT = reverse\n"
+            "  -o, --output FILE         CSV output file (default stdout, '-' for stdout)\n"
+            "  -e, --every N             write every Nth step (default 1)\n"
+            "  -q, --quiet               do not write samples, only the summary\n"
+            "  -n, --drives N            simulate a fleet of N drives, output is one summary row per drive\n"
+            "  -j, --threads N           worker threads for --drives (default: online CPUs)\n"
+            "      --spread PCT          scale drive i's reference from 100 %% down to 100-PCT %%\n"
+            "      --rated-voltage V     --rated-current A   --rated-freq HZ   --rated-rpm RPM\n"
+            "      --ramp-up S           --ramp-down S       --max-freq HZ     --min-freq HZ\n"
+            "      --pwm-mode MODE       sine, thi or svpwm  --carrier HZ      PWM carrier (500-20000)\n"
+            "      --switching MODE      off, event or fixed PWM-level load current model (default off)\n"
+            "      --switch-dt SEC       step for --switching fixed (default 1e-6)\n"
+            "  -l, --load NM             constant load torque (default 0)\n"
+            "      --model MODEL         dq (induction machine, default) or ramp (legacy kinematic ramp)\n"
+            "      --integrator NAME     euler, rk4 (default) or exact for the dq model\n"
+            "      --substeps N          integrator sub-steps per tick (default 50)\n"
+            "      --control MODE        vf (default), foc, sensorless or dtc; the closed-loop modes need the dq model\n"
+            "      --control-rate HZ     closed-loop controller rate (default 10000)\n"
+            "      --dt SEC              simulation tick (default 0.05)\n"
+            "      --thermal MODEL       linear (default, rises with current) or network (winding, frame, ambient)\n"
+            "      --fast-forward        skip settled stretches between profile points and output rows in closed\n"
+            "                            form; not with --realtime, --record, --capture, --harmonics or --modbus\n"
+            "      --realtime            pace steps to wall-clock time instead of running flat out\n"
+            "      --stats SEC           print timing statistics to stderr every SEC of wall time and at exit\n"
+            "      --record FILE         capture every channel of every step to a columnar recording\n"
+            "      --replay FILE         write a recording as CSV to the output and exit\n"
+            "      --sweep NAME=LO:HI:N  sweep a parameter over N grid points (repeatable, up to 8), e.g.\n"
+            "                            ramp_up=0.5:10:20; names: rated_voltage rated_current rated_freq\n"
+            "                            rated_rpm ramp_up ramp_down max_freq min_freq carrier_freq load speed_ref\n"
+            "      --samples N           draw N random cases from the sweep ranges instead of the full grid\n"
+            "      --seed N              random seed for --samples (default 1)\n"
+            "      --load-profile LIST   comma list of constant, step, fan load profiles to sweep (default constant)\n"
+            "      --run-faulted         keep running sweep cases past their first fault\n"
+            "      --capture FILE        write the fault engine's samples around the first trip to a recording\n"
+            "      --capture-samples N   capture length, a quarter of it before the trip (default 4096)\n"
+            "      --harmonics N         track harmonics 1..N of v_ab and i_a and report them at exit (max 64)\n"
+            "      --spectrum FILE       write the full spectrum of the last analysis window as CSV at exit\n"
+            "      --checkpoint FILE     save the complete drive state to a snapshot at the end of the run\n"
+            "      --restore FILE        continue from a snapshot instead of standstill; its drive parameters\n"
+            "                            replace the ones given here and profile times stay absolute.\n"
+            "                            With --drives, every drive is a branch forked from the snapshot\n"
+            "      --modbus PORT         serve Modbus TCP on 127.0.0.1:PORT; the master sets the reference and\n"
+            "                            run command in place of --profile, and the run is paced to real time\n"
+            "      --shm NAME            publish the drive status to the shared-memory object NAME every tick\n",
+            prog);
+}
+
+static int parse_profile(const char *arg) {
+    char *copy = strdup(arg);
+    char *save = NULL;
+    for (char *tok = strtok_r(copy, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+        if (profile_len == MAX_PROFILE_POINTS) break;
+        ProfilePoint *pt = &profile[profile_len];
+        if (sscanf(tok, "%lf:%lf", &pt->time, &pt->speed_ref) != 2) {
+            free(copy);
+            return 0;
+        }
+        if (profile_len > 0 && pt->time < profile[profile_len - 1].time) {
+            free(copy);
+            return 0;
+        }
+        profile_len++;
+    }
+    free(copy);
+    return profile_len > 0;
+}
+
+typedef struct {
+    int run;
+    double speed_ref;
+} RemoteDrive;
+
+// Applies what a Modbus master wrote since the last tick. A stopped drive
+// ramps down to zero reference.
+static void remote_inputs(DriveCommands *c, RemoteDrive *r, SimInputs *in, FaultState *fault) {
+    unsigned changed = drive_commands_take(c);
+    if (changed & DRIVE_CMD_RUN) r->run = atomic_load(&c->run);
+    if (changed & DRIVE_CMD_REVERSE) in->is_forward = !atomic_load(&c->reverse);
+    if (changed & DRIVE_CMD_SPEED) r->speed_ref = atomic_load(&c->speed_ref) / 100.0;
+    if (changed & DRIVE_CMD_LOAD) in->load_torque = atomic_load(&c->load_torque) / 10.0;
+    if (changed & DRIVE_CMD_RESET) reset_faults(fault);
+    in->speed_ref = r->run ? r->speed_ref : 0.0;
+}
+
+// Ticks the drive may skip without missing an output row or a profile point.
+static long quiet_ticks(const SimContext *ctx, long every, long limit) {
+    if (every > 0) {
+        long row = every - 1 - (long)(ctx->steps % (unsigned long)every);
+        if (row < limit) limit = row;
+    }
+    for (int k = 0; k < profile_len; k++) {
+        if (profile[k].time <= ctx->time) continue;
+        long due = (long)floor((profile[k].time - ctx->time) / ctx->motor.dt) - 1;
+        if (due < limit) limit = due;
+        break;
+    }
+    return limit;
+}
+
+static void profile_inputs(double t, SimInputs *in) {
+    int idx = 0;
+    while (idx + 1 < profile_len && profile[idx + 1].time <= t) idx++;
+    double ref = profile[idx].speed_ref;
+    in->is_forward = ref >= 0.0;
+    in->speed_ref = ref >= 0.0 ? ref : -ref;
+    in->load_torque = load_torque;
+}
+
+typedef struct {
+    int num_drives;
+    double spread;
+    double start_time;
+} FleetProfile;
+
+static void fleet_profile_tick(Fleet *fleet, unsigned long tick, void *user_data) {
+    FleetProfile *fp = user_data;
+    SimInputs base;
+    profile_inputs(fp->start_time + tick * fleet_drive(fleet, 0)->motor.dt, &base);
+    for (int i = 0; i < fp->num_drives; i++) {
+        SimInputs *in = fleet_inputs(fleet, i);
+        double scale = fp->num_drives > 1 ? 1.0 - fp->spread / 100.0 * i / (fp->num_drives - 1) : 1.0;
+        in->speed_ref = base.speed_ref * scale;
+        in->is_forward = base.is_forward;
+        in->load_torque = base.load_torque;
+    }
+}
+
+// With a start state, every drive is forked from it.
+static int run_fleet(const SimParams *params, const SimContext *start, double duration, int num_drives,
+                     int num_threads, double spread, FILE *out) {
+    Fleet *fleet = fleet_create(num_drives, num_threads, params);
+    if (!fleet) {
+        fprintf(stderr, "Could not create fleet of %d drives\n", num_drives);
+        return 1;
+    }
+    if (start) fleet_fork(fleet, start);
+    FleetProfile fp = { num_drives, spread, start ? start->time : 0.0 };
+    FleetStats stats;
+    unsigned long ticks = (unsigned long)(duration / fleet_drive(fleet, 0)->motor.dt + 0.5);
+    fleet_run(fleet, ticks, fleet_profile_tick, &fp, &stats);
+    int faulted = 0;
+    if (out) fprintf(out, "drive,time,speed,current,torque,temp,fault\n");
+    for (int i = 0; i < num_drives; i++) {
+        const SimContext *ctx = fleet_drive(fleet, i);
+        if (has_fault(&ctx->fault)) faulted++;
+        if (out) {
+            fprintf(out, "%d,%.3f,%.4f,%.4f,%.4f,%.4f,%d\n", i, ctx->time,
+                    get_motor_speed(&ctx->motor), get_motor_current(&ctx->motor),
+                    get_motor_torque(&ctx->motor), get_motor_temp(&ctx->motor),
+                    (int)ctx->fault.current_fault);
+        }
+    }
+    fprintf(stderr, "Fleet: %d drives, %d threads, %lu ticks, %lu drive-steps in %.3f ms\n",
+            num_drives, num_threads, stats.ticks, stats.drive_steps, stats.wall_seconds * 1e3);
+    fprintf(stderr, "Throughput: %.3g drive-steps/s, %lu chunks stolen, %d drives faulted\n",
+            stats.steps_per_second, stats.steals, faulted);
+    fleet_destroy(fleet);
+    return 0;
+}
+
+typedef struct {
+    const SweepSpec *spec;
+    FILE *out;
+    int best;              // fastest case to reach speed without faulting
+    double best_time;
+} SweepReport;
+
+static int report_sweep_result(const SweepResult *r, void *user_data) {
+    SweepReport *rep = user_data;
+    if (rep->out) {
+        char line[512];
+        sweep_format_result(rep->spec, r, line, sizeof(line));
+        fputs(line, rep->out);
+        fflush(rep->out);
+    }
+    if (r->c.valid && r->fault == FAULT_NONE && r->time_to_speed >= 0.0 &&
+        (rep->best < 0 || r->time_to_speed < rep->best_time ||
+         (r->time_to_speed == rep->best_time && r->c.index < rep->best))) {
+        rep->best = r->c.index;
+        rep->best_time = r->time_to_speed;
+    }
+    return 0;
+}
+
+static int run_sweep(const SweepSpec *spec, int num_threads, FILE *out) {
+    int cases = sweep_case_count(spec);
+    if (cases <= 0) {
+        fprintf(stderr, "Sweep has no cases\n");
+        return 1;
+    }
+    SweepReport rep = { spec, out, -1, 0.0 };
+    if (out) {
+        char header[512];
+        sweep_format_header(spec, header, sizeof(header));
+        fputs(header, out);
+    }
+    SweepStats stats;
+    sweep_run(spec, num_threads, report_sweep_result, &rep, &stats);
+    fprintf(stderr, "Sweep: %d cases on %d threads in %.3f s, %d faulted, %d invalid, %lu steps (%lu skipped after faults)\n",
+            stats.completed, num_threads, stats.wall_seconds, stats.faulted, stats.invalid, stats.steps, stats.steps_saved);
+    if (rep.best >= 0) {
+        SweepCase c;
+        sweep_make_case(spec, rep.best, &c);
+        fprintf(stderr, "Fastest to speed without a fault: case %d, %.3f s (", rep.best, rep.best_time);
+        for (int a = 0; a < spec->num_axes; a++)
+            fprintf(stderr, "%s%s=%g", a ? " " : "", sweep_field_name(spec->axes[a].field),
+                    sweep_case_value(&c, spec->axes[a].field));
+        fprintf(stderr, "%sload_profile=%s)\n", spec->num_axes ? " " : "", sweep_load_profile_name(c.load_profile));
+    } else {
+        fprintf(stderr, "No case reached speed without a fault\n");
+    }
+    return 0;
+}
+
+static int export_recording(const char *path, FILE *out) {
+    Recording *rec = recording_open(path);
+    if (!rec) {
+        fprintf(stderr, "Cannot open recording %s\n", path);
+        return 1;
+    }
+    int channels = recording_channels(rec);
+    uint64_t count = recording_count(rec);
+    if (out) {
+        for (int ch = 0; ch < channels; ch++)
+            fprintf(out, "%s%c", recording_channel_name(rec, ch), ch + 1 < channels ? ',' : '\n');
+        for (uint64_t i = 0; i < count; i++) {
+            for (int ch = 0; ch < channels; ch++)
+                fprintf(out, "%.6g%c", recording_value(rec, ch, i), ch + 1 < channels ? ',' : '\n');
+        }
+    }
+    fprintf(stderr, "%s: %d channels, %lu samples\n", path, channels, (unsigned long)count);
+    recording_close(rec);
+    return 0;
+}
+
+// One channel per fault signal between time and the latched fault.
+static int write_capture(const FaultCapture *capture, size_t length, const char *path) {
+    const char *names[CAPTURE_CHANNELS];
+    names[0] = "time";
+    for (int k = 0; k < FAULT_SIGNAL_COUNT; k++) names[k + 1] = fault_signal_name((FaultSignal)k);
+    names[CAPTURE_CHANNELS - 1] = "fault";
+    FaultSample *samples = malloc(sizeof(FaultSample) * length);
+    Recorder *r = samples ? recorder_create(path, CAPTURE_CHANNELS, names) : NULL;
+    if (!r) {
+        free(samples);
+        return 0;
+    }
+    size_t n = fault_capture_read(capture, samples, length);
+    for (size_t i = 0; i < n; i++) {
+        double row[CAPTURE_CHANNELS];
+        row[0] = samples[i].time;
+        memcpy(row + 1, samples[i].signals, sizeof(samples[i].signals));
+        row[CAPTURE_CHANNELS - 1] = samples[i].fault;
+        recorder_append(r, row);
+    }
+    free(samples);
+    return recorder_close(r);
+}
+
+static void print_harmonics(const HarmonicAnalyzer *h) {
+    static const char *const names[SIM_HARMONIC_CHANNELS] = { "v_ab", "i_a" };
+    HarmonicSnapshot snap;
+    harmonic_snapshot(h, &snap);
+    if (!snap.ready) {
+        fprintf(stderr, "Harmonics: no complete window at %.2f Hz\n", snap.fundamental);
+        return;
+    }
+    for (int c = 0; c < snap.channels; c++) {
+        double fund = snap.amplitude[c][1];
+        if (isnan(snap.thd[c])) {
+            fprintf(stderr, "Harmonics %s: no fundamental\n", names[c]);
+            continue;
+        }
+        fprintf(stderr, "Harmonics %s: fundamental %.4g at %.2f Hz, THD %.3f %%;", names[c], fund, snap.fundamental,
+                snap.thd[c] * 100.0);
+        // Every harmonic of at least 1 % of the fundamental
+        for (int o = 2; o <= snap.orders; o++)
+            if (snap.amplitude[c][o] >= 0.01 * fund) fprintf(stderr, " h%d %.2f %%", o, snap.amplitude[c][o] / fund * 100.0);
+        fprintf(stderr, "\n");
+    }
+}
+
+static int write_spectrum(HarmonicAnalyzer *h, const char *path) {
+    int max_bins = harmonic_spectrum_bins(h);
+    double *amp[SIM_HARMONIC_CHANNELS];
+    int bins = 0;
+    double bin_hz = 0.0;
+    for (int c = 0; c < SIM_HARMONIC_CHANNELS; c++) {
+        amp[c] = malloc(sizeof(double) * (size_t)max_bins);
+        if (amp[c]) bins = harmonic_spectrum(h, c, amp[c], max_bins, &bin_hz);
+    }
+    FILE *f = amp[0] && amp[1] ? fopen(path, "w") : NULL;
+    if (f) {
+        fprintf(f, "freq_hz,v_ab,i_a\n");
+        for (int b = 0; b < bins; b++) fprintf(f, "%.6g,%.6g,%.6g\n", b * bin_hz, amp[0][b], amp[1][b]);
+    }
+    for (int c = 0; c < SIM_HARMONIC_CHANNELS; c++) free(amp[c]);
+    return f && fclose(f) == 0;
+}
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void sleep_seconds(double s) {
+    struct timespec ts;
+    ts.tv_sec = (time_t)s;
+    ts.tv_nsec = (long)((s - ts.tv_sec) * 1e9);
+    nanosleep(&ts, NULL);
+}
+
+static void print_stats(double sim_time) {
+    char buf[1024];
+    instrument_format(buf, sizeof(buf));
+    fprintf(stderr, "--- stats at t=%.2f s ---\n%s", sim_time, buf);
+}
+
+int main(int argc, char *argv[]) {
+    enum {
+        OPT_RATED_VOLTAGE = 256, OPT_RATED_CURRENT, OPT_RATED_FREQ, OPT_RATED_RPM,
+        OPT_RAMP_UP, OPT_RAMP_DOWN, OPT_MAX_FREQ, OPT_MIN_FREQ, OPT_SPREAD,
+        OPT_PWM_MODE, OPT_CARRIER, OPT_SWITCHING, OPT_SWITCH_DT,
+        OPT_MODEL, OPT_INTEGRATOR, OPT_SUBSTEPS, OPT_DT, OPT_REALTIME, OPT_STATS,
+        OPT_RECORD, OPT_REPLAY, OPT_SWEEP, OPT_SAMPLES, OPT_SEED, OPT_LOAD_PROFILE, OPT_RUN_FAULTED,
+        OPT_CAPTURE, OPT_CAPTURE_SAMPLES, OPT_HARMONICS, OPT_SPECTRUM, OPT_CONTROL, OPT_CONTROL_RATE,
+        OPT_CHECKPOINT, OPT_RESTORE, OPT_MODBUS, OPT_SHM, OPT_THERMAL, OPT_FAST_FORWARD
+    };
+    static const struct option long_opts[] = {
+        {"duration", required_argument, NULL, 'd'},
+        {"speed-ref", required_argument, NULL, 's'},
+        {"reverse", no_argument, NULL, 'r'},
+        {"profile", required_argument, NULL, 'p'},
+        {"output", required_argument, NULL, 'o'},
+        {"every", required_argument, NULL, 'e'},
+        {"quiet", no_argument, NULL, 'q'},
+        {"drives", required_argument, NULL, 'n'},
+        {"threads", required_argument, NULL, 'j'},
+        {"spread", required_argument, NULL, OPT_SPREAD},
+        {"help", no_argument, NULL, 'h'},
+        {"rated-voltage", required_argument, NULL, OPT_RATED_VOLTAGE},
+        {"rated-current", required_argument, NULL, OPT_RATED_CURRENT},
+        {"rated-freq", required_argument, NULL, OPT_RATED_FREQ},
+        {"rated-rpm", required_argument, NULL, OPT_RATED_RPM},
+        {"ramp-up", required_argument, NULL, OPT_RAMP_UP},
+        {"ramp-down", required_argument, NULL, OPT_RAMP_DOWN},
+        {"max-freq", required_argument, NULL, OPT_MAX_FREQ},
+        {"min-freq", required_argument, NULL, OPT_MIN_FREQ},
+        {"pwm-mode", required_argument, NULL, OPT_PWM_MODE},
+        {"carrier", required_argument, NULL, OPT_CARRIER},
+        {"switching", required_argument, NULL, OPT_SWITCHING},
+        {"switch-dt", required_argument, NULL, OPT_SWITCH_DT},
+        {"load", required_argument, NULL, 'l'},
+        {"model", required_argument, NULL, OPT_MODEL},
+        {"integrator", required_argument, NULL, OPT_INTEGRATOR},
+        {"substeps", required_argument, NULL, OPT_SUBSTEPS},
+        {"control", required_argument, NULL, OPT_CONTROL},
+        {"control-rate", required_argument, NULL, OPT_CONTROL_RATE},
+        {"dt", required_argument, NULL, OPT_DT},
+        {"thermal", required_argument, NULL, OPT_THERMAL},
+        {"fast-forward", no_argument, NULL, OPT_FAST_FORWARD},
+        {"realtime", no_argument, NULL, OPT_REALTIME},
+        {"stats", required_argument, NULL, OPT_STATS},
+        {"record", required_argument, NULL, OPT_RECORD},
+        {"replay", required_argument, NULL, OPT_REPLAY},
+        {"sweep", required_argument, NULL, OPT_SWEEP},
+        {"samples", required_argument, NULL, OPT_SAMPLES},
+        {"seed", required_argument, NULL, OPT_SEED},
+        {"load-profile", required_argument, NULL, OPT_LOAD_PROFILE},
+        {"run-faulted", no_argument, NULL, OPT_RUN_FAULTED},
+        {"capture", required_argument, NULL, OPT_CAPTURE},
+        {"capture-samples", required_argument, NULL, OPT_CAPTURE_SAMPLES},
+        {"harmonics", required_argument, NULL, OPT_HARMONICS},
+        {"spectrum", required_argument, NULL, OPT_SPECTRUM},
+        {"checkpoint", required_argument, NULL, OPT_CHECKPOINT},
+        {"restore", required_argument, NULL, OPT_RESTORE},
+        {"modbus", required_argument, NULL, OPT_MODBUS},
+        {"shm", required_argument, NULL, OPT_SHM},
+        {NULL, 0, NULL, 0}
+    };
+    SimParams params;
+    sim_default_params(&params);
+    double duration = 600.0;
+    double speed_ref = 50.0;
+    int reverse = 0;
+    const char *output_path = NULL;
+    long every = 1;
+    int quiet = 0;
+    int num_drives = 0;
+    int num_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    double spread = 0.0;
+    int realtime = 0;
+    double stats_every = 0.0;
+    const char *record_path = NULL;
+    const char *replay_path = NULL;
+    const char *capture_path = NULL;
+    long capture_samples = 4096;
+    int harmonic_orders = 0;
+    const char *spectrum_path = NULL;
+    const char *checkpoint_path = NULL;
+    const char *restore_path = NULL;
+    int modbus_port = -1;
+    const char *shm_name = NULL;
+    int fast_forward = 0;
+    SweepSpec sweep;
+    sweep_default_spec(&sweep);
+    int opt;
+    while ((opt = getopt_long(argc, argv, "d:s:rp:o:e:qn:j:l:h", long_opts, NULL)) != -1) {
+        switch (opt) {
+            case 'd': duration = atof(optarg); break;
+            case 's': speed_ref = atof(optarg); break;
+            case 'r': reverse = 1; break;
+            case 'p':
+                if (!parse_profile(optarg)) {
+                    fprintf(stderr, "Invalid profile: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'o': output_path = optarg; break;
+            case 'e': every = atol(optarg); break;
+            case 'q': quiet = 1; break;
+            case 'n': num_drives = atoi(optarg); break;
+            case 'j': num_threads = atoi(optarg); break;
+            case OPT_SPREAD: spread = atof(optarg); break;
+            case OPT_RATED_VOLTAGE: params.rated_voltage = atof(optarg); break;
+            case OPT_RATED_CURRENT: params.rated_current = atof(optarg); break;
+            case OPT_RATED_FREQ: params.rated_freq = atof(optarg); break;
+            case OPT_RATED_RPM: params.rated_rpm = atof(optarg); break;
+            case OPT_RAMP_UP: params.ramp_up = atof(optarg); break;
+            case OPT_RAMP_DOWN: params.ramp_down = atof(optarg); break;
+            case OPT_MAX_FREQ: params.max_freq = atof(optarg); break;
+            case OPT_MIN_FREQ: params.min_freq = atof(optarg); break;
+            case OPT_PWM_MODE:
+                if (strcmp(optarg, "sine") == 0) params.pwm_mode = PWM_SINE;
+                else if (strcmp(optarg, "thi") == 0) params.pwm_mode = PWM_THIRD_HARMONIC;
+                else if (strcmp(optarg, "svpwm") == 0) params.pwm_mode = PWM_SPACE_VECTOR;
+                else {
+                    fprintf(stderr, "Unknown PWM mode: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case OPT_CARRIER: params.carrier_freq = atof(optarg); break;
+            case OPT_SWITCHING:
+                if (strcmp(optarg, "off") == 0) params.switching_mode = SWITCHING_OFF;
+                else if (strcmp(optarg, "event") == 0) params.switching_mode = SWITCHING_EVENT;
+                else if (strcmp(optarg, "fixed") == 0) params.switching_mode = SWITCHING_FIXED;
+                else {
+                    fprintf(stderr, "Unknown switching mode: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case OPT_SWITCH_DT: params.switching_dt = atof(optarg); break;
+            case 'l': load_torque = atof(optarg); break;
+            case OPT_MODEL:
+                if (strcmp(optarg, "dq") == 0) params.motor_model = MOTOR_MODEL_DQ;
+                else if (strcmp(optarg, "ramp") == 0) params.motor_model = MOTOR_MODEL_RAMP;
+                else {
+                    fprintf(stderr, "Unknown motor model: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case OPT_INTEGRATOR:
+                if (strcmp(optarg, "euler") == 0) params.integrator = INTEGRATOR_EULER;
+                else if (strcmp(optarg, "rk4") == 0) params.integrator = INTEGRATOR_RK4;
+                else if (strcmp(optarg, "exact") == 0) params.integrator = INTEGRATOR_EXACT;
+                else {
+                    fprintf(stderr, "Unknown integrator: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case OPT_SUBSTEPS: params.substeps = atoi(optarg); break;
+            case OPT_CONTROL:
+                if (strcmp(optarg, "vf") == 0) params.control_mode = CONTROL_VF;
+                else if (strcmp(optarg, "foc") == 0) params.control_mode = CONTROL_FOC;
+                else if (strcmp(optarg, "sensorless") == 0) params.control_mode = CONTROL_SENSORLESS;
+                else if (strcmp(optarg, "dtc") == 0) params.control_mode = CONTROL_DTC;
+                else {
+                    fprintf(stderr, "Unknown control mode: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case OPT_CONTROL_RATE: params.control_rate = atof(optarg); break;
+            case OPT_DT: params.dt = atof(optarg); break;
+            case OPT_THERMAL:
+                if (strcmp(optarg, "linear") == 0) params.thermal_model = THERMAL_LINEAR;
+                else if (strcmp(optarg, "network") == 0) params.thermal_model = THERMAL_NETWORK;
+                else {
+                    fprintf(stderr, "Unknown thermal model: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case OPT_FAST_FORWARD: fast_forward = 1; break;
+            case OPT_REALTIME: realtime = 1; break;
+            case OPT_STATS: stats_every = atof(optarg); break;
+            case OPT_RECORD: record_path = optarg; break;
+            case OPT_REPLAY: replay_path = optarg; break;
+            case OPT_SWEEP:
+                if (sweep.num_axes == SWEEP_MAX_AXES || !sweep_parse_axis(optarg, &sweep.axes[sweep.num_axes])) {
+                    fprintf(stderr, "Invalid sweep axis: %s\n", optarg);
+                    return 1;
+                }
+                sweep.num_axes++;
+                break;
+            case OPT_SAMPLES: sweep.samples = atoi(optarg); break;
+            case OPT_SEED: sweep.seed = strtoul(optarg, NULL, 0); break;
+            case OPT_LOAD_PROFILE:
+                if (!sweep_parse_load_profiles(optarg, &sweep.load_profiles)) {
+                    fprintf(stderr, "Invalid load profile list: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case OPT_RUN_FAULTED: sweep.stop_on_fault = 0; break;
+            case OPT_CAPTURE: capture_path = optarg; break;
+            case OPT_CAPTURE_SAMPLES: capture_samples = atol(optarg); break;
+            case OPT_HARMONICS: harmonic_orders = atoi(optarg); break;
+            case OPT_SPECTRUM: spectrum_path = optarg; break;
+            case OPT_CHECKPOINT: checkpoint_path = optarg; break;
+            case OPT_RESTORE: restore_path = optarg; break;
+            case OPT_MODBUS: modbus_port = atoi(optarg); break;
+            case OPT_SHM: shm_name = optarg; break;
+            case 'h': usage(argv[0]); return 0;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    char error_msg[256];
+    if (!sim_validate_params(&params, error_msg, sizeof(error_msg))) {
+        fprintf(stderr, "%s\n", error_msg);
+        return 1;
+    }
+    if (!(duration > 0 && isfinite(duration)) || every < 1 || num_drives < 0 || num_threads < 1 || capture_samples < 4 ||
+        harmonic_orders < 0 || harmonic_orders > HARMONIC_MAX_ORDERS || modbus_port > 65535) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (modbus_port >= 0 && profile_len > 0) {
+        fprintf(stderr, "--profile cannot be combined with --modbus\n");
+        return 1;
+    }
+    if ((modbus_port >= 0 || shm_name) && (num_drives > 0 || sweep.num_axes > 0 || sweep.samples > 0)) {
+        fprintf(stderr, "--modbus and --shm serve a single drive\n");
+        return 1;
+    }
+    if (fast_forward && (realtime || record_path || capture_path || harmonic_orders > 0 || spectrum_path ||
+                         modbus_port >= 0 || num_drives > 0 || sweep.num_axes > 0 || sweep.samples > 0)) {
+        fprintf(stderr, "--fast-forward runs a single drive without taps, recording or pacing\n");
+        return 1;
+    }
+    if (profile_len == 0) {
+        profile[0].time = 0.0;
+        profile[0].speed_ref = reverse ? -speed_ref : speed_ref;
+        profile_len = 1;
+    }
+
+    FILE *out = NULL;
+    if (!quiet) {
+        out = (!output_path || strcmp(output_path, "-") == 0) ? stdout : fopen(output_path, "w");
+        if (!out) {
+            perror(output_path);
+            return 1;
+        }
+    }
+    if (replay_path) {
+        int status = export_recording(replay_path, out);
+        if (out && out != stdout) fclose(out);
+        return status;
+    }
+    if (sweep.num_axes > 0 || sweep.samples > 0 || sweep.load_profiles != 1u << LOAD_PROFILE_CONSTANT) {
+        sweep.base = params;
+        sweep.duration = duration;
+        sweep.inputs.speed_ref = speed_ref;
+        sweep.inputs.is_forward = !reverse;
+        sweep.inputs.load_torque = load_torque;
+        int status = run_sweep(&sweep, num_threads, out);
+        if (out && out != stdout) fclose(out);
+        return status;
+    }
+    SimContext ctx;
+    if (restore_path) {
+        if (!snapshot_read(restore_path, &ctx)) {
+            fprintf(stderr, "Cannot restore %s: missing, damaged or from another build\n", restore_path);
+            return 1;
+        }
+        fprintf(stderr, "Restored %s at t=%.3f s\n", restore_path, ctx.time);
+    } else {
+        sim_init(&ctx, &params);
+    }
+    if (num_drives > 0) {
+        int status = run_fleet(&params, restore_path ? &ctx : NULL, duration, num_drives, num_threads, spread, out);
+        if (out && out != stdout) fclose(out);
+        return status;
+    }
+    if (out) fprintf(out, "time,speed_ref_hz,vll,current,speed,torque,temp,fault,ia\n");
+
+    SimInputs in;
+    Recorder *recorder = NULL;
+    if (record_path) {
+        recorder = recorder_create(record_path, SIM_CHANNELS, sim_channel_names);
+        if (!recorder) {
+            perror(record_path);
+            return 1;
+        }
+    }
+    SimTaps taps = { NULL, NULL };
+    if (capture_path) {
+        taps.capture = fault_capture_create((size_t)capture_samples, (size_t)capture_samples / 4);
+        if (!taps.capture) {
+            fprintf(stderr, "Cannot allocate a %ld-sample capture\n", capture_samples);
+            return 1;
+        }
+    }
+    if (spectrum_path && harmonic_orders == 0) harmonic_orders = HARMONIC_DEFAULT_ORDERS;
+    if (harmonic_orders > 0) {
+        taps.harmonics = harmonic_create(SIM_HARMONIC_CHANNELS, harmonic_orders, HARMONIC_DEFAULT_CYCLES,
+                                         HARMONIC_DEFAULT_RATE);
+        if (!taps.harmonics) {
+            fprintf(stderr, "Cannot allocate the harmonic analyser\n");
+            return 1;
+        }
+    }
+    DriveStatusBlock local_status;
+    DriveStatusBlock *status = NULL;
+    DriveCommands commands;
+    RemoteDrive remote = { 1, 0.0 };
+    ModbusServer *modbus = NULL;
+    if (shm_name) {
+        status = drive_status_shm_create(shm_name);
+        if (!status) {
+            perror(shm_name);
+            return 1;
+        }
+    } else if (modbus_port >= 0) {
+        status = &local_status;
+        drive_status_init(status);
+    }
+    if (modbus_port >= 0) {
+        profile_inputs(ctx.time, &in);
+        remote.speed_ref = in.speed_ref;
+        drive_commands_init(&commands, &in, remote.run);
+        modbus = modbus_server_start(modbus_port, status, &commands);
+        if (!modbus) {
+            perror("Modbus server");
+            return 1;
+        }
+        fprintf(stderr, "Modbus TCP on 127.0.0.1:%d\n", modbus_server_port(modbus));
+        realtime = 1;
+    }
+    double channels[SIM_CHANNELS];
+    long total_steps = (long)(duration / ctx.motor.dt + 0.5);
+    double start_time = ctx.time;
+    unsigned long start_steps = ctx.steps;
+    long skipped = 0;
+    instrument_attach_thread();
+    double start = now_seconds();
+    double next_stats = start + stats_every;
+    for (long i = 0; i < total_steps; i++) {
+        if (realtime) {
+            double wait = start + i * ctx.motor.dt - now_seconds();
+            if (wait > 0) sleep_seconds(wait);
+            TICK_MARK(TICK_SIM, ctx.motor.dt);
+        }
+        if (stats_every > 0 && (realtime || (i & STATS_CHECK_MASK) == 0) && now_seconds() >= next_stats) {
+            print_stats(ctx.time);
+            next_stats += stats_every;
+        }
+        if (modbus) remote_inputs(&commands, &remote, &in, &ctx.fault);
+        else profile_inputs(ctx.time, &in);
+        if (fast_forward && !has_fault(&ctx.fault)) {
+            long skip = sim_fast_forward(&ctx, &in, quiet_ticks(&ctx, out ? every : 0, total_steps - i - 1));
+            skipped += skip;
+            i += skip;
+        }
+        // Only a Modbus master can reset a trip; until then the drive holds.
+        if (!has_fault(&ctx.fault)) {
+            sim_step_tapped(&ctx, &in, &taps);
+            if (recorder) {
+                sim_channel_values(&ctx, channels);
+                recorder_append(recorder, channels);
+            }
+            if (out && (ctx.steps % every == 0 || has_fault(&ctx.fault))) {
+                fprintf(out, "%.3f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%d,%.4f\n",
+                        ctx.time, ctx.inverter.freq, calculate_vll(&ctx.inverter),
+                        get_motor_current(&ctx.motor), get_motor_speed(&ctx.motor),
+                        get_motor_torque(&ctx.motor), get_motor_temp(&ctx.motor),
+                        (int)ctx.fault.current_fault, ctx.switching.current[0]);
+            }
+        }
+        if (status) {
+            DriveStatus st;
+            drive_status_fill(&st, &ctx, &in, remote.run && !has_fault(&ctx.fault));
+            drive_status_publish(status, &st);
+        }
+        if (has_fault(&ctx.fault) && !modbus) break;
+    }
+    if (modbus) {
+        ModbusStats ms;
+        modbus_server_stats(modbus, &ms);
+        modbus_server_stop(modbus);
+        fprintf(stderr, "Modbus: %lu connections (%lu refused), %lu requests in %lu batches, %lu exceptions\n",
+                ms.connections, ms.refused, ms.requests, ms.batches, ms.exceptions);
+    }
+    if (shm_name) {
+        drive_status_shm_close(status);
+        drive_status_shm_unlink(shm_name);
+    }
+    double wall = now_seconds() - start;
+    double sim_time = ctx.time;
+    unsigned long sim_steps = ctx.steps - start_steps;
+    if (checkpoint_path) {
+        if (!snapshot_write(checkpoint_path, &ctx)) perror(checkpoint_path);
+        else fprintf(stderr, "Checkpointed t=%.3f s to %s\n", ctx.time, checkpoint_path);
+    }
+    if (taps.harmonics) {
+        print_harmonics(taps.harmonics);
+        if (spectrum_path && !write_spectrum(taps.harmonics, spectrum_path)) perror(spectrum_path);
+        harmonic_destroy(taps.harmonics);
+        taps.harmonics = NULL;
+    }
+    FaultCapture *capture = taps.capture;
+    if (capture) {
+        // The engine samples at least once per tick, so this many ticks fill
+        // the post-trigger part with the drive's gates off.
+        for (long i = 0; i < capture_samples && has_fault(&ctx.fault) && !fault_capture_ready(capture); i++)
+            sim_step_tapped(&ctx, &in, &taps);
+        if (!has_fault(&ctx.fault)) fprintf(stderr, "No trip, nothing captured to %s\n", capture_path);
+        else if (!write_capture(capture, (size_t)capture_samples, capture_path)) perror(capture_path);
+        else fprintf(stderr, "Captured the trip at t=%.6f s to %s\n", fault_capture_trigger_time(capture), capture_path);
+        fault_capture_destroy(capture);
+    }
+    if (out && out != stdout) fclose(out);
+    if (recorder) {
+        unsigned long recorded = (unsigned long)recorder_count(recorder);
+        if (!recorder_close(recorder)) perror(record_path);
+        else fprintf(stderr, "Recorded %lu samples to %s\n", recorded, record_path);
+    }
+
+    fprintf(stderr, "Simulated %.2f s in %lu steps, wall %.3f ms (%.0fx real time)\n",
+            sim_time - start_time, sim_steps, wall * 1e3, wall > 0 ? (sim_time - start_time) / wall : 0.0);
+    if (fast_forward)
+        fprintf(stderr, "Fast-forwarded %ld of %lu steps (%.1f %%)\n", skipped, sim_steps,
+                sim_steps ? 100.0 * skipped / sim_steps : 0.0);
+    if (stats_every > 0) print_stats(sim_time);
+    if (has_fault(&ctx.fault)) {
+        const FaultState *f = &ctx.fault;
+        fprintf(stderr, "%s at t=%.2f s", get_fault_status(f), sim_time);
+        if (f->trip_rule >= 0)
+            fprintf(stderr, " (rule %d, %s %.4g)", f->trip_rule, fault_signal_name(f->rules[f->trip_rule].signal),
+                    f->trip_value);
+        fprintf(stderr, "\n");
+        return 2;
+    }
+    return 0;
+}
@@ -0,0 +1,285 @@
+#include "induction.h"
+#include <complex.h>
+#include <math.h>
+#include <string.h>
+
+#define TAYLOR_TERMS 12
+
+// Typical per-unit values for a small four-pole machine, scaled to the
+// nameplate so the model stays sensible for whatever the user enters.
+#define PU_RS 0.03
+#define PU_RR 0.03
+#define PU_XLS 0.08
+#define PU_XLR 0.08
+#define PU_XM 2.5
+#define PU_INERTIA_H 0.5
+#define PU_FRICTION 0.005
+#define LOAD_SPEED_EPS 1.0    // rad/s over which the load torque builds up from standstill
+
+void induction_params_from_rating(InductionParams *p, double rated_voltage, double rated_current,
+                                  double rated_freq, double rated_rpm) {
+    double vb = rated_voltage * sqrt(2.0 / 3.0);
+    double ib = rated_current * sqrt(2.0);
+    double zb = vb / ib;
+    double wb = 2.0 * M_PI * rated_freq;
+    double lb = zb / wb;
+    double pole_pairs = floor(60.0 * rated_freq / rated_rpm + 0.5);
+    if (pole_pairs < 1.0) pole_pairs = 1.0;
+    double wm = wb / pole_pairs;
+    double sb = 1.5 * vb * ib;
+    p->rs = PU_RS * zb;
+    p->rr = PU_RR * zb;
+    p->lm = PU_XM * lb;
+    p->ls = p->lm + PU_XLS * lb;
+    p->lr = p->lm + PU_XLR * lb;
+    p->pole_pairs = pole_pairs;
+    p->inertia = 2.0 * PU_INERTIA_H * sb / (wm * wm);
+    p->friction = PU_FRICTION * sb / (wm * wm);
+}
+
+double induction_rated_torque(const InductionParams *p, double rated_voltage, double rated_current,
+                              double rated_freq) {
+    double sb = 1.5 * rated_voltage * sqrt(2.0 / 3.0) * rated_current * sqrt(2.0);
+    return sb / (2.0 * M_PI * rated_freq / p->pole_pairs);
+}
+
+void induction_init(InductionState *s, const InductionParams *p) {
+    memset(s, 0, sizeof(*s));
+    s->params = *p;
+}
+
+const char *integrator_name(Integrator integrator) {
+    switch (integrator) {
+        case INTEGRATOR_EULER: return "euler";
+        case INTEGRATOR_RK4: return "rk4";
+        default: return "exact";
+    }
+}
+
+// Largest factor by which one step of h scales a mode of the electrical
+// part at fixed frame and rotor speeds; above 1 the integrator diverges.
+// With psi = psi_d + j psi_q the four real states are two complex ones,
+// so the modes are the eigenvalues of a 2x2 complex matrix.
+double induction_step_growth(const InductionParams *p, Integrator integrator, double omega, double omega_r,
+                             double h) {
+    if (integrator == INTEGRATOR_EXACT) return 0.0;
+    double d = p->ls * p->lr - p->lm * p->lm;
+    double complex a = -p->rs * p->lr / d - I * omega, b = p->rs * p->lm / d;
+    double complex c = p->rr * p->lm / d, e = -p->rr * p->ls / d - I * (omega - omega_r);
+    double complex mean = 0.5 * (a + e), root = csqrt(0.25 * (a - e) * (a - e) + b * c);
+    double complex modes[2] = { mean + root, mean - root };
+    double growth = 0.0;
+    for (int k = 0; k < 2; k++) {
+        double complex z = h * modes[k];
+        double complex r = integrator == INTEGRATOR_RK4 ? 1.0 + z * (1.0 + z / 2.0 * (1.0 + z / 3.0 * (1.0 + z / 4.0)))
+                                                        : 1.0 + z;
+        growth = fmax(growth, cabs(r));
+    }
+    return growth;
+}
+
+static void currents(const InductionParams *p, const double *x, double *ids, double *iqs,
+                     double *idr, double *iqr) {
+    double d = p->ls * p->lr - p->lm * p->lm;
+    *ids = (p->lr * x[0] - p->lm * x[2]) / d;
+    *iqs = (p->lr * x[1] - p->lm * x[3]) / d;
+    *idr = (p->ls * x[2] - p->lm * x[0]) / d;
+    *iqr = (p->ls * x[3] - p->lm * x[1]) / d;
+}
+
+static double electromagnetic_torque(const InductionParams *p, const double *x) {
+    double ids, iqs, idr, iqr;
+    currents(p, x, &ids, &iqs, &idr, &iqr);
+    return 1.5 * p->pole_pairs * (x[0] * iqs - x[1] * ids);
+}
+
+// The load is reactive: it opposes rotation and cannot drive the shaft backwards.
+static double speed_derivative(const InductionParams *p, double torque, double omega_r, double load_torque) {
+    double omega_m = omega_r / p->pole_pairs;
+    double load = load_torque * tanh(omega_m / LOAD_SPEED_EPS);
+    return p->pole_pairs / p->inertia * (torque - load - p->friction * omega_m);
+}
+
+static void derivatives(const InductionParams *p, const double *x, double vds, double vqs,
+                        double omega, double load_torque, double *dx) {
+    double ids, iqs, idr, iqr;
+    currents(p, x, &ids, &iqs, &idr, &iqr);
+    double slip = omega - x[4];
+    dx[0] = vds - p->rs * ids + omega * x[1];
+    dx[1] = vqs - p->rs * iqs - omega * x[0];
+    dx[2] = -p->rr * idr + slip * x[3];
+    dx[3] = -p->rr * iqr - slip * x[2];
+    double torque = 1.5 * p->pole_pairs * (x[0] * iqs - x[1] * ids);
+    dx[4] = speed_derivative(p, torque, x[4], load_torque);
+}
+
+// Electrical system matrix dx/dt = A x + [vds vqs 0 0]^T for fixed speeds.
+static void system_matrix(const InductionParams *p, double omega, double omega_r, double a[4][4]) {
+    double d = p->ls * p->lr - p->lm * p->lm;
+    double ks = p->rs / d;
+    double kr = p->rr / d;
+    double slip = omega - omega_r;
+    memset(a, 0, sizeof(double) * 16);
+    a[0][0] = -ks * p->lr; a[0][1] = omega;       a[0][2] = ks * p->lm;
+    a[1][0] = -omega;      a[1][1] = -ks * p->lr;                       a[1][3] = ks * p->lm;
+    a[2][0] = kr * p->lm;  a[2][2] = -kr * p->ls; a[2][3] = slip;
+    a[3][1] = kr * p->lm;  a[3][2] = -slip;       a[3][3] = -kr * p->ls;
+}
+
+static void mat_mul(double a[4][4], double b[4][4], double out[4][4]) {
+    double t[4][4];
+    for (int i = 0; i < 4; i++) {
+        for (int j = 0; j < 4; j++) {
+            double sum = 0.0;
+            for (int k = 0; k < 4; k++) sum += a[i][k] * b[k][j];
+            t[i][j] = sum;
+        }
+    }
+    memcpy(out, t, sizeof(t));
+}
+
+// Phi = e^{Ah} and Gamma = integral_0^h e^{As} ds (input columns 0 and 1)
+// by Taylor series on a scaled step followed by repeated doubling:
+// Phi(2h) = Phi(h)^2, Gamma(2h) = Gamma(h) + Phi(h) Gamma(h).
+static void discretize(InductionState *s, double omega, double h) {
+    double a[4][4];
+    system_matrix(&s->params, omega, s->omega_r, a);
+    double norm = 0.0;
+    for (int i = 0; i < 4; i++) {
+        double row = 0.0;
+        for (int j = 0; j < 4; j++) row += fabs(a[i][j]);
+        norm = fmax(norm, row);
+    }
+    int squarings = 0;
+    double hs = h;
+    while (norm * hs > 0.5) {
+        hs *= 0.5;
+        squarings++;
+    }
+    double phi[4][4] = {{0}}, psi[4][4] = {{0}}, term[4][4] = {{0}}, ah[4][4];
+    for (int i = 0; i < 4; i++) {
+        for (int j = 0; j < 4; j++) ah[i][j] = a[i][j] * hs;
+        phi[i][i] = 1.0;
+        psi[i][i] = hs;
+        term[i][i] = 1.0;
+    }
+    // term = (A hs)^k / k!, phi += term, psi += term * hs / (k + 1)
+    for (int k = 1; k <= TAYLOR_TERMS; k++) {
+        mat_mul(term, ah, term);
+        for (int i = 0; i < 4; i++) {
+            for (int j = 0; j < 4; j++) {
+                term[i][j] /= k;
+                phi[i][j] += term[i][j];
+                psi[i][j] += term[i][j] * hs / (k + 1);
+            }
+        }
+    }
+    for (int n = 0; n < squarings; n++) {
+        double phi_psi[4][4];
+        mat_mul(phi, psi, phi_psi);
+        for (int i = 0; i < 4; i++) {
+            for (int j = 0; j < 4; j++) psi[i][j] += phi_psi[i][j];
+        }
+        mat_mul(phi, phi, phi);
+    }
+    memcpy(s->phi, phi, sizeof(phi));
+    for (int i = 0; i < 4; i++) {
+        s->gamma[i][0] = psi[i][0];
+        s->gamma[i][1] = psi[i][1];
+    }
+    s->cache_omega = omega;
+    s->cache_omega_r = s->omega_r;
+    s->cache_h = h;
+    s->cache_valid = 1;
+    s->discretizations++;
+}
+
+static void step_exact(InductionState *s, double vds, double vqs, double omega, double load_torque, double h) {
+    if (!s->cache_valid || h != s->cache_h || fabs(omega - s->cache_omega) > INDUCTION_EXACT_TOL ||
+        fabs(s->omega_r - s->cache_omega_r) > INDUCTION_EXACT_TOL) {
+        discretize(s, omega, h);
+    }
+    double x[4] = { s->psi_ds, s->psi_qs, s->psi_dr, s->psi_qr };
+    double y[4];
+    for (int i = 0; i < 4; i++) {
+        y[i] = s->phi[i][0] * x[0] + s->phi[i][1] * x[1] + s->phi[i][2] * x[2] + s->phi[i][3] * x[3]
+               + s->gamma[i][0] * vds + s->gamma[i][1] * vqs;
+    }
+    // Mechanical part with the torque averaged over the step
+    double torque = 0.5 * (electromagnetic_torque(&s->params, x) + electromagnetic_torque(&s->params, y));
+    s->omega_r += h * speed_derivative(&s->params, torque, s->omega_r, load_torque);
+    s->psi_ds = y[0];
+    s->psi_qs = y[1];
+    s->psi_dr = y[2];
+    s->psi_qr = y[3];
+}
+
+// Currents and torque of the present flux linkages
+static void update_outputs(InductionState *s) {
+    const InductionParams *p = &s->params;
+    double state[4] = { s->psi_ds, s->psi_qs, s->psi_dr, s->psi_qr };
+    double idr, iqr;
+    currents(p, state, &s->ids, &s->iqs, &idr, &iqr);
+    s->torque = 1.5 * p->pole_pairs * (state[0] * s->iqs - state[1] * s->ids);
+}
+
+// In the complex form of induction_step_growth the electrical part at a
+// fixed rotor speed is two modes, so an exact step of any length is two
+// complex exponentials, where step_exact would need a discretization for
+// every new step length.
+void induction_step_held(InductionState *s, double vds, double vqs, double load_torque, double h) {
+    const InductionParams *p = &s->params;
+    double d = p->ls * p->lr - p->lm * p->lm;
+    double complex a = -p->rs * p->lr / d, b = p->rs * p->lm / d;
+    double complex c = p->rr * p->lm / d, e = -p->rr * p->ls / d + I * s->omega_r;
+    double complex mean = 0.5 * (a + e), root = csqrt(0.25 * (a - e) * (a - e) + b * c);
+    double complex l1 = mean + root, l2 = mean - root;
+    // Steady state under the held voltage, then the offset from it split into
+    // the modes, whose eigenvectors are (b, l - a).
+    double complex v = vds + I * vqs, det = a * e - b * c;
+    double complex ss_s = -e * v / det, ss_r = c * v / det;
+    double complex y_s = s->psi_ds + I * s->psi_qs - ss_s, y_r = s->psi_dr + I * s->psi_qr - ss_r;
+    double complex z1 = ((l2 - a) * y_s - b * y_r) / (b * (l2 - l1)) * cexp(l1 * h);
+    double complex z2 = ((a - l1) * y_s + b * y_r) / (b * (l2 - l1)) * cexp(l2 * h);
+    double complex psi_s = ss_s + b * (z1 + z2), psi_r = ss_r + (l1 - a) * z1 + (l2 - a) * z2;
+    double x[4] = { s->psi_ds, s->psi_qs, s->psi_dr, s->psi_qr };
+    double y[4] = { creal(psi_s), cimag(psi_s), creal(psi_r), cimag(psi_r) };
+    double torque = 0.5 * (electromagnetic_torque(p, x) + electromagnetic_torque(p, y));
+    s->omega_r += h * speed_derivative(p, torque, s->omega_r, load_torque);
+    s->psi_ds = y[0];
+    s->psi_qs = y[1];
+    s->psi_dr = y[2];
+    s->psi_qr = y[3];
+    update_outputs(s);
+}
+
+void induction_step(InductionState *s, Integrator integrator, double vds, double vqs,
+                    double omega, double load_torque, double h) {
+    const InductionParams *p = &s->params;
+    double x[5] = { s->psi_ds, s->psi_qs, s->psi_dr, s->psi_qr, s->omega_r };
+    if (integrator == INTEGRATOR_EXACT) {
+        step_exact(s, vds, vqs, omega, load_torque, h);
+    } else if (integrator == INTEGRATOR_RK4) {
+        double k1[5], k2[5], k3[5], k4[5], tmp[5];
+        derivatives(p, x, vds, vqs, omega, load_torque, k1);
+        for (int i = 0; i < 5; i++) tmp[i] = x[i] + 0.5 * h * k1[i];
+        derivatives(p, tmp, vds, vqs, omega, load_torque, k2);
+        for (int i = 0; i < 5; i++) tmp[i] = x[i] + 0.5 * h * k2[i];
+        derivatives(p, tmp, vds, vqs, omega, load_torque, k3);
+        for (int i = 0; i < 5; i++) tmp[i] = x[i] + h * k3[i];
+        derivatives(p, tmp, vds, vqs, omega, load_torque, k4);
+        for (int i = 0; i < 5; i++) x[i] += h / 6.0 * (k1[i] + 2.0 * k2[i] + 2.0 * k3[i] + k4[i]);
+    } else {
+        double dx[5];
+        derivatives(p, x, vds, vqs, omega, load_torque, dx);
+        for (int i = 0; i < 5; i++) x[i] += h * dx[i];
+    }
+    if (integrator != INTEGRATOR_EXACT) {
+        s->psi_ds = x[0];
+        s->psi_qs = x[1];
+        s->psi_dr = x[2];
+        s->psi_qr = x[3];
+        s->omega_r = x[4];
+    }
+    update_outputs(s);
+}
@@ -0,0 +1,61 @@
+#ifndef INDUCTION_H
+#define INDUCTION_H
+
+typedef enum {
+    INTEGRATOR_EULER,
+    INTEGRATOR_RK4,
+    INTEGRATOR_EXACT
+} Integrator;
+
+typedef struct {
+    double rs;          // stator resistance (ohm)
+    double rr;          // rotor resistance referred to the stator (ohm)
+    double ls;          // stator self inductance (H)
+    double lr;          // rotor self inductance (H)
+    double lm;          // magnetizing inductance (H)
+    double pole_pairs;
+    double inertia;     // kg m^2
+    double friction;    // Nm s/rad
+} InductionParams;
+
+// Flux-linkage dq model in a frame rotating at the supply frequency. The
+// load torque passed to induction_step always opposes rotation.
+// EXACT advances the (linear, for fixed speeds) electrical part with a
+// cached zero-order-hold discretization that is only recomputed when the
+// frame speed, rotor speed or step move by more than INDUCTION_EXACT_TOL.
+typedef struct {
+    InductionParams params;
+    double psi_ds;
+    double psi_qs;
+    double psi_dr;
+    double psi_qr;
+    double omega_r;     // electrical rotor speed (rad/s)
+    double torque;
+    double ids;
+    double iqs;
+    double phi[4][4];
+    double gamma[4][2];
+    double cache_omega;
+    double cache_omega_r;
+    double cache_h;
+    int cache_valid;
+    unsigned long discretizations;
+} InductionState;
+
+#define INDUCTION_EXACT_TOL 0.01
+
+void induction_params_from_rating(InductionParams *p, double rated_voltage, double rated_current,
+                                  double rated_freq, double rated_rpm);
+void induction_init(InductionState *s, const InductionParams *p);
+void induction_step(InductionState *s, Integrator integrator, double vds, double vqs,
+                    double omega, double load_torque, double h);
+// Exact step of any length h in a fixed frame (omega = 0) with the stator
+// voltage held, as between two switching instants of a PWM inverter.
+void induction_step_held(InductionState *s, double vds, double vqs, double load_torque, double h);
+double induction_rated_torque(const InductionParams *p, double rated_voltage, double rated_current,
+                              double rated_freq);
+const char *integrator_name(Integrator integrator);
+double induction_step_growth(const InductionParams *p, Integrator integrator, double omega, double omega_r,
+                             double h);
+
+#endif
@@ -0,0 +1,199 @@
+#include "instrument.h"
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define INSTRUMENT_TSC 1
+#endif
+
+#define LATE_RATIO 1.1
+#define CALIBRATE_NS 20000000
+
+typedef struct {
+    Histogram jitter;
+    atomic_ulong late;
+    atomic_ulong missed;
+    uint64_t last;   // owner thread only
+} TickStats;
+
+_Thread_local int instrument_thread_active = 0;
+
+static Histogram probes[PROBE_COUNT];
+static TickStats ticks[TICK_COUNT];
+static double ns_per_tick = 1.0;
+static pthread_once_t init_once = PTHREAD_ONCE_INIT;
+
+static const char *probe_names[PROBE_COUNT] = { "sim_step", "fault_check", "control", "label_update", "draw_waveform" };
+static const char *tick_names[TICK_COUNT] = { "sim_tick", "gui_timer" };
+
+static uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+// The TSC is read in a few ns, against ~20 ns for clock_gettime, so probes
+// use it where available and convert with a rate measured once at start-up.
+static void calibrate(void) {
+#ifdef INSTRUMENT_TSC
+    uint64_t t0 = monotonic_ns(), c0 = __rdtsc(), t1;
+    do t1 = monotonic_ns(); while (t1 - t0 < CALIBRATE_NS);
+    uint64_t c1 = __rdtsc();
+    if (c1 > c0) ns_per_tick = (double)(t1 - t0) / (double)(c1 - c0);
+#endif
+}
+
+void instrument_init(void) {
+    pthread_once(&init_once, calibrate);
+}
+
+void instrument_attach_thread(void) {
+    instrument_init();
+    instrument_thread_active = 1;
+}
+
+int instrument_enabled(void) {
+#ifdef INVERTER_INSTRUMENT
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+uint64_t instrument_now(void) {
+#ifdef INSTRUMENT_TSC
+    return __rdtsc();
+#else
+    return monotonic_ns();
+#endif
+}
+
+// Single writer: a load and a store, no locked read-modify-write.
+static inline void add_relaxed(atomic_ulong *a, unsigned long v) {
+    atomic_store_explicit(a, atomic_load_explicit(a, memory_order_relaxed) + v, memory_order_relaxed);
+}
+
+static int bucket_of(uint64_t ns) {
+    if (ns < 4) return (int)ns;
+    int octave = 63 - __builtin_clzll(ns);
+    int b = (octave - 1) * 4 + (int)((ns >> (octave - 2)) & 3);
+    return b < INSTRUMENT_BUCKETS ? b : INSTRUMENT_BUCKETS - 1;
+}
+
+static double bucket_mid(int b) {
+    if (b < 4) return b;
+    int octave = b / 4 + 1;
+    double lo = (double)(4 + b % 4) * ldexp(1.0, octave - 2);
+    return lo + ldexp(1.0, octave - 2) / 2.0;
+}
+
+static void histogram_add(Histogram *h, uint64_t ns) {
+    add_relaxed(&h->count, 1);
+    add_relaxed(&h->sum_ns, ns);
+    if (ns > atomic_load_explicit(&h->max_ns, memory_order_relaxed))
+        atomic_store_explicit(&h->max_ns, ns, memory_order_relaxed);
+    add_relaxed(&h->buckets[bucket_of(ns)], 1);
+}
+
+void instrument_record(ProbeId id, uint64_t start) {
+    histogram_add(&probes[id], (uint64_t)((instrument_now() - start) * ns_per_tick));
+}
+
+void instrument_tick(TickId id, double nominal_seconds) {
+    TickStats *t = &ticks[id];
+    uint64_t now = instrument_now();
+    if (t->last) {
+        double period = (double)(now - t->last) * ns_per_tick;
+        double nominal = nominal_seconds * 1e9;
+        histogram_add(&t->jitter, (uint64_t)fabs(period - nominal));
+        if (period > nominal * LATE_RATIO) {
+            add_relaxed(&t->late, 1);
+            long skipped = lround(period / nominal) - 1;
+            if (skipped > 0) add_relaxed(&t->missed, (unsigned long)skipped);
+        }
+    }
+    t->last = now;
+}
+
+static void histogram_clear(Histogram *h) {
+    atomic_store_explicit(&h->count, 0, memory_order_relaxed);
+    atomic_store_explicit(&h->sum_ns, 0, memory_order_relaxed);
+    atomic_store_explicit(&h->max_ns, 0, memory_order_relaxed);
+    for (int b = 0; b < INSTRUMENT_BUCKETS; b++)
+        atomic_store_explicit(&h->buckets[b], 0, memory_order_relaxed);
+}
+
+void instrument_reset(void) {
+    for (int p = 0; p < PROBE_COUNT; p++) histogram_clear(&probes[p]);
+    for (int t = 0; t < TICK_COUNT; t++) {
+        histogram_clear(&ticks[t].jitter);
+        atomic_store_explicit(&ticks[t].late, 0, memory_order_relaxed);
+        atomic_store_explicit(&ticks[t].missed, 0, memory_order_relaxed);
+    }
+}
+
+// Readers may run on another thread; counts read mid-update are off by at
+// most the sample being written.
+static void histogram_summary(const Histogram *h, HistogramSummary *out) {
+    unsigned long buckets[INSTRUMENT_BUCKETS], total = 0;
+    for (int b = 0; b < INSTRUMENT_BUCKETS; b++) {
+        buckets[b] = atomic_load_explicit(&h->buckets[b], memory_order_relaxed);
+        total += buckets[b];
+    }
+    out->count = total;
+    out->max_ns = (double)atomic_load_explicit(&h->max_ns, memory_order_relaxed);
+    unsigned long count = atomic_load_explicit(&h->count, memory_order_relaxed);
+    out->mean_ns = count ? (double)atomic_load_explicit(&h->sum_ns, memory_order_relaxed) / count : 0.0;
+    out->p50_ns = out->p99_ns = 0.0;
+    unsigned long seen = 0;
+    int have50 = 0;
+    for (int b = 0; b < INSTRUMENT_BUCKETS && total; b++) {
+        seen += buckets[b];
+        if (!have50 && seen * 2 >= total) {
+            out->p50_ns = fmin(bucket_mid(b), out->max_ns);
+            have50 = 1;
+        }
+        if (seen * 100 >= total * 99) {
+            out->p99_ns = fmin(bucket_mid(b), out->max_ns);
+            break;
+        }
+    }
+}
+
+void instrument_probe_summary(ProbeId id, InstrumentSummary *out) {
+    histogram_summary(&probes[id], &out->latency);
+    out->late = 0;
+    out->missed = 0;
+}
+
+void instrument_tick_summary(TickId id, InstrumentSummary *out) {
+    histogram_summary(&ticks[id].jitter, &out->latency);
+    out->late = atomic_load_explicit(&ticks[id].late, memory_order_relaxed);
+    out->missed = atomic_load_explicit(&ticks[id].missed, memory_order_relaxed);
+}
+
+// Text table shared by the GUI stats panel and the headless dump. Times in us.
+size_t instrument_format(char *buf, size_t len) {
+    if (!instrument_enabled()) return (size_t)snprintf(buf, len, "Instrumentation compiled out\n");
+    size_t n = 0;
+#define APPEND(...) do { int w = snprintf(buf + n, n < len ? len - n : 0, __VA_ARGS__); if (w > 0) n += (size_t)w; } while (0)
+    APPEND("%-14s %9s %9s %9s %9s %9s\n", "probe (us)", "count", "mean", "p50", "p99", "max");
+    for (int p = 0; p < PROBE_COUNT; p++) {
+        InstrumentSummary s;
+        instrument_probe_summary((ProbeId)p, &s);
+        APPEND("%-14s %9lu %9.2f %9.2f %9.2f %9.2f\n", probe_names[p], s.latency.count,
+               s.latency.mean_ns / 1e3, s.latency.p50_ns / 1e3, s.latency.p99_ns / 1e3, s.latency.max_ns / 1e3);
+    }
+    APPEND("%-14s %9s %9s %9s %9s %9s %7s %7s\n", "jitter (us)", "ticks", "mean", "p50", "p99", "max", "late", "missed");
+    for (int t = 0; t < TICK_COUNT; t++) {
+        InstrumentSummary s;
+        instrument_tick_summary((TickId)t, &s);
+        APPEND("%-14s %9lu %9.1f %9.1f %9.1f %9.1f %7lu %7lu\n", tick_names[t], s.latency.count,
+               s.latency.mean_ns / 1e3, s.latency.p50_ns / 1e3, s.latency.p99_ns / 1e3, s.latency.max_ns / 1e3,
+               s.late, s.missed);
+    }
+#undef APPEND
+    return n;
+}
@@ -0,0 +1,77 @@
+#ifndef INSTRUMENT_H
+#define INSTRUMENT_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Latency probes around hot paths and period statistics for fixed-rate
+// loops. Build with INVERTER_INSTRUMENT to enable; without it every macro
+// below expands to nothing.
+//
+// Each probe and tick is recorded by one thread only, so updates are plain
+// relaxed stores. A thread records only after instrument_attach_thread(),
+// which keeps fleet workers stepping the same code out of the statistics.
+
+#define INSTRUMENT_BUCKETS 256   // 4 per power of two of nanoseconds
+
+typedef enum {
+    PROBE_SIM_STEP,
+    PROBE_FAULT_CHECK,
+    PROBE_CONTROL,
+    PROBE_LABEL_UPDATE,
+    PROBE_DRAW,
+    PROBE_COUNT
+} ProbeId;
+
+typedef enum {
+    TICK_SIM,
+    TICK_GUI_TIMER,
+    TICK_COUNT
+} TickId;
+
+typedef struct {
+    atomic_ulong count;
+    atomic_ulong sum_ns;
+    atomic_ulong max_ns;
+    atomic_ulong buckets[INSTRUMENT_BUCKETS];
+} Histogram;
+
+typedef struct {
+    unsigned long count;
+    double mean_ns;
+    double p50_ns;
+    double p99_ns;
+    double max_ns;
+} HistogramSummary;
+
+typedef struct {
+    HistogramSummary latency;   // per probe: time inside; per tick: |period - nominal|
+    unsigned long late;         // ticks more than 10 % over the nominal period
+    unsigned long missed;       // whole periods skipped
+} InstrumentSummary;
+
+extern _Thread_local int instrument_thread_active;
+
+void instrument_init(void);
+void instrument_attach_thread(void);
+void instrument_reset(void);
+uint64_t instrument_now(void);
+void instrument_record(ProbeId id, uint64_t start);
+void instrument_tick(TickId id, double nominal_seconds);
+int instrument_enabled(void);
+void instrument_probe_summary(ProbeId id, InstrumentSummary *out);
+void instrument_tick_summary(TickId id, InstrumentSummary *out);
+size_t instrument_format(char *buf, size_t len);
+
+#ifdef INVERTER_INSTRUMENT
+#define PROBE_BEGIN(id) uint64_t probe_start_##id = instrument_thread_active ? instrument_now() : 0
+#define PROBE_END(id) do { if (instrument_thread_active) instrument_record(id, probe_start_##id); } while (0)
+#define TICK_MARK(id, nominal) do { if (instrument_thread_active) instrument_tick(id, nominal); } while (0)
+#else
+#define PROBE_BEGIN(id) do { } while (0)
+#define PROBE_END(id) do { } while (0)
+#define TICK_MARK(id, nominal) do { } while (0)
+#endif
+
+#endif
@@ -1,26 +1,198 @@
 #include "inverter.h"
 #include <math.h>
+#include <stddef.h>
 
-static double vdc = 400.0;
-static double freq = 50.0;
-static double mod_index = 0.8;
+#define PWM_TABLE_SIZE (1 << PWM_TABLE_BITS)
+#define PWM_FRAC_BITS (32 - PWM_TABLE_BITS)
+#define PWM_CHUNK 256
+#define PHASE_120 0x55555555u
+#define PHASE_240 0xAAAAAAABu
 
-void set_inverter_params(double vdc_in, double freq_in, double mod_index_in) {
-    vdc = vdc_in;
-    freq = freq_in;
-    mod_index = mod_index_in;
+// One extra entry so interpolation never wraps.
+static double sine_table[PWM_TABLE_SIZE + 1];
+
+__attribute__((constructor))
+static void init_sine_table(void) {
+    for (int i = 0; i <= PWM_TABLE_SIZE; i++) {
+        sine_table[i] = sin(2.0 * M_PI * i / PWM_TABLE_SIZE);
+    }
 }
 
-double calculate_vll(void) {
-    // V_L-L = m_a * V_dc * sqrt(3)/sqrt(2)
-    return mod_index * vdc * sqrt(3.0) / sqrt(2.0);
+static inline double table_sin(uint32_t phase) {
+    uint32_t idx = phase >> PWM_FRAC_BITS;
+    double frac = (phase & ((1u << PWM_FRAC_BITS) - 1)) * (1.0 / (1u << PWM_FRAC_BITS));
+    return sine_table[idx] + (sine_table[idx + 1] - sine_table[idx]) * frac;
 }
 
-void get_pwm_waveform(double *waveform, int samples, double time) {
-    double period = (freq > 0) ? 1.0 / freq : 1.0;
-    double t_step = period / samples;
+uint32_t pwm_phase(double cycles) {
+    return (uint32_t)(int64_t)((cycles - floor(cycles)) * 4294967296.0);
+}
+
+void inverter_init(InverterState *inv) {
+    inv->vdc = 400.0;
+    inv->freq = 50.0;
+    inv->mod_index = 0.8;
+    inv->pwm_mode = PWM_SINE;
+    inv->carrier_freq = 5000.0;
+}
+
+void set_inverter_params(InverterState *inv, double vdc_in, double freq_in, double mod_index_in) {
+    inv->vdc = vdc_in;
+    inv->freq = freq_in;
+    inv->mod_index = mod_index_in;
+}
+
+void set_pwm_params(InverterState *inv, PwmMode mode, double carrier_freq) {
+    inv->pwm_mode = mode;
+    inv->carrier_freq = fmax(PWM_MIN_CARRIER, fmin(PWM_MAX_CARRIER, carrier_freq));
+}
+
+double calculate_vll(const InverterState *inv) {
+    // Fundamental V_L-L (RMS) = m_a * V_dc/2 * sqrt(3)/sqrt(2)
+    return inv->mod_index * inv->vdc * sqrt(3.0) / (2.0 * sqrt(2.0));
+}
+
+const char *pwm_mode_name(PwmMode mode) {
+    switch (mode) {
+        case PWM_THIRD_HARMONIC: return "Third Harmonic";
+        case PWM_SPACE_VECTOR: return "SVPWM";
+        default: return "Sine PWM";
+    }
+}
+
+// Normalised (-1..1) references for the three legs at the given fundamental phase.
+void pwm_leg_references(const InverterState *inv, uint32_t phase, double ref[3]) {
+    double m = inv->mod_index;
+    double a = m * table_sin(phase);
+    double b = m * table_sin(phase - PHASE_120);
+    double c = m * table_sin(phase - PHASE_240);
+    double zero = 0.0;
+    if (inv->pwm_mode == PWM_THIRD_HARMONIC) {
+        zero = m * table_sin(phase * 3u) / 6.0;
+    } else if (inv->pwm_mode == PWM_SPACE_VECTOR) {
+        // Min-max zero-sequence injection gives the same leg duties as SVPWM
+        zero = -0.5 * (fmax(a, fmax(b, c)) + fmin(a, fmin(b, c)));
+    }
+    ref[0] = a + zero;
+    ref[1] = b + zero;
+    ref[2] = c + zero;
+}
+
+// References that put the phase voltage vector (v_alpha, v_beta), in volts,
+// on the output: a = m sin(phase) lines phase a up with the alpha axis a
+// quarter turn before the vector.
+void pwm_vector_references(const InverterState *inv, double v_alpha, double v_beta, double ref[3]) {
+    InverterState at = *inv;
+    at.mod_index = hypot(v_alpha, v_beta) / (0.5 * inv->vdc);
+    pwm_leg_references(&at, pwm_phase(atan2(v_beta, v_alpha) / (2.0 * M_PI) + 0.25), ref);
+}
+
+// Symmetric regular-sampled PWM: each leg reference is sampled at the
+// carrier peak and held for the whole carrier period, so the sine table is
+// read three times per carrier period and the per-sample loop is pure
+// compare arithmetic that the compiler vectorizes.
+void pwm_generate(const InverterState *inv, double time, double dt, int samples, PwmOutput *out) {
+    double fc = inv->carrier_freq;
+    double carrier_pos = time * fc;
+    double period0 = floor(carrier_pos);
+    uint32_t phase0 = pwm_phase(inv->freq * period0 / fc);
+    uint32_t phase_step = pwm_phase(inv->freq / fc);
+    double x_step = dt * fc;
+    double k = period0 - 1.0;
+    for (int i = 0; i < samples;) {
+        // Period of sample i, from its carrier position: with dt over a
+        // carrier period whole periods pass between samples.
+        k = fmax(k + 1.0, floor(carrier_pos + i * x_step));
+        uint32_t phase = phase0 + (uint32_t)(int64_t)(k - period0) * phase_step;
+        double ref[3];
+        pwm_leg_references(inv, phase, ref);
+        // Samples whose carrier position falls inside period k
+        int end = (int)ceil((k + 1.0 - carrier_pos) / x_step);
+        if (end > samples) end = samples;
+        if (end <= i) end = i + 1;
+        // Single precision keeps the compare loop vectorizable on plain SSE2
+        float ra = (float)ref[0], rb = (float)ref[1], rc = (float)ref[2];
+        float x0 = (float)(carrier_pos + i * x_step - k);
+        float xs = (float)x_step;
+        uint8_t *restrict la = out->leg_a + i;
+        uint8_t *restrict lb = out->leg_b + i;
+        uint8_t *restrict lc = out->leg_c + i;
+        int n = end - i;
+        for (int j = 0; j < n; j++) {
+            float tri = 4.0f * fabsf(x0 + j * xs - 0.5f) - 1.0f;
+            la[j] = ra > tri;
+            lb[j] = rb > tri;
+            lc[j] = rc > tri;
+        }
+        i = end;
+    }
+    double vdc = inv->vdc;
+    if (out->vab) {
+        for (int j = 0; j < samples; j++) out->vab[j] = vdc * ((int)out->leg_a[j] - (int)out->leg_b[j]);
+    }
+    if (out->vbc) {
+        for (int j = 0; j < samples; j++) out->vbc[j] = vdc * ((int)out->leg_b[j] - (int)out->leg_c[j]);
+    }
+    if (out->vca) {
+        for (int j = 0; j < samples; j++) out->vca[j] = vdc * ((int)out->leg_c[j] - (int)out->leg_a[j]);
+    }
+}
+
+// Share of carrier positions lo..hi (0..1 within a period) for which a leg
+// with reference r is on; see pwm_generate for the on interval.
+static double leg_on_share(double lo, double hi, double r) {
+    r = fmax(-1.0, fmin(1.0, r));
+    double on = fmin(hi, (3.0 + r) * 0.25) - fmax(lo, (1.0 - r) * 0.25);
+    return on > 0.0 ? on : 0.0;
+}
+
+// Mean of V_ab over each of the intervals [time + i dt, time + (i + 1) dt):
+// the PWM pattern integrated exactly, as an ideal anti-aliasing filter ahead
+// of a sampler would see it. Point samples of the edges would alias carrier
+// sidebands onto the low harmonics.
+void pwm_average_vab(const InverterState *inv, double time, double dt, int samples, double *vab) {
+    double fc = inv->carrier_freq;
+    double pos = time * fc;
+    double step = dt * fc;
+    double k = floor(pos);
+    uint32_t phase = pwm_phase(inv->freq * k / fc);
+    uint32_t phase_step = pwm_phase(inv->freq / fc);
+    double ref[3];
+    pwm_leg_references(inv, phase, ref);
     for (int i = 0; i < samples; i++) {
-        double t = time + i * t_step;
-        waveform[i] = mod_index * vdc * sin(2.0 * M_PI * freq * t);
+        double x0 = pos + i * step, x1 = x0 + step;
+        double on = 0.0;
+        for (;;) {
+            double lo = fmax(x0, k) - k, hi = fmin(x1, k + 1.0) - k;
+            if (hi > lo) on += leg_on_share(lo, hi, ref[0]) - leg_on_share(lo, hi, ref[1]);
+            if (x1 <= k + 1.0) break;
+            k += 1.0;
+            phase += phase_step;
+            pwm_leg_references(inv, phase, ref);
+        }
+        vab[i] = inv->vdc * on / step;
+    }
+}
+
+int pwm_period_samples(const InverterState *inv, int samples_per_carrier) {
+    double freq = inv->freq > 0 ? inv->freq : 1.0;
+    return (int)ceil(inv->carrier_freq / freq * samples_per_carrier);
+}
+
+// Line-to-line voltage V_ab over one fundamental period starting at time.
+// Samples further apart than a carrier period would alias the carrier, so
+// those are the mean over each sample interval instead.
+void get_pwm_waveform(const InverterState *inv, double *waveform, int samples, double time) {
+    double period = (inv->freq > 0) ? 1.0 / inv->freq : 1.0;
+    double t_step = period / samples;
+    if (t_step * inv->carrier_freq > 1.0) {
+        pwm_average_vab(inv, time, t_step, samples, waveform);
+        return;
+    }
+    uint8_t leg_a[PWM_CHUNK], leg_b[PWM_CHUNK], leg_c[PWM_CHUNK];
+    for (int i = 0; i < samples; i += PWM_CHUNK) {
+        int n = samples - i < PWM_CHUNK ? samples - i : PWM_CHUNK;
+        PwmOutput out = { leg_a, leg_b, leg_c, waveform + i, NULL, NULL };
+        pwm_generate(inv, time + i * t_step, t_step, n, &out);
     }
 }
@@ -1,8 +1,48 @@
 #ifndef INVERTER_H
 #define INVERTER_H
 
-void set_inverter_params(double vdc, double freq, double mod_index);
-double calculate_vll(void);
-void get_pwm_waveform(double *waveform, int samples, double time);
+#include <stdint.h>
+
+#define PWM_MIN_CARRIER 500.0
+#define PWM_MAX_CARRIER 20000.0
+#define PWM_TABLE_BITS 12
+
+typedef enum {
+    PWM_SINE,
+    PWM_THIRD_HARMONIC,
+    PWM_SPACE_VECTOR
+} PwmMode;
+
+typedef struct {
+    double vdc;
+    double freq;
+    double mod_index;
+    PwmMode pwm_mode;
+    double carrier_freq;
+} InverterState;
+
+// Output of pwm_generate. Leg states (1 = upper switch on) are required,
+// line-to-line voltages are optional and skipped when NULL.
+typedef struct {
+    uint8_t *leg_a;
+    uint8_t *leg_b;
+    uint8_t *leg_c;
+    double *vab;
+    double *vbc;
+    double *vca;
+} PwmOutput;
+
+void inverter_init(InverterState *inv);
+void set_inverter_params(InverterState *inv, double vdc, double freq, double mod_index);
+void set_pwm_params(InverterState *inv, PwmMode mode, double carrier_freq);
+double calculate_vll(const InverterState *inv);
+void get_pwm_waveform(const InverterState *inv, double *waveform, int samples, double time);
+void pwm_generate(const InverterState *inv, double time, double dt, int samples, PwmOutput *out);
+void pwm_average_vab(const InverterState *inv, double time, double dt, int samples, double *vab);
+int pwm_period_samples(const InverterState *inv, int samples_per_carrier);
+uint32_t pwm_phase(double cycles);
+void pwm_leg_references(const InverterState *inv, uint32_t phase, double ref[3]);
+void pwm_vector_references(const InverterState *inv, double v_alpha, double v_beta, double ref[3]);
+const char *pwm_mode_name(PwmMode mode);
 
 #endif
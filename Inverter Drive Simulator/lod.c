@@ -0,0 +1,272 @@
+#include "lod.h"
+#include <fcntl.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Each block: LodBlockHeader, then per channel LOD_BLOCK mins, maxes and means.
+typedef struct {
+    uint32_t level;
+    uint32_t count;
+    uint64_t first;   // index of the first bucket in the block
+} LodBlockHeader;
+
+typedef struct {
+    double *min, *max, *sum;   // running bucket, per channel
+    uint64_t samples;          // raw samples folded into the running bucket
+    int filled;                // inputs folded into the running bucket
+    uint64_t emitted;          // buckets completed at this level
+    LodBlockHeader *block;     // staging block for the next write
+} LodLevel;
+
+struct LodWriter {
+    int fd;
+    int num_channels;
+    size_t block_bytes;
+    int ok;
+    LodLevel levels[LOD_LEVELS];
+};
+
+struct LodIndex {
+    int fd;
+    int num_channels;
+    const unsigned char *map;
+    size_t map_len;
+    const LodBlockHeader **blocks[LOD_LEVELS];
+    uint64_t count[LOD_LEVELS];
+};
+
+static size_t block_bytes_for(int num_channels) {
+    return sizeof(LodBlockHeader) + (size_t)num_channels * 3 * LOD_BLOCK * sizeof(double);
+}
+
+static double *block_column(const LodBlockHeader *b, int ch, int field) {
+    return (double *)(b + 1) + ((size_t)ch * 3 + (size_t)field) * LOD_BLOCK;
+}
+
+uint64_t lod_bucket_samples(int level) {
+    uint64_t n = LOD_BASE;
+    for (int l = 1; l < level; l++) n *= LOD_FANOUT;
+    return n;
+}
+
+static void reset_bucket(LodWriter *w, LodLevel *lv) {
+    for (int ch = 0; ch < w->num_channels; ch++) {
+        lv->min[ch] = INFINITY;
+        lv->max[ch] = -INFINITY;
+        lv->sum[ch] = 0.0;
+    }
+    lv->samples = 0;
+    lv->filled = 0;
+}
+
+LodWriter *lod_writer_create(const char *path, int num_channels) {
+    LodWriter *w = calloc(1, sizeof(*w));
+    if (!w) return NULL;
+    w->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (w->fd < 0) {
+        free(w);
+        return NULL;
+    }
+    w->num_channels = num_channels;
+    w->block_bytes = block_bytes_for(num_channels);
+    w->ok = 1;
+    LodHeader h = {0};
+    memcpy(h.magic, LOD_MAGIC, sizeof(LOD_MAGIC));
+    h.num_channels = (uint32_t)num_channels;
+    h.base = LOD_BASE;
+    h.fanout = LOD_FANOUT;
+    h.levels = LOD_LEVELS;
+    h.block = LOD_BLOCK;
+    if (write(w->fd, &h, sizeof(h)) != (ssize_t)sizeof(h)) w->ok = 0;
+    for (int l = 0; l < LOD_LEVELS; l++) {
+        LodLevel *lv = &w->levels[l];
+        lv->min = malloc(3 * (size_t)num_channels * sizeof(double));
+        lv->block = calloc(1, w->block_bytes);
+        if (!lv->min || !lv->block) w->ok = 0;
+        if (!lv->min) continue;
+        lv->max = lv->min + num_channels;
+        lv->sum = lv->max + num_channels;
+        reset_bucket(w, lv);
+    }
+    if (!w->ok) {
+        lod_writer_close(w);
+        return NULL;
+    }
+    return w;
+}
+
+static void flush_block(LodWriter *w, int level) {
+    LodLevel *lv = &w->levels[level - 1];
+    uint32_t count = (uint32_t)(lv->emitted % LOD_BLOCK);
+    if (count == 0) count = LOD_BLOCK;
+    lv->block->level = (uint32_t)level;
+    lv->block->count = count;
+    lv->block->first = lv->emitted - count;
+    if (write(w->fd, lv->block, w->block_bytes) != (ssize_t)w->block_bytes) w->ok = 0;
+}
+
+// Completes the running bucket of a level and folds it into the one above.
+static void emit_bucket(LodWriter *w, int level) {
+    LodLevel *lv = &w->levels[level - 1];
+    LodLevel *up = level < LOD_LEVELS ? &w->levels[level] : NULL;
+    size_t slot = (size_t)(lv->emitted % LOD_BLOCK);
+    for (int ch = 0; ch < w->num_channels; ch++) {
+        block_column(lv->block, ch, 0)[slot] = lv->min[ch];
+        block_column(lv->block, ch, 1)[slot] = lv->max[ch];
+        block_column(lv->block, ch, 2)[slot] = lv->sum[ch] / (double)lv->samples;
+        if (up) {
+            if (lv->min[ch] < up->min[ch]) up->min[ch] = lv->min[ch];
+            if (lv->max[ch] > up->max[ch]) up->max[ch] = lv->max[ch];
+            up->sum[ch] += lv->sum[ch];
+        }
+    }
+    lv->emitted++;
+    if (slot == LOD_BLOCK - 1) flush_block(w, level);
+    if (up) {
+        up->samples += lv->samples;
+        up->filled++;
+    }
+    reset_bucket(w, lv);
+    if (up && up->filled == LOD_FANOUT) emit_bucket(w, level + 1);
+}
+
+// Per sample only level 1 is touched; higher levels update once per bucket below.
+int lod_writer_append(LodWriter *w, const double *values) {
+    LodLevel *lv = &w->levels[0];
+    for (int ch = 0; ch < w->num_channels; ch++) {
+        double v = values[ch];
+        if (v < lv->min[ch]) lv->min[ch] = v;
+        if (v > lv->max[ch]) lv->max[ch] = v;
+        lv->sum[ch] += v;
+    }
+    lv->samples++;
+    if (++lv->filled == LOD_BASE) emit_bucket(w, 1);
+    return w->ok;
+}
+
+// Emits the partial buckets at the tail, so every level covers every sample,
+// then writes the partial blocks.
+int lod_writer_close(LodWriter *w) {
+    if (!w) return 0;
+    for (int l = 1; l <= LOD_LEVELS && w->ok; l++)
+        if (w->levels[l - 1].filled > 0) emit_bucket(w, l);
+    for (int l = 1; l <= LOD_LEVELS && w->ok; l++)
+        if (w->levels[l - 1].emitted % LOD_BLOCK) flush_block(w, l);
+    for (int l = 0; l < LOD_LEVELS; l++) {
+        free(w->levels[l].min);
+        free(w->levels[l].block);
+    }
+    int ok = w->ok;
+    ok = close(w->fd) == 0 && ok;
+    free(w);
+    return ok;
+}
+
+LodIndex *lod_open(const char *path, int num_channels) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(LodHeader)) {
+        close(fd);
+        return NULL;
+    }
+    void *p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) {
+        close(fd);
+        return NULL;
+    }
+    const LodHeader *h = p;
+    if (memcmp(h->magic, LOD_MAGIC, sizeof(LOD_MAGIC)) != 0 || h->num_channels != (uint32_t)num_channels ||
+        h->base != LOD_BASE || h->fanout != LOD_FANOUT || h->levels != LOD_LEVELS || h->block != LOD_BLOCK) {
+        munmap(p, (size_t)st.st_size);
+        close(fd);
+        return NULL;
+    }
+    LodIndex *idx = calloc(1, sizeof(*idx));
+    idx->fd = fd;
+    idx->num_channels = num_channels;
+    idx->map = p;
+    idx->map_len = (size_t)st.st_size;
+    size_t block_bytes = block_bytes_for(num_channels);
+    size_t nblocks = (idx->map_len - sizeof(LodHeader)) / block_bytes;
+    for (int l = 0; l < LOD_LEVELS; l++) idx->blocks[l] = calloc(nblocks ? nblocks : 1, sizeof(*idx->blocks[l]));
+    // Blocks of one level are written in order; a level is usable up to its
+    // first gap, which only a truncated file can have.
+    size_t have[LOD_LEVELS] = {0};
+    for (size_t i = 0; i < nblocks; i++) {
+        const LodBlockHeader *b = (const LodBlockHeader *)(idx->map + sizeof(LodHeader) + i * block_bytes);
+        if (b->level < 1 || b->level > LOD_LEVELS || b->count < 1 || b->count > LOD_BLOCK) continue;
+        int l = (int)b->level - 1;
+        if (b->first != (uint64_t)have[l] * LOD_BLOCK || idx->count[l] % LOD_BLOCK) continue;
+        idx->blocks[l][have[l]++] = b;
+        idx->count[l] += b->count;
+    }
+    madvise(p, idx->map_len, MADV_RANDOM);
+    return idx;
+}
+
+void lod_close(LodIndex *idx) {
+    if (!idx) return;
+    for (int l = 0; l < LOD_LEVELS; l++) free(idx->blocks[l]);
+    munmap((void *)idx->map, idx->map_len);
+    close(idx->fd);
+    free(idx);
+}
+
+uint64_t lod_count(const LodIndex *idx, int level) {
+    if (level < 1 || level > LOD_LEVELS) return 0;
+    return idx->count[level - 1];
+}
+
+int lod_get(const LodIndex *idx, int level, int ch, uint64_t bucket, double *min, double *max, double *mean) {
+    if (level < 1 || level > LOD_LEVELS || bucket >= idx->count[level - 1] || ch < 0 || ch >= idx->num_channels)
+        return 0;
+    const LodBlockHeader *b = idx->blocks[level - 1][bucket / LOD_BLOCK];
+    size_t slot = (size_t)(bucket % LOD_BLOCK);
+    if (min) *min = block_column(b, ch, 0)[slot];
+    if (max) *max = block_column(b, ch, 1)[slot];
+    if (mean) *mean = block_column(b, ch, 2)[slot];
+    return 1;
+}
+
+// Extremes over buckets [b0, b1] of one level, a block column at a time.
+int lod_extremes(const LodIndex *idx, int level, int ch, uint64_t b0, uint64_t b1, double *lo, double *hi) {
+    if (level < 1 || level > LOD_LEVELS || b0 > b1 || b1 >= idx->count[level - 1] || ch < 0 || ch >= idx->num_channels)
+        return 0;
+    double mn = INFINITY, mx = -INFINITY;
+    for (uint64_t b = b0; b <= b1;) {
+        const LodBlockHeader *blk = idx->blocks[level - 1][b / LOD_BLOCK];
+        size_t slot = (size_t)(b % LOD_BLOCK);
+        size_t take = LOD_BLOCK - slot;
+        if (take > b1 - b + 1) take = (size_t)(b1 - b + 1);
+        const double *cmin = block_column(blk, ch, 0) + slot, *cmax = block_column(blk, ch, 1) + slot;
+        for (size_t k = 0; k < take; k++) {
+            if (cmin[k] < mn) mn = cmin[k];
+            if (cmax[k] > mx) mx = cmax[k];
+        }
+        b += take;
+    }
+    *lo = mn;
+    *hi = mx;
+    return 1;
+}
+
+// Coarsest level that still gives every column at least one bucket and
+// covers [first, last); 0 means the range needs raw samples. A column then
+// spans fewer than LOD_FANOUT buckets, so the cost per frame is bounded by
+// the column count whatever the zoom.
+int lod_pick_level(const LodIndex *idx, uint64_t first, uint64_t last, int columns) {
+    if (!idx || last <= first || columns < 1) return 0;
+    uint64_t n = last - first;
+    int best = 0;
+    for (int l = 1; l <= LOD_LEVELS; l++) {
+        uint64_t bs = lod_bucket_samples(l);
+        if (bs * (uint64_t)columns > n) break;
+        if (idx->count[l - 1] * bs >= last) best = l;
+    }
+    return best;
+}
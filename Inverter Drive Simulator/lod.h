@@ -0,0 +1,45 @@
+#ifndef LOD_H
+#define LOD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Min/max/mean level-of-detail pyramid over a recording, kept in a side
+// file (<recording>.lod). Level 1 summarises LOD_BASE samples per bucket and
+// each further level LOD_FANOUT buckets of the one below. Buckets are
+// appended in blocks of LOD_BLOCK per level, each with its own header, so
+// the index can be rebuilt by scanning blocks and a cut-short file still
+// opens with the blocks it has.
+
+#define LOD_MAGIC "IDSLOD1"
+#define LOD_BASE 64
+#define LOD_FANOUT 8
+#define LOD_LEVELS 8
+#define LOD_BLOCK 512
+
+typedef struct {
+    char magic[8];
+    uint32_t num_channels;
+    uint32_t base;
+    uint32_t fanout;
+    uint32_t levels;
+    uint32_t block;
+    uint32_t reserved;
+} LodHeader;
+
+typedef struct LodWriter LodWriter;
+typedef struct LodIndex LodIndex;
+
+LodWriter *lod_writer_create(const char *path, int num_channels);
+int lod_writer_append(LodWriter *w, const double *values);
+int lod_writer_close(LodWriter *w);
+
+LodIndex *lod_open(const char *path, int num_channels);
+void lod_close(LodIndex *idx);
+uint64_t lod_bucket_samples(int level);
+uint64_t lod_count(const LodIndex *idx, int level);
+int lod_get(const LodIndex *idx, int level, int ch, uint64_t bucket, double *min, double *max, double *mean);
+int lod_extremes(const LodIndex *idx, int level, int ch, uint64_t b0, uint64_t b1, double *lo, double *hi);
+int lod_pick_level(const LodIndex *idx, uint64_t first, uint64_t last, int columns);
+
+#endif
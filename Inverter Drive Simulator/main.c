@@ -1,14 +1,25 @@
 #include <gtk/gtk.h>
 #include "gui.h"
 
+static int modbus_port = -1;
+static char *shm_name = NULL;
+
+static const GOptionEntry options[] = {
+    { "modbus", 0, 0, G_OPTION_ARG_INT, &modbus_port, "Serve Modbus TCP on 127.0.0.1:PORT", "PORT" },
+    { "shm", 0, 0, G_OPTION_ARG_STRING, &shm_name, "Publish the drive status to the shared-memory object NAME", "NAME" },
+    { NULL }
+};
+
 static void activate(GtkApplication *app, gpointer user_data) {
     GtkSettings *settings = gtk_settings_get_default();
     g_object_set(settings, "gtk-application-prefer-dark-theme", TRUE, NULL);
+    gui_set_remote(modbus_port, shm_name);
     create_main_window(app);
 }
 
 int main(int argc, char *argv[]) {
     GtkApplication *app = gtk_application_new("com.example.InverterSimulator", G_APPLICATION_DEFAULT_FLAGS);
+    g_application_add_main_option_entries(G_APPLICATION(app), options);
     g_signal_connect(app, "activate", G_CALLBACK(activate), NULL);
     int status = g_application_run(G_APPLICATION(app), argc, argv);
     g_object_unref(app);
@@ -0,0 +1,442 @@
+#include "modbus.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define MBAP_SIZE 7        // transaction, protocol, length, unit
+#define FRAME_MAX 260      // MBAP plus the largest PDU
+#define RX_SIZE 1024
+#define TX_SIZE 4096
+#define MAX_EVENTS 64
+#define TAG_LISTEN ((uint64_t)-1)
+#define TAG_WAKE ((uint64_t)-2)
+
+enum { EX_ILLEGAL_FUNCTION = 1, EX_ILLEGAL_ADDRESS = 2, EX_ILLEGAL_VALUE = 3 };
+
+// Requests are answered in arrival order into tx. While tx has no room for
+// another response the connection stops reading, so a client that does not
+// drain its replies only stalls itself.
+typedef struct {
+    int fd;             // -1 while the slot is free
+    uint32_t events;    // current epoll interest
+    size_t rx_len;
+    size_t tx_len;
+    uint8_t rx[RX_SIZE];
+    uint8_t tx[TX_SIZE];
+} Connection;
+
+struct ModbusServer {
+    int listen_fd;
+    int epoll_fd;
+    int wake_fd;
+    int port;
+    pthread_t thread;
+    DriveStatusBlock *status;
+    DriveCommands *commands;
+    Connection *conns;
+    atomic_ulong connections;
+    atomic_ulong refused;
+    atomic_ulong active;
+    atomic_ulong requests;
+    atomic_ulong exceptions;
+    atomic_ulong batches;
+};
+
+// Status read at most once per wakeup of a connection, so every request in
+// a pipelined batch sees the same tick.
+typedef struct {
+    int have_status;
+    DriveStatus status;
+} Batch;
+
+static uint16_t get16(const uint8_t *p) {
+    return (uint16_t)(p[0] << 8 | p[1]);
+}
+
+static void put16(uint8_t *p, unsigned v) {
+    p[0] = (uint8_t)(v >> 8);
+    p[1] = (uint8_t)v;
+}
+
+static void count(atomic_ulong *counter) {
+    atomic_fetch_add_explicit(counter, 1, memory_order_relaxed);
+}
+
+// Rounds to the register's unit and saturates instead of wrapping.
+static uint16_t scaled(double v, double unit, int is_signed) {
+    double lo = is_signed ? -32768.0 : 0.0, hi = is_signed ? 32767.0 : 65535.0;
+    double x = isnan(v) ? 0.0 : fmin(hi, fmax(lo, round(v / unit)));
+    return is_signed ? (uint16_t)(int16_t)x : (uint16_t)x;
+}
+
+static const DriveStatus *batch_status(ModbusServer *s, Batch *b) {
+    if (!b->have_status) {
+        drive_status_read(s->status, &b->status);
+        b->have_status = 1;
+    }
+    return &b->status;
+}
+
+static uint16_t input_register(const DriveStatus *st, int addr) {
+    if (addr >= MODBUS_IR_FLOAT) {
+        const double values[MODBUS_IR_FLOAT_COUNT / 2] = {
+            st->time, st->speed_ref, st->freq, st->vll, st->current, st->speed, st->torque, st->temp
+        };
+        float f = (float)values[(addr - MODBUS_IR_FLOAT) / 2];
+        uint32_t bits;
+        memcpy(&bits, &f, sizeof(bits));
+        return (addr - MODBUS_IR_FLOAT) % 2 ? (uint16_t)bits : (uint16_t)(bits >> 16);
+    }
+    uint32_t ms = (uint32_t)(uint64_t)(st->time * 1000.0);
+    switch (addr) {
+        case MODBUS_IR_STATUS: return (uint16_t)st->flags;
+        case MODBUS_IR_FAULT: return (uint16_t)st->fault;
+        case MODBUS_IR_FREQ: return scaled(st->freq, 0.01, 0);
+        case MODBUS_IR_SPEED: return scaled(st->speed, 1.0, 1);
+        case MODBUS_IR_CURRENT: return scaled(st->current, 0.1, 0);
+        case MODBUS_IR_TORQUE: return scaled(st->torque, 0.1, 1);
+        case MODBUS_IR_VLL: return scaled(st->vll, 0.1, 0);
+        case MODBUS_IR_TEMP: return scaled(st->temp, 0.1, 1);
+        case MODBUS_IR_TIME: return (uint16_t)(ms >> 16);
+        case MODBUS_IR_TIME + 1: return (uint16_t)ms;
+        case MODBUS_IR_COUNTER: return (uint16_t)st->steps;
+        case MODBUS_IR_SPEED_REF: return scaled(st->speed_ref, 0.01, 0);
+        default: return 0;
+    }
+}
+
+static int input_range_valid(int addr, int qty) {
+    return addr + qty <= MODBUS_IR_COUNT ||
+           (addr >= MODBUS_IR_FLOAT && addr + qty <= MODBUS_IR_FLOAT + MODBUS_IR_FLOAT_COUNT);
+}
+
+static uint16_t holding_register(DriveCommands *c, int addr) {
+    switch (addr) {
+        case MODBUS_HR_CONTROL:
+            return (uint16_t)((atomic_load(&c->run) ? 1 : 0) | (atomic_load(&c->reverse) ? 2 : 0));
+        case MODBUS_HR_SPEED_REF: return (uint16_t)atomic_load(&c->speed_ref);
+        case MODBUS_HR_LOAD: return (uint16_t)(int16_t)atomic_load(&c->load_torque);
+        default: return 0;
+    }
+}
+
+static int holding_value_valid(int addr, uint16_t v) {
+    if (addr == MODBUS_HR_CONTROL) return (v & ~7u) == 0;
+    if (addr == MODBUS_HR_SPEED_REF) return v <= 10000;
+    return 1;
+}
+
+static void write_holding(DriveCommands *c, int addr, uint16_t v) {
+    switch (addr) {
+        case MODBUS_HR_CONTROL:
+            drive_commands_post(c, DRIVE_CMD_RUN, v & 1);
+            drive_commands_post(c, DRIVE_CMD_REVERSE, (v >> 1) & 1);
+            if (v & 4) drive_commands_post(c, DRIVE_CMD_RESET, 1);
+            break;
+        case MODBUS_HR_SPEED_REF: drive_commands_post(c, DRIVE_CMD_SPEED, v); break;
+        case MODBUS_HR_LOAD: drive_commands_post(c, DRIVE_CMD_LOAD, (int16_t)v); break;
+        default: break;
+    }
+}
+
+static int coil(DriveCommands *c, int addr) {
+    if (addr == MODBUS_COIL_RUN) return atomic_load(&c->run) != 0;
+    if (addr == MODBUS_COIL_REVERSE) return atomic_load(&c->reverse) != 0;
+    return 0;
+}
+
+static void write_coil(DriveCommands *c, int addr, int on) {
+    if (addr == MODBUS_COIL_RUN) drive_commands_post(c, DRIVE_CMD_RUN, on);
+    else if (addr == MODBUS_COIL_REVERSE) drive_commands_post(c, DRIVE_CMD_REVERSE, on);
+    else if (on) drive_commands_post(c, DRIVE_CMD_RESET, 1);
+}
+
+static int exception(ModbusServer *s, uint8_t function, int code, uint8_t *resp) {
+    count(&s->exceptions);
+    resp[0] = function | 0x80;
+    resp[1] = (uint8_t)code;
+    return 2;
+}
+
+// Answers one request PDU into resp and returns the response length.
+static int handle_pdu(ModbusServer *s, Batch *b, const uint8_t *req, int len, uint8_t *resp) {
+    uint8_t function = req[0];
+    if (function < 1 || (function > 6 && function != 15 && function != 16))
+        return exception(s, function, EX_ILLEGAL_FUNCTION, resp);
+    if (len < 5) return exception(s, function, EX_ILLEGAL_VALUE, resp);
+    int addr = get16(req + 1), qty = get16(req + 3);
+    resp[0] = function;
+    switch (function) {
+        case 1:
+        case 2: {
+            if (len != 5 || qty < 1 || qty > MODBUS_MAX_BITS) return exception(s, function, EX_ILLEGAL_VALUE, resp);
+            if (addr + qty > (function == 1 ? MODBUS_COIL_COUNT : MODBUS_DI_COUNT))
+                return exception(s, function, EX_ILLEGAL_ADDRESS, resp);
+            int bytes = (qty + 7) / 8;
+            resp[1] = (uint8_t)bytes;
+            memset(resp + 2, 0, (size_t)bytes);
+            uint32_t flags = function == 2 ? batch_status(s, b)->flags : 0;
+            for (int i = 0; i < qty; i++) {
+                int on = function == 1 ? coil(s->commands, addr + i) : (int)(flags >> (addr + i)) & 1;
+                if (on) resp[2 + i / 8] |= (uint8_t)(1 << (i % 8));
+            }
+            return 2 + bytes;
+        }
+        case 3:
+        case 4: {
+            if (len != 5 || qty < 1 || qty > MODBUS_MAX_READ) return exception(s, function, EX_ILLEGAL_VALUE, resp);
+            if (function == 3 ? addr + qty > MODBUS_HR_COUNT : !input_range_valid(addr, qty))
+                return exception(s, function, EX_ILLEGAL_ADDRESS, resp);
+            resp[1] = (uint8_t)(2 * qty);
+            const DriveStatus *st = function == 4 ? batch_status(s, b) : NULL;
+            for (int i = 0; i < qty; i++)
+                put16(resp + 2 + 2 * i, st ? input_register(st, addr + i) : holding_register(s->commands, addr + i));
+            return 2 + 2 * qty;
+        }
+        case 5:
+            if (len != 5 || (qty != 0xFF00 && qty != 0)) return exception(s, function, EX_ILLEGAL_VALUE, resp);
+            if (addr >= MODBUS_COIL_COUNT) return exception(s, function, EX_ILLEGAL_ADDRESS, resp);
+            write_coil(s->commands, addr, qty != 0);
+            memcpy(resp, req, 5);
+            return 5;
+        case 6:
+            if (len != 5) return exception(s, function, EX_ILLEGAL_VALUE, resp);
+            if (addr >= MODBUS_HR_COUNT) return exception(s, function, EX_ILLEGAL_ADDRESS, resp);
+            if (!holding_value_valid(addr, (uint16_t)qty)) return exception(s, function, EX_ILLEGAL_VALUE, resp);
+            write_holding(s->commands, addr, (uint16_t)qty);
+            memcpy(resp, req, 5);
+            return 5;
+        case 15:
+        case 16: {
+            int max = function == 15 ? 1968 : MODBUS_MAX_WRITE;   // what fits one frame
+            int bytes = function == 15 ? (qty + 7) / 8 : 2 * qty;
+            if (len < 6 || qty < 1 || qty > max || req[5] != bytes || len != 6 + bytes)
+                return exception(s, function, EX_ILLEGAL_VALUE, resp);
+            if (addr + qty > (function == 15 ? MODBUS_COIL_COUNT : MODBUS_HR_COUNT))
+                return exception(s, function, EX_ILLEGAL_ADDRESS, resp);
+            const uint8_t *data = req + 6;
+            if (function == 15) {
+                for (int i = 0; i < qty; i++) write_coil(s->commands, addr + i, (data[i / 8] >> (i % 8)) & 1);
+            } else {
+                // All or nothing: a bad value anywhere rejects the whole write
+                for (int i = 0; i < qty; i++)
+                    if (!holding_value_valid(addr + i, get16(data + 2 * i)))
+                        return exception(s, function, EX_ILLEGAL_VALUE, resp);
+                for (int i = 0; i < qty; i++) write_holding(s->commands, addr + i, get16(data + 2 * i));
+            }
+            memcpy(resp, req, 5);
+            return 5;
+        }
+    }
+    return exception(s, function, EX_ILLEGAL_FUNCTION, resp);
+}
+
+// Answers every complete frame in rx while tx has room. Returns 0 if the
+// stream is not Modbus TCP and the connection should be dropped.
+static int serve_frames(ModbusServer *s, Connection *c) {
+    Batch batch = { 0 };
+    size_t pos = 0;
+    int served = 0;
+    while (c->rx_len - pos >= MBAP_SIZE && c->tx_len + FRAME_MAX <= TX_SIZE) {
+        const uint8_t *frame = c->rx + pos;
+        size_t length = get16(frame + 4);
+        if (get16(frame + 2) != 0 || length < 2 || length > FRAME_MAX - 6) return 0;
+        if (c->rx_len - pos < 6 + length) break;
+        uint8_t *out = c->tx + c->tx_len;
+        memcpy(out, frame, 4);
+        out[6] = frame[6];
+        int n = handle_pdu(s, &batch, frame + MBAP_SIZE, (int)length - 1, out + MBAP_SIZE);
+        put16(out + 4, (unsigned)n + 1);
+        c->tx_len += MBAP_SIZE + (size_t)n;
+        pos += 6 + length;
+        served++;
+    }
+    if (pos) memmove(c->rx, c->rx + pos, c->rx_len - pos);
+    c->rx_len -= pos;
+    if (served) {
+        atomic_fetch_add_explicit(&s->requests, (unsigned long)served, memory_order_relaxed);
+        count(&s->batches);
+    }
+    return 1;
+}
+
+static void close_connection(ModbusServer *s, Connection *c) {
+    epoll_ctl(s->epoll_fd, EPOLL_CTL_DEL, c->fd, NULL);
+    close(c->fd);
+    c->fd = -1;
+    atomic_fetch_sub_explicit(&s->active, 1, memory_order_relaxed);
+}
+
+// Sends what it can without blocking. Returns 0 on a dead socket.
+static int flush(Connection *c) {
+    size_t sent = 0;
+    while (sent < c->tx_len) {
+        ssize_t n = send(c->fd, c->tx + sent, c->tx_len - sent, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            return 0;
+        }
+        sent += (size_t)n;
+    }
+    if (sent) memmove(c->tx, c->tx + sent, c->tx_len - sent);
+    c->tx_len -= sent;
+    return 1;
+}
+
+// Reads only while a response fits, and waits for writability only while
+// replies are queued.
+static int update_interest(ModbusServer *s, Connection *c) {
+    uint32_t events = (c->tx_len + FRAME_MAX <= TX_SIZE ? EPOLLIN : 0) | (c->tx_len ? EPOLLOUT : 0);
+    if (events == c->events) return 1;
+    struct epoll_event ev = { .events = events, .data.u64 = (uint64_t)(c - s->conns) };
+    c->events = events;
+    return epoll_ctl(s->epoll_fd, EPOLL_CTL_MOD, c->fd, &ev) == 0;
+}
+
+static void service(ModbusServer *s, Connection *c, uint32_t events) {
+    int ok = 1;
+    if (events & EPOLLOUT) ok = flush(c) && serve_frames(s, c);
+    while (ok && (events & (EPOLLIN | EPOLLHUP | EPOLLERR)) && c->tx_len + FRAME_MAX <= TX_SIZE) {
+        ssize_t n = recv(c->fd, c->rx + c->rx_len, RX_SIZE - c->rx_len, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        if (n <= 0) {
+            ok = 0;
+        } else {
+            c->rx_len += (size_t)n;
+            ok = serve_frames(s, c);
+        }
+    }
+    ok = ok && flush(c) && update_interest(s, c);
+    if (!ok) close_connection(s, c);
+}
+
+static void accept_clients(ModbusServer *s) {
+    for (;;) {
+        int fd = accept(s->listen_fd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            return;
+        }
+        fcntl(fd, F_SETFL, O_NONBLOCK);
+        Connection *c = NULL;
+        for (int i = 0; i < MODBUS_MAX_CLIENTS && !c; i++)
+            if (s->conns[i].fd < 0) c = &s->conns[i];
+        if (!c) {
+            close(fd);
+            count(&s->refused);
+            continue;
+        }
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        c->fd = fd;
+        c->events = EPOLLIN;
+        c->rx_len = 0;
+        c->tx_len = 0;
+        struct epoll_event ev = { .events = EPOLLIN, .data.u64 = (uint64_t)(c - s->conns) };
+        if (epoll_ctl(s->epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+            close(fd);
+            c->fd = -1;
+            continue;
+        }
+        count(&s->connections);
+        count(&s->active);
+    }
+}
+
+static void *serve(void *arg) {
+    ModbusServer *s = arg;
+    struct epoll_event events[MAX_EVENTS];
+    for (;;) {
+        int n = epoll_wait(s->epoll_fd, events, MAX_EVENTS, -1);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) return NULL;
+        for (int i = 0; i < n; i++) {
+            uint64_t tag = events[i].data.u64;
+            if (tag == TAG_WAKE) return NULL;
+            if (tag == TAG_LISTEN) accept_clients(s);
+            else if (s->conns[tag].fd >= 0) service(s, &s->conns[tag], events[i].events);
+        }
+    }
+}
+
+static void release(ModbusServer *s) {
+    if (s->conns) {
+        for (int i = 0; i < MODBUS_MAX_CLIENTS; i++)
+            if (s->conns[i].fd >= 0) close(s->conns[i].fd);
+    }
+    if (s->listen_fd >= 0) close(s->listen_fd);
+    if (s->epoll_fd >= 0) close(s->epoll_fd);
+    if (s->wake_fd >= 0) close(s->wake_fd);
+    free(s->conns);
+    free(s);
+}
+
+// port 0 picks a free one; modbus_server_port says which.
+ModbusServer *modbus_server_start(int port, DriveStatusBlock *status, DriveCommands *commands) {
+    ModbusServer *s = calloc(1, sizeof(*s));
+    if (!s) return NULL;
+    s->status = status;
+    s->commands = commands;
+    s->listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    s->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    s->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    s->conns = calloc(MODBUS_MAX_CLIENTS, sizeof(Connection));
+    if (s->conns)
+        for (int i = 0; i < MODBUS_MAX_CLIENTS; i++) s->conns[i].fd = -1;
+    int one = 1;
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons((uint16_t)port),
+                                .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+    socklen_t addr_len = sizeof(addr);
+    struct epoll_event listen_ev = { .events = EPOLLIN, .data.u64 = TAG_LISTEN };
+    struct epoll_event wake_ev = { .events = EPOLLIN, .data.u64 = TAG_WAKE };
+    if (s->listen_fd < 0 || s->epoll_fd < 0 || s->wake_fd < 0 || !s->conns ||
+        setsockopt(s->listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) != 0 ||
+        bind(s->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(s->listen_fd, SOMAXCONN) != 0 ||
+        getsockname(s->listen_fd, (struct sockaddr *)&addr, &addr_len) != 0 ||
+        epoll_ctl(s->epoll_fd, EPOLL_CTL_ADD, s->listen_fd, &listen_ev) != 0 ||
+        epoll_ctl(s->epoll_fd, EPOLL_CTL_ADD, s->wake_fd, &wake_ev) != 0) {
+        int saved = errno;
+        release(s);
+        errno = saved;
+        return NULL;
+    }
+    s->port = ntohs(addr.sin_port);
+    if (pthread_create(&s->thread, NULL, serve, s) != 0) {
+        release(s);
+        return NULL;
+    }
+    return s;
+}
+
+void modbus_server_stop(ModbusServer *s) {
+    if (!s) return;
+    uint64_t one = 1;
+    if (write(s->wake_fd, &one, sizeof(one)) != sizeof(one)) return;
+    pthread_join(s->thread, NULL);
+    release(s);
+}
+
+int modbus_server_port(const ModbusServer *s) {
+    return s->port;
+}
+
+void modbus_server_stats(ModbusServer *s, ModbusStats *out) {
+    out->connections = atomic_load_explicit(&s->connections, memory_order_relaxed);
+    out->refused = atomic_load_explicit(&s->refused, memory_order_relaxed);
+    out->active = atomic_load_explicit(&s->active, memory_order_relaxed);
+    out->requests = atomic_load_explicit(&s->requests, memory_order_relaxed);
+    out->exceptions = atomic_load_explicit(&s->exceptions, memory_order_relaxed);
+    out->batches = atomic_load_explicit(&s->batches, memory_order_relaxed);
+}
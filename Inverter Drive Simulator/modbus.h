@@ -0,0 +1,65 @@
+#ifndef MODBUS_H
+#define MODBUS_H
+
+#include "drive_io.h"
+
+// Modbus TCP slave for the drive, listening on localhost only. One thread
+// serves every connection from an epoll loop on non-blocking sockets.
+// Requests read the status block and post commands, so the simulation never
+// waits for a client. Any unit id is answered.
+
+#define MODBUS_DEFAULT_PORT 5020   // 502 needs privileges
+#define MODBUS_MAX_CLIENTS 256
+#define MODBUS_MAX_READ 125        // registers per read request
+#define MODBUS_MAX_WRITE 123       // registers per write request
+#define MODBUS_MAX_BITS 2000       // coils or discrete inputs per read
+
+// Input registers (function 04), scaled integers; signed ones are two's complement
+#define MODBUS_IR_STATUS 0          // DRIVE_FLAG_* bits
+#define MODBUS_IR_FAULT 1           // FaultType
+#define MODBUS_IR_FREQ 2            // 0.01 Hz
+#define MODBUS_IR_SPEED 3           // rpm, signed
+#define MODBUS_IR_CURRENT 4         // 0.1 A
+#define MODBUS_IR_TORQUE 5          // 0.1 Nm, signed
+#define MODBUS_IR_VLL 6             // 0.1 V
+#define MODBUS_IR_TEMP 7            // 0.1 C, signed
+#define MODBUS_IR_TIME 8            // ms, 32 bits, high word first
+#define MODBUS_IR_COUNTER 10        // low 16 bits of the step count, to spot stale data
+#define MODBUS_IR_SPEED_REF 11      // 0.01 %
+#define MODBUS_IR_COUNT 12
+// The same quantities as IEEE-754 floats, two registers each, high word first:
+// time, speed_ref, freq, vll, current, speed, torque, temp
+#define MODBUS_IR_FLOAT 100
+#define MODBUS_IR_FLOAT_COUNT 16
+
+// Holding registers (functions 03, 06, 16); reads return the last command
+#define MODBUS_HR_CONTROL 0         // bit 0 run, bit 1 reverse, bit 2 fault reset (reads 0)
+#define MODBUS_HR_SPEED_REF 1       // 0.01 %, 0..10000
+#define MODBUS_HR_LOAD 2            // 0.1 Nm, signed
+#define MODBUS_HR_COUNT 3
+
+// Coils (functions 01, 05, 15) mirror the control word bits; discrete
+// inputs (function 02) the DRIVE_FLAG_* bits.
+#define MODBUS_COIL_RUN 0
+#define MODBUS_COIL_REVERSE 1
+#define MODBUS_COIL_RESET 2
+#define MODBUS_COIL_COUNT 3
+#define MODBUS_DI_COUNT 3
+
+typedef struct ModbusServer ModbusServer;
+
+typedef struct {
+    unsigned long connections;   // accepted since start
+    unsigned long refused;       // turned away at MODBUS_MAX_CLIENTS
+    unsigned long active;
+    unsigned long requests;
+    unsigned long exceptions;
+    unsigned long batches;       // wakeups that served at least one request
+} ModbusStats;
+
+ModbusServer *modbus_server_start(int port, DriveStatusBlock *status, DriveCommands *commands);
+void modbus_server_stop(ModbusServer *s);
+int modbus_server_port(const ModbusServer *s);
+void modbus_server_stats(ModbusServer *s, ModbusStats *out);
+
+#endif
@@ -0,0 +1,416 @@
+#include "modbus.h"
+#include "fault.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <math.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_CLIENTS 4096
+#define RX_SIZE 1024
+#define TAG_TIMER ((uint64_t)-1)
+#define POLL_SLOTS 16   // clients are spread over this many phases of the interval
+
+typedef struct {
+    int fd;
+    uint16_t tid;
+    int outstanding;
+    double sent_at;
+    size_t rx_len;
+    uint8_t rx[RX_SIZE];
+} Client;
+
+typedef struct {
+    unsigned long sent;
+    unsigned long answered;
+    unsigned long exceptions;
+    unsigned long errors;
+    unsigned long overruns;   // polls skipped because the last reply had not arrived
+    double *latency_us;
+    size_t latency_len;
+    size_t latency_cap;
+} LoadStats;
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "Commands, sent in this order over one connection:\n"
+            "      --stop / --run        clear or set the run command\n"
+            "      --forward / --reverse direction\n"
+            "      --speed PCT           speed reference, 0-100 %% of max freq\n"
+            "      --load NM             load torque\n"
+            "      --reset               reset a latched fault\n"
+            "      --read                print the drive status\n"
+            "      --shm NAME            print the status from the shared-memory block instead of over TCP\n"
+            "Without a command, load-test the server:\n"
+            "  -c, --clients N           concurrent connections (default 1)\n"
+            "  -i, --interval MS         poll period of every client (default 1)\n"
+            "  -d, --duration SEC        test length (default 10)\n"
+            "  -n, --registers N         input registers per read, 1-%d (default %d)\n"
+            "      --float               read the float block instead of the scaled registers\n"
+            "  -p, --port PORT           server port on 127.0.0.1 (default %d)\n",
+            prog, MODBUS_MAX_READ, MODBUS_IR_COUNT, MODBUS_DEFAULT_PORT);
+}
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void put16(uint8_t *p, unsigned v) {
+    p[0] = (uint8_t)(v >> 8);
+    p[1] = (uint8_t)v;
+}
+
+static uint16_t get16(const uint8_t *p) {
+    return (uint16_t)(p[0] << 8 | p[1]);
+}
+
+static int connect_local(int port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons((uint16_t)port),
+                                .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Frames a request: MBAP header, unit 1, then the PDU.
+static size_t frame(uint8_t *out, uint16_t tid, const uint8_t *pdu, size_t len) {
+    put16(out, tid);
+    put16(out + 2, 0);
+    put16(out + 4, (unsigned)len + 1);
+    out[6] = 1;
+    memcpy(out + 7, pdu, len);
+    return len + 7;
+}
+
+static int read_full(int fd, uint8_t *buf, size_t len) {
+    size_t got = 0;
+    while (got < len) {
+        ssize_t n = recv(fd, buf + got, len - got, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return 0;
+        got += (size_t)n;
+    }
+    return 1;
+}
+
+// One blocking request; returns the response PDU length, or -1.
+static int transact(int fd, const uint8_t *pdu, size_t len, uint8_t *resp) {
+    static uint16_t tid;
+    uint8_t req[300];
+    size_t n = frame(req, ++tid, pdu, len);
+    if (send(fd, req, n, MSG_NOSIGNAL) != (ssize_t)n) return -1;
+    uint8_t mbap[7];
+    if (!read_full(fd, mbap, sizeof(mbap))) return -1;
+    int pdu_len = get16(mbap + 4) - 1;
+    if (get16(mbap) != tid || pdu_len < 2 || pdu_len > 253 || !read_full(fd, resp, (size_t)pdu_len)) return -1;
+    if (resp[0] & 0x80) {
+        fprintf(stderr, "Modbus exception %d to function %d\n", resp[1], resp[0] & 0x7f);
+        return -1;
+    }
+    return pdu_len;
+}
+
+static int write_register(int fd, int addr, int value) {
+    uint8_t pdu[5] = { 6 }, resp[260];
+    put16(pdu + 1, (unsigned)addr);
+    put16(pdu + 3, (unsigned)(uint16_t)value);
+    return transact(fd, pdu, sizeof(pdu), resp) == 5;
+}
+
+static int write_coil(int fd, int addr, int on) {
+    uint8_t pdu[5] = { 5 }, resp[260];
+    put16(pdu + 1, (unsigned)addr);
+    put16(pdu + 3, on ? 0xFF00 : 0);
+    return transact(fd, pdu, sizeof(pdu), resp) == 5;
+}
+
+static int read_registers(int fd, int function, int addr, int qty, uint16_t *out) {
+    uint8_t pdu[5] = { (uint8_t)function }, resp[260];
+    put16(pdu + 1, (unsigned)addr);
+    put16(pdu + 3, (unsigned)qty);
+    if (transact(fd, pdu, sizeof(pdu), resp) != 2 + 2 * qty) return 0;
+    for (int i = 0; i < qty; i++) out[i] = get16(resp + 2 + 2 * i);
+    return 1;
+}
+
+static void print_status(const DriveStatus *s) {
+    FaultState fault = { .current_fault = (FaultType)s->fault };
+    printf("time %.3f s  %s%s  ref %.2f %%  freq %.2f Hz  speed %.1f rpm  current %.2f A  torque %.2f Nm  "
+           "vll %.1f V  temp %.1f C  %s\n",
+           s->time, s->flags & DRIVE_FLAG_RUNNING ? "running" : "stopped",
+           s->flags & DRIVE_FLAG_REVERSE ? " reverse" : "", s->speed_ref, s->freq, s->speed, s->current, s->torque,
+           s->vll, s->temp, get_fault_status(&fault));
+}
+
+// The float block holds every analogue quantity; the flags and the fault
+// come from the head of the scaled block.
+static int read_status(int fd, DriveStatus *s) {
+    uint16_t regs[MODBUS_IR_FLOAT_COUNT], head[2];
+    if (!read_registers(fd, 4, MODBUS_IR_STATUS, 2, head) ||
+        !read_registers(fd, 4, MODBUS_IR_FLOAT, MODBUS_IR_FLOAT_COUNT, regs))
+        return 0;
+    double *fields[] = { &s->time, &s->speed_ref, &s->freq, &s->vll, &s->current, &s->speed, &s->torque, &s->temp };
+    for (int k = 0; k < MODBUS_IR_FLOAT_COUNT / 2; k++) {
+        uint32_t bits = (uint32_t)regs[2 * k] << 16 | regs[2 * k + 1];
+        float f;
+        memcpy(&f, &bits, sizeof(f));
+        *fields[k] = f;
+    }
+    s->flags = head[0];
+    s->fault = head[1];
+    return 1;
+}
+
+static void add_latency(LoadStats *st, double us) {
+    if (st->latency_len == st->latency_cap) {
+        size_t cap = st->latency_cap ? st->latency_cap * 2 : 65536;
+        double *p = realloc(st->latency_us, cap * sizeof(double));
+        if (!p) return;
+        st->latency_us = p;
+        st->latency_cap = cap;
+    }
+    st->latency_us[st->latency_len++] = us;
+}
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double percentile(const double *sorted, size_t n, double p) {
+    return n ? sorted[(size_t)(p * (double)(n - 1) + 0.5)] : 0.0;
+}
+
+// Consumes complete responses; returns 0 if the connection broke.
+static int receive(Client *c, int qty, LoadStats *st) {
+    for (;;) {
+        ssize_t n = recv(c->fd, c->rx + c->rx_len, RX_SIZE - c->rx_len, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return 1;
+        if (n <= 0) return 0;
+        c->rx_len += (size_t)n;
+        double now = now_seconds();
+        size_t pos = 0;
+        while (c->rx_len - pos >= 7) {
+            size_t len = get16(c->rx + pos + 4);
+            if (len < 2 || len > 254) return 0;
+            if (c->rx_len - pos < 6 + len) break;
+            const uint8_t *pdu = c->rx + pos + 7;
+            if (get16(c->rx + pos) != c->tid || !c->outstanding) st->errors++;
+            else if (pdu[0] & 0x80) st->exceptions++;
+            else if (len - 1 != (size_t)(2 + 2 * qty)) st->errors++;
+            else {
+                st->answered++;
+                add_latency(st, (now - c->sent_at) * 1e6);
+            }
+            c->outstanding = 0;
+            pos += 6 + len;
+        }
+        memmove(c->rx, c->rx + pos, c->rx_len - pos);
+        c->rx_len -= pos;
+    }
+}
+
+static int load_test(int port, int clients, double interval_ms, double duration, int first, int qty) {
+    Client *cl = calloc((size_t)clients, sizeof(Client));
+    LoadStats st = { 0 };
+    int ep = epoll_create1(0);
+    int tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    if (!cl || ep < 0 || tfd < 0) {
+        perror("load test");
+        return 1;
+    }
+    int connected = 0;
+    for (int i = 0; i < clients; i++) {
+        cl[i].fd = connect_local(port);
+        if (cl[i].fd < 0) continue;
+        fcntl(cl[i].fd, F_SETFL, O_NONBLOCK);
+        struct epoll_event ev = { .events = EPOLLIN, .data.u64 = (uint64_t)i };
+        epoll_ctl(ep, EPOLL_CTL_ADD, cl[i].fd, &ev);
+        connected++;
+    }
+    if (connected == 0) {
+        fprintf(stderr, "Cannot connect to 127.0.0.1:%d\n", port);
+        return 1;
+    }
+    // Like independent masters, the clients do not all poll at once: the
+    // timer ticks once per slot and each client polls in its own slot.
+    int slots = clients < POLL_SLOTS ? clients : POLL_SLOTS, slot = 0;
+    long ns = (long)(interval_ms * 1e6 / slots);
+    struct itimerspec its = { { ns / 1000000000L, ns % 1000000000L }, { ns / 1000000000L, ns % 1000000000L } };
+    timerfd_settime(tfd, 0, &its, NULL);
+    struct epoll_event tev = { .events = EPOLLIN, .data.u64 = TAG_TIMER };
+    epoll_ctl(ep, EPOLL_CTL_ADD, tfd, &tev);
+    uint8_t pdu[5] = { 4 };
+    put16(pdu + 1, (unsigned)first);
+    put16(pdu + 3, (unsigned)qty);
+    double start = now_seconds(), end = start + duration;
+    struct epoll_event events[64];
+    while (now_seconds() < end) {
+        int n = epoll_wait(ep, events, 64, 100);
+        for (int e = 0; e < n; e++) {
+            if (events[e].data.u64 == TAG_TIMER) {
+                uint64_t expirations;
+                if (read(tfd, &expirations, sizeof(expirations)) != sizeof(expirations)) continue;
+                double now = now_seconds();
+                slot = (slot + 1) % slots;
+                for (int i = slot; i < clients; i += slots) {
+                    Client *c = &cl[i];
+                    if (c->fd < 0) continue;
+                    if (c->outstanding) {
+                        st.overruns++;
+                        continue;
+                    }
+                    uint8_t req[12];
+                    size_t len = frame(req, ++c->tid, pdu, sizeof(pdu));
+                    if (send(c->fd, req, len, MSG_NOSIGNAL) != (ssize_t)len) {
+                        st.errors++;
+                        continue;
+                    }
+                    c->outstanding = 1;
+                    c->sent_at = now;
+                    st.sent++;
+                }
+                continue;
+            }
+            Client *c = &cl[events[e].data.u64];
+            if (!receive(c, qty, &st)) {
+                st.errors++;
+                close(c->fd);
+                c->fd = -1;
+                connected--;
+            }
+        }
+    }
+    double wall = now_seconds() - start;
+    qsort(st.latency_us, st.latency_len, sizeof(double), compare_double);
+    printf("%d of %d clients connected, polling %d registers every %.3g ms for %.1f s\n", connected, clients, qty,
+           interval_ms, wall);
+    printf("requests %lu  answered %lu (%.0f/s)  exceptions %lu  errors %lu  overruns %lu\n", st.sent, st.answered,
+           st.answered / wall, st.exceptions, st.errors, st.overruns);
+    if (st.latency_len)
+        printf("round trip us: p50 %.1f  p90 %.1f  p99 %.1f  p99.9 %.1f  max %.1f\n",
+               percentile(st.latency_us, st.latency_len, 0.5), percentile(st.latency_us, st.latency_len, 0.9),
+               percentile(st.latency_us, st.latency_len, 0.99), percentile(st.latency_us, st.latency_len, 0.999),
+               st.latency_us[st.latency_len - 1]);
+    for (int i = 0; i < clients; i++)
+        if (cl[i].fd >= 0) close(cl[i].fd);
+    close(tfd);
+    close(ep);
+    free(cl);
+    free(st.latency_us);
+    return st.errors || st.exceptions ? 2 : 0;
+}
+
+int main(int argc, char *argv[]) {
+    enum {
+        OPT_RUN = 256, OPT_STOP, OPT_FORWARD, OPT_REVERSE, OPT_SPEED, OPT_LOAD, OPT_RESET, OPT_READ, OPT_SHM, OPT_FLOAT
+    };
+    static const struct option long_opts[] = {
+        {"port", required_argument, NULL, 'p'},
+        {"clients", required_argument, NULL, 'c'},
+        {"interval", required_argument, NULL, 'i'},
+        {"duration", required_argument, NULL, 'd'},
+        {"registers", required_argument, NULL, 'n'},
+        {"float", no_argument, NULL, OPT_FLOAT},
+        {"run", no_argument, NULL, OPT_RUN},
+        {"stop", no_argument, NULL, OPT_STOP},
+        {"forward", no_argument, NULL, OPT_FORWARD},
+        {"reverse", no_argument, NULL, OPT_REVERSE},
+        {"speed", required_argument, NULL, OPT_SPEED},
+        {"load", required_argument, NULL, OPT_LOAD},
+        {"reset", no_argument, NULL, OPT_RESET},
+        {"read", no_argument, NULL, OPT_READ},
+        {"shm", required_argument, NULL, OPT_SHM},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+    int port = MODBUS_DEFAULT_PORT, clients = 1, qty = -1, use_float = 0;
+    double interval_ms = 1.0, duration = 10.0;
+    int run = -1, reverse = -1, reset = 0, show = 0;
+    double speed = -1.0, load = NAN;
+    const char *shm_name = NULL;
+    int opt;
+    while ((opt = getopt_long(argc, argv, "p:c:i:d:n:h", long_opts, NULL)) != -1) {
+        switch (opt) {
+            case 'p': port = atoi(optarg); break;
+            case 'c': clients = atoi(optarg); break;
+            case 'i': interval_ms = atof(optarg); break;
+            case 'd': duration = atof(optarg); break;
+            case 'n': qty = atoi(optarg); break;
+            case OPT_FLOAT: use_float = 1; break;
+            case OPT_RUN: run = 1; break;
+            case OPT_STOP: run = 0; break;
+            case OPT_FORWARD: reverse = 0; break;
+            case OPT_REVERSE: reverse = 1; break;
+            case OPT_SPEED: speed = atof(optarg); break;
+            case OPT_LOAD: load = atof(optarg); break;
+            case OPT_RESET: reset = 1; break;
+            case OPT_READ: show = 1; break;
+            case OPT_SHM: shm_name = optarg; break;
+            case 'h': usage(argv[0]); return 0;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    int max_qty = use_float ? MODBUS_IR_FLOAT_COUNT : MODBUS_IR_COUNT;
+    if (qty < 0) qty = max_qty;
+    if (clients < 1 || clients > MAX_CLIENTS || interval_ms <= 0.0 || duration <= 0.0 || qty < 1 || qty > max_qty ||
+        speed > 100.0) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (shm_name) {
+        DriveStatusBlock *b = drive_status_shm_open(shm_name);
+        if (!b) {
+            fprintf(stderr, "Cannot map drive status %s\n", shm_name);
+            return 1;
+        }
+        DriveStatus s;
+        drive_status_read(b, &s);
+        print_status(&s);
+        drive_status_shm_close(b);
+        return 0;
+    }
+    if (run < 0 && reverse < 0 && speed < 0.0 && isnan(load) && !reset && !show)
+        return load_test(port, clients, interval_ms, duration, use_float ? MODBUS_IR_FLOAT : 0, qty);
+
+    int fd = connect_local(port);
+    if (fd < 0) {
+        fprintf(stderr, "Cannot connect to 127.0.0.1:%d\n", port);
+        return 1;
+    }
+    int ok = 1;
+    if (run == 0) ok = ok && write_coil(fd, MODBUS_COIL_RUN, 0);
+    if (reverse >= 0) ok = ok && write_coil(fd, MODBUS_COIL_REVERSE, reverse);
+    if (speed >= 0.0) ok = ok && write_register(fd, MODBUS_HR_SPEED_REF, (int)(speed * 100.0 + 0.5));
+    if (!isnan(load)) ok = ok && write_register(fd, MODBUS_HR_LOAD, (int)lround(load * 10.0));
+    if (reset) ok = ok && write_coil(fd, MODBUS_COIL_RESET, 1);
+    if (run == 1) ok = ok && write_coil(fd, MODBUS_COIL_RUN, 1);
+    DriveStatus s;
+    if (ok && show) {
+        ok = read_status(fd, &s);
+        if (ok) print_status(&s);
+    }
+    close(fd);
+    if (!ok) fprintf(stderr, "Request failed\n");
+    return ok ? 0 : 1;
+}
@@ -1,63 +1,368 @@
 #include "motor.h"
+#include "instrument.h"
 #include <math.h>
+#include <string.h>
 
-static double rated_voltage = 400.0;
-static double rated_current = 10.0;
-static double rated_freq = 50.0;
-static double rated_rpm = 1500.0;
-static double ramp_up = 2.0;
-static double ramp_down = 2.0;
-static double max_freq = 100.0;
-static double min_freq = 10.0;
-static double current_speed = 0.0;
-static double current_freq = 0.0;
-static double torque = 0.0;
-static double current = 0.0;
-static double temp = 25.0;
-
-void set_motor_params(double voltage, double current, double freq, double rpm) {
-    rated_voltage = voltage;
-    rated_current = current;
-    rated_freq = freq;
-    rated_rpm = rpm;
-}
-
-void set_drive_params(double ramp_up_in, double ramp_down_in, double max_freq_in, double min_freq_in) {
-    ramp_up = ramp_up_in;
-    ramp_down = ramp_down_in;
-    max_freq = max_freq_in;
-    min_freq = min_freq_in;
-}
-
-void update_motor(double target_freq, int is_forward, double ramp_up, double ramp_down) {
-    target_freq = fmax(min_freq, fmin(max_freq, target_freq));
-    double target_speed = (target_freq / rated_freq) * rated_rpm * (is_forward ? 1.0 : -1.0);
-    double accel = rated_rpm / ramp_up;
-    double decel = rated_rpm / ramp_down;
-    if (current_speed < target_speed) {
-        current_speed = fmin(current_speed + accel * 0.05, target_speed);
+// Stator copper loss at an RMS phase current
+static double copper_loss(const MotorState *m, double current) {
+    return 3.0 * m->im.params.rs * current * current;
+}
+
+void motor_init(MotorState *m) {
+    m->rated_voltage = 400.0;
+    m->rated_current = 10.0;
+    m->rated_freq = 50.0;
+    m->rated_rpm = 1500.0;
+    m->ramp_up = 2.0;
+    m->ramp_down = 2.0;
+    m->max_freq = 100.0;
+    m->min_freq = 10.0;
+    m->current_speed = 0.0;
+    m->current_freq = 0.0;
+    m->torque = 0.0;
+    m->current = 0.0;
+    m->voltage = 0.0;
+    m->temp = 25.0;
+    m->model = MOTOR_MODEL_DQ;
+    m->integrator = INTEGRATOR_RK4;
+    m->substeps = MOTOR_SUBSTEPS;
+    m->dt = MOTOR_DT;
+    m->drive_freq = 0.0;
+    m->load_torque = 0.0;
+    m->frame_angle = 0.0;
+    InductionParams p;
+    induction_params_from_rating(&p, m->rated_voltage, m->rated_current, m->rated_freq, m->rated_rpm);
+    induction_init(&m->im, &p);
+    control_init(&m->ctrl);
+    memset(&m->tick, 0, sizeof(m->tick));
+    m->thermal_model = THERMAL_LINEAR;
+    ThermalParams tp;
+    thermal_params_from_rating(&tp, copper_loss(m, m->rated_current));
+    thermal_init(&m->thermal, &tp);
+}
+
+void set_motor_params(MotorState *m, double voltage, double current, double freq, double rpm) {
+    m->rated_voltage = voltage;
+    m->rated_current = current;
+    m->rated_freq = freq;
+    m->rated_rpm = rpm;
+    InductionParams p;
+    induction_params_from_rating(&p, voltage, current, freq, rpm);
+    if (memcmp(&p, &m->im.params, sizeof(p)) != 0) {
+        m->im.params = p;
+        m->im.cache_valid = 0;
+    }
+    ThermalParams tp;
+    thermal_params_from_rating(&tp, copper_loss(m, current));
+    thermal_set_params(&m->thermal, &tp);
+}
+
+void set_drive_params(MotorState *m, double ramp_up_in, double ramp_down_in, double max_freq_in, double min_freq_in) {
+    m->ramp_up = ramp_up_in;
+    m->ramp_down = ramp_down_in;
+    m->max_freq = max_freq_in;
+    m->min_freq = min_freq_in;
+}
+
+void set_motor_model(MotorState *m, MotorModel model, Integrator integrator, int substeps, double dt) {
+    m->model = model;
+    m->integrator = integrator;
+    m->substeps = substeps > 0 ? substeps : 1;
+    m->dt = dt;
+}
+
+void set_motor_load(MotorState *m, double load_torque) {
+    m->load_torque = load_torque;
+}
+
+// Moves the dq model to a frame at angle, leaving the machine untouched.
+static void rotate_frame(MotorState *m, double angle) {
+    double c = cos(angle - m->frame_angle), s = sin(angle - m->frame_angle);
+    double *pairs[3][2] = { { &m->im.psi_ds, &m->im.psi_qs }, { &m->im.psi_dr, &m->im.psi_qr }, { &m->im.ids, &m->im.iqs } };
+    for (int k = 0; k < 3; k++) {
+        double d = *pairs[k][0], q = *pairs[k][1];
+        *pairs[k][0] = c * d + s * q;
+        *pairs[k][1] = -s * d + c * q;
+    }
+    m->frame_angle = remainder(angle, 2.0 * M_PI);
+}
+
+// Switching takes over a spinning machine. A closed-loop controller starts
+// with its estimators on the machine's flux; V/f resumes at the controller's
+// field frequency with the frame's d axis on the stator flux, where its
+// voltage vector leads the flux as in steady state.
+void set_motor_control(MotorState *m, ControlMode mode, double rate) {
+    ControlState *c = &m->ctrl;
+    c->rate = rate;
+    if (mode == c->mode) return;
+    c->mode = mode;
+    if (mode == CONTROL_VF) {
+        m->drive_freq = c->omega_e / (2.0 * M_PI);
+        rotate_frame(m, m->frame_angle + atan2(m->im.psi_qs, m->im.psi_ds));
+    } else {
+        double cs = cos(m->frame_angle), sn = sin(m->frame_angle);
+        double psi_s[2] = { cs * m->im.psi_ds - sn * m->im.psi_qs, sn * m->im.psi_ds + cs * m->im.psi_qs };
+        double psi_r[2] = { cs * m->im.psi_dr - sn * m->im.psi_qr, sn * m->im.psi_dr + cs * m->im.psi_qr };
+        control_reset(c, psi_s, psi_r, 2.0 * M_PI * m->drive_freq);
+    }
+}
+
+// The network picks up from the present temperature, winding and frame alike.
+void set_motor_thermal(MotorState *m, ThermalModel model) {
+    if (model == THERMAL_NETWORK && m->thermal_model != THERMAL_NETWORK) {
+        m->thermal.winding = m->temp;
+        m->thermal.frame = m->temp;
+    }
+    m->thermal_model = model;
+}
+
+// V/f: the phase voltage peak follows the output frequency up to rated,
+// with a boost at low speed, and is zero at standstill.
+static double vf_voltage(const MotorState *m, double f) {
+    if (f <= 0.0) return 0.0;
+    return m->rated_voltage * sqrt(2.0 / 3.0) * fmin(1.0, MOTOR_VF_BOOST + (1.0 - MOTOR_VF_BOOST) * f / m->rated_freq);
+}
+
+static void update_ramp(MotorState *m, double target_freq, int is_forward) {
+    double target_speed = (target_freq / m->rated_freq) * m->rated_rpm * (is_forward ? 1.0 : -1.0);
+    double accel = m->rated_rpm / m->ramp_up;
+    double decel = m->rated_rpm / m->ramp_down;
+    if (m->current_speed < target_speed) {
+        m->current_speed = fmin(m->current_speed + accel * m->dt, target_speed);
+    } else {
+        m->current_speed = fmax(m->current_speed - decel * m->dt, target_speed);
+    }
+    m->current_freq = fabs(m->current_speed / m->rated_rpm) * m->rated_freq;
+    m->torque = m->rated_current * m->rated_voltage / m->rated_rpm * fabs(m->current_speed);
+    m->current = m->rated_current * (m->current_freq / m->rated_freq);
+}
+
+// The ramp generator now shapes the V/f output frequency; speed, torque
+// and current follow from the machine model.
+static void ramp_drive_freq(MotorState *m, double target) {
+    double accel = m->rated_freq / m->ramp_up;
+    double decel = m->rated_freq / m->ramp_down;
+    if (m->drive_freq < target) {
+        m->drive_freq = fmin(m->drive_freq + accel * m->dt, target);
+    } else {
+        m->drive_freq = fmax(m->drive_freq - decel * m->dt, target);
+    }
+}
+
+static void machine_outputs(MotorState *m) {
+    m->current_speed = m->im.omega_r / m->im.params.pole_pairs * 60.0 / (2.0 * M_PI);
+    m->torque = m->im.torque;
+    m->current = sqrt(0.5 * (m->im.ids * m->im.ids + m->im.iqs * m->im.iqs));
+}
+
+// Ramps the V/f output and sets its voltage, the vector (0, voltage) of the frame.
+static void ramp_vf(MotorState *m, double target_freq, int is_forward) {
+    double target = target_freq * (is_forward ? 1.0 : -1.0);
+    // Stall prevention: hold the acceleration ramp while the current is over the limit
+    int moving_away = fabs(target) > fabs(m->drive_freq) && target * m->drive_freq >= 0.0;
+    if (moving_away && m->current > MOTOR_CURRENT_LIMIT * m->rated_current) {
+        target = m->drive_freq;
+    }
+    ramp_drive_freq(m, target);
+    m->current_freq = fabs(m->drive_freq);
+    m->voltage = vf_voltage(m, m->current_freq);
+}
+
+static void update_dq(MotorState *m, double target_freq, int is_forward) {
+    ramp_vf(m, target_freq, is_forward);
+    double omega = 2.0 * M_PI * m->drive_freq;
+    double h = m->dt / m->substeps;
+    for (int i = 0; i < m->substeps; i++) {
+        induction_step(&m->im, m->integrator, 0.0, m->voltage, omega, m->load_torque, h);
+    }
+    m->frame_angle = remainder(m->frame_angle + omega * m->dt, 2.0 * M_PI);
+    machine_outputs(m);
+}
+
+// The ramp shapes the speed reference instead, interpolated across the
+// dt * rate control periods of a tick as a drive's own ramp generator would.
+static void begin_closed_loop(MotorState *m, double target_freq, int is_forward) {
+    MotorTick *t = &m->tick;
+    t->ramp_from = m->drive_freq;
+    ramp_drive_freq(m, target_freq * (is_forward ? 1.0 : -1.0));
+    control_configure(&m->ctrl, &m->im.params, m->rated_voltage * sqrt(2.0 / 3.0), 2.0 * M_PI * m->rated_freq,
+                      MOTOR_CURRENT_LIMIT * m->rated_current * sqrt(2.0));
+    t->periods = (int)lround(m->dt * m->ctrl.rate);
+    if (t->periods < 1) t->periods = 1;
+    t->period = 0;
+    t->omega_sum = 0.0;
+    t->voltage_sum = 0.0;
+}
+
+// One controller period: the machine is stepped in a fixed frame, so the
+// controller's stationary-frame quantities are one rotation away. Returns
+// the voltage for the period in v.
+static void control_period(MotorState *m, double v[2]) {
+    MotorTick *t = &m->tick;
+    const InductionParams *p = &m->im.params;
+    ControlState *c = &m->ctrl;
+    double cs = cos(m->frame_angle), sn = sin(m->frame_angle);
+    // Phase current sensors and the encoder
+    double i_ab[2] = { cs * m->im.ids - sn * m->im.iqs, sn * m->im.ids + cs * m->im.iqs };
+    double i_abc[3];
+    control_inverse_clarke(i_ab, i_abc);
+    PROBE_BEGIN(PROBE_CONTROL);
+    double freq_ref = t->ramp_from + (m->drive_freq - t->ramp_from) * (t->period + 1) / t->periods;
+    control_step(c, i_abc, m->im.omega_r / p->pole_pairs, 2.0 * M_PI * freq_ref / p->pole_pairs,
+                 m->dt / t->periods, v);
+    PROBE_END(PROBE_CONTROL);
+    t->period++;
+    t->omega_sum += fabs(c->omega_e);
+    t->voltage_sum += hypot(v[0], v[1]);
+}
+
+// Output frequency as a drive displays it, and the voltage, averaged over the tick
+static void end_closed_loop(MotorState *m) {
+    m->current_freq = m->tick.omega_sum / m->tick.periods / (2.0 * M_PI);
+    m->voltage = m->tick.voltage_sum / m->tick.periods;
+    machine_outputs(m);
+}
+
+static void update_closed_loop(MotorState *m, double target_freq, int is_forward) {
+    begin_closed_loop(m, target_freq, is_forward);
+    double ts = m->dt / m->tick.periods;
+    double cs = cos(m->frame_angle), sn = sin(m->frame_angle);
+    while (m->tick.period < m->tick.periods) {
+        double v[2];
+        control_period(m, v);
+        induction_step(&m->im, m->integrator, cs * v[0] + sn * v[1], -sn * v[0] + cs * v[1], 0.0, m->load_torque, ts);
+    }
+    end_closed_loop(m);
+}
+
+static void update_temp(MotorState *m) {
+    if (m->thermal_model == THERMAL_NETWORK) {
+        thermal_step(&m->thermal, copper_loss(m, m->current), m->dt);
+        m->temp = m->thermal.winding;
     } else {
-        current_speed = fmax(current_speed - decel * 0.05, target_speed);
+        m->temp += m->current * MOTOR_TEMP_RISE * m->dt;
+        m->temp = fmax(25.0, m->temp);
     }
-    current_freq = fabs(current_speed / rated_rpm) * rated_freq;
-    torque = rated_current * rated_voltage / rated_rpm * fabs(current_speed);
-    current = rated_current * (current_freq / rated_freq);
-    temp += current * 0.01;
-    temp = fmax(25.0, temp);
 }
 
-double get_motor_current(void) {
-    return current;
+void update_motor(MotorState *m, double target_freq, int is_forward) {
+    target_freq = fmax(m->min_freq, fmin(m->max_freq, target_freq));
+    if (m->model == MOTOR_MODEL_RAMP) {
+        update_ramp(m, target_freq, is_forward);
+    } else if (m->ctrl.mode != CONTROL_VF) {
+        update_closed_loop(m, target_freq, is_forward);
+    } else {
+        update_dq(m, target_freq, is_forward);
+    }
+    update_temp(m);
 }
 
-double get_motor_speed(void) {
-    return current_speed;
+// SwitchingLoad of the dq machine: the leg voltages go through Clarke and
+// Park into its frame, which holds still for the tick.
+static void pwm_load(void *user_data, const double v[3], double h, double i[3]) {
+    MotorState *m = user_data;
+    double v_ab[2], v_dq[2], i_ab[2];
+    control_clarke(v, v_ab);
+    control_park(v_ab, m->frame_angle, v_dq);
+    induction_step_held(&m->im, v_dq[0], v_dq[1], m->load_torque, h);
+    double i_dq[2] = { m->im.ids, m->im.iqs };
+    control_inverse_park(i_dq, m->frame_angle, i_ab);
+    control_inverse_clarke(i_ab, i);
 }
 
-double get_motor_torque(void) {
-    return torque;
+// V/f hands the switching model its voltage vector at the frame angle,
+// turning at the output frequency, and moves the frame on at the end.
+void motor_pwm_begin(MotorState *m, double target_freq, int is_forward, SwitchingState *s) {
+    target_freq = fmax(m->min_freq, fmin(m->max_freq, target_freq));
+    m->tick.start = s->time;
+    // DTC picks inverter states, its zero vector all legs low, not voltages to modulate.
+    s->direct = m->ctrl.mode == CONTROL_DTC;
+    if (m->ctrl.mode != CONTROL_VF) {
+        begin_closed_loop(m, target_freq, is_forward);
+        return;
+    }
+    ramp_vf(m, target_freq, is_forward);
+    switching_set_reference(s, -m->voltage * sin(m->frame_angle), m->voltage * cos(m->frame_angle),
+                            2.0 * M_PI * m->drive_freq);
+}
+
+// Closed-loop, the controller runs at the start of each of its periods and
+// the switching model takes up its voltage from the next carrier period.
+void motor_pwm_run(MotorState *m, SwitchingState *s, const InverterState *inv, SwitchingMode mode, double fixed_dt,
+                   double until) {
+    MotorTick *t = &m->tick;
+    // The controllers are limited to the space-vector linear range, so they
+    // modulate that way whatever the V/f PWM mode.
+    InverterState at = *inv;
+    if (m->ctrl.mode != CONTROL_VF) at.pwm_mode = PWM_SPACE_VECTOR;
+    while (s->time < until) {
+        double next = until;
+        if (m->ctrl.mode != CONTROL_VF && t->period < t->periods) {
+            double due = t->start + m->dt * t->period / t->periods;
+            if (s->time >= due) {
+                double v[2];
+                control_period(m, v);
+                switching_set_reference(s, v[0], v[1], 0.0);
+                due = t->start + m->dt * t->period / t->periods;
+            }
+            next = fmin(until, due);
+        }
+        if (mode == SWITCHING_EVENT) switching_run(s, &at, next, pwm_load, m);
+        else switching_run_fixed(s, &at, next, fixed_dt, pwm_load, m);
+    }
+    machine_outputs(m);
+}
+
+void motor_pwm_end(MotorState *m) {
+    if (m->ctrl.mode != CONTROL_VF) end_closed_loop(m);
+    else rotate_frame(m, m->frame_angle + 2.0 * M_PI * m->drive_freq * m->dt);
+    machine_outputs(m);
+    update_temp(m);
+}
+
+double get_motor_current(const MotorState *m) {
+    return m->current;
+}
+
+double get_motor_speed(const MotorState *m) {
+    return m->current_speed;
+}
+
+double get_motor_torque(const MotorState *m) {
+    return m->torque;
+}
+
+double get_motor_temp(const MotorState *m) {
+    return m->temp;
+}
+
+// The ramp model has no windings to feed; it reads as running at V/f.
+double get_motor_voltage(const MotorState *m) {
+    return m->model == MOTOR_MODEL_RAMP ? vf_voltage(m, m->current_freq) : m->voltage;
+}
+
+double get_motor_rated_torque(const MotorState *m) {
+    return induction_rated_torque(&m->im.params, m->rated_voltage, m->rated_current, m->rated_freq);
+}
+
+// Only the temperature and the dq frame move on a settled drive, and both
+// have closed forms at constant current and frequency.
+void motor_advance(MotorState *m, long ticks) {
+    double span = (double)ticks * m->dt;
+    if (m->thermal_model == THERMAL_NETWORK) {
+        thermal_advance(&m->thermal, copper_loss(m, m->current), span);
+        m->temp = m->thermal.winding;
+    } else {
+        m->temp = fmax(25.0, m->temp + m->current * MOTOR_TEMP_RISE * span);
+    }
+    if (m->model == MOTOR_MODEL_DQ)
+        m->frame_angle = remainder(m->frame_angle + 2.0 * M_PI * m->drive_freq * span, 2.0 * M_PI);
 }
 
-double get_motor_temp(void) {
-    return temp;
+double motor_temp_crossing(const MotorState *m, double level) {
+    if (m->thermal_model == THERMAL_NETWORK) return thermal_time_to(&m->thermal, copper_loss(m, m->current), level);
+    // The linear model only ever heats.
+    double rate = m->current * MOTOR_TEMP_RISE;
+    if (level == m->temp) return 0.0;
+    return level > m->temp && rate > 0.0 ? (level - m->temp) / rate : HUGE_VAL;
 }
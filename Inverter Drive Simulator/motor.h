@@ -1,12 +1,91 @@
 #ifndef MOTOR_H
 #define MOTOR_H
 
-void set_motor_params(double rated_voltage, double rated_current, double rated_freq, double rated_rpm);
-void set_drive_params(double ramp_up, double ramp_down, double max_freq, double min_freq);
-void update_motor(double target_freq, int is_forward, double ramp_up, double ramp_down);
-double get_motor_current(void);
-double get_motor_speed(void);
-double get_motor_torque(void);
-double get_motor_temp(void);
+#include "induction.h"
+#include "control.h"
+#include "thermal.h"
+#include "switching.h"
+
+#define MOTOR_DT 0.05
+#define MOTOR_SUBSTEPS 50
+#define MOTOR_TEMP_RISE 0.2   // degC per A per second
+#define MOTOR_VF_BOOST 0.01   // V/f low-speed voltage boost (per unit)
+#define MOTOR_CURRENT_LIMIT 1.5 // ramp hold threshold (per unit of rated current)
+
+typedef enum {
+    MOTOR_MODEL_RAMP,
+    MOTOR_MODEL_DQ
+} MotorModel;
+
+// Bookkeeping of the tick in progress: the closed-loop controller's periods,
+// and the switching model's time when a PWM-fed tick began.
+typedef struct {
+    double start;        // s
+    double ramp_from;    // speed reference at the tick start (Hz)
+    int periods;         // controller periods in the tick
+    int period;          // controller periods run so far
+    double omega_sum;
+    double voltage_sum;
+} MotorTick;
+
+typedef struct {
+    double rated_voltage;
+    double rated_current;
+    double rated_freq;
+    double rated_rpm;
+    double ramp_up;
+    double ramp_down;
+    double max_freq;
+    double min_freq;
+    double current_speed;
+    double current_freq;
+    double torque;
+    double current;
+    double voltage;      // peak phase voltage applied, mean over the last tick (V); dq model
+    double temp;
+    MotorModel model;
+    Integrator integrator;
+    int substeps;
+    double dt;
+    double drive_freq;   // signed V/f output frequency (Hz), dq model only
+    double load_torque;  // Nm, dq model only
+    double frame_angle;  // angle of the dq model's reference frame (rad)
+    InductionState im;
+    ControlState ctrl;   // closed-loop controller, dq model only
+    MotorTick tick;
+    ThermalModel thermal_model;
+    ThermalState thermal;   // THERMAL_NETWORK only
+} MotorState;
+
+void motor_init(MotorState *m);
+void set_motor_params(MotorState *m, double rated_voltage, double rated_current, double rated_freq, double rated_rpm);
+void set_drive_params(MotorState *m, double ramp_up, double ramp_down, double max_freq, double min_freq);
+void set_motor_model(MotorState *m, MotorModel model, Integrator integrator, int substeps, double dt);
+void set_motor_load(MotorState *m, double load_torque);
+void set_motor_control(MotorState *m, ControlMode mode, double rate);
+void set_motor_thermal(MotorState *m, ThermalModel model);
+void update_motor(MotorState *m, double target_freq, int is_forward);
+double get_motor_current(const MotorState *m);
+double get_motor_speed(const MotorState *m);
+double get_motor_torque(const MotorState *m);
+double get_motor_temp(const MotorState *m);
+double get_motor_voltage(const MotorState *m);
+double get_motor_rated_torque(const MotorState *m);
+
+// A tick of the dq model fed through the switching model, in place of
+// update_motor: motor_pwm_begin sets the switching model's voltage
+// reference, motor_pwm_run advances both to until (once or in pieces, up
+// to the end of the tick), stepping the machine exactly between switching
+// instants, and motor_pwm_end completes the tick.
+void motor_pwm_begin(MotorState *m, double target_freq, int is_forward, SwitchingState *s);
+void motor_pwm_run(MotorState *m, SwitchingState *s, const InverterState *inv, SwitchingMode mode, double fixed_dt,
+                   double until);
+void motor_pwm_end(MotorState *m);
+
+// Fast-forward support. motor_advance moves a settled drive ticks on
+// without stepping it, and motor_temp_crossing gives the seconds until its
+// winding reaches level at the present current, HUGE_VAL if never.
+void motor_advance(MotorState *m, long ticks);
+double motor_temp_crossing(const MotorState *m, double level);
 
 #endif
@@ -0,0 +1,225 @@
+#include "motor_batch.h"
+#include <math.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define MOTOR_BATCH_X86 1
+#endif
+
+#define BATCH_ALIGN 32
+#define BATCH_FIELDS 15
+
+typedef void (*BatchKernel)(MotorBatch *b, int begin, int end);
+
+static void update_scalar(MotorBatch *b, int begin, int end) {
+    for (int i = begin; i < end; i++) {
+        double target_freq = fmax(b->min_freq[i], fmin(b->max_freq[i], b->target_freq[i]));
+        double target_speed = (target_freq / b->rated_freq[i]) * b->rated_rpm[i] * b->direction[i];
+        double accel = b->rated_rpm[i] / b->ramp_up[i];
+        double decel = b->rated_rpm[i] / b->ramp_down[i];
+        double speed = b->speed[i];
+        double up = fmin(speed + accel * b->dt, target_speed);
+        double down = fmax(speed - decel * b->dt, target_speed);
+        speed = speed < target_speed ? up : down;
+        double freq = fabs(speed / b->rated_rpm[i]) * b->rated_freq[i];
+        double current = b->rated_current[i] * (freq / b->rated_freq[i]);
+        b->speed[i] = speed;
+        b->freq[i] = freq;
+        b->torque[i] = b->rated_current[i] * b->rated_voltage[i] / b->rated_rpm[i] * fabs(speed);
+        b->current[i] = current;
+        b->temp[i] = fmax(25.0, b->temp[i] + current * MOTOR_TEMP_RISE * b->dt);
+    }
+}
+
+#ifdef MOTOR_BATCH_X86
+static void update_sse2(MotorBatch *b, int begin, int end) {
+    const __m128d dt = _mm_set1_pd(b->dt);
+    const __m128d temp_rise = _mm_set1_pd(MOTOR_TEMP_RISE);
+    const __m128d ambient = _mm_set1_pd(25.0);
+    const __m128d sign = _mm_set1_pd(-0.0);
+    int i = begin;
+    for (; i + 2 <= end; i += 2) {
+        __m128d rated_freq = _mm_loadu_pd(b->rated_freq + i);
+        __m128d rated_rpm = _mm_loadu_pd(b->rated_rpm + i);
+        __m128d rated_current = _mm_loadu_pd(b->rated_current + i);
+        __m128d target_freq = _mm_max_pd(_mm_loadu_pd(b->min_freq + i),
+                                         _mm_min_pd(_mm_loadu_pd(b->max_freq + i), _mm_loadu_pd(b->target_freq + i)));
+        __m128d target_speed = _mm_mul_pd(_mm_mul_pd(_mm_div_pd(target_freq, rated_freq), rated_rpm),
+                                          _mm_loadu_pd(b->direction + i));
+        __m128d accel = _mm_div_pd(rated_rpm, _mm_loadu_pd(b->ramp_up + i));
+        __m128d decel = _mm_div_pd(rated_rpm, _mm_loadu_pd(b->ramp_down + i));
+        __m128d speed = _mm_loadu_pd(b->speed + i);
+        __m128d up = _mm_min_pd(_mm_add_pd(speed, _mm_mul_pd(accel, dt)), target_speed);
+        __m128d down = _mm_max_pd(_mm_sub_pd(speed, _mm_mul_pd(decel, dt)), target_speed);
+        __m128d rising = _mm_cmplt_pd(speed, target_speed);
+        speed = _mm_or_pd(_mm_and_pd(rising, up), _mm_andnot_pd(rising, down));
+        __m128d abs_speed = _mm_andnot_pd(sign, speed);
+        __m128d freq = _mm_mul_pd(_mm_andnot_pd(sign, _mm_div_pd(speed, rated_rpm)), rated_freq);
+        __m128d current = _mm_mul_pd(rated_current, _mm_div_pd(freq, rated_freq));
+        __m128d torque = _mm_mul_pd(_mm_div_pd(_mm_mul_pd(rated_current, _mm_loadu_pd(b->rated_voltage + i)), rated_rpm),
+                                    abs_speed);
+        __m128d temp = _mm_add_pd(_mm_loadu_pd(b->temp + i), _mm_mul_pd(_mm_mul_pd(current, temp_rise), dt));
+        _mm_storeu_pd(b->speed + i, speed);
+        _mm_storeu_pd(b->freq + i, freq);
+        _mm_storeu_pd(b->torque + i, torque);
+        _mm_storeu_pd(b->current + i, current);
+        _mm_storeu_pd(b->temp + i, _mm_max_pd(ambient, temp));
+    }
+    update_scalar(b, i, end);
+}
+
+__attribute__((target("avx2")))
+static void update_avx2(MotorBatch *b, int begin, int end) {
+    const __m256d dt = _mm256_set1_pd(b->dt);
+    const __m256d temp_rise = _mm256_set1_pd(MOTOR_TEMP_RISE);
+    const __m256d ambient = _mm256_set1_pd(25.0);
+    const __m256d sign = _mm256_set1_pd(-0.0);
+    int i = begin;
+    for (; i + 4 <= end; i += 4) {
+        __m256d rated_freq = _mm256_loadu_pd(b->rated_freq + i);
+        __m256d rated_rpm = _mm256_loadu_pd(b->rated_rpm + i);
+        __m256d rated_current = _mm256_loadu_pd(b->rated_current + i);
+        __m256d target_freq = _mm256_max_pd(_mm256_loadu_pd(b->min_freq + i),
+                                            _mm256_min_pd(_mm256_loadu_pd(b->max_freq + i), _mm256_loadu_pd(b->target_freq + i)));
+        __m256d target_speed = _mm256_mul_pd(_mm256_mul_pd(_mm256_div_pd(target_freq, rated_freq), rated_rpm),
+                                             _mm256_loadu_pd(b->direction + i));
+        __m256d accel = _mm256_div_pd(rated_rpm, _mm256_loadu_pd(b->ramp_up + i));
+        __m256d decel = _mm256_div_pd(rated_rpm, _mm256_loadu_pd(b->ramp_down + i));
+        __m256d speed = _mm256_loadu_pd(b->speed + i);
+        __m256d up = _mm256_min_pd(_mm256_add_pd(speed, _mm256_mul_pd(accel, dt)), target_speed);
+        __m256d down = _mm256_max_pd(_mm256_sub_pd(speed, _mm256_mul_pd(decel, dt)), target_speed);
+        __m256d rising = _mm256_cmp_pd(speed, target_speed, _CMP_LT_OQ);
+        speed = _mm256_blendv_pd(down, up, rising);
+        __m256d abs_speed = _mm256_andnot_pd(sign, speed);
+        __m256d freq = _mm256_mul_pd(_mm256_andnot_pd(sign, _mm256_div_pd(speed, rated_rpm)), rated_freq);
+        __m256d current = _mm256_mul_pd(rated_current, _mm256_div_pd(freq, rated_freq));
+        __m256d torque = _mm256_mul_pd(_mm256_div_pd(_mm256_mul_pd(rated_current, _mm256_loadu_pd(b->rated_voltage + i)), rated_rpm),
+                                       abs_speed);
+        __m256d temp = _mm256_add_pd(_mm256_loadu_pd(b->temp + i), _mm256_mul_pd(_mm256_mul_pd(current, temp_rise), dt));
+        _mm256_storeu_pd(b->speed + i, speed);
+        _mm256_storeu_pd(b->freq + i, freq);
+        _mm256_storeu_pd(b->torque + i, torque);
+        _mm256_storeu_pd(b->current + i, current);
+        _mm256_storeu_pd(b->temp + i, _mm256_max_pd(ambient, temp));
+    }
+    update_scalar(b, i, end);
+}
+#endif
+
+// The selection is global and may be made from any thread; the kernel
+// follows from the one atomic, so it never disagrees with the ISA.
+static atomic_int active_isa = MOTOR_BATCH_AUTO;   // AUTO until selected
+
+static BatchKernel isa_kernel(MotorBatchIsa isa) {
+    switch (isa) {
+#ifdef MOTOR_BATCH_X86
+        case MOTOR_BATCH_AVX2: return update_avx2;
+        case MOTOR_BATCH_SSE2: return update_sse2;
+#endif
+        default: return update_scalar;
+    }
+}
+
+static MotorBatchIsa detect_isa(void) {
+#ifdef MOTOR_BATCH_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return MOTOR_BATCH_AVX2;
+    if (__builtin_cpu_supports("sse2")) return MOTOR_BATCH_SSE2;
+#endif
+    return MOTOR_BATCH_SCALAR;
+}
+
+MotorBatchIsa motor_batch_select(MotorBatchIsa isa) {
+    MotorBatchIsa best = detect_isa();
+    if (isa == MOTOR_BATCH_AUTO || isa > best) isa = best;
+    atomic_store_explicit(&active_isa, isa, memory_order_relaxed);
+    return isa;
+}
+
+const char *motor_batch_isa_name(MotorBatchIsa isa) {
+    switch (isa) {
+        case MOTOR_BATCH_SCALAR: return "scalar";
+        case MOTOR_BATCH_SSE2: return "sse2";
+        case MOTOR_BATCH_AVX2: return "avx2";
+        default: return "auto";
+    }
+}
+
+void motor_batch_update(MotorBatch *b) {
+    MotorBatchIsa isa = atomic_load_explicit(&active_isa, memory_order_relaxed);
+    if (isa == MOTOR_BATCH_AUTO) isa = motor_batch_select(MOTOR_BATCH_AUTO);
+    isa_kernel(isa)(b, 0, b->count);
+}
+
+MotorBatch *motor_batch_create(int count) {
+    if (count <= 0) return NULL;
+    MotorBatch *b = calloc(1, sizeof(MotorBatch));
+    if (!b) return NULL;
+    // One allocation, each field padded to a whole number of 32-byte vectors.
+    size_t stride = ((size_t)count + 3) & ~(size_t)3;
+    double *block = aligned_alloc(BATCH_ALIGN, stride * BATCH_FIELDS * sizeof(double));
+    if (!block) {
+        free(b);
+        return NULL;
+    }
+    memset(block, 0, stride * BATCH_FIELDS * sizeof(double));
+    double **fields[BATCH_FIELDS] = {
+        &b->rated_voltage, &b->rated_current, &b->rated_freq, &b->rated_rpm,
+        &b->ramp_up, &b->ramp_down, &b->max_freq, &b->min_freq,
+        &b->speed, &b->freq, &b->torque, &b->current, &b->temp,
+        &b->target_freq, &b->direction
+    };
+    for (int f = 0; f < BATCH_FIELDS; f++) *fields[f] = block + f * stride;
+    b->count = count;
+    b->dt = MOTOR_DT;
+    MotorState m;
+    motor_init(&m);
+    m.model = MOTOR_MODEL_RAMP;
+    for (int i = 0; i < count; i++) {
+        motor_batch_load(b, i, &m);
+        b->direction[i] = 1.0;
+    }
+    return b;
+}
+
+void motor_batch_destroy(MotorBatch *b) {
+    if (!b) return;
+    free(b->rated_voltage);
+    free(b);
+}
+
+int motor_batch_load(MotorBatch *b, int index, const MotorState *m) {
+    if (m->model != MOTOR_MODEL_RAMP || m->thermal_model != THERMAL_LINEAR) return 0;
+    b->rated_voltage[index] = m->rated_voltage;
+    b->rated_current[index] = m->rated_current;
+    b->rated_freq[index] = m->rated_freq;
+    b->rated_rpm[index] = m->rated_rpm;
+    b->ramp_up[index] = m->ramp_up;
+    b->ramp_down[index] = m->ramp_down;
+    b->max_freq[index] = m->max_freq;
+    b->min_freq[index] = m->min_freq;
+    b->speed[index] = m->current_speed;
+    b->freq[index] = m->current_freq;
+    b->torque[index] = m->torque;
+    b->current[index] = m->current;
+    b->temp[index] = m->temp;
+    return 1;
+}
+
+void motor_batch_store(const MotorBatch *b, int index, MotorState *m) {
+    m->rated_voltage = b->rated_voltage[index];
+    m->rated_current = b->rated_current[index];
+    m->rated_freq = b->rated_freq[index];
+    m->rated_rpm = b->rated_rpm[index];
+    m->ramp_up = b->ramp_up[index];
+    m->ramp_down = b->ramp_down[index];
+    m->max_freq = b->max_freq[index];
+    m->min_freq = b->min_freq[index];
+    m->current_speed = b->speed[index];
+    m->current_freq = b->freq[index];
+    m->torque = b->torque[index];
+    m->current = b->current[index];
+    m->temp = b->temp[index];
+}
@@ -0,0 +1,51 @@
+#ifndef MOTOR_BATCH_H
+#define MOTOR_BATCH_H
+
+#include "motor.h"
+
+// Structure-of-arrays form of MotorState for stepping many drives of the
+// MOTOR_MODEL_RAMP kind in one call, all with the same step dt.
+// motor_batch_update performs exactly the operations of update_motor
+// in the same order, so every ISA produces bit-identical results to the
+// scalar path as long as the scalar build does not contract a*b+c into FMA
+// (the default for x86-64 without -mfma; use -ffp-contract=off otherwise).
+// Inputs must be finite: like the C fmin/fmax the vector min/max only
+// disagree on NaN operands. motor_batch_load returns 0 for a state the
+// kernels cannot step: another motor model or the thermal network.
+
+typedef enum {
+    MOTOR_BATCH_AUTO,
+    MOTOR_BATCH_SCALAR,
+    MOTOR_BATCH_SSE2,
+    MOTOR_BATCH_AVX2
+} MotorBatchIsa;
+
+typedef struct {
+    int count;
+    double dt;
+    double *rated_voltage;
+    double *rated_current;
+    double *rated_freq;
+    double *rated_rpm;
+    double *ramp_up;
+    double *ramp_down;
+    double *max_freq;
+    double *min_freq;
+    double *speed;
+    double *freq;
+    double *torque;
+    double *current;
+    double *temp;
+    double *target_freq;
+    double *direction;   // +1.0 forward, -1.0 reverse
+} MotorBatch;
+
+MotorBatch *motor_batch_create(int count);
+void motor_batch_destroy(MotorBatch *b);
+int motor_batch_load(MotorBatch *b, int index, const MotorState *m);
+void motor_batch_store(const MotorBatch *b, int index, MotorState *m);
+void motor_batch_update(MotorBatch *b);
+MotorBatchIsa motor_batch_select(MotorBatchIsa isa);
+const char *motor_batch_isa_name(MotorBatchIsa isa);
+
+#endif
@@ -0,0 +1,197 @@
+#ifndef NUMERIC_H
+#define NUMERIC_H
+
+#include <math.h>
+#include <stdint.h>
+
+// Scalar type of the numeric kernels, fixed when the including file is
+// compiled: NUMERIC_TYPE picks double, float, or Q31/Q15 fixed point with
+// saturating arithmetic. Fixed-point values are per unit of a full scale
+// chosen by the kernel, in [-1, 1). Besides num_t every type provides
+//   num_acc_t   an accumulator for squares and long sums (Q31 in 64 bits
+//               for the fixed types, as a multiply-accumulate unit keeps it)
+//   num_coef_t  a constant factor of magnitude below 1, held with its own
+//               exponent in fixed point so small factors keep their precision
+// Conversions from double are meant for setup, not the hot loop.
+
+#define NUMERIC_DOUBLE 0
+#define NUMERIC_FLOAT 1
+#define NUMERIC_Q31 2
+#define NUMERIC_Q15 3
+
+#ifndef NUMERIC_TYPE
+#define NUMERIC_TYPE NUMERIC_DOUBLE
+#endif
+
+#define NUM_SIN_BITS 12
+#define NUM_SIN_SIZE (1 << NUM_SIN_BITS)
+#define NUM_SIN_FRAC_BITS (32 - NUM_SIN_BITS)
+
+#if NUMERIC_TYPE == NUMERIC_DOUBLE || NUMERIC_TYPE == NUMERIC_FLOAT
+
+#if NUMERIC_TYPE == NUMERIC_DOUBLE
+typedef double num_t;
+#define NUM_SUFFIX double
+#define NUM_TYPE_NAME "double"
+#else
+typedef float num_t;
+#define NUM_SUFFIX float
+#define NUM_TYPE_NAME "float"
+#endif
+typedef num_t num_acc_t;
+typedef num_t num_coef_t;
+
+static inline num_t num_from_double(double x) { return (num_t)x; }
+static inline double num_to_double(num_t x) { return x; }
+static inline num_acc_t num_acc_from_double(double x) { return (num_t)x; }
+static inline num_coef_t num_coef_from_double(double x) { return (num_t)x; }
+
+static inline num_t num_add(num_t a, num_t b) { return a + b; }
+static inline num_t num_sub(num_t a, num_t b) { return a - b; }
+static inline num_t num_mul(num_t a, num_t b) { return a * b; }
+static inline num_t num_mul_coef(num_t a, num_coef_t c) { return a * c; }
+static inline num_t num_neg(num_t a) { return -a; }
+static inline num_t num_half(num_t a) { return a * (num_t)0.5; }
+static inline num_t num_abs(num_t a) { return a < 0 ? -a : a; }
+static inline num_t num_min(num_t a, num_t b) { return b < a ? b : a; }
+static inline num_t num_max(num_t a, num_t b) { return b > a ? b : a; }
+
+static inline num_acc_t num_sq(num_t a) { return a * a; }
+static inline num_acc_t num_acc_mul_coef(num_acc_t a, num_coef_t c) { return a * c; }
+
+// Triangle carrier at position pos (a 2^-32 fraction of its period):
+// +1 at the period ends, -1 in the middle.
+static inline num_t num_carrier(uint32_t pos) {
+    num_t x = (num_t)pos * (num_t)(1.0 / 4294967296.0);
+    return (num_t)4.0 * num_abs(x - (num_t)0.5) - (num_t)1.0;
+}
+
+static inline num_t num_sin_frac(uint32_t phase) {
+    return (num_t)(phase & ((1u << NUM_SIN_FRAC_BITS) - 1)) * (num_t)(1.0 / (1u << NUM_SIN_FRAC_BITS));
+}
+
+#else
+
+#if NUMERIC_TYPE == NUMERIC_Q31
+typedef int32_t num_t;
+typedef int64_t num_wide_t;
+#define NUM_FRAC_BITS 31
+#define NUM_SUFFIX q31
+#define NUM_TYPE_NAME "q31"
+#elif NUMERIC_TYPE == NUMERIC_Q15
+typedef int16_t num_t;
+typedef int32_t num_wide_t;
+#define NUM_FRAC_BITS 15
+#define NUM_SUFFIX q15
+#define NUM_TYPE_NAME "q15"
+#else
+#error "NUMERIC_TYPE must be NUMERIC_DOUBLE, NUMERIC_FLOAT, NUMERIC_Q31 or NUMERIC_Q15"
+#endif
+
+#define NUM_ONE ((num_wide_t)1 << NUM_FRAC_BITS)
+#define NUM_MAX (NUM_ONE - 1)
+#define NUM_MIN (-NUM_ONE)
+
+typedef int64_t num_acc_t;                          // Q31
+typedef struct { int32_t m; int shift; } num_coef_t;  // m 2^-31 2^-shift, shift 0..31
+
+static inline num_t num_sat(num_wide_t x) {
+    return (num_t)(x > NUM_MAX ? NUM_MAX : x < NUM_MIN ? NUM_MIN : x);
+}
+
+static inline num_t num_from_double(double x) {
+    double v = x * (double)NUM_ONE;
+    if (v >= (double)NUM_MAX) return (num_t)NUM_MAX;
+    if (v <= (double)NUM_MIN) return (num_t)NUM_MIN;
+    return (num_t)(num_wide_t)(v < 0 ? v - 0.5 : v + 0.5);
+}
+
+static inline double num_to_double(num_t x) { return x * (1.0 / (double)NUM_ONE); }
+
+static inline num_acc_t num_acc_from_double(double x) {
+    double v = x * 2147483648.0;
+    return (num_acc_t)(v < 0 ? v - 0.5 : v + 0.5);
+}
+
+// Factors of 2^-32 or less round to zero, 1 and above saturate.
+static inline num_coef_t num_coef_from_double(double x) {
+    num_coef_t c = { 0, 0 };
+    int e;
+    double f = frexp(x, &e);
+    if (x == 0.0 || -e > 31) return c;
+    if (e > 0) {
+        c.m = x > 0 ? INT32_MAX : INT32_MIN;
+        return c;
+    }
+    double m = f * 2147483648.0;
+    c.m = m >= 2147483647.0 ? INT32_MAX : (int32_t)(m < 0 ? m - 0.5 : m + 0.5);
+    c.shift = -e;
+    return c;
+}
+
+static inline num_t num_add(num_t a, num_t b) { return num_sat((num_wide_t)a + b); }
+static inline num_t num_sub(num_t a, num_t b) { return num_sat((num_wide_t)a - b); }
+
+static inline num_t num_mul(num_t a, num_t b) {
+    num_wide_t p = (num_wide_t)a * b;
+    return num_sat((p + ((num_wide_t)1 << (NUM_FRAC_BITS - 1))) >> NUM_FRAC_BITS);
+}
+
+static inline num_t num_mul_coef(num_t a, num_coef_t c) {
+    int s = 31 + c.shift;
+    int64_t p = (int64_t)a * c.m;
+    return num_sat((num_wide_t)((p + ((int64_t)1 << (s - 1))) >> s));
+}
+
+static inline num_t num_neg(num_t a) { return num_sat(-(num_wide_t)a); }
+static inline num_t num_half(num_t a) { return (num_t)(a >> 1); }
+static inline num_t num_abs(num_t a) { return a < 0 ? num_neg(a) : a; }
+static inline num_t num_min(num_t a, num_t b) { return b < a ? b : a; }
+static inline num_t num_max(num_t a, num_t b) { return b > a ? b : a; }
+
+static inline num_acc_t num_sq(num_t a) {
+#if NUM_FRAC_BITS == 31
+    return ((int64_t)a * a + ((int64_t)1 << 30)) >> 31;
+#else
+    return (int64_t)((num_wide_t)a * a) << (31 - 2 * NUM_FRAC_BITS);
+#endif
+}
+
+// a must be within [-1, 1], as a difference of squares is.
+static inline num_acc_t num_acc_mul_coef(num_acc_t a, num_coef_t c) {
+    int s = 31 + c.shift;
+    return (a * c.m + ((int64_t)1 << (s - 1))) >> s;
+}
+
+static inline num_t num_carrier(uint32_t pos) {
+#if NUM_FRAC_BITS == 31
+    num_wide_t d = 2 * (num_wide_t)pos - ((num_wide_t)1 << 32);
+#else
+    num_wide_t d = (num_wide_t)(pos >> (30 - NUM_FRAC_BITS)) - 2 * NUM_ONE;
+#endif
+    return num_sat((d < 0 ? -d : d) - NUM_ONE);
+}
+
+static inline num_t num_sin_frac(uint32_t phase) {
+    uint32_t frac = phase & ((1u << NUM_SIN_FRAC_BITS) - 1);
+#if NUM_FRAC_BITS > NUM_SIN_FRAC_BITS
+    return (num_t)(frac << (NUM_FRAC_BITS - NUM_SIN_FRAC_BITS));
+#else
+    return (num_t)(frac >> (NUM_SIN_FRAC_BITS - NUM_FRAC_BITS));
+#endif
+}
+
+#endif
+
+// Linear interpolation in a table of NUM_SIN_SIZE + 1 entries over one
+// period, indexed by a 2^-32 fraction of a turn.
+static inline num_t num_sin(const num_t *table, uint32_t phase) {
+    uint32_t idx = phase >> NUM_SIN_FRAC_BITS;
+    return num_add(table[idx], num_mul(num_sub(table[idx + 1], table[idx]), num_sin_frac(phase)));
+}
+
+#define NUM_CAT2(a, b) a##_##b
+#define NUM_CAT(a, b) NUM_CAT2(a, b)
+#define NUM_NAME(name) NUM_CAT(name, NUM_SUFFIX)
+
+#endif
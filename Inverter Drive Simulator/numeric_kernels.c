@@ -0,0 +1,323 @@
+#include "numeric_kernels.h"
+#include "numeric.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define SPEED_HEADROOM 1.25    // full scale over the fastest speed a drive can reach
+#define TEMP_BASE 256.0        // C at full scale
+#define SIGNAL_HEADROOM 2.0    // full scale over a signal's highest threshold
+#define PHASE_120 0x55555555u
+#define PHASE_240 0xAAAAAAABu
+
+// One extra entry so interpolation never wraps.
+static num_t sine_table[NUM_SIN_SIZE + 1];
+
+__attribute__((constructor))
+static void init_sine_table(void) {
+    for (int i = 0; i <= NUM_SIN_SIZE; i++) {
+        sine_table[i] = num_from_double(sin(2.0 * M_PI * i / NUM_SIN_SIZE));
+    }
+}
+
+// Per unit of the speed base, the ramp model's frequency, torque and current
+// all equal |speed|, so only speed and temperature are carried; the bases
+// turn them back into physical units.
+struct NumRamp {
+    int count;
+    num_t ambient;
+    num_t *speed;
+    num_t *temp;
+    num_t *target;          // requested frequency
+    num_t *min_freq;
+    num_t *max_freq;
+    num_t *accel;           // per tick
+    num_t *decel;
+    num_coef_t *heating;    // temperature rise per tick per unit of |speed|
+    uint8_t *forward;
+    double *speed_base;     // rpm
+    double *freq_base;
+    double *torque_base;
+    double *current_base;
+};
+
+static void ramp_destroy(NumRamp *r) {
+    if (!r) return;
+    free(r->speed);
+    free(r->temp);
+    free(r->target);
+    free(r->min_freq);
+    free(r->max_freq);
+    free(r->accel);
+    free(r->decel);
+    free(r->heating);
+    free(r->forward);
+    free(r->speed_base);
+    free(r->freq_base);
+    free(r->torque_base);
+    free(r->current_base);
+    free(r);
+}
+
+static NumRamp *ramp_create(const MotorState *drives, const double *target_freq, const int *is_forward, int count) {
+    NumRamp *r = calloc(1, sizeof(*r));
+    if (!r) return NULL;
+    size_t n = count > 0 ? (size_t)count : 1;
+    r->count = count;
+    r->speed = calloc(n, sizeof(num_t));
+    r->temp = calloc(n, sizeof(num_t));
+    r->target = calloc(n, sizeof(num_t));
+    r->min_freq = calloc(n, sizeof(num_t));
+    r->max_freq = calloc(n, sizeof(num_t));
+    r->accel = calloc(n, sizeof(num_t));
+    r->decel = calloc(n, sizeof(num_t));
+    r->heating = calloc(n, sizeof(num_coef_t));
+    r->forward = calloc(n, 1);
+    r->speed_base = calloc(n, sizeof(double));
+    r->freq_base = calloc(n, sizeof(double));
+    r->torque_base = calloc(n, sizeof(double));
+    r->current_base = calloc(n, sizeof(double));
+    if (!r->speed || !r->temp || !r->target || !r->min_freq || !r->max_freq || !r->accel || !r->decel ||
+        !r->heating || !r->forward || !r->speed_base || !r->freq_base || !r->torque_base || !r->current_base) {
+        ramp_destroy(r);
+        return NULL;
+    }
+    r->ambient = num_from_double(25.0 / TEMP_BASE);
+    for (int i = 0; i < count; i++) {
+        const MotorState *m = &drives[i];
+        double top = fmax(fabs(m->current_speed), m->max_freq / m->rated_freq * m->rated_rpm);
+        double speed_base = top * SPEED_HEADROOM;
+        double freq_base = speed_base / m->rated_rpm * m->rated_freq;
+        double current_base = m->rated_current * freq_base / m->rated_freq;
+        r->speed_base[i] = speed_base;
+        r->freq_base[i] = freq_base;
+        r->torque_base[i] = m->rated_current * m->rated_voltage / m->rated_rpm * speed_base;
+        r->current_base[i] = current_base;
+        r->speed[i] = num_from_double(m->current_speed / speed_base);
+        r->temp[i] = num_from_double(m->temp / TEMP_BASE);
+        r->target[i] = num_from_double(target_freq[i] / freq_base);
+        r->min_freq[i] = num_from_double(m->min_freq / freq_base);
+        r->max_freq[i] = num_from_double(m->max_freq / freq_base);
+        r->accel[i] = num_from_double(m->rated_rpm / m->ramp_up * m->dt / speed_base);
+        r->decel[i] = num_from_double(m->rated_rpm / m->ramp_down * m->dt / speed_base);
+        r->heating[i] = num_coef_from_double(current_base * MOTOR_TEMP_RISE * m->dt / TEMP_BASE);
+        r->forward[i] = is_forward[i] != 0;
+    }
+    return r;
+}
+
+// update_ramp and the temperature update of update_motor; the target clamp
+// is hoisted since the targets stay fixed.
+static void ramp_update(NumRamp *r, int steps) {
+    for (int i = 0; i < r->count; i++) {
+        num_t target = num_max(r->min_freq[i], num_min(r->max_freq[i], r->target[i]));
+        if (!r->forward[i]) target = num_neg(target);
+        num_t accel = r->accel[i], decel = r->decel[i], ambient = r->ambient;
+        num_coef_t heating = r->heating[i];
+        num_t speed = r->speed[i], temp = r->temp[i];
+        for (int k = 0; k < steps; k++) {
+            if (speed < target) {
+                speed = num_min(num_add(speed, accel), target);
+            } else {
+                speed = num_max(num_sub(speed, decel), target);
+            }
+            temp = num_max(ambient, num_add(temp, num_mul_coef(num_abs(speed), heating)));
+        }
+        r->speed[i] = speed;
+        r->temp[i] = temp;
+    }
+}
+
+static void ramp_store(const NumRamp *r, int index, MotorState *m) {
+    double speed = num_to_double(r->speed[index]);
+    m->current_speed = speed * r->speed_base[index];
+    m->current_freq = fabs(speed) * r->freq_base[index];
+    m->torque = fabs(speed) * r->torque_base[index];
+    m->current = fabs(speed) * r->current_base[index];
+    m->temp = num_to_double(r->temp[index]) * TEMP_BASE;
+}
+
+static void leg_references(num_t m, PwmMode mode, uint32_t phase, num_t ref[3]) {
+    num_t a = num_mul(m, num_sin(sine_table, phase));
+    num_t b = num_mul(m, num_sin(sine_table, phase - PHASE_120));
+    num_t c = num_mul(m, num_sin(sine_table, phase - PHASE_240));
+    num_t zero = 0;
+    if (mode == PWM_THIRD_HARMONIC) {
+        zero = num_mul(num_mul(m, num_sin(sine_table, phase * 3u)), num_from_double(1.0 / 6.0));
+    } else if (mode == PWM_SPACE_VECTOR) {
+        zero = num_neg(num_add(num_half(num_max(a, num_max(b, c))), num_half(num_min(a, num_min(b, c)))));
+    }
+    ref[0] = num_add(a, zero);
+    ref[1] = num_add(b, zero);
+    ref[2] = num_add(c, zero);
+}
+
+// pwm_generate's regular sampling with the carrier position in 32.32 fixed
+// point from the first sample's period. Each chunk takes its position from
+// the absolute carrier position, so the whole periods, however many pass
+// between two samples, set the fundamental phase; within the chunk the
+// fraction drives the carrier.
+static void pwm_generate_num(const InverterState *inv, double time, double dt, int samples, PwmOutput *out) {
+    double fc = inv->carrier_freq;
+    double carrier_pos = time * fc;
+    double period0 = floor(carrier_pos);
+    uint32_t phase0 = pwm_phase(inv->freq * period0 / fc);
+    uint32_t phase_step = pwm_phase(inv->freq / fc);
+    double x_step = dt * fc;
+    uint64_t pos_step = ((uint64_t)floor(x_step) << 32) + pwm_phase(x_step);
+    if (pos_step == 0) pos_step = 1;
+    uint32_t frac_step = (uint32_t)pos_step;
+    num_t m = num_from_double(inv->mod_index);
+    int i = 0;
+    while (i < samples) {
+        double x = carrier_pos + i * x_step - period0;
+        uint64_t pos = ((uint64_t)floor(x) << 32) + pwm_phase(x);
+        uint32_t phase = phase0 + (uint32_t)(pos >> 32) * phase_step;
+        uint32_t frac = (uint32_t)pos;
+        num_t ref[3];
+        leg_references(m, inv->pwm_mode, phase, ref);
+        uint64_t left = ((1ull << 32) - frac + pos_step - 1) / pos_step;
+        int n = (uint64_t)(samples - i) < left ? samples - i : (int)left;
+        num_t ra = ref[0], rb = ref[1], rc = ref[2];
+        uint8_t *restrict la = out->leg_a + i;
+        uint8_t *restrict lb = out->leg_b + i;
+        uint8_t *restrict lc = out->leg_c + i;
+        for (int j = 0; j < n; j++) {
+            num_t tri = num_carrier(frac + (uint32_t)j * frac_step);
+            la[j] = ra > tri;
+            lb[j] = rb > tri;
+            lc[j] = rc > tri;
+        }
+        i += n;
+    }
+}
+
+// An I2T rule integrates (x^2 - pickup^2) dt / limit in per unit of its
+// signal's full scale, so it trips at 1. Debounce counts samples.
+typedef struct {
+    FaultSignal signal;
+    FaultRuleKind kind;
+    num_t threshold;
+    num_acc_t pickup_sq;
+    num_coef_t heating;
+    num_acc_t limit;
+    int debounce;
+} NumRule;
+
+struct NumFault {
+    int num_rules;
+    int trip_rule;
+    NumRule rules[FAULT_MAX_RULES];
+    num_acc_t i2t[FAULT_MAX_RULES];
+    int held[FAULT_MAX_RULES];
+    int count;
+    num_t *signals;   // count samples of FAULT_SIGNAL_COUNT
+};
+
+static NumFault *fault_create(const FaultRule *rules, int num_rules, double dt,
+                              const double (*signals)[FAULT_SIGNAL_COUNT], int count) {
+    if (num_rules < 0 || num_rules > FAULT_MAX_RULES || dt <= 0.0) return NULL;
+    double base[FAULT_SIGNAL_COUNT];
+    for (int s = 0; s < FAULT_SIGNAL_COUNT; s++) base[s] = 0.0;
+    for (int i = 0; i < num_rules; i++) {
+        if (rules[i].kind == FAULT_RULE_RMS_ABOVE) return NULL;
+        base[rules[i].signal] = fmax(base[rules[i].signal], fabs(rules[i].threshold) * SIGNAL_HEADROOM);
+    }
+    for (int s = 0; s < FAULT_SIGNAL_COUNT; s++) {
+        if (base[s] == 0.0) base[s] = 1.0;
+    }
+    NumFault *f = calloc(1, sizeof(*f));
+    if (!f) return NULL;
+    f->signals = malloc(sizeof(num_t) * FAULT_SIGNAL_COUNT * (size_t)(count > 0 ? count : 1));
+    if (!f->signals) {
+        free(f);
+        return NULL;
+    }
+    f->num_rules = num_rules;
+    f->trip_rule = -1;
+    f->count = count;
+    for (int i = 0; i < num_rules; i++) {
+        const FaultRule *r = &rules[i];
+        NumRule *q = &f->rules[i];
+        double th = r->threshold / base[r->signal];
+        q->signal = r->signal;
+        q->kind = r->kind;
+        q->threshold = num_from_double(th);
+        q->pickup_sq = num_acc_from_double(th * th);
+        q->limit = num_acc_from_double(1.0);
+        q->debounce = (int)ceil(r->debounce / dt - 1e-9);
+        if (r->kind == FAULT_RULE_I2T) {
+            double heating = r->limit > 0.0 ? dt * base[r->signal] * base[r->signal] / r->limit : 1.0;
+            if (heating >= 1.0) {
+                free(f->signals);
+                free(f);
+                return NULL;
+            }
+            q->heating = num_coef_from_double(heating);
+        }
+    }
+    for (int k = 0; k < count; k++) {
+        for (int s = 0; s < FAULT_SIGNAL_COUNT; s++) {
+            f->signals[(size_t)k * FAULT_SIGNAL_COUNT + s] = num_from_double(signals[k][s] / base[s]);
+        }
+    }
+    return f;
+}
+
+static int fault_run(NumFault *f, int begin, int end) {
+    if (f->trip_rule >= 0) return end;
+    if (end > f->count) end = f->count;
+    for (int k = begin; k < end; k++) {
+        const num_t *x = f->signals + (size_t)k * FAULT_SIGNAL_COUNT;
+        for (int i = 0; i < f->num_rules; i++) {
+            const NumRule *r = &f->rules[i];
+            num_t v = x[r->signal];
+            int cond = 0;
+            switch (r->kind) {
+                case FAULT_RULE_ABOVE: cond = v > r->threshold; break;
+                case FAULT_RULE_BELOW: cond = v < r->threshold; break;
+                case FAULT_RULE_I2T: {
+                    num_acc_t heat = f->i2t[i] + num_acc_mul_coef(num_sq(v) - r->pickup_sq, r->heating);
+                    if (heat < 0) heat = 0;
+                    f->i2t[i] = heat;
+                    cond = heat >= r->limit;
+                    break;
+                }
+                default: break;
+            }
+            f->held[i] = cond ? f->held[i] + 1 : 0;
+            if (cond && f->held[i] >= r->debounce && f->trip_rule < 0) f->trip_rule = i;
+        }
+        if (f->trip_rule >= 0) return k;
+    }
+    return end;
+}
+
+static int fault_trip_rule(const NumFault *f) {
+    return f->trip_rule;
+}
+
+// I2T heat is kept, as reset_faults keeps it.
+static void fault_reset(NumFault *f) {
+    f->trip_rule = -1;
+    memset(f->held, 0, sizeof(f->held));
+}
+
+static void fault_destroy(NumFault *f) {
+    if (!f) return;
+    free(f->signals);
+    free(f);
+}
+
+const NumericKernels NUM_NAME(numeric_kernels) = {
+    NUM_TYPE_NAME,
+    ramp_create,
+    ramp_update,
+    ramp_store,
+    ramp_destroy,
+    pwm_generate_num,
+    fault_create,
+    fault_run,
+    fault_trip_rule,
+    fault_reset,
+    fault_destroy,
+};
@@ -0,0 +1,50 @@
+#ifndef NUMERIC_KERNELS_H
+#define NUMERIC_KERNELS_H
+
+#include "motor.h"
+#include "inverter.h"
+#include "fault.h"
+
+// The ramp model, the PWM modulator and the fault engine written against
+// numeric.h, to size controller firmware for MCUs with a single-precision
+// FPU or none. numeric_kernels.c is compiled once per scalar type and each
+// build fills one table, so a call through a table runs a loop built for a
+// single type. Values cross this interface as double and are converted to
+// per unit of a full scale the kernel picks on the way in.
+//
+// Every type defines NumRamp and NumFault its own way: hand a handle only
+// to the table that created it.
+
+typedef struct NumRamp NumRamp;
+typedef struct NumFault NumFault;
+
+typedef struct {
+    const char *name;
+    // MOTOR_MODEL_RAMP drives with fixed targets, stepped as update_motor
+    // steps them; ramp_store writes back speed, frequency, torque, current
+    // and temperature.
+    NumRamp *(*ramp_create)(const MotorState *drives, const double *target_freq, const int *is_forward, int count);
+    void (*ramp_update)(NumRamp *r, int steps);
+    void (*ramp_store)(const NumRamp *r, int index, MotorState *m);
+    void (*ramp_destroy)(NumRamp *r);
+    // The leg states of pwm_generate; the voltages are left alone. dt must
+    // be shorter than a carrier period.
+    void (*pwm_generate)(const InverterState *inv, double time, double dt, int samples, PwmOutput *out);
+    // The rules evaluated on a trace of samples dt apart. FAULT_RULE_RMS_ABOVE
+    // is not supported and makes fault_create return NULL. fault_run returns
+    // the first sample in begin..end - 1 that trips, or end; a trip latches
+    // until fault_reset, and nothing is evaluated while one is latched.
+    NumFault *(*fault_create)(const FaultRule *rules, int num_rules, double dt,
+                              const double (*signals)[FAULT_SIGNAL_COUNT], int count);
+    int (*fault_run)(NumFault *f, int begin, int end);
+    int (*fault_trip_rule)(const NumFault *f);
+    void (*fault_reset)(NumFault *f);
+    void (*fault_destroy)(NumFault *f);
+} NumericKernels;
+
+extern const NumericKernels numeric_kernels_double;
+extern const NumericKernels numeric_kernels_float;
+extern const NumericKernels numeric_kernels_q31;
+extern const NumericKernels numeric_kernels_q15;
+
+#endif
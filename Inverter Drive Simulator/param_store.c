@@ -0,0 +1,53 @@
+#include "param_store.h"
+#include <string.h>
+
+static void write_begin(ParamStore *s) {
+    unsigned long seq = atomic_load_explicit(&s->seq, memory_order_relaxed);
+    atomic_store_explicit(&s->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+
+static void write_end(ParamStore *s) {
+    s->data.version++;
+    atomic_fetch_add_explicit(&s->seq, 1, memory_order_release);
+}
+
+void param_store_init(ParamStore *s, const SimParams *params, const SimInputs *inputs) {
+    atomic_init(&s->seq, 0);
+    s->data.params = *params;
+    s->data.inputs = *inputs;
+    s->data.params_version = 0;
+    s->data.version = 0;
+}
+
+// Publishes params only if they validate; otherwise the store keeps the
+// last valid set and error_msg says why.
+int param_store_set_params(ParamStore *s, const SimParams *params, char *error_msg, size_t len) {
+    if (!sim_validate_params(params, error_msg, len)) return 0;
+    write_begin(s);
+    s->data.params = *params;
+    s->data.params_version++;
+    write_end(s);
+    return 1;
+}
+
+void param_store_set_inputs(ParamStore *s, const SimInputs *inputs) {
+    write_begin(s);
+    s->data.inputs = *inputs;
+    write_end(s);
+}
+
+// Cheap change check for hot loops: one atomic load.
+unsigned long param_store_version(ParamStore *s) {
+    return atomic_load_explicit(&s->seq, memory_order_acquire) / 2;
+}
+
+void param_store_snapshot(ParamStore *s, ParamSnapshot *out) {
+    for (;;) {
+        unsigned long before = atomic_load_explicit(&s->seq, memory_order_acquire);
+        if (before & 1) continue;
+        memcpy(out, &s->data, sizeof(*out));
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&s->seq, memory_order_relaxed) == before) return;
+    }
+}
@@ -0,0 +1,28 @@
+#ifndef PARAM_STORE_H
+#define PARAM_STORE_H
+
+#include <stdatomic.h>
+#include "sim.h"
+
+// Immutable copy of the store as seen by a reader.
+typedef struct {
+    SimParams params;
+    SimInputs inputs;
+    unsigned long params_version;   // bumped only when params change
+    unsigned long version;          // bumped on every update
+} ParamSnapshot;
+
+// Seqlock-protected parameters. One writer thread (the GUI); any number of
+// readers, which never block the writer and retry only if they race it.
+typedef struct {
+    _Alignas(64) atomic_ulong seq;
+    ParamSnapshot data;
+} ParamStore;
+
+void param_store_init(ParamStore *s, const SimParams *params, const SimInputs *inputs);
+int param_store_set_params(ParamStore *s, const SimParams *params, char *error_msg, size_t len);
+void param_store_set_inputs(ParamStore *s, const SimInputs *inputs);
+unsigned long param_store_version(ParamStore *s);
+void param_store_snapshot(ParamStore *s, ParamSnapshot *out);
+
+#endif
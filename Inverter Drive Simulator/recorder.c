@@ -0,0 +1,273 @@
+#include "recorder.h"
+#include "lod.h"
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+struct Recorder {
+    int fd;
+    int num_channels;
+    size_t chunk_bytes;
+    RecorderHeader *header;   // mapped header page
+    double *window;           // mapped chunks [window_first, window_first + RECORDER_WINDOW_CHUNKS)
+    uint64_t window_first;
+    uint64_t count;
+    LodWriter *lod;
+};
+
+struct Recording {
+    int fd;
+    const unsigned char *map;
+    size_t map_len;
+    const RecorderHeader *header;
+    uint64_t count;
+    size_t chunk_bytes;
+    LodIndex *lod;
+};
+
+static size_t chunk_bytes_for(int num_channels) {
+    return (size_t)RECORDER_CHUNK * (size_t)num_channels * sizeof(double);
+}
+
+static void lod_path(const char *path, char *buf, size_t len) {
+    snprintf(buf, len, "%s.lod", path);
+}
+
+static off_t chunk_offset(size_t chunk_bytes, uint64_t chunk) {
+    return (off_t)(RECORDER_DATA_OFFSET + chunk * chunk_bytes);
+}
+
+// Grows the file and maps the next window of chunks. Chunk sizes are whole
+// pages, so every window starts page-aligned.
+static int map_window(Recorder *r, uint64_t first_chunk) {
+    size_t len = r->chunk_bytes * RECORDER_WINDOW_CHUNKS;
+    if (r->window) munmap(r->window, len);
+    r->window = NULL;
+    off_t off = chunk_offset(r->chunk_bytes, first_chunk);
+    if (ftruncate(r->fd, off + (off_t)len) != 0) return 0;
+    void *p = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, r->fd, off);
+    if (p == MAP_FAILED) return 0;
+    r->window = p;
+    r->window_first = first_chunk;
+    return 1;
+}
+
+Recorder *recorder_create(const char *path, int num_channels, const char *const *names) {
+    if (num_channels < 1 || num_channels > RECORDER_MAX_CHANNELS) return NULL;
+    Recorder *r = calloc(1, sizeof(*r));
+    if (!r) return NULL;
+    r->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (r->fd < 0) {
+        free(r);
+        return NULL;
+    }
+    r->num_channels = num_channels;
+    r->chunk_bytes = chunk_bytes_for(num_channels);
+    void *h = MAP_FAILED;
+    if (ftruncate(r->fd, RECORDER_DATA_OFFSET) == 0)
+        h = mmap(NULL, RECORDER_DATA_OFFSET, PROT_READ | PROT_WRITE, MAP_SHARED, r->fd, 0);
+    if (h == MAP_FAILED || !map_window(r, 0)) {
+        if (h != MAP_FAILED) munmap(h, RECORDER_DATA_OFFSET);
+        close(r->fd);
+        free(r);
+        return NULL;
+    }
+    r->header = h;
+    memcpy(r->header->magic, RECORDER_MAGIC, sizeof(RECORDER_MAGIC));
+    r->header->version = RECORDER_VERSION;
+    r->header->num_channels = (uint32_t)num_channels;
+    r->header->chunk_samples = RECORDER_CHUNK;
+    r->header->num_samples = 0;
+    for (int ch = 0; ch < num_channels; ch++)
+        strncpy(r->header->names[ch], names[ch], RECORDER_NAME_LEN - 1);
+    // The pyramid is an accelerator only; a capture without one still replays.
+    char lod[4096];
+    lod_path(path, lod, sizeof(lod));
+    r->lod = lod_writer_create(lod, num_channels);
+    if (!r->lod) unlink(lod);
+    return r;
+}
+
+int recorder_append(Recorder *r, const double *values) {
+    uint64_t chunk = r->count / RECORDER_CHUNK;
+    size_t slot = (size_t)(r->count % RECORDER_CHUNK);
+    if (chunk >= r->window_first + RECORDER_WINDOW_CHUNKS && !map_window(r, chunk)) return 0;
+    double *base = r->window + (size_t)(chunk - r->window_first) * RECORDER_CHUNK * (size_t)r->num_channels;
+    for (int ch = 0; ch < r->num_channels; ch++)
+        base[(size_t)ch * RECORDER_CHUNK + slot] = values[ch];
+    r->count++;
+    if (slot == RECORDER_CHUNK - 1) r->header->num_samples = r->count;
+    if (r->lod) lod_writer_append(r->lod, values);
+    return 1;
+}
+
+uint64_t recorder_count(const Recorder *r) {
+    return r->count;
+}
+
+// Commits the sample count and trims the file to the last used chunk.
+int recorder_close(Recorder *r) {
+    if (!r) return 0;
+    r->header->num_samples = r->count;
+    munmap(r->window, r->chunk_bytes * RECORDER_WINDOW_CHUNKS);
+    munmap(r->header, RECORDER_DATA_OFFSET);
+    uint64_t chunks = (r->count + RECORDER_CHUNK - 1) / RECORDER_CHUNK;
+    int ok = ftruncate(r->fd, chunk_offset(r->chunk_bytes, chunks)) == 0;
+    ok = close(r->fd) == 0 && ok;
+    if (r->lod) ok = lod_writer_close(r->lod) && ok;
+    free(r);
+    return ok;
+}
+
+Recording *recording_open(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < RECORDER_DATA_OFFSET) {
+        close(fd);
+        return NULL;
+    }
+    void *p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) {
+        close(fd);
+        return NULL;
+    }
+    const RecorderHeader *h = p;
+    if (memcmp(h->magic, RECORDER_MAGIC, sizeof(RECORDER_MAGIC)) != 0 || h->version != RECORDER_VERSION ||
+        h->chunk_samples != RECORDER_CHUNK || h->num_channels < 1 || h->num_channels > RECORDER_MAX_CHANNELS) {
+        munmap(p, (size_t)st.st_size);
+        close(fd);
+        return NULL;
+    }
+    Recording *rec = calloc(1, sizeof(*rec));
+    rec->fd = fd;
+    rec->map = p;
+    rec->map_len = (size_t)st.st_size;
+    rec->header = h;
+    rec->chunk_bytes = chunk_bytes_for((int)h->num_channels);
+    // Never trust the count beyond what the file actually holds
+    uint64_t chunks = (rec->map_len - RECORDER_DATA_OFFSET) / rec->chunk_bytes;
+    rec->count = h->num_samples < chunks * RECORDER_CHUNK ? h->num_samples : chunks * RECORDER_CHUNK;
+    madvise(p, rec->map_len, MADV_RANDOM);
+    char lod[4096];
+    lod_path(path, lod, sizeof(lod));
+    rec->lod = lod_open(lod, (int)h->num_channels);
+    return rec;
+}
+
+void recording_close(Recording *rec) {
+    if (!rec) return;
+    lod_close(rec->lod);
+    munmap((void *)rec->map, rec->map_len);
+    close(rec->fd);
+    free(rec);
+}
+
+uint64_t recording_count(const Recording *rec) {
+    return rec->count;
+}
+
+int recording_channels(const Recording *rec) {
+    return (int)rec->header->num_channels;
+}
+
+const char *recording_channel_name(const Recording *rec, int ch) {
+    return rec->header->names[ch];
+}
+
+int recording_channel_index(const Recording *rec, const char *name) {
+    for (int ch = 0; ch < recording_channels(rec); ch++)
+        if (strncmp(rec->header->names[ch], name, RECORDER_NAME_LEN) == 0) return ch;
+    return -1;
+}
+
+static const double *column(const Recording *rec, int ch, uint64_t chunk) {
+    return (const double *)(rec->map + chunk_offset(rec->chunk_bytes, chunk)) + (size_t)ch * RECORDER_CHUNK;
+}
+
+double recording_value(const Recording *rec, int ch, uint64_t index) {
+    return column(rec, ch, index / RECORDER_CHUNK)[index % RECORDER_CHUNK];
+}
+
+// Copies n samples of one channel starting at first, a chunk-sized memcpy at a time.
+size_t recording_read(const Recording *rec, int ch, uint64_t first, size_t n, double *out) {
+    if (first >= rec->count) return 0;
+    if (n > rec->count - first) n = (size_t)(rec->count - first);
+    size_t done = 0;
+    while (done < n) {
+        uint64_t i = first + done;
+        size_t slot = (size_t)(i % RECORDER_CHUNK);
+        size_t take = RECORDER_CHUNK - slot;
+        if (take > n - done) take = n - done;
+        memcpy(out + done, column(rec, ch, i / RECORDER_CHUNK) + slot, take * sizeof(double));
+        done += take;
+    }
+    return n;
+}
+
+// Index of the first sample at or after time t; the time channel is monotonic.
+uint64_t recording_find_time(const Recording *rec, int time_ch, double t) {
+    uint64_t lo = 0, hi = rec->count;
+    while (lo < hi) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        if (recording_value(rec, time_ch, mid) < t) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+int recording_has_lod(const Recording *rec) {
+    return rec->lod != NULL;
+}
+
+// Extremes of one channel over [first, last), straight from the mapped chunks.
+static void raw_extremes(const Recording *rec, int ch, uint64_t first, uint64_t last, double *lo, double *hi) {
+    double mn = INFINITY, mx = -INFINITY;
+    for (uint64_t i = first; i < last;) {
+        size_t slot = (size_t)(i % RECORDER_CHUNK);
+        size_t take = RECORDER_CHUNK - slot;
+        if (take > last - i) take = (size_t)(last - i);
+        const double *col = column(rec, ch, i / RECORDER_CHUNK) + slot;
+        for (size_t k = 0; k < take; k++) {
+            if (col[k] < mn) mn = col[k];
+            if (col[k] > mx) mx = col[k];
+        }
+        i += take;
+    }
+    *lo = mn;
+    *hi = mx;
+}
+
+// Per-column min/max of samples [first, last) for a plot `columns` wide.
+// Reads the coarsest pyramid level with at least one bucket per column and
+// falls back to raw samples when zoomed in that far or without a pyramid.
+// When the range holds no more samples than columns, the samples themselves
+// are returned (min == max) and the result is their count.
+int recording_envelope(const Recording *rec, int ch, uint64_t first, uint64_t last, int columns,
+                       double *col_min, double *col_max) {
+    if (last > rec->count) last = rec->count;
+    if (first >= last || columns < 1) return 0;
+    uint64_t n = last - first;
+    if (n <= (uint64_t)columns) {
+        recording_read(rec, ch, first, (size_t)n, col_min);
+        memcpy(col_max, col_min, (size_t)n * sizeof(double));
+        return (int)n;
+    }
+    int level = lod_pick_level(rec->lod, first, last, columns);
+    uint64_t bs = lod_bucket_samples(level);
+    for (int c = 0; c < columns; c++) {
+        uint64_t s0 = first + n * (uint64_t)c / (uint64_t)columns;
+        uint64_t s1 = first + n * (uint64_t)(c + 1) / (uint64_t)columns;
+        if (level == 0) {
+            raw_extremes(rec, ch, s0, s1, &col_min[c], &col_max[c]);
+            continue;
+        }
+        lod_extremes(rec->lod, level, ch, s0 / bs, (s1 - 1) / bs, &col_min[c], &col_max[c]);
+    }
+    return columns;
+}
@@ -0,0 +1,58 @@
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Append-only columnar capture file:
+//   page 0: RecorderHeader
+//   then fixed-size chunks of RECORDER_CHUNK samples, each holding one
+//   contiguous column of doubles per channel.
+// num_samples is updated as each chunk fills and on close, so a capture cut
+// short by a crash still opens up to its last complete chunk.
+
+#define RECORDER_MAGIC "IDSREC1"
+#define RECORDER_VERSION 1
+#define RECORDER_MAX_CHANNELS 16
+#define RECORDER_NAME_LEN 16
+#define RECORDER_CHUNK 4096            // samples per chunk
+#define RECORDER_WINDOW_CHUNKS 64      // chunks mapped at once while writing
+#define RECORDER_DATA_OFFSET 4096
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t num_channels;
+    uint32_t chunk_samples;
+    uint32_t reserved;
+    uint64_t num_samples;
+    char names[RECORDER_MAX_CHANNELS][RECORDER_NAME_LEN];
+} RecorderHeader;
+
+typedef struct Recorder Recorder;
+typedef struct Recording Recording;
+
+Recorder *recorder_create(const char *path, int num_channels, const char *const *names);
+int recorder_append(Recorder *r, const double *values);
+uint64_t recorder_count(const Recorder *r);
+int recorder_close(Recorder *r);
+
+// Read side: the whole file is mapped read-only, so opening costs the same
+// for any size and pages are faulted in only when touched.
+Recording *recording_open(const char *path);
+void recording_close(Recording *rec);
+uint64_t recording_count(const Recording *rec);
+int recording_channels(const Recording *rec);
+const char *recording_channel_name(const Recording *rec, int ch);
+int recording_channel_index(const Recording *rec, const char *name);
+double recording_value(const Recording *rec, int ch, uint64_t index);
+size_t recording_read(const Recording *rec, int ch, uint64_t first, size_t n, double *out);
+uint64_t recording_find_time(const Recording *rec, int time_ch, double t);
+
+// Zoomable view backed by the level-of-detail pyramid in <path>.lod, which
+// the writer builds as samples arrive (see lod.h).
+int recording_has_lod(const Recording *rec);
+int recording_envelope(const Recording *rec, int ch, uint64_t first, uint64_t last, int columns,
+                       double *col_min, double *col_max);
+
+#endif
@@ -0,0 +1,362 @@
+#include "scenario.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LINE_MAX_LEN 1024
+
+const char *const scenario_trace_names[SCENARIO_TRACE_CHANNELS] = {
+    "t", "time", "freq", "vll", "current", "speed", "torque", "temp", "fault", "ia", "ib", "ic"
+};
+
+typedef struct {
+    const char *name;
+    size_t offset;
+} DoubleParam;
+
+static const DoubleParam double_params[] = {
+    { "rated_voltage", offsetof(SimParams, rated_voltage) },
+    { "rated_current", offsetof(SimParams, rated_current) },
+    { "rated_freq", offsetof(SimParams, rated_freq) },
+    { "rated_rpm", offsetof(SimParams, rated_rpm) },
+    { "ramp_up", offsetof(SimParams, ramp_up) },
+    { "ramp_down", offsetof(SimParams, ramp_down) },
+    { "max_freq", offsetof(SimParams, max_freq) },
+    { "min_freq", offsetof(SimParams, min_freq) },
+    { "carrier_freq", offsetof(SimParams, carrier_freq) },
+    { "switch_dt", offsetof(SimParams, switching_dt) },
+    { "dt", offsetof(SimParams, dt) },
+    { "control_rate", offsetof(SimParams, control_rate) },
+};
+
+typedef struct {
+    const char *param;
+    const char *value;
+    int code;
+} EnumParam;
+
+static const EnumParam enum_params[] = {
+    { "pwm_mode", "sine", PWM_SINE },
+    { "pwm_mode", "thi", PWM_THIRD_HARMONIC },
+    { "pwm_mode", "svpwm", PWM_SPACE_VECTOR },
+    { "switching", "off", SWITCHING_OFF },
+    { "switching", "event", SWITCHING_EVENT },
+    { "switching", "fixed", SWITCHING_FIXED },
+    { "model", "dq", MOTOR_MODEL_DQ },
+    { "model", "ramp", MOTOR_MODEL_RAMP },
+    { "integrator", "euler", INTEGRATOR_EULER },
+    { "integrator", "rk4", INTEGRATOR_RK4 },
+    { "integrator", "exact", INTEGRATOR_EXACT },
+    { "control", "vf", CONTROL_VF },
+    { "control", "foc", CONTROL_FOC },
+    { "control", "sensorless", CONTROL_SENSORLESS },
+    { "control", "dtc", CONTROL_DTC },
+    { "thermal", "linear", THERMAL_LINEAR },
+    { "thermal", "network", THERMAL_NETWORK },
+};
+
+
+static int set_param(SimParams *p, const char *name, const char *value) {
+    char *end;
+    for (size_t i = 0; i < sizeof(double_params) / sizeof(double_params[0]); i++) {
+        if (strcmp(name, double_params[i].name) != 0) continue;
+        double v = strtod(value, &end);
+        if (end == value || *end) return 0;
+        *(double *)((char *)p + double_params[i].offset) = v;
+        return 1;
+    }
+    if (strcmp(name, "substeps") == 0) {
+        long v = strtol(value, &end, 10);
+        if (end == value || *end || v < 1) return 0;
+        p->substeps = (int)v;
+        return 1;
+    }
+    for (size_t i = 0; i < sizeof(enum_params) / sizeof(enum_params[0]); i++) {
+        const EnumParam *e = &enum_params[i];
+        if (strcmp(name, e->param) != 0 || strcmp(value, e->value) != 0) continue;
+        if (strcmp(name, "pwm_mode") == 0) p->pwm_mode = (PwmMode)e->code;
+        else if (strcmp(name, "switching") == 0) p->switching_mode = (SwitchingMode)e->code;
+        else if (strcmp(name, "model") == 0) p->motor_model = (MotorModel)e->code;
+        else if (strcmp(name, "control") == 0) p->control_mode = (ControlMode)e->code;
+        else if (strcmp(name, "thermal") == 0) p->thermal_model = (ThermalModel)e->code;
+        else p->integrator = (Integrator)e->code;
+        return 1;
+    }
+    return 0;
+}
+
+static int trace_channel(const char *name) {
+    for (int ch = 0; ch < SCENARIO_TRACE_CHANNELS; ch++)
+        if (strcmp(name, scenario_trace_names[ch]) == 0) return ch;
+    return -1;
+}
+
+static int parse_event(const char *verb, const char *arg, ScenarioEvent *ev) {
+    static const struct { const char *verb; ScenarioAction action; int has_arg; } verbs[] = {
+        { "speed", SCENARIO_SPEED, 1 }, { "forward", SCENARIO_FORWARD, 0 }, { "reverse", SCENARIO_REVERSE, 0 },
+        { "load", SCENARIO_LOAD, 1 }, { "fault", SCENARIO_FAULT, 1 }, { "reset", SCENARIO_RESET, 0 },
+        { "stop", SCENARIO_STOP, 0 }, { "run", SCENARIO_RUN, 0 },
+    };
+    for (size_t i = 0; i < sizeof(verbs) / sizeof(verbs[0]); i++) {
+        if (strcmp(verb, verbs[i].verb) != 0) continue;
+        if (verbs[i].has_arg != (arg != NULL)) return 0;
+        ev->action = verbs[i].action;
+        ev->value = 0.0;
+        if (ev->action == SCENARIO_FAULT) {
+            for (int f = FAULT_OVERCURRENT; f < FAULT_TYPE_COUNT; f++)
+                if (strcmp(arg, fault_type_name((FaultType)f)) == 0) ev->value = f;
+            return ev->value != 0.0;
+        }
+        if (arg) {
+            char *end;
+            ev->value = strtod(arg, &end);
+            if (end == arg || *end) return 0;
+            if (ev->action == SCENARIO_SPEED && (ev->value < 0.0 || ev->value > 100.0)) return 0;
+        }
+        return 1;
+    }
+    return 0;
+}
+
+int scenario_parse(FILE *f, Scenario *s, char *error_msg, size_t len) {
+    memset(s, 0, sizeof(*s));
+    sim_default_params(&s->params);
+    s->duration = 10.0;
+    s->every = 1;
+    error_msg[0] = '\0';
+    char line[LINE_MAX_LEN];
+    int lineno = 0;
+    while (fgets(line, sizeof(line), f)) {
+        lineno++;
+        char *hash = strchr(line, '#');
+        if (hash) *hash = '\0';
+        char *save = NULL;
+        char *tok[5] = { NULL };
+        int n = 0;
+        for (char *t = strtok_r(line, " \t\r\n", &save); t; t = strtok_r(NULL, " \t\r\n", &save)) {
+            if (n == 5) {
+                n++;
+                break;
+            }
+            tok[n++] = t;
+        }
+        if (n == 0) continue;
+        int ok = 0;
+        if (strcmp(tok[0], "duration") == 0 && n == 2) {
+            s->duration = atof(tok[1]);
+            ok = s->duration > 0.0 && isfinite(s->duration);
+        } else if (strcmp(tok[0], "every") == 0 && n == 2) {
+            s->every = atol(tok[1]);
+            ok = s->every >= 1;
+        } else if (strcmp(tok[0], "fast_forward") == 0 && n == 2) {
+            s->fast_forward = strcmp(tok[1], "on") == 0;
+            ok = s->fast_forward || strcmp(tok[1], "off") == 0;
+        } else if (strcmp(tok[0], "set") == 0 && n == 3) {
+            ok = set_param(&s->params, tok[1], tok[2]);
+        } else if (strcmp(tok[0], "tolerance") == 0 && (n == 3 || n == 4)) {
+            int ch = trace_channel(tok[1]);
+            if (ch >= 0) {
+                s->abs_tol[ch] = atof(tok[2]);
+                s->rel_tol[ch] = n == 4 ? atof(tok[3]) : 0.0;
+                ok = s->abs_tol[ch] >= 0.0 && s->rel_tol[ch] >= 0.0;
+            }
+        } else if (strcmp(tok[0], "at") == 0 && (n == 3 || n == 4) && s->num_events < SCENARIO_MAX_EVENTS) {
+            ScenarioEvent ev;
+            char *end;
+            ev.time = strtod(tok[1], &end);
+            ok = end != tok[1] && !*end && ev.time >= 0.0 && parse_event(tok[2], n == 4 ? tok[3] : NULL, &ev);
+            if (ok) {
+                // Insertion keeps events sorted and equal times in file order.
+                int i = s->num_events++;
+                while (i > 0 && s->events[i - 1].time > ev.time) {
+                    s->events[i] = s->events[i - 1];
+                    i--;
+                }
+                s->events[i] = ev;
+            }
+        }
+        if (!ok) {
+            snprintf(error_msg, len, "line %d: cannot parse '%s'", lineno, tok[0]);
+            return 0;
+        }
+    }
+    return sim_validate_params(&s->params, error_msg, len);
+}
+
+int scenario_load(const char *path, Scenario *s, char *error_msg, size_t len) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        snprintf(error_msg, len, "cannot open %s", path);
+        return 0;
+    }
+    int ok = scenario_parse(f, s, error_msg, len);
+    fclose(f);
+    return ok;
+}
+
+static void apply_event(const ScenarioEvent *ev, SimContext *ctx, SimInputs *in, int *running) {
+    switch (ev->action) {
+        case SCENARIO_SPEED: in->speed_ref = ev->value; break;
+        case SCENARIO_FORWARD: in->is_forward = 1; break;
+        case SCENARIO_REVERSE: in->is_forward = 0; break;
+        case SCENARIO_LOAD: in->load_torque = ev->value; break;
+        case SCENARIO_FAULT: trigger_fault(&ctx->fault, (FaultType)ev->value); break;
+        case SCENARIO_RESET: reset_faults(&ctx->fault); break;
+        case SCENARIO_STOP: *running = 0; break;
+        case SCENARIO_RUN: *running = 1; break;
+    }
+}
+
+static long quiet_ticks(const Scenario *s, int next, long i, long ticks) {
+    long limit = (i / s->every + 1) * s->every - 1;
+    if (next < s->num_events) {
+        // Conservative: a tick or so short of the first one the event is due on
+        long due = (long)floor(s->events[next].time / s->params.dt) - 1;
+        if (due < limit) limit = due;
+    }
+    if (ticks < limit) limit = ticks;
+    return limit - i;
+}
+
+// Nothing here depends on wall time, threads or uninitialised memory, so a
+// scenario always yields the same rows on the same build.
+long scenario_run(const Scenario *s, ScenarioRowFn fn, void *user_data) {
+    SimContext ctx;
+    sim_init(&ctx, &s->params);
+    SimInputs in = { 0.0, 1, 0.0 };
+    int running = 1;
+    int next = 0;
+    double dt = s->params.dt;
+    long ticks = (long)(s->duration / dt + 0.5);
+    long rows = 0;
+    double row[SCENARIO_TRACE_CHANNELS];
+    for (long i = 0; i < ticks; i++) {
+        // Scenario time from the tick count, so it never drifts from the events.
+        double t = (double)i * dt;
+        while (next < s->num_events && s->events[next].time <= t + dt * 1e-6)
+            apply_event(&s->events[next++], &ctx, &in, &running);
+        if (running && !has_fault(&ctx.fault)) {
+            // A skip covers ticks i.. up to the one before the next that
+            // applies an event or traces a row.
+            long skip = s->fast_forward ? sim_fast_forward(&ctx, &in, quiet_ticks(s, next, i, ticks)) : 0;
+            if (skip > 0) {
+                i += skip - 1;
+                continue;
+            }
+            sim_step(&ctx, &in);
+        }
+        if ((i + 1) % s->every != 0) continue;
+        row[0] = (double)(i + 1) * dt;
+        sim_channel_values(&ctx, row + 1);
+        rows++;
+        if (fn && fn(row, user_data)) break;
+    }
+    return rows;
+}
+
+static void write_header(FILE *out) {
+    for (int ch = 0; ch < SCENARIO_TRACE_CHANNELS; ch++)
+        fprintf(out, "%s%c", scenario_trace_names[ch], ch + 1 < SCENARIO_TRACE_CHANNELS ? ',' : '\n');
+}
+
+// %.17g round-trips every double, so a trace read back compares bit for bit.
+static void write_row(FILE *out, const double *row) {
+    for (int ch = 0; ch < SCENARIO_TRACE_CHANNELS; ch++)
+        fprintf(out, "%.17g%c", row[ch], ch + 1 < SCENARIO_TRACE_CHANNELS ? ',' : '\n');
+}
+
+static int write_row_fn(const double *row, void *user_data) {
+    write_row(user_data, row);
+    return 0;
+}
+
+int scenario_write_trace(const Scenario *s, FILE *out) {
+    write_header(out);
+    scenario_run(s, write_row_fn, out);
+    return !ferror(out);
+}
+
+typedef struct {
+    const Scenario *s;
+    FILE *golden;
+    FILE *actual_out;
+    ScenarioCompare *result;
+    char line[LINE_MAX_LEN];
+} CompareState;
+
+static int compare_row(const double *row, void *user_data) {
+    CompareState *cs = user_data;
+    ScenarioCompare *r = cs->result;
+    if (cs->actual_out) write_row(cs->actual_out, row);
+    if (!fgets(cs->line, sizeof(cs->line), cs->golden)) {
+        if (r->passed) snprintf(r->message, sizeof(r->message), "golden ends after %ld rows", r->rows);
+        r->passed = 0;
+        return !cs->actual_out;
+    }
+    double golden[SCENARIO_TRACE_CHANNELS];
+    char *p = cs->line;
+    for (int ch = 0; ch < SCENARIO_TRACE_CHANNELS; ch++) {
+        char *end;
+        golden[ch] = strtod(p, &end);
+        if (end == p) {
+            if (r->passed) snprintf(r->message, sizeof(r->message), "golden row %ld is malformed", r->rows);
+            r->passed = 0;
+            return !cs->actual_out;
+        }
+        p = *end == ',' ? end + 1 : end;
+    }
+    int row_bad = 0;
+    for (int ch = 0; ch < SCENARIO_TRACE_CHANNELS; ch++) {
+        double err = fabs(row[ch] - golden[ch]);
+        if (isnan(row[ch]) && isnan(golden[ch])) err = 0.0;
+        else if (isnan(err)) err = INFINITY;
+        if (err > r->max_error[ch]) r->max_error[ch] = err;
+        if (err > cs->s->abs_tol[ch] + cs->s->rel_tol[ch] * fabs(golden[ch])) {
+            if (r->first_row < 0) {
+                r->first_row = r->rows;
+                r->first_channel = ch;
+                snprintf(r->message, sizeof(r->message), "row %ld (t=%.6g) %s: got %.17g, golden %.17g",
+                         r->rows, row[0], scenario_trace_names[ch], row[ch], golden[ch]);
+            }
+            row_bad = 1;
+        }
+    }
+    if (row_bad) {
+        r->mismatches++;
+        r->passed = 0;
+    }
+    r->rows++;
+    return 0;
+}
+
+// Runs the scenario against a golden trace written by scenario_write_trace.
+// Every row is checked, so the result carries the worst error per channel
+// as well as the first violation.
+int scenario_compare(const Scenario *s, FILE *golden, FILE *actual_out, ScenarioCompare *result) {
+    CompareState cs = { s, golden, actual_out, result, "" };
+    memset(result, 0, sizeof(*result));
+    result->passed = 1;
+    result->first_row = -1;
+    result->first_channel = -1;
+    char expect[LINE_MAX_LEN];
+    size_t n = 0;
+    for (int ch = 0; ch < SCENARIO_TRACE_CHANNELS; ch++)
+        n += (size_t)snprintf(expect + n, sizeof(expect) - n, "%s%s", scenario_trace_names[ch],
+                              ch + 1 < SCENARIO_TRACE_CHANNELS ? "," : "\n");
+    if (actual_out) write_header(actual_out);
+    if (!fgets(cs.line, sizeof(cs.line), golden) || strcmp(cs.line, expect) != 0) {
+        snprintf(result->message, sizeof(result->message), "golden header does not match the trace channels");
+        result->passed = 0;
+        if (!actual_out) return 0;
+    }
+    if (!result->passed) {
+        scenario_run(s, write_row_fn, actual_out);
+        return 0;
+    }
+    scenario_run(s, compare_row, &cs);
+    if (result->passed && fgets(cs.line, sizeof(cs.line), golden)) {
+        snprintf(result->message, sizeof(result->message), "golden has more than %ld rows", result->rows);
+        result->passed = 0;
+    }
+    return result->passed;
+}
@@ -0,0 +1,78 @@
+#ifndef SCENARIO_H
+#define SCENARIO_H
+
+#include <stdio.h>
+#include "sim.h"
+
+// Scripted test procedure, one directive per line, '#' starts a comment:
+//
+//   duration 12            simulated seconds
+//   every 4                trace every 4th tick (default 1)
+//   set ramp_up 1.5        any drive parameter, as in the headless options
+//   tolerance current 1e-6 [REL]
+//                          allowed |actual - golden| per channel, absolute
+//                          plus relative; exact match by default
+//   at 0 speed 50          timed events, applied before the first tick at or
+//   at 3 reverse           after their time, in file order for equal times:
+//   at 4 load 20             speed PCT, forward, reverse, load NM,
+//   at 6 fault overcurrent   fault overcurrent|undervoltage|overtemp|overload,
+//   at 7 reset               reset, stop, run
+//   fast_forward on        skip settled stretches between events and traced
+//                          rows in closed form (sim_fast_forward); off by default
+//
+// Like the GUI, the drive does not step while stopped or faulted, but the
+// scenario clock and the trace keep going.
+
+#define SCENARIO_MAX_EVENTS 1024
+#define SCENARIO_TRACE_CHANNELS (SIM_CHANNELS + 1)   // scenario time first
+
+typedef enum {
+    SCENARIO_SPEED,
+    SCENARIO_FORWARD,
+    SCENARIO_REVERSE,
+    SCENARIO_LOAD,
+    SCENARIO_FAULT,
+    SCENARIO_RESET,
+    SCENARIO_STOP,
+    SCENARIO_RUN
+} ScenarioAction;
+
+typedef struct {
+    double time;
+    ScenarioAction action;
+    double value;   // speed, load or FaultType
+} ScenarioEvent;
+
+typedef struct {
+    SimParams params;
+    double duration;
+    long every;
+    int fast_forward;
+    double abs_tol[SCENARIO_TRACE_CHANNELS];
+    double rel_tol[SCENARIO_TRACE_CHANNELS];
+    int num_events;
+    ScenarioEvent events[SCENARIO_MAX_EVENTS];
+} Scenario;
+
+typedef struct {
+    int passed;
+    long rows;
+    long mismatches;
+    long first_row;                  // first mismatching row, -1 if none
+    int first_channel;
+    double max_error[SCENARIO_TRACE_CHANNELS];
+    char message[256];
+} ScenarioCompare;
+
+// Receives every traced row; return nonzero to stop the run.
+typedef int (*ScenarioRowFn)(const double *row, void *user_data);
+
+extern const char *const scenario_trace_names[SCENARIO_TRACE_CHANNELS];
+
+int scenario_load(const char *path, Scenario *s, char *error_msg, size_t len);
+int scenario_parse(FILE *f, Scenario *s, char *error_msg, size_t len);
+long scenario_run(const Scenario *s, ScenarioRowFn fn, void *user_data);
+int scenario_write_trace(const Scenario *s, FILE *out);
+int scenario_compare(const Scenario *s, FILE *golden, FILE *actual_out, ScenarioCompare *result);
+
+#endif
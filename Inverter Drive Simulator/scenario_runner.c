@@ -0,0 +1,172 @@
+#include "scenario.h"
+#include <getopt.h>
+#include <libgen.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define PATH_LEN 4096
+
+typedef struct {
+    char **paths;
+    int count;
+    const char *golden_dir;
+    const char *actual_dir;
+    int update;
+    int quiet;
+    int fast_forward;
+    atomic_int next;
+    pthread_mutex_t lock;   // serialises output and the counters below
+    int passed;
+    int failed;
+    long rows;
+} Batch;
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [options] SCENARIO...\n"
+            "  -g, --golden-dir DIR   where golden traces live (default: next to each scenario)\n"
+            "  -a, --actual-dir DIR   write the actual trace of every failing scenario here\n"
+            "  -u, --update           (re)write the golden traces instead of comparing\n"
+            "  -j, --threads N        scenarios run in parallel (default: online CPUs)\n"
+            "  -q, --quiet            report failures and the summary only\n"
+            "  -f, --fast-forward     fast-forward every scenario, as its fast_forward directive does\n"
+            "Golden trace of dir/name.scn: name.golden.csv; actual trace: name.actual.csv\n",
+            prog);
+}
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// dir/name.ext -> out_dir/name<suffix>, out_dir defaulting to dir.
+static void trace_path(const char *scenario, const char *out_dir, const char *suffix, char *buf, size_t len) {
+    char copy_dir[PATH_LEN], copy_base[PATH_LEN];
+    snprintf(copy_dir, sizeof(copy_dir), "%s", scenario);
+    snprintf(copy_base, sizeof(copy_base), "%s", scenario);
+    const char *dir = out_dir ? out_dir : dirname(copy_dir);
+    char *base = basename(copy_base);
+    char *dot = strrchr(base, '.');
+    if (dot && dot != base) *dot = '\0';
+    snprintf(buf, len, "%s/%s%s", dir, base, suffix);
+}
+
+static int write_trace_file(const Scenario *s, const char *path) {
+    FILE *f = fopen(path, "w");
+    if (!f) return 0;
+    int ok = scenario_write_trace(s, f);
+    return fclose(f) == 0 && ok;
+}
+
+static void run_one(Batch *b, const char *path) {
+    char msg[PATH_LEN + 256] = "";
+    char golden_path[PATH_LEN];
+    trace_path(path, b->golden_dir, ".golden.csv", golden_path, sizeof(golden_path));
+    Scenario *s = malloc(sizeof(*s));
+    double t0 = now_seconds();
+    int ok = 0;
+    long rows = 0;
+    if (!s) {
+        snprintf(msg, sizeof(msg), "out of memory");
+    } else if (scenario_load(path, s, msg, sizeof(msg))) {
+        if (b->fast_forward) s->fast_forward = 1;
+        if (b->update) {
+            ok = write_trace_file(s, golden_path);
+            snprintf(msg, sizeof(msg), ok ? "wrote %s" : "cannot write %s", golden_path);
+        } else {
+            FILE *golden = fopen(golden_path, "r");
+            if (!golden) {
+                snprintf(msg, sizeof(msg), "no golden trace %s", golden_path);
+            } else {
+                ScenarioCompare cmp;
+                ok = scenario_compare(s, golden, NULL, &cmp);
+                rows = cmp.rows;
+                fclose(golden);
+                if (!ok)
+                    snprintf(msg, sizeof(msg), "%s (%ld of %ld rows differ)", cmp.message, cmp.mismatches, cmp.rows);
+            }
+            if (!ok && b->actual_dir) {
+                // Runs are deterministic, so rerunning reproduces the failing trace.
+                char actual_path[PATH_LEN];
+                trace_path(path, b->actual_dir, ".actual.csv", actual_path, sizeof(actual_path));
+                if (!write_trace_file(s, actual_path)) fprintf(stderr, "cannot write %s\n", actual_path);
+            }
+        }
+    }
+    double ms = (now_seconds() - t0) * 1e3;
+    free(s);
+    pthread_mutex_lock(&b->lock);
+    if (ok) b->passed++;
+    else b->failed++;
+    b->rows += rows;
+    if (!ok) printf("FAIL %s: %s\n", path, msg);
+    else if (b->update && !b->quiet) printf("UPDATE %s: %s (%.1f ms)\n", path, msg, ms);
+    else if (!b->quiet) printf("PASS %s (%ld rows, %.1f ms)\n", path, rows, ms);
+    fflush(stdout);
+    pthread_mutex_unlock(&b->lock);
+}
+
+static void *batch_worker(void *arg) {
+    Batch *b = arg;
+    for (;;) {
+        int i = atomic_fetch_add_explicit(&b->next, 1, memory_order_relaxed);
+        if (i >= b->count) break;
+        run_one(b, b->paths[i]);
+    }
+    return NULL;
+}
+
+int main(int argc, char *argv[]) {
+    static const struct option long_opts[] = {
+        {"golden-dir", required_argument, NULL, 'g'},
+        {"actual-dir", required_argument, NULL, 'a'},
+        {"update", no_argument, NULL, 'u'},
+        {"threads", required_argument, NULL, 'j'},
+        {"quiet", no_argument, NULL, 'q'},
+        {"fast-forward", no_argument, NULL, 'f'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+    Batch b = { 0 };
+    int num_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int opt;
+    while ((opt = getopt_long(argc, argv, "g:a:uj:qfh", long_opts, NULL)) != -1) {
+        switch (opt) {
+            case 'g': b.golden_dir = optarg; break;
+            case 'a': b.actual_dir = optarg; break;
+            case 'u': b.update = 1; break;
+            case 'j': num_threads = atoi(optarg); break;
+            case 'q': b.quiet = 1; break;
+            case 'f': b.fast_forward = 1; break;
+            case 'h': usage(argv[0]); return 0;
+            default: usage(argv[0]); return 2;
+        }
+    }
+    if (optind >= argc || num_threads < 1) {
+        usage(argv[0]);
+        return 2;
+    }
+    b.paths = argv + optind;
+    b.count = argc - optind;
+    if (num_threads > b.count) num_threads = b.count;
+    atomic_init(&b.next, 0);
+    pthread_mutex_init(&b.lock, NULL);
+    double t0 = now_seconds();
+    pthread_t *threads = calloc((size_t)num_threads, sizeof(pthread_t));
+    int started = 1;
+    for (int w = 1; threads && w < num_threads; w++, started++)
+        if (pthread_create(&threads[w], NULL, batch_worker, &b) != 0) break;
+    batch_worker(&b);
+    for (int w = 1; w < started; w++) pthread_join(threads[w], NULL);
+    free(threads);
+    pthread_mutex_destroy(&b.lock);
+    printf("%d scenarios: %d passed, %d failed, %ld rows compared, %.3f s on %d threads\n",
+           b.count, b.passed, b.failed, b.rows, now_seconds() - t0, num_threads);
+    return b.failed ? 1 : 0;
+}
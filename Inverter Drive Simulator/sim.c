@@ -0,0 +1,284 @@
+#include "sim.h"
+#include "instrument.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+const char *const sim_channel_names[SIM_CHANNELS] = {
+    "time", "freq", "vll", "current", "speed", "torque", "temp", "fault", "ia", "ib", "ic"
+};
+
+void sim_default_params(SimParams *p) {
+    p->rated_voltage = 400.0;
+    p->rated_current = 10.0;
+    p->rated_freq = 50.0;
+    p->rated_rpm = 1500.0;
+    p->ramp_up = 2.0;
+    p->ramp_down = 2.0;
+    p->max_freq = 100.0;
+    p->min_freq = 10.0;
+    p->pwm_mode = PWM_SINE;
+    p->carrier_freq = 5000.0;
+    p->switching_mode = SWITCHING_OFF;
+    p->switching_dt = 1e-6;
+    p->motor_model = MOTOR_MODEL_DQ;
+    p->integrator = INTEGRATOR_RK4;
+    p->substeps = MOTOR_SUBSTEPS;
+    p->dt = MOTOR_DT;
+    p->control_mode = CONTROL_VF;
+    p->control_rate = CONTROL_DEFAULT_RATE;
+    p->thermal_model = THERMAL_LINEAR;
+}
+
+int sim_validate_params(const SimParams *p, char *error_msg, size_t len) {
+    error_msg[0] = '\0';
+    if (p->rated_voltage <= 0 || p->rated_voltage > 10000) snprintf(error_msg, len, "Invalid Rated Voltage (1-10000 V)");
+    else if (p->rated_current <= 0 || p->rated_current > 1000) snprintf(error_msg, len, "Invalid Rated Current (1-1000 A)");
+    else if (p->rated_freq <= 0 || p->rated_freq > 1000) snprintf(error_msg, len, "Invalid Rated Frequency (1-1000 Hz)");
+    else if (p->rated_rpm <= 0 || p->rated_rpm > 10000) snprintf(error_msg, len, "Invalid Rated RPM (1-10000)");
+    else if (p->ramp_up < 0 || p->ramp_up > 60) snprintf(error_msg, len, "Invalid Ramp Up Time (0-60 s)");
+    else if (p->ramp_down < 0 || p->ramp_down > 60) snprintf(error_msg, len, "Invalid Ramp Down Time (0-60 s)");
+    else if (p->max_freq <= p->min_freq || p->max_freq > 1000) snprintf(error_msg, len, "Invalid Max Frequency");
+    else if (p->min_freq < 0 || p->min_freq > p->max_freq) snprintf(error_msg, len, "Invalid Min Frequency");
+    else if (p->carrier_freq < PWM_MIN_CARRIER || p->carrier_freq > PWM_MAX_CARRIER) snprintf(error_msg, len, "Invalid Carrier Frequency (500-20000 Hz)");
+    else if (!(p->switching_dt > 0.0)) snprintf(error_msg, len, "Invalid Switching Step (must be > 0 s)");
+    else if (!(p->dt >= SIM_MIN_DT && p->dt <= SIM_MAX_DT)) snprintf(error_msg, len, "Invalid Tick (1e-6 to 1 s)");
+    else if (p->substeps < 1) snprintf(error_msg, len, "Invalid Substeps (at least 1)");
+    else if (p->control_rate < CONTROL_MIN_RATE || p->control_rate > CONTROL_MAX_RATE) snprintf(error_msg, len, "Invalid Control Rate (1000-50000 Hz)");
+    else if (p->switching_mode != SWITCHING_OFF && p->motor_model != MOTOR_MODEL_DQ) snprintf(error_msg, len, "Switching Model Needs the DQ Motor Model");
+    if (!error_msg[0] && p->motor_model == MOTOR_MODEL_DQ) {
+        // The explicit integrators must keep the machine's modes from growing
+        // with the rotor at the top of the speed range: V/f steps in that frame with
+        // the substeps, a closed-loop controller in a fixed one at its rate.
+        InductionParams ip;
+        induction_params_from_rating(&ip, p->rated_voltage, p->rated_current, p->rated_freq, p->rated_rpm);
+        double w = 2.0 * M_PI * fmax(p->rated_freq, p->max_freq);
+        int vf = p->control_mode == CONTROL_VF;
+        double h = vf ? p->dt / p->substeps : p->dt / fmax(1.0, round(p->dt * p->control_rate));
+        double growth = induction_step_growth(&ip, p->integrator, vf ? w : 0.0, w, h);
+        if (growth > 1.0)
+            snprintf(error_msg, len, "Unstable Integration: %s grows %.3g per step, lower dt or raise substeps",
+                     integrator_name(p->integrator), growth);
+    }
+    return error_msg[0] == '\0';
+}
+
+void sim_init(SimContext *ctx, const SimParams *p) {
+    motor_init(&ctx->motor);
+    inverter_init(&ctx->inverter);
+    fault_init(&ctx->fault);
+    SwitchingParams sp;
+    switching_default_params(&sp);
+    switching_init(&ctx->switching, &sp);
+    ctx->switching_mode = SWITCHING_OFF;
+    ctx->switching_dt = 1e-6;
+    ctx->time = 0.0;
+    ctx->steps = 0;
+    ctx->settled_ticks = 0;
+    ctx->settle_freq = 0.0;
+    ctx->settle_load = 0.0;
+    ctx->settle_forward = 1;
+    if (p) sim_apply_params(ctx, p);
+}
+
+void sim_apply_params(SimContext *ctx, const SimParams *p) {
+    set_motor_params(&ctx->motor, p->rated_voltage, p->rated_current, p->rated_freq, p->rated_rpm);
+    set_drive_params(&ctx->motor, p->ramp_up, p->ramp_down, p->max_freq, p->min_freq);
+    ctx->inverter.vdc = SIM_DC_LINK * p->rated_voltage;
+    set_pwm_params(&ctx->inverter, p->pwm_mode, p->carrier_freq);
+    set_motor_model(&ctx->motor, p->motor_model, p->integrator, p->substeps, p->dt);
+    set_motor_control(&ctx->motor, p->control_mode, p->control_rate);
+    set_motor_thermal(&ctx->motor, p->thermal_model);
+    ctx->switching_mode = p->switching_mode;
+    ctx->switching_dt = p->switching_dt;
+}
+
+double sim_target_freq(const SimContext *ctx, const SimInputs *in) {
+    return in->speed_ref * ctx->motor.max_freq / 100.0;
+}
+
+void sim_channel_values(const SimContext *ctx, double *out) {
+    out[0] = ctx->time;
+    out[1] = ctx->inverter.freq;
+    out[2] = calculate_vll(&ctx->inverter);
+    out[3] = get_motor_current(&ctx->motor);
+    out[4] = get_motor_speed(&ctx->motor);
+    out[5] = get_motor_torque(&ctx->motor);
+    out[6] = get_motor_temp(&ctx->motor);
+    out[7] = ctx->fault.current_fault;
+    out[8] = ctx->switching.current[0];
+    out[9] = ctx->switching.current[1];
+    out[10] = ctx->switching.current[2];
+}
+
+#define SIM_PWM_CHUNK 256
+
+static void sample_faults(SimContext *ctx, double dt, const double *signals, FaultCapture *capture) {
+    PROBE_BEGIN(PROBE_FAULT_CHECK);
+    fault_sample(&ctx->fault, dt, signals);
+    PROBE_END(PROBE_FAULT_CHECK);
+    if (capture) fault_capture_push(capture, &ctx->fault, signals);
+}
+
+static void run_switching(SimContext *ctx, double until) {
+    motor_pwm_run(&ctx->motor, &ctx->switching, &ctx->inverter, ctx->switching_mode, ctx->switching_dt, until);
+}
+
+// Advances the switching model to until, stopping at every harmonic sample
+// due on the way. A sample holds the mean output voltage V_ab since the
+// previous one, from the model's running integral, and the phase current i_a.
+static void run_switching_sampled(SimContext *ctx, double until, HarmonicAnalyzer *h) {
+    double dt = h ? 1.0 / harmonic_sample_rate(h) : 0.0;
+    double ts = h ? fmax(harmonic_next_time(h), ctx->switching.time + dt) : HUGE_VAL;
+    if (ts <= until) {
+        run_switching(ctx, ts - dt);
+        double mark = ctx->switching.vab_integral;
+        for (; ts <= until; ts += dt) {
+            run_switching(ctx, ts);
+            double x[SIM_HARMONIC_CHANNELS] = { (ctx->switching.vab_integral - mark) / dt, ctx->switching.current[0] };
+            mark = ctx->switching.vab_integral;
+            harmonic_push(h, ts, x);
+        }
+    }
+    run_switching(ctx, until);
+}
+
+// Without the switching model the ideal PWM voltage is averaged over each
+// sample interval, and there is no phase current waveform to analyse.
+static void sample_pwm(SimContext *ctx, double until, HarmonicAnalyzer *h) {
+    double dt = 1.0 / harmonic_sample_rate(h);
+    double ts = fmax(harmonic_next_time(h), ctx->time + dt);
+    double vab[SIM_PWM_CHUNK];
+    while (ts <= until) {
+        int n = (int)floor((until - ts) / dt) + 1;
+        if (n > SIM_PWM_CHUNK) n = SIM_PWM_CHUNK;
+        pwm_average_vab(&ctx->inverter, ts - dt, dt, n, vab);
+        for (int i = 0; i < n; i++) {
+            double x[SIM_HARMONIC_CHANNELS] = { vab[i], 0.0 };
+            harmonic_push(h, ts + i * dt, x);
+        }
+        ts += n * dt;
+    }
+}
+
+// A tick is settled when speed, current, torque and the V/f output all
+// held still: the ramp model gets there exactly, the V/f dq model to within
+// rounding once the machine reaches its operating point. A closed-loop
+// controller's switching never settles.
+static void track_settling(SimContext *ctx, double target_freq, const SimInputs *in, const double *before) {
+    const MotorState *m = &ctx->motor;
+    const double after[4] = { m->current_speed, m->current, m->torque, m->drive_freq };
+    int steady = m->model == MOTOR_MODEL_RAMP || m->ctrl.mode == CONTROL_VF;
+    for (int k = 0; k < 4; k++)
+        if (fabs(after[k] - before[k]) > SIM_SETTLE_TOL * (1.0 + fabs(after[k]))) steady = 0;
+    if (target_freq != ctx->settle_freq || in->is_forward != ctx->settle_forward || in->load_torque != ctx->settle_load) {
+        ctx->settle_freq = target_freq;
+        ctx->settle_forward = in->is_forward;
+        ctx->settle_load = in->load_torque;
+        ctx->settled_ticks = 0;
+    }
+    ctx->settled_ticks = steady ? ctx->settled_ticks + 1 : 0;
+}
+
+void sim_step(SimContext *ctx, const SimInputs *in) {
+    sim_step_tapped(ctx, in, NULL);
+}
+
+// A tripped drive has its gates off: no PWM, no phase current, and the
+// motor is brought to rest. Callers normally stop stepping it; stepping on
+// only serves to fill a post-trigger capture.
+void sim_step_tapped(SimContext *ctx, const SimInputs *in, const SimTaps *taps) {
+    PROBE_BEGIN(PROBE_SIM_STEP);
+    FaultCapture *capture = taps ? taps->capture : NULL;
+    HarmonicAnalyzer *harmonics = taps ? taps->harmonics : NULL;
+    int tripped = has_fault(&ctx->fault);
+    int pwm = ctx->switching_mode != SWITCHING_OFF && !tripped;
+    double target_freq = tripped ? 0.0 : sim_target_freq(ctx, in);
+    set_motor_load(&ctx->motor, in->load_torque);
+    const MotorState *m = &ctx->motor;
+    const double before[4] = { m->current_speed, m->current, m->torque, m->drive_freq };
+    double until = ctx->time + ctx->motor.dt;
+    double signals[FAULT_SIGNAL_COUNT];
+    signals[FAULT_SIGNAL_VOLTAGE] = ctx->inverter.vdc;
+    if (pwm) {
+        // The switching model picks up at the present time if it was off;
+        // its clock otherwise only drifts from the tick count by rounding.
+        if (fabs(ctx->switching.time - ctx->time) > 1e-9 * ctx->motor.dt) {
+            ctx->switching.time = ctx->time;
+            ctx->switching.half_end = ctx->time;
+            ctx->switching.falling = 0;
+            ctx->switching.num_pending = 0;
+        }
+        motor_pwm_begin(&ctx->motor, target_freq, in->is_forward, &ctx->switching);
+        ctx->inverter.freq = m->current_freq;
+        if (harmonics) harmonic_set_fundamental(harmonics, ctx->inverter.freq);
+        // Fault rules see the phase currents once per carrier period, their
+        // RMS over it, and the winding temperature as the tick began.
+        signals[FAULT_SIGNAL_TEMP] = get_motor_temp(m);
+        double period = 1.0 / ctx->inverter.carrier_freq;
+        for (double t = ctx->time; t < until - period * 1e-6;) {
+            double next = fmin(t + period, until);
+            double mark = ctx->switching.i2_integral;
+            run_switching_sampled(ctx, next, harmonics);
+            const double *i = ctx->switching.current;
+            signals[FAULT_SIGNAL_CURRENT] = sqrt((ctx->switching.i2_integral - mark) / (next - t));
+            signals[FAULT_SIGNAL_PHASE] = fmax(fabs(i[0]), fmax(fabs(i[1]), fabs(i[2])));
+            sample_faults(ctx, next - t, signals, capture);
+            t = next;
+        }
+        motor_pwm_end(&ctx->motor);
+    } else {
+        update_motor(&ctx->motor, target_freq, in->is_forward);
+    }
+    track_settling(ctx, target_freq, in, before);
+    // The inverter puts out what the motor is fed; a tripped one nothing.
+    ctx->inverter.freq = tripped ? 0.0 : m->current_freq;
+    ctx->inverter.mod_index = tripped ? 0.0 : get_motor_voltage(m) / (0.5 * ctx->inverter.vdc);
+    if (!pwm) {
+        if (harmonics) harmonic_set_fundamental(harmonics, ctx->inverter.freq);
+        if (tripped) memset(ctx->switching.current, 0, sizeof(ctx->switching.current));
+        else if (harmonics) sample_pwm(ctx, until, harmonics);
+        signals[FAULT_SIGNAL_CURRENT] = get_motor_current(m);
+        signals[FAULT_SIGNAL_TEMP] = get_motor_temp(m);
+        // Without the switching model the phase current is taken at its crest.
+        signals[FAULT_SIGNAL_PHASE] = sqrt(2.0) * signals[FAULT_SIGNAL_CURRENT];
+        sample_faults(ctx, ctx->motor.dt, signals, capture);
+    }
+    ctx->time = until;
+    ctx->steps++;
+    PROBE_END(PROBE_SIM_STEP);
+}
+
+static double temp_crossing(FaultSignal signal, double level, void *user_data) {
+    (void)signal;
+    return motor_temp_crossing(user_data, level);
+}
+
+// Skips up to max_ticks steps of a drive that has settled at these inputs,
+// stopping short of any tick on which a fault rule could act, and returns
+// the ticks skipped. Only the winding temperature moves while settled, so
+// nothing is stepped: the thermal model and the fault rules are advanced in
+// closed form. Taps see nothing of the skipped ticks, and a drive with the
+// switching model on is never skipped.
+long sim_fast_forward(SimContext *ctx, const SimInputs *in, long max_ticks) {
+    MotorState *m = &ctx->motor;
+    if (max_ticks <= 0 || has_fault(&ctx->fault) || ctx->switching_mode != SWITCHING_OFF) return 0;
+    if (ctx->settled_ticks < SIM_SETTLE_TICKS || sim_target_freq(ctx, in) != ctx->settle_freq ||
+        in->is_forward != ctx->settle_forward || in->load_torque != ctx->settle_load)
+        return 0;
+    double signals[FAULT_SIGNAL_COUNT];
+    signals[FAULT_SIGNAL_CURRENT] = get_motor_current(m);
+    signals[FAULT_SIGNAL_PHASE] = sqrt(2.0) * signals[FAULT_SIGNAL_CURRENT];
+    signals[FAULT_SIGNAL_VOLTAGE] = ctx->inverter.vdc;
+    signals[FAULT_SIGNAL_TEMP] = get_motor_temp(m);
+    double quiet = fault_quiet_time(&ctx->fault, signals, 1u << FAULT_SIGNAL_TEMP, temp_crossing, m);
+    double horizon = floor(quiet / m->dt) - SIM_FF_MARGIN;
+    long n = horizon < (double)max_ticks ? (long)horizon : max_ticks;
+    if (n <= 0) return 0;
+    motor_advance(m, n);
+    fault_advance(&ctx->fault, m->dt, n, signals);
+    for (long i = 0; i < n; i++) ctx->time += m->dt;
+    ctx->steps += (unsigned long)n;
+    ctx->settled_ticks += n;
+    return n;
+}
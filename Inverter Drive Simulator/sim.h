@@ -0,0 +1,86 @@
+#ifndef SIM_H
+#define SIM_H
+
+#include <stddef.h>
+#include "motor.h"
+#include "inverter.h"
+#include "fault.h"
+#include "switching.h"
+#include "harmonic.h"
+
+#define SIM_DC_LINK 1.4142135623730951   // DC link per volt of rated line voltage: a diode rectifier
+#define SIM_CHANNELS 11
+#define SIM_HARMONIC_CHANNELS 2   // line voltage v_ab, phase current i_a
+#define SIM_MIN_DT 1e-6
+#define SIM_MAX_DT 1.0
+#define SIM_SETTLE_TICKS 20       // settled ticks before a drive may be fast-forwarded
+#define SIM_SETTLE_TOL 1e-9       // largest relative change per tick of a settled drive
+#define SIM_FF_MARGIN 2           // ticks left to step before a predicted trip
+
+typedef struct {
+    double rated_voltage;
+    double rated_current;
+    double rated_freq;
+    double rated_rpm;
+    double ramp_up;
+    double ramp_down;
+    double max_freq;
+    double min_freq;
+    PwmMode pwm_mode;
+    double carrier_freq;
+    SwitchingMode switching_mode;
+    double switching_dt;   // step for SWITCHING_FIXED
+    MotorModel motor_model;
+    Integrator integrator;
+    int substeps;
+    double dt;             // simulation tick (s)
+    ControlMode control_mode;
+    double control_rate;   // closed-loop controller rate (Hz)
+    ThermalModel thermal_model;
+} SimParams;
+
+typedef struct {
+    double speed_ref;   // percent of max_freq, 0..100
+    int is_forward;
+    double load_torque; // Nm
+} SimInputs;
+
+// Complete state of one drive. Holds no pointers, so it can be copied freely.
+typedef struct {
+    MotorState motor;
+    InverterState inverter;
+    FaultState fault;
+    SwitchingState switching;
+    SwitchingMode switching_mode;
+    double switching_dt;
+    double time;
+    unsigned long steps;
+    // Ticks in a row that changed nothing but the temperature and the frame
+    // angle, under the inputs they ran at. Kept here rather than in
+    // MotorState, which the batch kernel mirrors field for field.
+    long settled_ticks;
+    double settle_freq;
+    double settle_load;
+    int settle_forward;
+} SimContext;
+
+// Optional observers of a step, kept outside SimContext; either may be NULL.
+typedef struct {
+    FaultCapture *capture;
+    HarmonicAnalyzer *harmonics;   // SIM_HARMONIC_CHANNELS channels
+} SimTaps;
+
+void sim_default_params(SimParams *p);
+int sim_validate_params(const SimParams *p, char *error_msg, size_t len);
+void sim_init(SimContext *ctx, const SimParams *p);
+void sim_apply_params(SimContext *ctx, const SimParams *p);
+void sim_step(SimContext *ctx, const SimInputs *in);
+void sim_step_tapped(SimContext *ctx, const SimInputs *in, const SimTaps *taps);
+double sim_target_freq(const SimContext *ctx, const SimInputs *in);
+long sim_fast_forward(SimContext *ctx, const SimInputs *in, long max_ticks);
+
+// Every observable signal of a drive, in the order of sim_channel_names.
+extern const char *const sim_channel_names[SIM_CHANNELS];
+void sim_channel_values(const SimContext *ctx, double *out);
+
+#endif
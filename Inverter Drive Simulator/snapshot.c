@@ -0,0 +1,80 @@
+#include "snapshot.h"
+#include <stdio.h>
+#include <string.h>
+
+_Static_assert(sizeof(SimContext) % 8 == 0, "snapshot checksum covers the state in whole words");
+
+// FNV-1a taken a 64-bit word at a time, eight times fewer dependent
+// multiplies than bytewise. Every state struct is a whole number of words.
+static uint64_t checksum(const void *p, size_t n) {
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i + 8 <= n; i += 8) {
+        uint64_t w;
+        memcpy(&w, (const char *)p + i, sizeof(w));
+        h ^= w;
+        h *= 0x100000001b3ull;
+    }
+    return h;
+}
+
+static void fill_layout(SnapshotHeader *h) {
+    memset(h, 0, sizeof(*h));
+    memcpy(h->magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    h->version = SNAPSHOT_VERSION;
+    h->byte_order = SNAPSHOT_BYTE_ORDER;
+    h->state_size = (uint32_t)sizeof(SimContext);
+    h->part_sizes[0] = (uint32_t)sizeof(MotorState);
+    h->part_sizes[1] = (uint32_t)sizeof(ControlState);
+    h->part_sizes[2] = (uint32_t)sizeof(InverterState);
+    h->part_sizes[3] = (uint32_t)sizeof(FaultState);
+    h->part_sizes[4] = (uint32_t)sizeof(SwitchingState);
+}
+
+size_t snapshot_size(void) {
+    return sizeof(SnapshotHeader) + sizeof(SimContext);
+}
+
+// Returns the bytes written, 0 if buf is too small.
+size_t snapshot_save(const SimContext *ctx, void *buf, size_t len) {
+    if (len < snapshot_size()) return 0;
+    SnapshotHeader h;
+    fill_layout(&h);
+    h.checksum = checksum(ctx, sizeof(*ctx));
+    memcpy(buf, &h, sizeof(h));
+    memcpy((char *)buf + sizeof(h), ctx, sizeof(*ctx));
+    return snapshot_size();
+}
+
+// Leaves ctx untouched and returns 0 unless buf holds an intact snapshot
+// written by a build with the same state layout.
+int snapshot_restore(SimContext *ctx, const void *buf, size_t len) {
+    if (len < snapshot_size()) return 0;
+    SnapshotHeader expect, h;
+    fill_layout(&expect);
+    memcpy(&h, buf, sizeof(h));
+    expect.checksum = h.checksum;
+    if (memcmp(&h, &expect, sizeof(h)) != 0) return 0;
+    const unsigned char *state = (const unsigned char *)buf + sizeof(h);
+    if (checksum(state, sizeof(SimContext)) != h.checksum) return 0;
+    memcpy(ctx, state, sizeof(SimContext));
+    return 1;
+}
+
+int snapshot_write(const char *path, const SimContext *ctx) {
+    unsigned char buf[sizeof(SnapshotHeader) + sizeof(SimContext)];
+    size_t n = snapshot_save(ctx, buf, sizeof(buf));
+    FILE *f = fopen(path, "wb");
+    if (!f) return 0;
+    int ok = fwrite(buf, 1, n, f) == n;
+    return fclose(f) == 0 && ok;
+}
+
+int snapshot_read(const char *path, SimContext *ctx) {
+    unsigned char buf[sizeof(SnapshotHeader) + sizeof(SimContext)];
+    FILE *f = fopen(path, "rb");
+    if (!f) return 0;
+    size_t n = fread(buf, 1, sizeof(buf), f);
+    int extra = fgetc(f) != EOF;
+    fclose(f);
+    return !extra && snapshot_restore(ctx, buf, n);
+}
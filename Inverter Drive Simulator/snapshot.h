@@ -0,0 +1,34 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "sim.h"
+
+// Binary checkpoint of one drive: a SnapshotHeader followed by the raw bytes
+// of its SimContext. The context is plain data, so saving and restoring are
+// single copies. Snapshots are tied to the build that wrote them: the header
+// records the byte order and the size of every part of the state, and a
+// snapshot whose layout differs is rejected rather than misread. Bump
+// SNAPSHOT_VERSION when a state struct changes meaning without changing size.
+
+#define SNAPSHOT_MAGIC "IDSSNP1"
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_BYTE_ORDER 0x01020304u
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t state_size;    // sizeof(SimContext)
+    uint32_t part_sizes[5]; // MotorState, ControlState, InverterState, FaultState, SwitchingState
+    uint64_t checksum;      // FNV-1a over the state, by 64-bit word
+} SnapshotHeader;
+
+size_t snapshot_size(void);
+size_t snapshot_save(const SimContext *ctx, void *buf, size_t len);
+int snapshot_restore(SimContext *ctx, const void *buf, size_t len);
+int snapshot_write(const char *path, const SimContext *ctx);
+int snapshot_read(const char *path, SimContext *ctx);
+
+#endif
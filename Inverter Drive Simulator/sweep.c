@@ -0,0 +1,292 @@
+#include "sweep.h"
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef struct {
+    const char *name;
+    size_t offset;
+    int in_inputs;   // field of SimInputs rather than SimParams
+} FieldEntry;
+
+static const FieldEntry fields[SWEEP_FIELD_COUNT] = {
+    { "rated_voltage", offsetof(SimParams, rated_voltage), 0 },
+    { "rated_current", offsetof(SimParams, rated_current), 0 },
+    { "rated_freq", offsetof(SimParams, rated_freq), 0 },
+    { "rated_rpm", offsetof(SimParams, rated_rpm), 0 },
+    { "ramp_up", offsetof(SimParams, ramp_up), 0 },
+    { "ramp_down", offsetof(SimParams, ramp_down), 0 },
+    { "max_freq", offsetof(SimParams, max_freq), 0 },
+    { "min_freq", offsetof(SimParams, min_freq), 0 },
+    { "carrier_freq", offsetof(SimParams, carrier_freq), 0 },
+    { "load", offsetof(SimInputs, load_torque), 1 },
+    { "speed_ref", offsetof(SimInputs, speed_ref), 1 },
+};
+
+static const char *load_profile_names[LOAD_PROFILE_COUNT] = { "constant", "step", "fan" };
+
+typedef struct {
+    const SweepSpec *spec;
+    SweepResultFn fn;
+    void *user_data;
+    int cases;
+    atomic_int next;
+    atomic_int stop;
+    pthread_mutex_t lock;   // serialises fn and the stats below
+    SweepStats *stats;
+} SweepRun;
+
+static double *field_ptr(SimParams *p, SimInputs *in, SweepField f) {
+    return (double *)((char *)(fields[f].in_inputs ? (void *)in : (void *)p) + fields[f].offset);
+}
+
+void sweep_default_spec(SweepSpec *spec) {
+    memset(spec, 0, sizeof(*spec));
+    sim_default_params(&spec->base);
+    spec->inputs.speed_ref = 100.0;
+    spec->inputs.is_forward = 1;
+    spec->inputs.load_torque = 0.0;
+    spec->duration = 10.0;
+    spec->load_profiles = 1u << LOAD_PROFILE_CONSTANT;
+    spec->seed = 1;
+    spec->stop_on_fault = 1;
+}
+
+// NAME=LO:HI:N, NAME=LO:HI (5 points) or NAME=VALUE.
+int sweep_parse_axis(const char *arg, SweepAxis *axis) {
+    const char *eq = strchr(arg, '=');
+    if (!eq) return 0;
+    size_t len = (size_t)(eq - arg);
+    int field = -1;
+    for (int f = 0; f < SWEEP_FIELD_COUNT; f++)
+        if (strlen(fields[f].name) == len && strncmp(fields[f].name, arg, len) == 0) field = f;
+    if (field < 0) return 0;
+    axis->field = (SweepField)field;
+    axis->points = 5;
+    int n = sscanf(eq + 1, "%lf:%lf:%d", &axis->lo, &axis->hi, &axis->points);
+    if (n == 1) {
+        axis->hi = axis->lo;
+        axis->points = 1;
+    }
+    return n >= 1 && axis->points >= 1;
+}
+
+int sweep_parse_load_profiles(const char *arg, unsigned *mask) {
+    char *copy = strdup(arg);
+    char *save = NULL;
+    *mask = 0;
+    int ok = 1;
+    for (char *tok = strtok_r(copy, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+        int found = 0;
+        for (int p = 0; p < LOAD_PROFILE_COUNT; p++) {
+            if (strcmp(tok, load_profile_names[p]) == 0) {
+                *mask |= 1u << p;
+                found = 1;
+            }
+        }
+        if (!found) ok = 0;
+    }
+    free(copy);
+    return ok && *mask != 0;
+}
+
+static int profile_list(const SweepSpec *spec, LoadProfile *out) {
+    int n = 0;
+    for (int p = 0; p < LOAD_PROFILE_COUNT; p++)
+        if (spec->load_profiles & (1u << p)) out[n++] = (LoadProfile)p;
+    if (n == 0) out[n++] = LOAD_PROFILE_CONSTANT;
+    return n;
+}
+
+int sweep_case_count(const SweepSpec *spec) {
+    if (spec->samples > 0) return spec->samples;
+    LoadProfile profiles[LOAD_PROFILE_COUNT];
+    long count = profile_list(spec, profiles);
+    for (int a = 0; a < spec->num_axes; a++) {
+        count *= spec->axes[a].points;
+        if (count > 0x7fffffff) return -1;
+    }
+    return (int)count;
+}
+
+// Counter-based generator: a case's random draw depends only on the seed and
+// its index, never on which thread ran it or when.
+static uint64_t splitmix64(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ull;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+void sweep_make_case(const SweepSpec *spec, int index, SweepCase *c) {
+    LoadProfile profiles[LOAD_PROFILE_COUNT];
+    int num_profiles = profile_list(spec, profiles);
+    c->index = index;
+    c->params = spec->base;
+    c->inputs = spec->inputs;
+    int rest = index;
+    if (spec->samples > 0) {
+        uint64_t state = splitmix64((uint64_t)spec->seed ^ ((uint64_t)index << 20));
+        for (int a = 0; a < spec->num_axes; a++) {
+            const SweepAxis *ax = &spec->axes[a];
+            state = splitmix64(state);
+            double u = (double)(state >> 11) * (1.0 / 9007199254740992.0);
+            *field_ptr(&c->params, &c->inputs, ax->field) = ax->lo + (ax->hi - ax->lo) * u;
+        }
+        c->load_profile = profiles[index % num_profiles];
+    } else {
+        // Mixed-radix index: first axis varies fastest, load profile slowest.
+        for (int a = 0; a < spec->num_axes; a++) {
+            const SweepAxis *ax = &spec->axes[a];
+            int k = rest % ax->points;
+            rest /= ax->points;
+            double v = ax->points > 1 ? ax->lo + (ax->hi - ax->lo) * k / (ax->points - 1) : ax->lo;
+            *field_ptr(&c->params, &c->inputs, ax->field) = v;
+        }
+        c->load_profile = profiles[rest % num_profiles];
+    }
+    char error_msg[128];
+    c->valid = sim_validate_params(&c->params, error_msg, sizeof(error_msg)) && c->inputs.speed_ref >= 0.0 &&
+               c->inputs.speed_ref <= 100.0;
+}
+
+static double profile_load(const SweepCase *c, const SimContext *ctx, double duration) {
+    double full = c->inputs.load_torque;
+    switch (c->load_profile) {
+        case LOAD_PROFILE_STEP: return ctx->time >= duration / 2.0 ? full : 0.0;
+        case LOAD_PROFILE_FAN: {
+            double r = get_motor_speed(&ctx->motor) / c->params.rated_rpm;
+            return full * r * r;
+        }
+        default: return full;
+    }
+}
+
+void sweep_run_case(const SweepSpec *spec, const SweepCase *c, SweepResult *r) {
+    memset(r, 0, sizeof(*r));
+    r->c = *c;
+    r->time_to_speed = -1.0;
+    r->fault = FAULT_NONE;
+    r->fault_time = -1.0;
+    if (!c->valid) return;
+    SimContext ctx;
+    sim_init(&ctx, &c->params);
+    SimInputs in = c->inputs;
+    double target_rpm = sim_target_freq(&ctx, &in) / c->params.rated_freq * c->params.rated_rpm;
+    unsigned long total = (unsigned long)(spec->duration / c->params.dt + 0.5);
+    for (unsigned long i = 0; i < total; i++) {
+        in.load_torque = profile_load(c, &ctx, spec->duration);
+        sim_step(&ctx, &in);
+        double speed = fabs(get_motor_speed(&ctx.motor));
+        double current = fabs(get_motor_current(&ctx.motor));
+        if (current > r->peak_current) r->peak_current = current;
+        if (get_motor_temp(&ctx.motor) > r->peak_temp) r->peak_temp = get_motor_temp(&ctx.motor);
+        if (r->time_to_speed < 0.0 && target_rpm > 0.0 && speed >= target_rpm * (1.0 - SWEEP_SPEED_BAND))
+            r->time_to_speed = ctx.time;
+        if (r->fault == FAULT_NONE && has_fault(&ctx.fault)) {
+            r->fault = ctx.fault.current_fault;
+            r->fault_time = ctx.time;
+            if (spec->stop_on_fault) break;
+        }
+    }
+    r->final_speed = get_motor_speed(&ctx.motor);
+    r->sim_time = ctx.time;
+}
+
+static void *sweep_worker(void *arg) {
+    SweepRun *run = arg;
+    const SweepSpec *spec = run->spec;
+    for (;;) {
+        if (atomic_load_explicit(&run->stop, memory_order_relaxed)) break;
+        int index = atomic_fetch_add_explicit(&run->next, 1, memory_order_relaxed);
+        if (index >= run->cases) break;
+        SweepCase c;
+        SweepResult r;
+        sweep_make_case(spec, index, &c);
+        sweep_run_case(spec, &c, &r);
+        unsigned long steps = c.valid ? (unsigned long)(r.sim_time / c.params.dt + 0.5) : 0;
+        unsigned long planned = c.valid ? (unsigned long)(spec->duration / c.params.dt + 0.5) : 0;
+        pthread_mutex_lock(&run->lock);
+        SweepStats *s = run->stats;
+        s->completed++;
+        if (!c.valid) s->invalid++;
+        if (r.fault != FAULT_NONE) s->faulted++;
+        s->steps += steps;
+        if (planned > steps) s->steps_saved += planned - steps;
+        if (run->fn && run->fn(&r, run->user_data)) atomic_store(&run->stop, 1);
+        pthread_mutex_unlock(&run->lock);
+    }
+    return NULL;
+}
+
+// Runs every case with num_threads workers, the calling thread included.
+// Returns the number of cases completed, or -1 if the spec is unusable.
+int sweep_run(const SweepSpec *spec, int num_threads, SweepResultFn fn, void *user_data, SweepStats *stats) {
+    SweepStats local;
+    if (!stats) stats = &local;
+    memset(stats, 0, sizeof(*stats));
+    int cases = sweep_case_count(spec);
+    if (cases < 0 || spec->duration <= 0.0 || num_threads < 1) return -1;
+    if (num_threads > cases) num_threads = cases > 0 ? cases : 1;
+    SweepRun run = { .spec = spec, .fn = fn, .user_data = user_data, .cases = cases, .stats = stats };
+    atomic_init(&run.next, 0);
+    atomic_init(&run.stop, 0);
+    pthread_mutex_init(&run.lock, NULL);
+    stats->cases = cases;
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    pthread_t *threads = calloc((size_t)num_threads, sizeof(pthread_t));
+    int started = 1;
+    for (int w = 1; threads && w < num_threads; w++, started++)
+        if (pthread_create(&threads[w], NULL, sweep_worker, &run) != 0) break;
+    sweep_worker(&run);
+    for (int w = 1; w < started; w++) pthread_join(threads[w], NULL);
+    free(threads);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    stats->wall_seconds = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9;
+    pthread_mutex_destroy(&run.lock);
+    return stats->completed;
+}
+
+const char *sweep_field_name(SweepField field) {
+    return fields[field].name;
+}
+
+double sweep_case_value(const SweepCase *c, SweepField field) {
+    SweepCase copy = *c;
+    return *field_ptr(&copy.params, &copy.inputs, field);
+}
+
+const char *sweep_load_profile_name(LoadProfile profile) {
+    return load_profile_names[profile];
+}
+
+#define APPEND(...) do { int w = snprintf(buf + n, n < len ? len - n : 0, __VA_ARGS__); if (w > 0) n += (size_t)w; } while (0)
+
+size_t sweep_format_header(const SweepSpec *spec, char *buf, size_t len) {
+    size_t n = 0;
+    APPEND("case");
+    for (int a = 0; a < spec->num_axes; a++) APPEND(",%s", fields[spec->axes[a].field].name);
+    APPEND(",load_profile,time_to_speed,peak_current,peak_temp,final_speed,fault,fault_time\n");
+    return n;
+}
+
+size_t sweep_format_result(const SweepSpec *spec, const SweepResult *r, char *buf, size_t len) {
+    size_t n = 0;
+    APPEND("%d", r->c.index);
+    for (int a = 0; a < spec->num_axes; a++) APPEND(",%.6g", sweep_case_value(&r->c, spec->axes[a].field));
+    APPEND(",%s", load_profile_names[r->c.load_profile]);
+    if (!r->c.valid) {
+        APPEND(",,,,,invalid,\n");
+        return n;
+    }
+    APPEND(",%.3f,%.4f,%.4f,%.4f,%s,%.3f\n", r->time_to_speed, r->peak_current, r->peak_temp, r->final_speed,
+           fault_type_name(r->fault), r->fault_time);
+    return n;
+}
+
+#undef APPEND
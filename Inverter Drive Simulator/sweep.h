@@ -0,0 +1,103 @@
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include <stddef.h>
+#include "sim.h"
+
+// Design-space sweep: every case is one drive run from standstill for the
+// sweep duration with its own parameters, on its own SimContext. Cases are
+// handed to worker threads from a shared cursor and reported as each one
+// finishes, so results stream in completion order, not case order.
+
+#define SWEEP_MAX_AXES 8
+#define SWEEP_SPEED_BAND 0.05   // "at speed" within 5 % of the commanded speed
+
+typedef enum {
+    SWEEP_RATED_VOLTAGE,
+    SWEEP_RATED_CURRENT,
+    SWEEP_RATED_FREQ,
+    SWEEP_RATED_RPM,
+    SWEEP_RAMP_UP,
+    SWEEP_RAMP_DOWN,
+    SWEEP_MAX_FREQ,
+    SWEEP_MIN_FREQ,
+    SWEEP_CARRIER_FREQ,
+    SWEEP_LOAD,
+    SWEEP_SPEED_REF,
+    SWEEP_FIELD_COUNT
+} SweepField;
+
+typedef enum {
+    LOAD_PROFILE_CONSTANT,   // full load from the start
+    LOAD_PROFILE_STEP,       // no load, full load from half the duration
+    LOAD_PROFILE_FAN,        // load rising with the square of speed, full at rated speed
+    LOAD_PROFILE_COUNT
+} LoadProfile;
+
+typedef struct {
+    SweepField field;
+    double lo;
+    double hi;
+    int points;   // grid points, lo and hi included; ignored when sampling
+} SweepAxis;
+
+typedef struct {
+    SimParams base;
+    SimInputs inputs;
+    double duration;
+    SweepAxis axes[SWEEP_MAX_AXES];
+    int num_axes;
+    unsigned load_profiles;   // bit per LoadProfile, 0 means constant only
+    int samples;              // 0: full grid, otherwise this many random cases
+    unsigned long seed;
+    int stop_on_fault;        // end a case at its first fault
+} SweepSpec;
+
+typedef struct {
+    int index;
+    SimParams params;
+    SimInputs inputs;
+    LoadProfile load_profile;
+    int valid;   // params passed sim_validate_params
+} SweepCase;
+
+typedef struct {
+    SweepCase c;
+    double time_to_speed;   // -1 if never at speed
+    double peak_current;
+    double peak_temp;
+    double final_speed;
+    FaultType fault;        // first fault, FAULT_NONE if none
+    double fault_time;
+    double sim_time;        // simulated time actually run
+} SweepResult;
+
+typedef struct {
+    int cases;
+    int completed;
+    int faulted;
+    int invalid;
+    unsigned long steps;
+    unsigned long steps_saved;   // steps skipped by stopping faulted cases early
+    double wall_seconds;
+} SweepStats;
+
+// Called from worker threads, one call at a time. Return nonzero to stop
+// handing out further cases.
+typedef int (*SweepResultFn)(const SweepResult *result, void *user_data);
+
+void sweep_default_spec(SweepSpec *spec);
+int sweep_parse_axis(const char *arg, SweepAxis *axis);
+int sweep_parse_load_profiles(const char *arg, unsigned *mask);
+int sweep_case_count(const SweepSpec *spec);
+void sweep_make_case(const SweepSpec *spec, int index, SweepCase *c);
+void sweep_run_case(const SweepSpec *spec, const SweepCase *c, SweepResult *result);
+int sweep_run(const SweepSpec *spec, int num_threads, SweepResultFn fn, void *user_data, SweepStats *stats);
+
+const char *sweep_field_name(SweepField field);
+double sweep_case_value(const SweepCase *c, SweepField field);
+const char *sweep_load_profile_name(LoadProfile profile);
+size_t sweep_format_header(const SweepSpec *spec, char *buf, size_t len);
+size_t sweep_format_result(const SweepSpec *spec, const SweepResult *r, char *buf, size_t len);
+
+#endif
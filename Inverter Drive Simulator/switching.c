@@ -0,0 +1,169 @@
+#include "switching.h"
+#include <math.h>
+#include <string.h>
+
+void switching_default_params(SwitchingParams *p) {
+    p->dead_time = 2e-6;
+    p->min_pulse = 1e-6;
+}
+
+void switching_init(SwitchingState *s, const SwitchingParams *p) {
+    memset(s, 0, sizeof(*s));
+    s->params = *p;
+}
+
+// The new reference is sampled from the next half carrier period on.
+void switching_set_reference(SwitchingState *s, double v_alpha, double v_beta, double omega) {
+    s->ref[0] = v_alpha;
+    s->ref[1] = v_beta;
+    s->ref_omega = omega;
+    s->ref_time = s->time;
+}
+
+double switching_phase_voltage(const SwitchingState *s, const InverterState *inv, int leg) {
+    int sum = s->leg[0] + s->leg[1] + s->leg[2];
+    return inv->vdc / 3.0 * (3 * s->leg[leg] - sum);
+}
+
+static void push_event(SwitchingState *s, double time, int leg, uint8_t state, uint8_t is_gate) {
+    if (s->num_pending == SWITCHING_MAX_PENDING) return;
+    int i = s->num_pending++;
+    while (i > 0 && s->pending[i - 1].time > time) {
+        s->pending[i] = s->pending[i - 1];
+        i--;
+    }
+    s->pending[i].time = time;
+    s->pending[i].leg = leg;
+    s->pending[i].state = state;
+    s->pending[i].is_gate = is_gate;
+}
+
+static void pop_event(SwitchingState *s) {
+    s->num_pending--;
+    memmove(s->pending, s->pending + 1, sizeof(SwitchEvent) * s->num_pending);
+}
+
+// A gate edge overrides a commutation of its leg still waiting out the dead-time.
+static void cancel_commutation(SwitchingState *s, int leg) {
+    int n = 0;
+    for (int i = 0; i < s->num_pending; i++) {
+        if (s->pending[i].is_gate || s->pending[i].leg != leg) s->pending[n++] = s->pending[i];
+    }
+    s->num_pending = n;
+}
+
+// Double-update regular-sampled PWM has its crossings in closed form: each
+// half carrier period samples its own reference r, and the gate turns on at
+// carrier position (1 - r)/4 in the first half and off at (3 + r)/4 in the
+// second, so it is on for (1 + r)/4 of the period in each half. A half
+// after one held off or on first puts the gate where its pulse starts.
+// An edge that the dead-time will delay, going by the sign of the phase
+// current, is issued a dead-time early to compensate. Direct, each leg is
+// held high or low for the whole half.
+static void schedule_half(SwitchingState *s, const InverterState *inv) {
+    double half = 0.5 / inv->carrier_freq;
+    double min_pulse = 0.5 * fmax(s->params.min_pulse, s->params.dead_time);
+    int falling = s->falling;
+    double ref[3];
+    s->half_start = s->half_end;
+    s->half_end = s->half_start + half;
+    s->falling = !falling;
+    double turn = s->ref_omega * (s->half_start - s->ref_time);
+    double c = cos(turn), sn = sin(turn);
+    pwm_vector_references(inv, c * s->ref[0] - sn * s->ref[1], sn * s->ref[0] + c * s->ref[1], ref);
+    for (int leg = 0; leg < 3; leg++) {
+        double r = fmax(-1.0, fmin(1.0, ref[leg]));
+        if (s->direct) r = ref[leg] > 0.0 ? 1.0 : -1.0;
+        double on = (1.0 + r) * 0.5 * half;
+        if (on < min_pulse) {
+            if (s->gate[leg]) push_event(s, s->half_start, leg, 0, 1);
+        } else if (half - on < min_pulse) {
+            if (!s->gate[leg]) push_event(s, s->half_start, leg, 1, 1);
+        } else if (falling) {
+            if (!s->gate[leg]) push_event(s, s->half_start, leg, 1, 1);
+            double lead = s->current[leg] < 0.0 ? s->params.dead_time : 0.0;
+            push_event(s, fmax(s->half_start, s->half_start + on - lead), leg, 0, 1);
+        } else {
+            if (s->gate[leg]) push_event(s, s->half_start, leg, 0, 1);
+            double lead = s->current[leg] > 0.0 ? s->params.dead_time : 0.0;
+            push_event(s, fmax(s->half_start, s->half_end - on - lead), leg, 1, 1);
+        }
+    }
+}
+
+// A gate edge changes the leg output at once when the load current is
+// already commutated to the incoming side's diode, otherwise only after
+// the dead-time.
+static void apply_event(SwitchingState *s, const SwitchEvent *ev) {
+    s->events++;
+    if (!ev->is_gate) {
+        s->leg[ev->leg] = ev->state;
+        return;
+    }
+    s->gate[ev->leg] = ev->state;
+    cancel_commutation(s, ev->leg);
+    double i = s->current[ev->leg];
+    int immediate = ev->state ? i < 0.0 : i > 0.0;
+    if (immediate || s->params.dead_time <= 0.0) {
+        s->leg[ev->leg] = ev->state;
+    } else {
+        push_event(s, ev->time + s->params.dead_time, ev->leg, ev->state, 0);
+    }
+}
+
+static void integrate(SwitchingState *s, const InverterState *inv, double t1, SwitchingLoad load, void *user_data) {
+    double h = t1 - s->time;
+    if (h <= 0.0) return;
+    double v[3], i0[3], sq = 0.0;
+    for (int leg = 0; leg < 3; leg++) {
+        v[leg] = switching_phase_voltage(s, inv, leg);
+        i0[leg] = s->current[leg];
+    }
+    load(user_data, v, h, s->current);
+    // Mean square of a current ramping from a to b: (a^2 + ab + b^2) / 3
+    for (int leg = 0; leg < 3; leg++) {
+        double a = i0[leg], b = s->current[leg];
+        sq += (a * a + a * b + b * b) / 9.0;
+    }
+    s->i2_integral += sq * h;
+    s->vab_integral += inv->vdc * ((int)s->leg[0] - (int)s->leg[1]) * h;
+    s->time = t1;
+    s->intervals++;
+}
+
+// A stop within rounding of the next half period start becomes that start,
+// so a reference set on stopping there is sampled by the next half.
+static void align_half(SwitchingState *s, const InverterState *inv, double until) {
+    if (fabs(s->half_end - until) < 1e-9 / inv->carrier_freq) s->half_end = until;
+}
+
+void switching_run(SwitchingState *s, const InverterState *inv, double until, SwitchingLoad load, void *user_data) {
+    align_half(s, inv, until);
+    while (s->time < until) {
+        if (s->time >= s->half_end) schedule_half(s, inv);
+        double next = fmin(s->half_end, until);
+        if (s->num_pending > 0 && s->pending[0].time < next) next = s->pending[0].time;
+        integrate(s, inv, next, load, user_data);
+        while (s->num_pending > 0 && s->pending[0].time <= s->time) {
+            SwitchEvent ev = s->pending[0];
+            pop_event(s);
+            apply_event(s, &ev);
+        }
+    }
+}
+
+// Reference path: the same switching pattern, but every edge only takes
+// effect at the next multiple of dt.
+void switching_run_fixed(SwitchingState *s, const InverterState *inv, double until, double dt, SwitchingLoad load,
+                         void *user_data) {
+    align_half(s, inv, until);
+    while (s->time < until) {
+        if (s->time >= s->half_end) schedule_half(s, inv);
+        while (s->num_pending > 0 && s->pending[0].time <= s->time) {
+            SwitchEvent ev = s->pending[0];
+            pop_event(s);
+            apply_event(s, &ev);
+        }
+        integrate(s, inv, fmin(s->time + dt, until), load, user_data);
+    }
+}
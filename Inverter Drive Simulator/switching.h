@@ -0,0 +1,65 @@
+#ifndef SWITCHING_H
+#define SWITCHING_H
+
+#include <stdint.h>
+#include "inverter.h"
+
+#define SWITCHING_MAX_PENDING 16
+
+typedef enum {
+    SWITCHING_OFF,
+    SWITCHING_EVENT,
+    SWITCHING_FIXED
+} SwitchingMode;
+
+typedef struct {
+    double dead_time;    // s
+    double min_pulse;    // pulses shorter than this are dropped (s)
+} SwitchingParams;
+
+typedef struct {
+    double time;
+    int leg;
+    uint8_t state;
+    uint8_t is_gate;     // gate command, or delayed output edge after dead-time
+} SwitchEvent;
+
+// Steps the load between the legs over h with the phase voltages v held,
+// and returns its phase currents in i.
+typedef void (*SwitchingLoad)(void *user_data, const double v[3], double h, double i[3]);
+
+// PWM-level model of the inverter. The legs follow a phase voltage vector
+// in the stationary frame, turning at a set speed between updates, and the
+// load is stepped once per interval in which the leg voltages are constant,
+// so the event-driven mode jumps straight from one switching instant to the
+// next.
+typedef struct {
+    SwitchingParams params;
+    double time;
+    double current[3];
+    double vab_integral;     // running integral of the output V_ab (V s)
+    double i2_integral;      // running integral of the phase currents' mean square (A^2 s)
+    uint8_t gate[3];
+    uint8_t leg[3];
+    uint8_t falling;         // the next half period has the falling edges
+    uint8_t direct;          // legs take the sign of their reference: inverter states, not PWM
+    double ref[2];           // voltage vector (V) at ref_time
+    double ref_omega;        // its speed (rad/s)
+    double ref_time;
+    double half_start;       // half carrier period under way
+    double half_end;
+    SwitchEvent pending[SWITCHING_MAX_PENDING];
+    int num_pending;
+    unsigned long events;
+    unsigned long intervals;
+} SwitchingState;
+
+void switching_default_params(SwitchingParams *p);
+void switching_init(SwitchingState *s, const SwitchingParams *p);
+void switching_set_reference(SwitchingState *s, double v_alpha, double v_beta, double omega);
+void switching_run(SwitchingState *s, const InverterState *inv, double until, SwitchingLoad load, void *user_data);
+void switching_run_fixed(SwitchingState *s, const InverterState *inv, double until, double dt, SwitchingLoad load,
+                         void *user_data);
+double switching_phase_voltage(const SwitchingState *s, const InverterState *inv, int leg);
+
+#endif
@@ -0,0 +1,101 @@
+#include "telemetry.h"
+#include <string.h>
+
+#define RING_MASK (TELEMETRY_RING_SIZE - 1)
+#define DRAIN_BATCH 256
+
+void telemetry_ring_init(TelemetryRing *r) {
+    atomic_init(&r->head, 0);
+    atomic_init(&r->tail, 0);
+    atomic_init(&r->dropped, 0);
+    r->tail_cache = 0;
+    r->head_cache = 0;
+}
+
+int telemetry_push(TelemetryRing *r, const TelemetrySample *s) {
+    size_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    if (head - r->tail_cache >= TELEMETRY_RING_SIZE) {
+        r->tail_cache = atomic_load_explicit(&r->tail, memory_order_acquire);
+        if (head - r->tail_cache >= TELEMETRY_RING_SIZE) {
+            atomic_fetch_add_explicit(&r->dropped, 1, memory_order_relaxed);
+            return 0;
+        }
+    }
+    r->buf[head & RING_MASK] = *s;
+    atomic_store_explicit(&r->head, head + 1, memory_order_release);
+    return 1;
+}
+
+size_t telemetry_pop(TelemetryRing *r, TelemetrySample *out, size_t max) {
+    size_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    if (r->head_cache == tail)
+        r->head_cache = atomic_load_explicit(&r->head, memory_order_acquire);
+    size_t n = r->head_cache - tail;
+    if (n > max) n = max;
+    for (size_t i = 0; i < n; i++)
+        out[i] = r->buf[(tail + i) & RING_MASK];
+    atomic_store_explicit(&r->tail, tail + n, memory_order_release);
+    return n;
+}
+
+unsigned long telemetry_dropped(TelemetryRing *r) {
+    return atomic_load_explicit(&r->dropped, memory_order_relaxed);
+}
+
+void telemetry_history_init(TelemetryHistory *h) {
+    memset(h, 0, sizeof(*h));
+}
+
+double telemetry_channel_value(const TelemetrySample *s, TelemetryChannel ch) {
+    switch (ch) {
+        case TELEMETRY_VLL: return s->vll;
+        case TELEMETRY_CURRENT: return s->current;
+        case TELEMETRY_FREQ: return s->freq;
+        case TELEMETRY_TORQUE: return s->torque;
+        case TELEMETRY_SPEED: return s->speed;
+        case TELEMETRY_TEMP: return s->temp;
+        default: return 0.0;
+    }
+}
+
+const char *telemetry_channel_name(TelemetryChannel ch) {
+    switch (ch) {
+        case TELEMETRY_VLL: return "Voltage (V)";
+        case TELEMETRY_CURRENT: return "Current (A)";
+        case TELEMETRY_FREQ: return "Frequency (Hz)";
+        case TELEMETRY_TORQUE: return "Torque (Nm)";
+        case TELEMETRY_SPEED: return "Speed (RPM)";
+        case TELEMETRY_TEMP: return "Temperature (C)";
+        default: return "";
+    }
+}
+
+void telemetry_history_append(TelemetryHistory *h, const TelemetrySample *s) {
+    h->time[h->next] = s->time;
+    for (int ch = 0; ch < TELEMETRY_CHANNELS; ch++)
+        h->data[ch][h->next] = telemetry_channel_value(s, (TelemetryChannel)ch);
+    h->next = (h->next + 1) % TELEMETRY_HISTORY;
+    if (h->count < TELEMETRY_HISTORY) h->count++;
+    h->latest = *s;
+}
+
+size_t telemetry_history_drain(TelemetryHistory *h, TelemetryRing *r) {
+    TelemetrySample batch[DRAIN_BATCH];
+    size_t total = 0, n;
+    while ((n = telemetry_pop(r, batch, DRAIN_BATCH)) > 0) {
+        for (size_t i = 0; i < n; i++)
+            telemetry_history_append(h, &batch[i]);
+        total += n;
+    }
+    return total;
+}
+
+// Copies up to max samples of one channel, oldest first.
+size_t telemetry_history_read(const TelemetryHistory *h, TelemetryChannel ch, double *out, size_t max) {
+    size_t n = h->count < max ? h->count : max;
+    size_t start = (h->next + TELEMETRY_HISTORY - n) % TELEMETRY_HISTORY;
+    size_t first = TELEMETRY_HISTORY - start < n ? TELEMETRY_HISTORY - start : n;
+    memcpy(out, &h->data[ch][start], first * sizeof(double));
+    memcpy(out + first, &h->data[ch][0], (n - first) * sizeof(double));
+    return n;
+}
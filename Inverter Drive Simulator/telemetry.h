@@ -0,0 +1,63 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+
+#define TELEMETRY_RING_SIZE 4096   // power of two
+#define TELEMETRY_HISTORY 8192
+
+typedef struct {
+    double time;
+    double vll;
+    double current;
+    double speed;
+    double torque;
+    double temp;
+    double freq;
+    int fault;
+} TelemetrySample;
+
+typedef enum {
+    TELEMETRY_VLL,
+    TELEMETRY_CURRENT,
+    TELEMETRY_FREQ,
+    TELEMETRY_TORQUE,
+    TELEMETRY_SPEED,
+    TELEMETRY_TEMP,
+    TELEMETRY_CHANNELS
+} TelemetryChannel;
+
+// Single-producer/single-consumer ring. The producer never waits: when the
+// consumer falls behind, new samples are dropped and counted instead.
+typedef struct {
+    _Alignas(64) atomic_size_t head;   // written by the producer only
+    size_t tail_cache;
+    _Alignas(64) atomic_size_t tail;   // written by the consumer only
+    size_t head_cache;
+    _Alignas(64) atomic_ulong dropped;
+    TelemetrySample buf[TELEMETRY_RING_SIZE];
+} TelemetryRing;
+
+// Consumer-side history, one array per channel, oldest sample overwritten.
+typedef struct {
+    double time[TELEMETRY_HISTORY];
+    double data[TELEMETRY_CHANNELS][TELEMETRY_HISTORY];
+    size_t next;
+    size_t count;
+    TelemetrySample latest;
+} TelemetryHistory;
+
+void telemetry_ring_init(TelemetryRing *r);
+int telemetry_push(TelemetryRing *r, const TelemetrySample *s);
+size_t telemetry_pop(TelemetryRing *r, TelemetrySample *out, size_t max);
+unsigned long telemetry_dropped(TelemetryRing *r);
+
+void telemetry_history_init(TelemetryHistory *h);
+void telemetry_history_append(TelemetryHistory *h, const TelemetrySample *s);
+size_t telemetry_history_drain(TelemetryHistory *h, TelemetryRing *r);
+size_t telemetry_history_read(const TelemetryHistory *h, TelemetryChannel ch, double *out, size_t max);
+double telemetry_channel_value(const TelemetrySample *s, TelemetryChannel ch);
+const char *telemetry_channel_name(TelemetryChannel ch);
+
+#endif
@@ -0,0 +1,163 @@
+#include "thermal.h"
+#include <math.h>
+#include <string.h>
+
+#define THERMAL_BISECTIONS 200
+
+static const char *model_names[] = { "linear", "network" };
+
+// rated_loss is the copper loss at rated current. The rated rise splits
+// between the two resistances, and each capacitance sets its node's own
+// time constant.
+void thermal_params_from_rating(ThermalParams *p, double rated_loss) {
+    double r = THERMAL_RATED_RISE / rated_loss;
+    p->r_fa = THERMAL_FRAME_SHARE * r;
+    p->r_wf = (1.0 - THERMAL_FRAME_SHARE) * r;
+    p->c_w = THERMAL_WINDING_TAU / p->r_wf;
+    p->c_f = THERMAL_FRAME_TAU / p->r_fa;
+    p->ambient = THERMAL_AMBIENT;
+}
+
+void thermal_init(ThermalState *t, const ThermalParams *p) {
+    memset(t, 0, sizeof(*t));
+    t->params = *p;
+    t->winding = p->ambient;
+    t->frame = p->ambient;
+}
+
+void thermal_set_params(ThermalState *t, const ThermalParams *p) {
+    if (memcmp(p, &t->params, sizeof(*p)) == 0) return;
+    t->params = *p;
+    t->cache_dt = 0.0;
+}
+
+// The rises x = (winding, frame) - ambient obey x' = A x + B P with
+//   A = [[-a, a], [b, -(b + c)]],  a = 1/(r_wf c_w), b = 1/(r_wf c_f), c = 1/(r_fa c_f).
+// A has two distinct negative eigenvalues, so with E_k = A - l_k I
+//   e^(A t) = (e^(l1 t) E2 - e^(l2 t) E1) / (l1 - l2).
+typedef struct {
+    double a, b, c;
+    double l1, l2;
+    double ss[2];   // steady rise per watt
+} ThermalModes;
+
+static void modes(const ThermalParams *p, ThermalModes *m) {
+    m->a = 1.0 / (p->r_wf * p->c_w);
+    m->b = 1.0 / (p->r_wf * p->c_f);
+    m->c = 1.0 / (p->r_fa * p->c_f);
+    double tr = m->a + m->b + m->c;
+    double disc = sqrt(tr * tr - 4.0 * m->a * m->c);
+    m->l1 = -0.5 * (tr - disc);
+    // The product of the eigenvalues is a c; dividing keeps the small one accurate.
+    m->l2 = m->a * m->c / m->l1;
+    if (m->l2 > m->l1) {
+        double s = m->l1;
+        m->l1 = m->l2;
+        m->l2 = s;
+    }
+    m->ss[0] = p->r_wf + p->r_fa;
+    m->ss[1] = p->r_fa;
+}
+
+static void propagator(const ThermalModes *m, double t, double phi[2][2], double gamma[2]) {
+    double e1 = exp(m->l1 * t), e2 = exp(m->l2 * t);
+    double a[2][2] = { { -m->a, m->a }, { m->b, -(m->b + m->c) } };
+    double d = m->l1 - m->l2;
+    for (int i = 0; i < 2; i++) {
+        for (int j = 0; j < 2; j++) {
+            double diag = i == j ? 1.0 : 0.0;
+            phi[i][j] = (e1 * (a[i][j] - m->l2 * diag) - e2 * (a[i][j] - m->l1 * diag)) / d;
+        }
+    }
+    // Constant loss from t = 0: x = phi x0 + (I - phi) x_ss
+    for (int i = 0; i < 2; i++) gamma[i] = m->ss[i] - phi[i][0] * m->ss[0] - phi[i][1] * m->ss[1];
+}
+
+static void apply(ThermalState *t, double phi[2][2], const double gamma[2], double loss) {
+    double w = t->winding - t->params.ambient, f = t->frame - t->params.ambient;
+    t->winding = t->params.ambient + phi[0][0] * w + phi[0][1] * f + gamma[0] * loss;
+    t->frame = t->params.ambient + phi[1][0] * w + phi[1][1] * f + gamma[1] * loss;
+}
+
+void thermal_step(ThermalState *t, double loss, double dt) {
+    if (t->cache_dt != dt) {
+        ThermalModes m;
+        modes(&t->params, &m);
+        propagator(&m, dt, t->phi, t->gamma);
+        t->cache_dt = dt;
+    }
+    apply(t, t->phi, t->gamma, loss);
+}
+
+// One step of any length: the state stepping would reach after duration
+// seconds at this loss, up to rounding.
+void thermal_advance(ThermalState *t, double loss, double duration) {
+    ThermalModes m;
+    double phi[2][2], gamma[2];
+    modes(&t->params, &m);
+    propagator(&m, duration, phi, gamma);
+    apply(t, phi, gamma, loss);
+}
+
+// Winding temperature s seconds on, as w_ss + k1 e^(l1 s) + k2 e^(l2 s).
+typedef struct {
+    double w_ss, k1, k2, l1, l2;
+} WindingCurve;
+
+static double curve_at(const WindingCurve *c, double s) {
+    return c->w_ss + c->k1 * exp(c->l1 * s) + c->k2 * exp(c->l2 * s);
+}
+
+// Earliest s in [lo, hi] at which the curve, monotone there, reaches level;
+// the answer errs early.
+static double bisect(const WindingCurve *c, double level, double lo, double hi) {
+    double sign = curve_at(c, lo) < level ? 1.0 : -1.0;
+    for (int i = 0; i < THERMAL_BISECTIONS && hi - lo > 1e-9 * (1.0 + lo); i++) {
+        double mid = 0.5 * (lo + hi);
+        if (sign * (curve_at(c, mid) - level) < 0.0) lo = mid;
+        else hi = mid;
+    }
+    return lo;
+}
+
+// Seconds until the winding first reaches winding_level at this loss, or
+// HUGE_VAL if it never does. The curve has at most one turning point, so
+// bisecting the monotone stretch on either side of it finds the crossing.
+double thermal_time_to(const ThermalState *t, double loss, double winding_level) {
+    ThermalModes m;
+    modes(&t->params, &m);
+    double level = winding_level - t->params.ambient;
+    double d0 = t->winding - t->params.ambient - m.ss[0] * loss;
+    double d1 = t->frame - t->params.ambient - m.ss[1] * loss;
+    double dl = m.l1 - m.l2;
+    WindingCurve c = {
+        m.ss[0] * loss,
+        ((-m.a - m.l2) * d0 + m.a * d1) / dl,
+        -((-m.a - m.l1) * d0 + m.a * d1) / dl,
+        m.l1, m.l2
+    };
+    double x0 = curve_at(&c, 0.0);
+    if (x0 == level) return 0.0;
+    double turn = HUGE_VAL;
+    double ratio = c.k1 != 0.0 ? -c.k2 * m.l2 / (c.k1 * m.l1) : 0.0;
+    if (ratio > 0.0) {
+        double s = log(ratio) / dl;
+        if (s > 0.0) turn = s;
+    }
+    if (turn < HUGE_VAL) {
+        double xt = curve_at(&c, turn);
+        if ((x0 - level) * (xt - level) <= 0.0) return bisect(&c, level, 0.0, turn);
+        x0 = xt;
+    } else {
+        turn = 0.0;
+    }
+    // From the turning point on the curve heads straight for w_ss.
+    if ((x0 - level) * (c.w_ss - level) >= 0.0) return HUGE_VAL;
+    double hi = turn + 1.0 / -m.l2;
+    while ((curve_at(&c, hi) - level) * (x0 - level) > 0.0) hi = turn + 2.0 * (hi - turn);
+    return bisect(&c, level, turn, hi);
+}
+
+const char *thermal_model_name(ThermalModel model) {
+    return model >= THERMAL_LINEAR && model <= THERMAL_NETWORK ? model_names[model] : "unknown";
+}
@@ -0,0 +1,45 @@
+#ifndef THERMAL_H
+#define THERMAL_H
+
+typedef enum {
+    THERMAL_LINEAR,    // legacy: rises with current, never cools
+    THERMAL_NETWORK
+} ThermalModel;
+
+#define THERMAL_AMBIENT 25.0        // C
+#define THERMAL_RATED_RISE 45.0     // K of winding over ambient at rated current, steady
+#define THERMAL_FRAME_SHARE 0.6     // share of that rise across frame to ambient
+#define THERMAL_WINDING_TAU 300.0   // s, winding to frame
+#define THERMAL_FRAME_TAU 2400.0    // s, frame to ambient
+
+// Lumped network: copper loss heats the winding, which couples to the frame
+// through r_wf, and the frame to ambient through r_fa.
+typedef struct {
+    double r_wf;       // K/W
+    double r_fa;
+    double c_w;        // J/K
+    double c_f;
+    double ambient;    // C
+} ThermalParams;
+
+// Rises over ambient are stepped with the exact zero-order-hold solution, so
+// a step of any length under constant loss lands on the continuous curve.
+// The propagator for the last step length is cached.
+typedef struct {
+    ThermalParams params;
+    double winding;    // C
+    double frame;
+    double cache_dt;   // 0 when no propagator is cached
+    double phi[2][2];
+    double gamma[2];   // step response to 1 W of loss
+} ThermalState;
+
+void thermal_params_from_rating(ThermalParams *p, double rated_loss);
+void thermal_init(ThermalState *t, const ThermalParams *p);
+void thermal_set_params(ThermalState *t, const ThermalParams *p);
+void thermal_step(ThermalState *t, double loss, double dt);
+void thermal_advance(ThermalState *t, double loss, double duration);
+double thermal_time_to(const ThermalState *t, double loss, double winding);
+const char *thermal_model_name(ThermalModel model);
+
+#endif
@@ -1,32 +1,42 @@
 #include "waveform.h"
-#include "inverter.h"
-#include "motor.h"
 #include "gui.h"
+#include "telemetry.h"
+#include "instrument.h"
 #include <math.h>
-#include <time.h>
-#define SAMPLES 100
+#include <stdio.h>
+#include <string.h>
 #define PLOT_HEIGHT 120
+#define NUM_PLOTS 5
+#define MAX_COLUMNS 4096
+#define SPECTRUM_GAP 10
+#define SPECTRUM_RANGE_DB 80.0
 
-void draw_waveform(GtkDrawingArea *area, cairo_t *cr, int width, int height, gpointer user_data) {
-    g_print("Drawing waveform\n");
-    AppWidgets *widgets = (AppWidgets *)user_data;
-    double vdc = atof(gtk_editable_get_text(GTK_EDITABLE(widgets->rated_voltage_entry)));
-    double mod_index = 0.8;
-    double freq = atof(gtk_editable_get_text(GTK_EDITABLE(widgets->max_freq_entry))) *
-                  gtk_range_get_value(GTK_RANGE(widgets->speed_ref_scale)) / 100.0;
-    double max_v = vdc * mod_index * 1.1;
-    double max_current = atof(gtk_editable_get_text(GTK_EDITABLE(widgets->rated_current_entry))) * 1.5;
-    double max_speed = atof(gtk_editable_get_text(GTK_EDITABLE(widgets->rated_rpm_entry))) * 1.2;
-    double max_torque = max_current * vdc / max_speed * 1.5;
-    double max_freq = atof(gtk_editable_get_text(GTK_EDITABLE(widgets->max_freq_entry)));
-    double waveform[SAMPLES];
-    static double time = 0.0;
-    time += 0.05;
-    get_pwm_waveform(waveform, SAMPLES, time);
+static const TelemetryChannel plot_channels[NUM_PLOTS] = {
+    TELEMETRY_VLL, TELEMETRY_CURRENT, TELEMETRY_FREQ, TELEMETRY_TORQUE, TELEMETRY_SPEED
+};
+static const char *const record_channels[NUM_PLOTS] = { "vll", "current", "freq", "torque", "speed" };
+
+// Reduces n samples to per-column extremes so a plot costs O(columns) strokes.
+void waveform_decimate(const double *data, size_t n, int columns, double *col_min, double *col_max) {
+    for (int c = 0; c < columns; c++) {
+        size_t begin = n * (size_t)c / (size_t)columns;
+        size_t end = n * (size_t)(c + 1) / (size_t)columns;
+        if (end == begin) end = begin + 1;
+        double lo = data[begin], hi = data[begin];
+        for (size_t i = begin + 1; i < end; i++) {
+            lo = fmin(lo, data[i]);
+            hi = fmax(hi, data[i]);
+        }
+        col_min[c] = lo;
+        col_max[c] = hi;
+    }
+}
+
+// Background, grid and labels only change with the widget size.
+static void render_background(cairo_t *cr, int width) {
     cairo_set_source_rgb(cr, 0.2, 0.2, 0.2);
     cairo_paint(cr);
-
-    for (int plot = 0; plot < 5; plot++) {
+    for (int plot = 0; plot < NUM_PLOTS; plot++) {
         int y_offset = plot * (PLOT_HEIGHT + 10);
         cairo_set_source_rgb(cr, 0.9, 0.9, 0.9);
         for (int i = 0; i <= 4; i++) {
@@ -36,33 +46,146 @@ void draw_waveform(GtkDrawingArea *area, cairo_t *cr, int width, int height, gpo
             cairo_line_to(cr, i * width / 4, y_offset + PLOT_HEIGHT);
         }
         cairo_stroke(cr);
-        cairo_set_source_rgb(cr, 0.3, 0.7, 1.0);
-        double *data = waveform;
-        double max_val = max_v;
-        if (plot == 1) {
-                max_val = max_current; data = waveform;
+        cairo_set_source_rgb(cr, 1, 1, 1);
+        cairo_move_to(cr, 10, y_offset + 20);
+        cairo_show_text(cr, telemetry_channel_name(plot_channels[plot]));
+    }
+}
+
+void draw_waveform(GtkDrawingArea *area, cairo_t *cr, int width, int height, gpointer user_data) {
+    AppWidgets *widgets = (AppWidgets *)user_data;
+    static double data[TELEMETRY_HISTORY];
+    static double col_min[MAX_COLUMNS], col_max[MAX_COLUMNS];
+    PROBE_BEGIN(PROBE_DRAW);
+    if (!widgets->plot_background || widgets->plot_background_width != width ||
+        widgets->plot_background_height != height) {
+        if (widgets->plot_background) cairo_surface_destroy(widgets->plot_background);
+        widgets->plot_background = cairo_surface_create_similar(cairo_get_target(cr), CAIRO_CONTENT_COLOR, width, height);
+        cairo_t *bg = cairo_create(widgets->plot_background);
+        render_background(bg, width);
+        cairo_destroy(bg);
+        widgets->plot_background_width = width;
+        widgets->plot_background_height = height;
+    }
+    cairo_set_source_surface(cr, widgets->plot_background, 0, 0);
+    cairo_paint(cr);
+
+    cairo_set_source_rgb(cr, 0.3, 0.7, 1.0);
+    for (int plot = 0; plot < NUM_PLOTS; plot++) {
+        size_t samples = 0;
+        int columns, raw;
+        double span = 0.0;   // x step between raw samples
+        if (widgets->replay) {
+            // The zoom window spans the width; envelopes come from the LOD
+            // pyramid, so the cost does not depend on the window length.
+            int ch = recording_channel_index(widgets->replay, record_channels[plot]);
+            columns = width < MAX_COLUMNS ? width : MAX_COLUMNS;
+            if (ch < 0 || columns < 1) continue;
+            int n = recording_envelope(widgets->replay, ch, widgets->replay_first, widgets->replay_last, columns,
+                                       col_min, col_max);
+            if (n == 0) continue;
+            raw = n < columns;
+            if (raw) {
+                samples = (size_t)n;
+                memcpy(data, col_min, samples * sizeof(double));
+                span = samples > 1 ? (double)width / (double)(samples - 1) : 0.0;
+            }
+        } else {
+            // Newest sample at the right edge; the full history spans the width.
+            samples = telemetry_history_read(&widgets->history, plot_channels[plot], data, TELEMETRY_HISTORY);
+            if (samples == 0) continue;
+            columns = (int)ceil((double)samples * width / TELEMETRY_HISTORY);
+            if (columns > MAX_COLUMNS) columns = MAX_COLUMNS;
+            if (columns < 1) columns = 1;
+            raw = samples <= (size_t)columns * 2;
+            if (!raw) waveform_decimate(data, samples, columns, col_min, col_max);
+            span = (double)width / (TELEMETRY_HISTORY - 1);
+        }
+
+        double max_val = 1e-9;
+        if (raw) {
+            for (size_t i = 0; i < samples; i++) max_val = fmax(max_val, fabs(data[i]));
+        } else {
+            for (int c = 0; c < columns; c++) max_val = fmax(max_val, fmax(fabs(col_min[c]), fabs(col_max[c])));
         }
-        if (plot == 2) {
-                max_val = max_freq; data = waveform;
+        double scale = (PLOT_HEIGHT / 2) / (max_val * 1.1);
+        double y0 = plot * (PLOT_HEIGHT + 10) + PLOT_HEIGHT / 2;
+
+        if (raw) {
+            for (size_t i = 0; i < samples; i++) {
+                double x = width - (double)(samples - 1 - i) * span;
+                if (i == 0) cairo_move_to(cr, x, y0 - data[i] * scale);
+                else cairo_line_to(cr, x, y0 - data[i] * scale);
+            }
+        } else {
+            double x0 = width - columns + 0.5;
+            cairo_move_to(cr, x0, y0 - col_max[0] * scale);
+            for (int c = 0; c < columns; c++) {
+                cairo_line_to(cr, x0 + c, y0 - col_max[c] * scale);
+                cairo_line_to(cr, x0 + c, y0 - col_min[c] * scale);
+            }
         }
-        if (plot == 3) {
-                max_val = max_torque; data = waveform;
+    }
+    cairo_stroke(cr);
+    PROBE_END(PROBE_DRAW);
+}
+
+// Harmonic panels for v_ab and i_a next to the plots: bars of harmonics
+// 2..N in % of the fundamental, or the on-demand full spectrum in dB.
+void draw_spectrum(GtkDrawingArea *area, cairo_t *cr, int width, int height, gpointer user_data) {
+    static const char *const names[2] = { "v_ab", "i_a" };
+    AppWidgets *widgets = (AppWidgets *)user_data;
+    const HarmonicSnapshot *h = &widgets->harmonics;
+    gboolean full = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(widgets->fft_button)) && widgets->fft_bins > 1;
+    int panel = (height - SPECTRUM_GAP) / 2;
+    cairo_set_source_rgb(cr, 0.2, 0.2, 0.2);
+    cairo_paint(cr);
+    for (int c = 0; c < 2; c++) {
+        double y0 = c * (panel + SPECTRUM_GAP);
+        char text[64];
+        cairo_set_source_rgb(cr, 1, 1, 1);
+        if (full) {
+            // Peak per pixel column, in dB below the largest bin.
+            const double *amp = widgets->fft[c];
+            int bins = widgets->fft_bins;
+            double peak = 1e-12;
+            for (int b = 1; b < bins; b++) peak = fmax(peak, amp[b]);
+            snprintf(text, sizeof(text), "%s 0..%.0f kHz, %.0f dB", names[c], bins * widgets->fft_bin_hz / 1e3,
+                     -SPECTRUM_RANGE_DB);
+            cairo_move_to(cr, 10, y0 + 15);
+            cairo_show_text(cr, text);
+            cairo_set_source_rgb(cr, 1.0, 0.7, 0.3);
+            for (int x = 0; x < width; x++) {
+                int b0 = 1 + (int)((long)(bins - 1) * x / width), b1 = 1 + (int)((long)(bins - 1) * (x + 1) / width);
+                double v = amp[b0];
+                for (int b = b0 + 1; b < b1; b++) v = fmax(v, amp[b]);
+                double db = fmax(-SPECTRUM_RANGE_DB, 20.0 * log10(fmax(v, 1e-12) / peak));
+                double y = y0 + panel - (db + SPECTRUM_RANGE_DB) / SPECTRUM_RANGE_DB * (panel - 20);
+                if (x == 0) cairo_move_to(cr, x + 0.5, y);
+                else cairo_line_to(cr, x + 0.5, y);
+            }
+            cairo_stroke(cr);
+            continue;
         }
-        if (plot == 4) { max_val = max_speed; data = waveform;
+        double fund = h->amplitude[c][1];
+        if (!h->ready || !(fund > 0.0) || h->orders < 2) {
+            snprintf(text, sizeof(text), "%s: no fundamental", names[c]);
+            cairo_move_to(cr, 10, y0 + 15);
+            cairo_show_text(cr, text);
+            continue;
         }
-        for (int i = 0; i < SAMPLES - 1; i++) {
-            double x1 = (double)i * width / SAMPLES;
-            double y1 = y_offset + PLOT_HEIGHT / 2 - (data[i] / max_val) * PLOT_HEIGHT / 2;
-            double x2 = (double)(i + 1) * width / SAMPLES;
-            double y2 = y_offset + PLOT_HEIGHT / 2 - (data[i + 1] / max_val) * PLOT_HEIGHT / 2;
-            cairo_move_to(cr, x1, y1);
-            cairo_line_to(cr, x2, y2);
+        double top = 1.0;
+        for (int o = 2; o <= h->orders; o++) top = fmax(top, h->amplitude[c][o] / fund * 100.0);
+        top *= 1.1;
+        snprintf(text, sizeof(text), "%s h2..h%d, full scale %.1f %%", names[c], h->orders, top);
+        cairo_move_to(cr, 10, y0 + 15);
+        cairo_show_text(cr, text);
+        cairo_set_source_rgb(cr, 0.3, 0.7, 1.0);
+        double bar = (double)width / (h->orders - 1);
+        for (int o = 2; o <= h->orders; o++) {
+            double len = h->amplitude[c][o] / fund * 100.0 / top * (panel - 20);
+            cairo_rectangle(cr, (o - 2) * bar + 1, y0 + panel - len, fmax(1.0, bar - 2), len);
         }
-        cairo_stroke(cr);
-        cairo_set_source_rgb(cr, 1, 1, 1);
-        const char *label = plot == 0 ? "Voltage (V)" : plot == 1 ? "Current (A)" :
-                            plot == 2 ? "Frequency (Hz)" : plot == 3 ? "Torque (Nm)" : "Speed (RPM)";
-        cairo_move_to(cr, 10, y_offset + 20);
-        cairo_show_text(cr, label);
+        cairo_fill(cr);
     }
 }
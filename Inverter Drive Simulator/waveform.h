@@ -4,5 +4,7 @@
 #include <gtk/gtk.h>
 
 void draw_waveform(GtkDrawingArea *area, cairo_t *cr, int width, int height, gpointer user_data);
+void draw_spectrum(GtkDrawingArea *area, cairo_t *cr, int width, int height, gpointer user_data);
+void waveform_decimate(const double *data, size_t n, int columns, double *col_min, double *col_max);
 
 #endif